@@ -0,0 +1,27 @@
+# Copyright (c) 2011-2014 Microsoft Mobile.
+#
+# Command line tool applying the mirror effects to image sequences and
+# video streams offline. Needs neither a display nor a camera.
+
+TEMPLATE = app
+TARGET = mirrorhouse-batch
+VERSION = 1.3.1
+
+QT += core gui
+CONFIG += console
+CONFIG -= app_bundle
+
+include(src/effect.pri)
+
+INCLUDEPATH += src/batch
+
+HEADERS += \
+    src/batch/batchprocessor.h \
+    src/batch/framesink.h \
+    src/batch/framesource.h
+
+SOURCES += \
+    src/batch/batchprocessor.cpp \
+    src/batch/framesink.cpp \
+    src/batch/framesource.cpp \
+    src/batch/main.cpp
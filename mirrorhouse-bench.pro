@@ -0,0 +1,27 @@
+# Copyright (c) 2011-2014 Microsoft Mobile.
+#
+# Benchmark of the mirror effect's kernels over resolutions, transforms and
+# quality modes. Needs neither a display nor a camera.
+
+TEMPLATE = app
+TARGET = mirrorhouse-bench
+VERSION = 1.3.1
+
+QT += core
+CONFIG += console
+CONFIG -= app_bundle
+
+include(src/effect.pri)
+
+INCLUDEPATH += src/bench
+
+HEADERS += \
+    src/bench/benchmark.h \
+    src/bench/benchmarkreport.h \
+    src/bench/kernelcases.h
+
+SOURCES += \
+    src/bench/benchmark.cpp \
+    src/bench/benchmarkreport.cpp \
+    src/bench/kernelcases.cpp \
+    src/bench/main.cpp
@@ -10,17 +10,27 @@ MOBILITY = multimedia
 
 INCLUDEPATH += src
 
+include(src/effect.pri)
+
 HEADERS += \
-    src/mirroreffect.h \
+    src/capturehub.h \
+    src/effectworker.h \
+    src/framestats.h \
     src/mirroritem.h \
     src/myvideosurface.h \
+    src/qualitycontroller.h \
+    src/sourceframe.h \
     src/videoif.h
     
 SOURCES += \
+    src/capturehub.cpp \
+    src/effectworker.cpp \
+    src/framestats.cpp \
     src/main.cpp \
-    src/mirroreffect.cpp \
     src/mirroritem.cpp \
-    src/myvideosurface.cpp
+    src/myvideosurface.cpp \
+    src/qualitycontroller.cpp \
+    src/sourceframe.cpp
 
 OTHER_FILES += \
     qml/main.qml \
@@ -52,6 +62,9 @@ symbian {
 
 contains(MEEGO_EDITION,harmattan) {
     DEFINES += Q_OS_HARMATTAN
+
+    # The N9 has NEON, let the resampling kernels use it
+    QMAKE_CXXFLAGS += -mfpu=neon
     RESOURCES += harmattan_resources.qrc
     OTHER_FILES += qml/harmattan.qml
 
@@ -9,6 +9,9 @@ Item {
     id: mirror
     anchors.fill: parent
     property int mirrorEffectId
+    // The multipliers of the effect's power and size, can be animated
+    property real effectStrength: 1.0
+    property real effectCount: 1.0
 
     // Create camera component
     function createCamera(enable) {
@@ -26,7 +29,7 @@ Item {
     function enableCamera(enable) {
         createCamera(enable);
         if (cameraLoader.item != undefined) {
-            cameraLoader.item.enableEffect(mirrorEffectId,0,0);
+            cameraLoader.item.enableEffect(mirrorEffectId,effectStrength,effectCount);
             cameraLoader.item.enableCamera(enable);
         }
     }
@@ -35,7 +38,7 @@ Item {
     function enableCameraAt(enable, index) {
         createCamera(enable);
         if (cameraLoader.item != undefined) {
-            cameraLoader.item.enableEffect(mirrorEffectId,0,0);
+            cameraLoader.item.enableEffect(mirrorEffectId,effectStrength,effectCount);
             cameraLoader.item.enableCameraAt(enable,index);
         }
     }
@@ -52,6 +55,25 @@ Item {
             cameraLoader.item.saveToFile();
     }
 
+    // Format the frame statistics of MirrorItem: average, 95th percentile
+    // and maximum milliseconds per stage, and the frame counts
+    function formatStats(stats) {
+        var stages = ["map", "conversion", "rotation", "rebuild", "warp", "paint"];
+        var text = "";
+
+        for (var i = 0; i < stages.length; i++) {
+            var stage = stats[stages[i]];
+            if (stage != undefined && stage.count > 0) {
+                text += stages[i] + " " + stage.avg.toFixed(1) + " / "
+                        + stage.p95.toFixed(1) + " / " + stage.max.toFixed(1) + " ms\n";
+            }
+        }
+
+        return text + stats.processed + " of " + stats.delivered + " frames, "
+                + stats.dropped + " dropped, " + stats.skipped + " skipped\n"
+                + "quality " + stats.tier;
+    }
+
 
     signal zoomIn()
     signal zoomOut()
@@ -76,8 +98,12 @@ Item {
     Component {
         id: cameraComponent
         MirrorItem {
+            id: mirrorItem
             anchors.fill: parent
             effectId: mirror.mirrorEffectId
+            effectStrength: mirror.effectStrength
+            effectCount: mirror.effectCount
+            statsLogFile: frameStatsFile
 
             onMinimizeMirror: {
                 zoomOut();
@@ -85,6 +111,15 @@ Item {
             onMaximizeMirror: {
                 zoomIn();
             }
+
+            // Frame statistics overlay, shown with the --stats argument
+            Text {
+                anchors.centerIn: parent
+                visible: showFrameStats
+                color: "yellow"
+                font.pixelSize: 12
+                text: visible ? mirror.formatStats(mirrorItem.frameStats) : ""
+            }
         }
     }
 
@@ -0,0 +1,287 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "animatedtransform.h"
+
+#include <QVarLengthArray>
+#include <math.h>
+
+#include "bufferpool.h"
+#include "stagetimer.h"
+#include "transformgenerator.h"
+#include "transformmap.h"
+
+// The distance of the key fields: in the size for the transforms scaled by
+// the power, in the power (a twist of 20 * power) for Spiral
+static const float SizeKeyStep = 0.125f;
+static const float SpiralKeyStep = 0.025f;
+
+// The blend weights closer than this to a key use the key field alone
+static const float KeyEpsilon = 0.001f;
+
+
+/*!
+  \class AnimatedTransform
+  \brief Fills transform maps of animated parameters by blending cached displacement fields.
+*/
+
+
+/*!
+  Returns true if the displacement of \a transform is linear in the size
+  instead of the power.
+*/
+static bool scalesWithSize(MirrorEffect::MirrorTransform transform)
+{
+    return transform == MirrorEffect::Spiral;
+}
+
+
+/*!
+  Returns true if the displacement of \a transform depends on the parameter
+  it isn't linear in, i.e. it needs more than one key field.
+*/
+static bool hasKeyParameter(MirrorEffect::MirrorTransform transform)
+{
+    return transform != MirrorEffect::None
+            && transform != MirrorEffect::Spike
+            && transform != MirrorEffect::Dither;
+}
+
+
+/*!
+  Constructor.
+*/
+AnimatedTransform::AnimatedTransform()
+    : m_useCount(0),
+      m_lower(0),
+      m_upper(0),
+      m_weight(0.0f),
+      m_scale(0.0f),
+      m_writer(0)
+{
+}
+
+
+/*!
+  Destructor.
+*/
+AnimatedTransform::~AnimatedTransform()
+{
+    clear();
+}
+
+
+/*!
+  Fills \a map, created for the target and a \a sourceWidth x
+  \a sourceHeight source, with \a transform at \a power and \a size by
+  interpolating and scaling the key fields around the parameters. The
+  fields missing are generated first, and the nanoseconds spent generating
+  them are stored into \a generationTime. Returns false if the memory for
+  the fields runs out.
+*/
+bool AnimatedTransform::blend(TransformMap *map,
+                              MirrorEffect::MirrorTransform transform,
+                              float power,
+                              float size,
+                              int sourceWidth,
+                              int sourceHeight,
+                              int threadCount,
+                              qint64 *generationTime)
+{
+    *generationTime = 0;
+
+    if (map->isNull())
+        return false;
+
+    const bool spiral = scalesWithSize(transform);
+    const float step = spiral ? SpiralKeyStep : SizeKeyStep;
+    const float position = hasKeyParameter(transform) ? (spiral ? power : size) / step
+                                                      : 0.0f;
+    float lowerKey = floorf(position);
+    float weight = position - lowerKey;
+
+    if (weight > 1.0f - KeyEpsilon) {
+        lowerKey += 1.0f;
+        weight = 0.0f;
+    }
+
+    m_lower = keyField(transform, lowerKey * step, map->width(), map->height(),
+                       threadCount, *generationTime);
+    m_upper = weight > KeyEpsilon ? keyField(transform, (lowerKey + 1.0f) * step,
+                                             map->width(), map->height(),
+                                             threadCount, *generationTime)
+                                  : 0;
+
+    if (!m_lower || (weight > KeyEpsilon && !m_upper))
+        return false;
+
+    m_weight = m_upper ? weight : 0.0f;
+    m_scale = spiral ? size : power;
+
+        // The generator of the exact map only scales the displacement to the
+        // source and stores it with the shine
+    TransformGenerator writer(map, transform, power, size, sourceWidth, sourceHeight);
+    m_writer = &writer;
+
+    const int height = map->height();
+    WorkerPool::instance()->runBands(this, height, threadCount, 8);
+
+    m_writer = 0;
+    return true;
+}
+
+
+/*!
+  Releases all the key fields.
+*/
+void AnimatedTransform::clear()
+{
+    while (!m_fields.isEmpty()) {
+        KeyField *field = m_fields.takeLast();
+        releaseField(field);
+        delete field;
+    }
+
+    m_lower = 0;
+    m_upper = 0;
+}
+
+
+/*!
+  Returns the memory used by the key fields in bytes.
+*/
+int AnimatedTransform::byteCount() const
+{
+    int bytes = 0;
+
+    for (int i = 0; i < m_fields.count(); i++)
+        bytes += m_fields.at(i)->m_width * m_fields.at(i)->m_height * 2 * (int)sizeof(short);
+
+    return bytes;
+}
+
+
+/*!
+  From WorkerTask. Blends the rows [begin, end) of the map from the key
+  fields.
+*/
+void AnimatedTransform::run(int begin, int end)
+{
+    const int width = m_lower->m_width;
+    QVarLengthArray<float, 1024> fx(width);
+    QVarLengthArray<float, 1024> fy(width);
+
+        // The fields are in fixed point, scale them back at the same time
+    const float lowerScale = m_scale * (1.0f - m_weight) / TransformGenerator::DisplacementScale;
+    const float upperScale = m_scale * m_weight / TransformGenerator::DisplacementScale;
+
+    for (int y = begin; y < end; y++) {
+        const short *lowerX = m_lower->m_x + width * y;
+        const short *lowerY = m_lower->m_y + width * y;
+
+        if (m_upper) {
+            const short *upperX = m_upper->m_x + width * y;
+            const short *upperY = m_upper->m_y + width * y;
+
+            for (int x = 0; x < width; x++) {
+                fx[x] = lowerX[x] * lowerScale + upperX[x] * upperScale;
+                fy[x] = lowerY[x] * lowerScale + upperY[x] * upperScale;
+            }
+        }
+        else {
+            for (int x = 0; x < width; x++) {
+                fx[x] = lowerX[x] * lowerScale;
+                fy[x] = lowerY[x] * lowerScale;
+            }
+        }
+
+        m_writer->storeRow(y, fx.data(), fy.data());
+    }
+}
+
+
+/*!
+  Returns the field of \a transform at the key \a value for a \a width x
+  \a height target. A field not kept is generated, replacing the least
+  recently used one when MaxKeyFields are kept already, and the time spent
+  is added to \a generationTime. The field is generated with the parameter
+  the displacement is linear in at 1.0. Returns 0 if the memory runs out.
+*/
+const AnimatedTransform::KeyField *AnimatedTransform::keyField(MirrorEffect::MirrorTransform transform,
+                                                               float value,
+                                                               int width,
+                                                               int height,
+                                                               int threadCount,
+                                                               qint64 &generationTime)
+{
+    m_useCount++;
+    KeyField *leastUsed = 0;
+
+    for (int i = 0; i < m_fields.count(); i++) {
+        KeyField *field = m_fields.at(i);
+
+        if (field->m_transform == transform
+                && field->m_value == value
+                && field->m_width == width
+                && field->m_height == height)
+        {
+            field->m_lastUsed = m_useCount;
+            return field;
+        }
+
+        if (!leastUsed || field->m_lastUsed < leastUsed->m_lastUsed)
+            leastUsed = field;
+    }
+
+    StageTimer timer;
+    KeyField *field = leastUsed;
+
+    if (m_fields.count() < MaxKeyFields) {
+        field = new KeyField;
+        m_fields.append(field);
+    }
+
+    if (field->m_width * field->m_height != width * height) {
+        releaseField(field);
+
+        BufferPool *pool = BufferPool::instance();
+        field->m_x = pool->acquireArray<short>(width * height);
+        field->m_y = pool->acquireArray<short>(width * height);
+
+        if (!field->m_x || !field->m_y) {
+            releaseField(field);
+            return 0;
+        }
+    }
+
+    field->m_width = width;
+    field->m_height = height;
+    field->m_transform = transform;
+    field->m_value = value;
+    field->m_lastUsed = m_useCount;
+
+    const bool spiral = scalesWithSize(transform);
+    TransformGenerator generator(field->m_x, field->m_y, width, height, transform,
+                                 spiral ? value : 1.0f,
+                                 spiral ? 1.0f : value);
+    generator.generate(threadCount);
+
+    generationTime += timer.nsecsElapsed();
+    return field;
+}
+
+
+/*!
+  Releases the buffers of \a field.
+*/
+void AnimatedTransform::releaseField(KeyField *field)
+{
+    BufferPool *pool = BufferPool::instance();
+    pool->release(field->m_x);
+    pool->release(field->m_y);
+    field->m_x = 0;
+    field->m_y = 0;
+    field->m_width = 0;
+    field->m_height = 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef ANIMATEDTRANSFORM_H
+#define ANIMATEDTRANSFORM_H
+
+#include <QList>
+
+#include "mirroreffect.h"
+#include "workerpool.h"
+
+// Forward declarations
+class TransformGenerator;
+class TransformMap;
+
+
+/*!
+  \class AnimatedTransform
+  \brief Fills transform maps of animated parameters by blending cached displacement fields.
+
+  Every transform is linear in one of its parameters: the displacement of
+  all but Spiral is proportional to the power, and the displacement of
+  Spiral to the size, which its scaling to the source cancels out. A map
+  for any value of that parameter is therefore exact when scaled from a
+  single displacement field.
+
+  The other parameter, the size of the waves, the bubbles, the ripple and
+  the tiles or the twist of the spiral, is sampled at key values a fixed
+  step apart, and the displacement is interpolated linearly between the
+  two key fields around the value. The interpolation only approximates
+  the transform between the keys, so MirrorEffect uses the blended maps
+  while the parameters change and generates the exact map once they
+  settle.
+
+  The key fields hold the raw displacement (see TransformGenerator) of the
+  target, independent of the source. They are generated when first needed
+  and the latest MaxKeyFields are kept, so an animation back and forth
+  over the same values doesn't generate them again. Blending a map costs
+  no trigonometry: the rows are interpolated, scaled and stored with the
+  shine by TransformGenerator::storeRow(), in parallel on WorkerPool.
+*/
+class AnimatedTransform : public WorkerTask
+{
+public:
+    AnimatedTransform();
+    ~AnimatedTransform();
+
+public:
+        // Fills map, which must be created for the target and the source
+        // dimensions, with transform at power and size. threadCount as in
+        // MirrorEffect::setThreadCount(). Stores the nanoseconds spent
+        // generating new key fields into generationTime. Returns false if
+        // the memory runs out.
+    bool blend(TransformMap *map,
+               MirrorEffect::MirrorTransform transform,
+               float power,
+               float size,
+               int sourceWidth,
+               int sourceHeight,
+               int threadCount,
+               qint64 *generationTime);
+
+        // Releases the key fields
+    void clear();
+
+        // The memory used by the key fields
+    int byteCount() const;
+
+public: // From WorkerTask
+    void run(int begin, int end);
+
+private:
+    /*
+     * The displacement field of a transform at a key value.
+     */
+    class KeyField
+    {
+    public:
+        KeyField()
+            : m_x(0), m_y(0), m_width(0), m_height(0),
+              m_transform(MirrorEffect::None), m_value(0.0f), m_lastUsed(0) {}
+
+        short *m_x;     // From BufferPool
+        short *m_y;     // From BufferPool
+        int m_width;
+        int m_height;
+        MirrorEffect::MirrorTransform m_transform;
+        float m_value;
+        unsigned int m_lastUsed;
+    };
+
+    enum { MaxKeyFields = 4 };
+
+        // Returns the field of transform at the key value, generating it if
+        // needed. Adds the time spent to generationTime. Returns 0 if the
+        // memory runs out.
+    const KeyField *keyField(MirrorEffect::MirrorTransform transform,
+                             float value,
+                             int width,
+                             int height,
+                             int threadCount,
+                             qint64 &generationTime);
+
+    static void releaseField(KeyField *field);
+
+private: // Data
+    QList<KeyField*> m_fields;  // Owned
+    unsigned int m_useCount;
+
+        // The blend in progress
+    const KeyField *m_lower;
+    const KeyField *m_upper;    // 0 if the value is at m_lower's key
+    float m_weight;             // Of m_upper
+    float m_scale;              // The value of the linear parameter
+    TransformGenerator *m_writer;
+};
+
+#endif // ANIMATEDTRANSFORM_H
@@ -0,0 +1,222 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "batchprocessor.h"
+
+#include <QDebug>
+
+#include "framesink.h"
+
+
+/*!
+  \class BatchProcessor
+  \brief Applies a mirror transform to every frame of a FrameSource.
+*/
+
+
+/*!
+  Constructor. \a source and \a sink must outlive the processor.
+*/
+BatchProcessor::BatchProcessor(FrameSource *source,
+                               FrameSink *sink,
+                               const Settings &settings)
+    : m_source(source),
+      m_sink(sink),
+      m_settings(settings),
+      m_firstSlot(0),
+      m_frameCount(0),
+      m_failedCount(0)
+{
+}
+
+
+/*!
+  Destructor.
+*/
+BatchProcessor::~BatchProcessor()
+{
+    qDeleteAll(m_effects);
+}
+
+
+/*!
+  Processes the frames until the source ends. A frame which cannot be
+  loaded or stored is skipped with a warning; failing to write a stream
+  stops the processing.
+*/
+bool BatchProcessor::exec()
+{
+    WorkerPool *pool = WorkerPool::instance();
+    const int batchSize = m_settings.m_batchSize > 0
+            ? m_settings.m_batchSize : 2 * pool->threadCount();
+
+    m_frames.resize(batchSize);
+    m_failed.resize(batchSize);
+
+    qDeleteAll(m_effects);
+    m_effects.resize(batchSize);
+
+    for (int i = 0; i < batchSize; i++) {
+        m_effects[i] = new MirrorEffect();
+
+        // The frames of a batch are processed in parallel, each on a
+        // single thread. A batch of one frame uses all the threads.
+        m_effects[i]->setThreadCount(batchSize == 1 ? 0 : 1);
+    }
+
+    forever {
+        int count(0);
+
+        while (count < batchSize && m_source->next(m_frames[count]))
+            count++;
+
+        if (count == 0)
+            break;
+
+        for (int i = 0; i < count; i++)
+            m_failed[i] = false;
+
+        if (batchSize == 1) {
+            processSlot(0);
+        }
+        else {
+                // The first frame is processed alone, so that the other
+                // effects find its transform map in TransformMapCache
+                // instead of all of them generating it at once
+            m_firstSlot = m_frameCount == 0 ? 1 : 0;
+
+            if (m_firstSlot)
+                processSlot(0);
+
+            pool->run(this, count - m_firstSlot, 1);
+        }
+
+        for (int i = 0; i < count; i++) {
+            const BatchFrame &frame = m_frames.at(i);
+
+            if (m_failed.at(i)) {
+                qWarning() << "Skipped frame" << frame.m_index << frame.m_fileName;
+                m_failedCount++;
+            }
+            else if (!m_sink->write(frame)) {
+                m_errorString = m_sink->errorString();
+                return false;
+            }
+        }
+
+        m_frameCount += count;
+
+        if (count < batchSize)
+            break;
+    }
+
+    if (!m_source->errorString().isEmpty()) {
+        m_errorString = m_source->errorString();
+        return false;
+    }
+
+    return true;
+}
+
+
+/*!
+  Returns the reason exec() failed.
+*/
+QString BatchProcessor::errorString() const
+{
+    return m_errorString;
+}
+
+
+/*!
+  Returns the number of frames read from the source.
+*/
+int BatchProcessor::frameCount() const
+{
+    return m_frameCount;
+}
+
+
+/*!
+  Returns the number of frames skipped.
+*/
+int BatchProcessor::failedCount() const
+{
+    return m_failedCount;
+}
+
+
+/*!
+  From WorkerTask. Processes the batch slots [begin, end), counted from
+  the first slot not processed yet.
+*/
+void BatchProcessor::run(int begin, int end)
+{
+    for (int slot = begin; slot < end; slot++)
+        processSlot(m_firstSlot + slot);
+}
+
+
+/*!
+  Loads the frame of \a slot, warps it into its result image with the
+  slot's effect and stores the result.
+*/
+void BatchProcessor::processSlot(int slot)
+{
+    BatchFrame &frame = m_frames[slot];
+    MirrorEffect *effect = m_effects.at(slot);
+
+    if (!m_source->load(frame) || frame.m_width < 1 || frame.m_height < 1) {
+        m_failed[slot] = true;
+        return;
+    }
+
+    QSize targetSize = m_settings.m_targetSize;
+
+    if (!targetSize.isValid()) {
+        targetSize = m_settings.m_rotate90degrees
+                ? QSize(frame.m_height, frame.m_width)
+                : QSize(frame.m_width, frame.m_height);
+    }
+
+    if (frame.m_result.size() != targetSize)
+        frame.m_result = QImage(targetSize, QImage::Format_RGB32);
+
+    effect->setTarget((unsigned int*)frame.m_result.bits(),
+                      frame.m_result.width(),
+                      frame.m_result.height(),
+                      frame.m_result.bytesPerLine() / 4);
+
+    if (!frame.m_uyvy.isEmpty()) {
+        effect->setSourceUYVY((const unsigned char*)frame.m_uyvy.constData(),
+                              frame.m_width,
+                              frame.m_height,
+                              ((frame.m_width + 1) & ~1) * 2,
+                              m_settings.m_rotate90degrees,
+                              m_settings.m_flipY);
+    }
+    else {
+        effect->setSource((unsigned int*)frame.m_image.constBits(),
+                          frame.m_width,
+                          frame.m_height,
+                          frame.m_image.bytesPerLine() / 4,
+                          m_settings.m_rotate90degrees,
+                          m_settings.m_flipY);
+    }
+
+    effect->setYuvCoefficients(m_settings.m_coefficients);
+    effect->setHighQuality(m_settings.m_highQuality);
+    effect->setMipmapping(m_settings.m_mipmapping);
+    effect->setMirrorTransform(m_settings.m_transform,
+                               m_settings.m_power,
+                               m_settings.m_size);
+
+    for (int i = 0; i < m_settings.m_layers.count(); i++) {
+        const MirrorEffect::TransformLayer &layer = m_settings.m_layers.at(i);
+        effect->addMirrorTransform(layer.m_transform, layer.m_power, layer.m_size);
+    }
+
+    if (!effect->process() || !m_sink->store(frame))
+        m_failed[slot] = true;
+}
@@ -0,0 +1,98 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef BATCHPROCESSOR_H
+#define BATCHPROCESSOR_H
+
+#include <QSize>
+#include <QVector>
+
+#include "framesource.h"
+#include "mirroreffect.h"
+#include "workerpool.h"
+#include "yuvconverter.h"
+
+// Forward declarations
+class FrameSink;
+
+
+/*!
+  \class BatchProcessor
+  \brief Applies a mirror transform to every frame of a FrameSource.
+
+  The frames are processed in batches of a fixed number of frames. A batch
+  is read in order, the frames are then loaded, warped and stored in
+  parallel on the WorkerPool, one frame per thread, and finally written in
+  order. Every slot of the batch has a MirrorEffect of its own, and the
+  effects share the transform map through TransformMapCache, so the
+  memory use is bounded by the batch size whatever the length of the
+  sequence.
+*/
+class BatchProcessor : public WorkerTask
+{
+public: // Data types
+    class Settings
+    {
+    public:
+        Settings()
+            : m_transform(MirrorEffect::None),
+              m_power(1.0f),
+              m_size(1.0f),
+              m_highQuality(true),
+              m_mipmapping(false),
+              m_rotate90degrees(false),
+              m_flipY(false),
+              m_coefficients(YuvConverter::BT601),
+              m_batchSize(0) {}
+
+        MirrorEffect::MirrorTransform m_transform;
+        float m_power;
+        float m_size;
+        QVector<MirrorEffect::TransformLayer> m_layers; // Composed on top of m_transform
+        QSize m_targetSize;     // Invalid for the size of the (rotated) source
+        bool m_highQuality;
+        bool m_mipmapping;      // As in MirrorEffect::setMipmapping()
+        bool m_rotate90degrees; // As in MirrorEffect::setSource()
+        bool m_flipY;
+        YuvConverter::Coefficients m_coefficients;
+        int m_batchSize;        // 0 for twice the number of threads
+    };
+
+public:
+    BatchProcessor(FrameSource *source, FrameSink *sink, const Settings &settings);
+    ~BatchProcessor();
+
+public:
+        // Processes all the frames. Returns false if reading or writing
+        // failed, see errorString().
+    bool exec();
+
+    QString errorString() const;
+
+        // The frames processed and the ones which could not be loaded or
+        // stored
+    int frameCount() const;
+    int failedCount() const;
+
+public: // From WorkerTask
+    void run(int begin, int end);
+
+private:
+        // Loads, warps and stores the frame of a batch slot
+    void processSlot(int slot);
+
+private: // Data
+    FrameSource *m_source;  // Not owned
+    FrameSink *m_sink;      // Not owned
+    Settings m_settings;
+    QVector<BatchFrame> m_frames;
+    QVector<MirrorEffect*> m_effects;   // Owned
+    QVector<bool> m_failed;             // Per slot, written by the workers
+    QString m_errorString;
+    int m_firstSlot;                    // The slot run() counts from
+    int m_frameCount;
+    int m_failedCount;
+};
+
+#endif // BATCHPROCESSOR_H
@@ -0,0 +1,217 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "framesink.h"
+
+#include <QDir>
+#include <stdio.h>
+
+#include "framesource.h"
+
+
+/*!
+  \class ImageSequenceSink
+  \brief Saves every result into an image file of its own.
+*/
+
+
+/*!
+  Constructor. Creates \a directory if it doesn't exist. \a quality is
+  passed to QImage::save(), -1 for the default.
+*/
+ImageSequenceSink::ImageSequenceSink(const QString &directory,
+                                     const QString &format,
+                                     int quality)
+    : m_directory(directory),
+      m_format(format),
+      m_quality(quality)
+{
+    if (!QDir().mkpath(directory))
+        m_errorString = QString("Cannot create %1").arg(directory);
+}
+
+
+/*!
+  From FrameSink. Encodes and saves the result.
+*/
+bool ImageSequenceSink::store(const BatchFrame &frame)
+{
+    const QString fileName = QString("%1/%2.%3").arg(m_directory, frame.m_name, m_format);
+    return frame.m_result.save(fileName, m_format.toLatin1().constData(), m_quality);
+}
+
+
+/*!
+  \class StreamSink
+  \brief Base for the sinks writing the results into a file or the standard output.
+*/
+
+
+/*!
+  Constructor. Opens \a path for writing, or the standard output if \a path
+  is "-".
+*/
+StreamSink::StreamSink(const QString &path)
+{
+    bool opened(false);
+
+    if (path == "-") {
+        opened = m_file.open(stdout, QIODevice::WriteOnly);
+    }
+    else {
+        m_file.setFileName(path);
+        opened = m_file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    }
+
+    if (!opened)
+        m_errorString = QString("Cannot open %1: %2").arg(path, m_file.errorString());
+}
+
+
+/*!
+  Returns true if the stream could be opened.
+*/
+bool StreamSink::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+
+/*!
+  Writes \a size bytes from \a data. Returns false on an error.
+*/
+bool StreamSink::writeFully(const char *data, qint64 size)
+{
+    while (size > 0) {
+        const qint64 count = m_file.write(data, size);
+
+        if (count <= 0) {
+            m_errorString = m_file.errorString();
+            return false;
+        }
+
+        data += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+
+/*!
+  \class RawRgbSink
+  \brief Writes the results as headerless RGB32 frames.
+*/
+
+
+/*!
+  Constructor.
+*/
+RawRgbSink::RawRgbSink(const QString &path)
+    : StreamSink(path)
+{
+}
+
+
+/*!
+  From FrameSink. Writes the rows without their padding.
+*/
+bool RawRgbSink::write(const BatchFrame &frame)
+{
+    const QImage &image = frame.m_result;
+
+    for (int y = 0; y < image.height(); y++) {
+        if (!writeFully((const char*)image.constScanLine(y), image.width() * 4))
+            return false;
+    }
+
+    return true;
+}
+
+
+/*!
+  \class Y4mSink
+  \brief Writes the results as a 4:4:4 YUV4MPEG2 stream.
+*/
+
+
+/*!
+  Constructor. \a frameRate goes to the header as it is, e.g. "30:1".
+*/
+Y4mSink::Y4mSink(const QString &path,
+                 const QByteArray &frameRate,
+                 YuvConverter::Coefficients coefficients)
+    : StreamSink(path),
+      m_frameRate(frameRate),
+      m_coefficients(coefficients),
+      m_headerWritten(false)
+{
+}
+
+
+/*!
+  From FrameSink. Converts the result to Y'CbCr with the inverse of the
+  coefficients the sources are read with, in 8.8 fixed point.
+*/
+bool Y4mSink::write(const BatchFrame &frame)
+{
+    const QImage &image = frame.m_result;
+    const int width = image.width();
+    const int height = image.height();
+
+    if (!m_headerWritten) {
+        QByteArray header = QString("YUV4MPEG2 W%1 H%2 F%3 Ip A1:1 C444")
+                .arg(width).arg(height).arg(QString(m_frameRate)).toLatin1();
+
+        if (m_coefficients == YuvConverter::BT601FullRange)
+            header += " XCOLORRANGE=FULL";
+
+        header += '\n';
+
+        if (!writeFully(header.constData(), header.size()))
+            return false;
+
+        m_headerWritten = true;
+    }
+
+    // Y = (yr * R + yg * G + yb * B) / 256 + lumaOffset, and the chroma
+    // likewise around 128
+    int yr(66), yg(129), yb(25), ur(-38), ug(-74), ub(112), vr(112), vg(-94), vb(-18);
+    int lumaOffset(16);
+
+    if (m_coefficients == YuvConverter::BT709) {
+        yr = 47; yg = 157; yb = 16;
+        ur = -26; ug = -87; ub = 113;
+        vr = 112; vg = -102; vb = -10;
+    }
+    else if (m_coefficients == YuvConverter::BT601FullRange) {
+        yr = 77; yg = 150; yb = 29;
+        ur = -43; ug = -85; ub = 128;
+        vr = 128; vg = -107; vb = -21;
+        lumaOffset = 0;
+    }
+
+    m_planes.resize(width * height * 3);
+    uchar *luma = (uchar*)m_planes.data();
+    uchar *u = luma + width * height;
+    uchar *v = u + width * height;
+
+    for (int y = 0; y < height; y++) {
+        const unsigned int *s = (const unsigned int*)image.constScanLine(y);
+
+        for (int x = 0; x < width; x++) {
+            const int r = (s[x] >> 16) & 0xff;
+            const int g = (s[x] >> 8) & 0xff;
+            const int b = s[x] & 0xff;
+
+            // The chroma sums are offset by 128 * 256 before the shift, so
+            // they are never negative
+            *luma++ = qMin(255, ((yr * r + yg * g + yb * b + 128) >> 8) + lumaOffset);
+            *u++ = qBound(0, (ur * r + ug * g + ub * b + 32896) >> 8, 255);
+            *v++ = qBound(0, (vr * r + vg * g + vb * b + 32896) >> 8, 255);
+        }
+    }
+
+    return writeFully("FRAME\n", 6) && writeFully(m_planes.constData(), m_planes.size());
+}
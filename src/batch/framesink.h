@@ -0,0 +1,121 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef FRAMESINK_H
+#define FRAMESINK_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+#include "yuvconverter.h"
+
+// Forward declarations
+class BatchFrame;
+
+
+/*!
+  \class FrameSink
+  \brief Writes the results of BatchProcessor.
+
+  store() is called for the frames of a batch in parallel, in any order,
+  and write() for one frame at a time in the sequence order. A sink writing
+  separate files does its work in store(), a stream in write().
+*/
+class FrameSink
+{
+public:
+    virtual ~FrameSink() {}
+
+        // Stores the result of frame. Called concurrently for different
+        // frames.
+    virtual bool store(const BatchFrame &frame) { Q_UNUSED(frame); return true; }
+
+        // Writes the result of frame in order
+    virtual bool write(const BatchFrame &frame) { Q_UNUSED(frame); return true; }
+
+    QString errorString() const { return m_errorString; }
+
+protected:
+    QString m_errorString;
+};
+
+
+/*!
+  \class ImageSequenceSink
+  \brief Saves every result into an image file of its own.
+*/
+class ImageSequenceSink : public FrameSink
+{
+public:
+        // Writes <directory>/<frame name>.<format>, format as in QImage::save()
+    ImageSequenceSink(const QString &directory, const QString &format, int quality);
+
+public: // From FrameSink
+    bool store(const BatchFrame &frame);
+
+private: // Data
+    QString m_directory;
+    QString m_format;
+    int m_quality;
+};
+
+
+/*!
+  \class StreamSink
+  \brief Base for the sinks writing the results into a file or the standard output.
+*/
+class StreamSink : public FrameSink
+{
+public:
+        // "-" writes the standard output
+    explicit StreamSink(const QString &path);
+
+    bool isOpen() const;
+
+protected:
+    bool writeFully(const char *data, qint64 size);
+
+protected: // Data
+    QFile m_file;
+};
+
+
+/*!
+  \class RawRgbSink
+  \brief Writes the results as headerless RGB32 frames.
+*/
+class RawRgbSink : public StreamSink
+{
+public:
+    explicit RawRgbSink(const QString &path);
+
+public: // From FrameSink
+    bool write(const BatchFrame &frame);
+};
+
+
+/*!
+  \class Y4mSink
+  \brief Writes the results as a 4:4:4 YUV4MPEG2 stream.
+*/
+class Y4mSink : public StreamSink
+{
+public:
+        // The results are converted to YUV with coefficients
+    Y4mSink(const QString &path,
+            const QByteArray &frameRate,
+            YuvConverter::Coefficients coefficients);
+
+public: // From FrameSink
+    bool write(const BatchFrame &frame);
+
+private: // Data
+    QByteArray m_frameRate;
+    YuvConverter::Coefficients m_coefficients;
+    bool m_headerWritten;
+    QByteArray m_planes;
+};
+
+#endif // FRAMESINK_H
@@ -0,0 +1,371 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "framesource.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QList>
+#include <stdio.h>
+
+
+/*!
+  Returns the output base name of the frame \a index of a stream.
+*/
+static QString streamFrameName(int index)
+{
+    return QString("frame_%1").arg(index, 6, 10, QChar('0'));
+}
+
+
+/*!
+  \class ImageSequenceSource
+  \brief Reads a sequence of image files, PNG, JPEG or anything QImage reads.
+*/
+
+
+/*!
+  Constructor. The directories in \a paths are replaced with the image
+  files in them, sorted by name.
+*/
+ImageSequenceSource::ImageSequenceSource(const QStringList &paths)
+    : m_nextIndex(0)
+{
+    const QStringList nameFilters = QStringList()
+            << "*.png" << "*.jpg" << "*.jpeg" << "*.bmp" << "*.ppm";
+
+    foreach (const QString &path, paths) {
+        const QFileInfo info(path);
+
+        if (info.isDir()) {
+            const QDir dir(path);
+
+            foreach (const QString &fileName,
+                     dir.entryList(nameFilters, QDir::Files, QDir::Name))
+            {
+                m_files.append(dir.filePath(fileName));
+            }
+        }
+        else {
+            m_files.append(path);
+        }
+    }
+
+    if (m_files.isEmpty())
+        m_errorString = "No input images";
+}
+
+
+/*!
+  From FrameSource. Only takes the next file name, the image is decoded by
+  load().
+*/
+bool ImageSequenceSource::next(BatchFrame &frame)
+{
+    if (m_nextIndex >= m_files.count())
+        return false;
+
+    const QString &fileName = m_files.at(m_nextIndex);
+
+    frame.m_index = m_nextIndex++;
+    frame.m_fileName = fileName;
+    frame.m_name = QFileInfo(fileName).completeBaseName();
+    frame.m_uyvy.clear();
+    return true;
+}
+
+
+/*!
+  From FrameSource. Decodes the image as RGB32.
+*/
+bool ImageSequenceSource::load(BatchFrame &frame)
+{
+    QImage image(frame.m_fileName);
+
+    if (image.isNull())
+        return false;
+
+    if (image.format() != QImage::Format_RGB32)
+        image = image.convertToFormat(QImage::Format_RGB32);
+
+    frame.m_image = image;
+    frame.m_width = image.width();
+    frame.m_height = image.height();
+    return true;
+}
+
+
+/*!
+  \class StreamSource
+  \brief Base for the sources reading frames from a file or the standard input.
+*/
+
+
+/*!
+  Constructor. Opens \a path, or the standard input if \a path is "-".
+*/
+StreamSource::StreamSource(const QString &path)
+    : m_nextIndex(0)
+{
+    bool opened(false);
+
+    if (path == "-") {
+        opened = m_file.open(stdin, QIODevice::ReadOnly);
+    }
+    else {
+        m_file.setFileName(path);
+        opened = m_file.open(QIODevice::ReadOnly);
+    }
+
+    if (!opened)
+        m_errorString = QString("Cannot open %1: %2").arg(path, m_file.errorString());
+}
+
+
+/*!
+  Returns true if the stream could be opened.
+*/
+bool StreamSource::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+
+/*!
+  Reads \a size bytes into \a data. Returns false if the stream ends
+  before that.
+*/
+bool StreamSource::readFully(char *data, qint64 size)
+{
+    while (size > 0) {
+        const qint64 count = m_file.read(data, size);
+
+        if (count <= 0)
+            return false;
+
+        data += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+
+/*!
+  \class RawUyvySource
+  \brief Reads headerless packed UYVY frames of a given size.
+*/
+
+
+/*!
+  Constructor. The frames are \a width x \a height pixels.
+*/
+RawUyvySource::RawUyvySource(const QString &path, int width, int height)
+    : StreamSource(path),
+      m_width(width),
+      m_height(height)
+{
+    if (m_width < 2 || m_height < 1 || (m_width & 1))
+        m_errorString = "The UYVY frame width must be even";
+}
+
+
+/*!
+  From FrameSource.
+*/
+bool RawUyvySource::next(BatchFrame &frame)
+{
+    if (!isOpen() || !m_errorString.isEmpty())
+        return false;
+
+    frame.m_uyvy.resize(m_width * m_height * 2);
+
+    if (!readFully(frame.m_uyvy.data(), frame.m_uyvy.size()))
+        return false;
+
+    frame.m_index = m_nextIndex++;
+    frame.m_name = streamFrameName(frame.m_index);
+    frame.m_fileName.clear();
+    frame.m_image = QImage();
+    frame.m_width = m_width;
+    frame.m_height = m_height;
+    return true;
+}
+
+
+/*!
+  \class Y4mSource
+  \brief Reads a YUV4MPEG2 stream.
+*/
+
+
+/*!
+  Constructor. Reads the stream header.
+*/
+Y4mSource::Y4mSource(const QString &path)
+    : StreamSource(path),
+      m_width(0),
+      m_height(0),
+      m_chromaShiftX(1),
+      m_chromaShiftY(1),
+      m_mono(false),
+      m_frameRate("30:1")
+{
+    if (isOpen())
+        readHeader();
+}
+
+
+/*!
+  Returns the frame rate of the stream as given in its header.
+*/
+QByteArray Y4mSource::frameRate() const
+{
+    return m_frameRate;
+}
+
+
+/*!
+  Parses the "YUV4MPEG2 W<width> H<height> ..." header line.
+*/
+bool Y4mSource::readHeader()
+{
+    const QList<QByteArray> tokens = m_file.readLine(1024).trimmed().split(' ');
+
+    if (tokens.isEmpty() || tokens.first() != "YUV4MPEG2") {
+        m_errorString = "Not a YUV4MPEG2 stream";
+        return false;
+    }
+
+    foreach (const QByteArray &token, tokens) {
+        const QByteArray value = token.mid(1);
+
+        switch (token.at(0)) {
+        case 'W':
+            m_width = value.toInt();
+            break;
+        case 'H':
+            m_height = value.toInt();
+            break;
+        case 'F':
+            m_frameRate = value;
+            break;
+        case 'C': {
+            if (value == "420" || value == "420jpeg"
+                    || value == "420paldv" || value == "420mpeg2")
+            {
+                m_chromaShiftX = 1;
+                m_chromaShiftY = 1;
+            }
+            else if (value == "422") {
+                m_chromaShiftX = 1;
+                m_chromaShiftY = 0;
+            }
+            else if (value == "444") {
+                m_chromaShiftX = 0;
+                m_chromaShiftY = 0;
+            }
+            else if (value == "mono") {
+                m_mono = true;
+            }
+            else {
+                m_errorString = QString("Unsupported YUV4MPEG2 colour space C%1")
+                        .arg(QString(value));
+                return false;
+            }
+            break;
+        }
+        default:
+            break;
+        } // switch (token.at(0))
+    }
+
+    if (m_width < 1 || m_height < 1) {
+        m_errorString = "Invalid YUV4MPEG2 frame size";
+        return false;
+    }
+
+    return true;
+}
+
+
+/*!
+  From FrameSource. Reads a "FRAME" and its planes, and packs them as UYVY.
+*/
+bool Y4mSource::next(BatchFrame &frame)
+{
+    if (!isOpen() || !m_errorString.isEmpty())
+        return false;
+
+    if (!m_file.readLine(1024).startsWith("FRAME"))
+        return false;
+
+    const int chromaWidth = (m_width + (1 << m_chromaShiftX) - 1) >> m_chromaShiftX;
+    const int chromaHeight = (m_height + (1 << m_chromaShiftY) - 1) >> m_chromaShiftY;
+    const int planesSize = m_width * m_height
+            + (m_mono ? 0 : 2 * chromaWidth * chromaHeight);
+
+    m_planes.resize(planesSize);
+
+    if (!readFully(m_planes.data(), planesSize))
+        return false;
+
+    frame.m_index = m_nextIndex++;
+    frame.m_name = streamFrameName(frame.m_index);
+    frame.m_fileName.clear();
+    frame.m_image = QImage();
+    frame.m_width = m_width;
+    frame.m_height = m_height;
+    packUyvy(frame);
+    return true;
+}
+
+
+/*!
+  Packs the planar frame to UYVY, the width rounded up to even. 4:2:0
+  chroma is repeated on both rows of a pair and 4:4:4 chroma is averaged
+  over the pixel pairs.
+*/
+void Y4mSource::packUyvy(BatchFrame &frame) const
+{
+    const int uyvyWidth = (m_width + 1) & ~1;
+    const int chromaWidth = (m_width + (1 << m_chromaShiftX) - 1) >> m_chromaShiftX;
+    const int chromaHeight = (m_height + (1 << m_chromaShiftY) - 1) >> m_chromaShiftY;
+
+    const uchar *luma = (const uchar*)m_planes.constData();
+    const uchar *u = luma + m_width * m_height;
+    const uchar *v = u + chromaWidth * chromaHeight;
+
+    frame.m_uyvy.resize(uyvyWidth * 2 * m_height);
+    uchar *t = (uchar*)frame.m_uyvy.data();
+
+    for (int y = 0; y < m_height; y++) {
+        const uchar *lumaRow = luma + m_width * y;
+        const uchar *uRow = u + chromaWidth * (y >> m_chromaShiftY);
+        const uchar *vRow = v + chromaWidth * (y >> m_chromaShiftY);
+
+        for (int x = 0; x < uyvyWidth; x += 2) {
+            const int x1 = qMin(x + 1, m_width - 1);
+            int cu(128);
+            int cv(128);
+
+            if (!m_mono) {
+                if (m_chromaShiftX) {
+                    cu = uRow[x >> 1];
+                    cv = vRow[x >> 1];
+                }
+                else {
+                    cu = (uRow[x] + uRow[x1] + 1) >> 1;
+                    cv = (vRow[x] + vRow[x1] + 1) >> 1;
+                }
+            }
+
+            t[0] = cu;
+            t[1] = lumaRow[x];
+            t[2] = cv;
+            t[3] = lumaRow[x1];
+            t += 4;
+        }
+    }
+}
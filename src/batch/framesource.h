@@ -0,0 +1,164 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <QString>
+#include <QStringList>
+
+
+/*!
+  \class BatchFrame
+  \brief A frame on its way through BatchProcessor.
+
+  The source is either an RGB32 image or a packed UYVY frame, the result is
+  always RGB32. The frames are reused from one batch to the next, so the
+  buffers are allocated only when the frame size changes.
+*/
+class BatchFrame
+{
+public:
+    BatchFrame() : m_index(-1), m_width(0), m_height(0), m_valid(false) {}
+
+public: // Data
+    int m_index;            // Position in the sequence
+    QString m_name;         // Base name for the output file
+    QString m_fileName;     // Image file to be loaded, if any
+    QImage m_image;         // RGB32 source, or
+    QByteArray m_uyvy;      // UYVY source of m_width x m_height pixels
+    int m_width;
+    int m_height;
+    QImage m_result;
+    bool m_valid;           // False if the frame could not be loaded
+};
+
+
+/*!
+  \class FrameSource
+  \brief Reads the frames for BatchProcessor.
+
+  next() is called for one frame at a time in the sequence order and should
+  do only what must be done in order, like reading a stream. load() is then
+  called for the frames of a batch in parallel and does the rest, like
+  decoding an image file.
+*/
+class FrameSource
+{
+public:
+    virtual ~FrameSource() {}
+
+        // Reads the next frame in order. Returns false at the end or on an
+        // error, see errorString().
+    virtual bool next(BatchFrame &frame) = 0;
+
+        // Completes frame. Called concurrently for different frames.
+    virtual bool load(BatchFrame &frame) { Q_UNUSED(frame); return true; }
+
+    QString errorString() const { return m_errorString; }
+
+protected:
+    QString m_errorString;
+};
+
+
+/*!
+  \class ImageSequenceSource
+  \brief Reads a sequence of image files, PNG, JPEG or anything QImage reads.
+*/
+class ImageSequenceSource : public FrameSource
+{
+public:
+        // A directory is replaced with the images in it, in name order
+    explicit ImageSequenceSource(const QStringList &paths);
+
+public: // From FrameSource
+    bool next(BatchFrame &frame);
+    bool load(BatchFrame &frame);
+
+private: // Data
+    QStringList m_files;
+    int m_nextIndex;
+};
+
+
+/*!
+  \class StreamSource
+  \brief Base for the sources reading frames from a file or the standard input.
+*/
+class StreamSource : public FrameSource
+{
+public:
+        // "-" reads the standard input
+    explicit StreamSource(const QString &path);
+
+    bool isOpen() const;
+
+protected:
+        // Reads exactly size bytes, returns false at the end of the stream
+    bool readFully(char *data, qint64 size);
+
+protected: // Data
+    QFile m_file;
+    int m_nextIndex;
+};
+
+
+/*!
+  \class RawUyvySource
+  \brief Reads headerless packed UYVY frames of a given size.
+*/
+class RawUyvySource : public StreamSource
+{
+public:
+    RawUyvySource(const QString &path, int width, int height);
+
+public: // From FrameSource
+    bool next(BatchFrame &frame);
+
+private: // Data
+    int m_width;
+    int m_height;
+};
+
+
+/*!
+  \class Y4mSource
+  \brief Reads a YUV4MPEG2 stream.
+
+  The planar 4:2:0, 4:2:2, 4:4:4 and mono frames are repacked to UYVY, the
+  format of the camera frames, so they are sampled by the same code as on
+  the devices.
+*/
+class Y4mSource : public StreamSource
+{
+public:
+    explicit Y4mSource(const QString &path);
+
+public: // From FrameSource
+    bool next(BatchFrame &frame);
+
+        // The frame rate of the stream, e.g. "30:1"
+    QByteArray frameRate() const;
+
+private:
+    bool readHeader();
+
+        // Packs the planar frame in m_planes to UYVY
+    void packUyvy(BatchFrame &frame) const;
+
+private: // Data
+    int m_width;
+    int m_height;
+    int m_chromaShiftX;     // log2 of the chroma subsampling
+    int m_chromaShiftY;
+    bool m_mono;
+    QByteArray m_frameRate;
+    QByteArray m_planes;
+};
+
+#endif // FRAMESOURCE_H
@@ -0,0 +1,280 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QScopedPointer>
+#include <QStringList>
+#include <stdio.h>
+
+#include "batchprocessor.h"
+#include "framesink.h"
+#include "framesource.h"
+#include "transformmapstore.h"
+#include "transformpreset.h"
+
+
+/*!
+  Prints the usage.
+*/
+static void printUsage()
+{
+    fprintf(stderr,
+            "Usage: mirrorhouse-batch [options] -o <output> <input>...\n"
+            "\n"
+            "Applies a mirror transform to an image sequence or a video stream.\n"
+            "\n"
+            "Input:\n"
+            "  <input>...              Image files or directories of images (PNG, JPEG, ...),\n"
+            "                          a .y4m file, or - for YUV4MPEG2 from the standard input\n"
+            "  --uyvy <W>x<H>          The input is raw packed UYVY frames of W x H pixels\n"
+            "  --rotate90              Rotate the frames like the sideways mounted cameras\n"
+            "  --flip-y                Turn the (rotated) frames upside down\n"
+            "  --coefficients <c>      YUV coefficients: bt601 (default), bt709, bt601full\n"
+            "\n"
+            "Effect:\n"
+            "  -t, --transform <name>  none, hwave, vwave, bubbles, invbubbles, spiral,\n"
+            "                          ripple, spike, tile, dither (default none). Join\n"
+            "                          names with + to apply each on top of the previous,\n"
+            "                          e.g. spiral+ripple\n"
+            "  -p, --power <value>     Power of the (first) transform (default per transform)\n"
+            "  -s, --size <value>      Size of the (first) transform (default per transform)\n"
+            "  --target <W>x<H>        Output size (default the size of the rotated input)\n"
+            "  --quality <high|low>    Linear or nearest pixel resampling (default high)\n"
+            "  --mipmap                Sample the parts the transform shrinks from halved\n"
+            "                          copies of the input, which removes their aliasing\n"
+            "\n"
+            "Output:\n"
+            "  -o, --output <path>     A directory for an image sequence, a .y4m or .rgb\n"
+            "                          file, or - for YUV4MPEG2 to the standard output\n"
+            "  --format <format>       Image sequence format: png (default), jpg, bmp, ...\n"
+            "  --jpeg-quality <0-100>  Quality of the JPEG images\n"
+            "\n"
+            "Processing:\n"
+            "  --threads <n>           Threads to use (default all cores)\n"
+            "  --map-cache <dir>       Keep the transform maps in dir between the runs\n"
+            "  --batch <n>             Frames in memory at once (default twice the threads)\n");
+}
+
+
+/*!
+  Parses "<width>x<height>" into \a size.
+*/
+static bool parseSize(const QString &text, QSize &size)
+{
+    const QStringList parts = text.split('x');
+    bool widthOk(false);
+    bool heightOk(false);
+
+    if (parts.count() == 2) {
+        size = QSize(parts.at(0).toInt(&widthOk), parts.at(1).toInt(&heightOk));
+    }
+
+    return widthOk && heightOk && !size.isEmpty();
+}
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList arguments = app.arguments();
+    arguments.removeFirst();
+
+    BatchProcessor::Settings settings;
+    QStringList inputs;
+    QString output;
+    QString format("png");
+    QSize uyvySize;
+    QByteArray frameRate("30:1");
+    const TransformPreset *transform = &TransformPreset::at(0);
+    QVector<MirrorEffect::TransformLayer> layers;
+    float power(-1.0f);
+    float size(-1.0f);
+    int jpegQuality(-1);
+    int threadCount(0);
+
+    while (!arguments.isEmpty()) {
+        const QString argument = arguments.takeFirst();
+
+        if (argument == "-h" || argument == "--help") {
+            printUsage();
+            return 0;
+        }
+
+        if (argument == "--rotate90") {
+            settings.m_rotate90degrees = true;
+            continue;
+        }
+
+        if (argument == "--flip-y") {
+            settings.m_flipY = true;
+            continue;
+        }
+
+        if (argument == "--mipmap") {
+            settings.m_mipmapping = true;
+            continue;
+        }
+
+        if (!argument.startsWith('-') || argument == "-") {
+            inputs.append(argument);
+            continue;
+        }
+
+        if (arguments.isEmpty()) {
+            fprintf(stderr, "Missing value for %s\n", qPrintable(argument));
+            return 1;
+        }
+
+        const QString value = arguments.takeFirst();
+        bool ok(true);
+
+        if (argument == "-t" || argument == "--transform") {
+            const QStringList names = value.split('+');
+            transform = TransformPreset::find(names.first());
+            ok = transform != 0;
+            layers.clear();
+
+            for (int i = 1; i < names.count() && ok; i++) {
+                const TransformPreset *layer = TransformPreset::find(names.at(i));
+                ok = layer != 0;
+
+                if (ok) {
+                    layers.append(MirrorEffect::TransformLayer(layer->m_transform,
+                                                               layer->m_power,
+                                                               layer->m_size));
+                }
+            }
+        }
+        else if (argument == "-p" || argument == "--power") {
+            power = value.toFloat(&ok);
+        }
+        else if (argument == "-s" || argument == "--size") {
+            size = value.toFloat(&ok);
+        }
+        else if (argument == "--target") {
+            ok = parseSize(value, settings.m_targetSize);
+        }
+        else if (argument == "--quality") {
+            ok = value == "high" || value == "low";
+            settings.m_highQuality = value == "high";
+        }
+        else if (argument == "--uyvy") {
+            ok = parseSize(value, uyvySize);
+        }
+        else if (argument == "--coefficients") {
+            if (value == "bt601")
+                settings.m_coefficients = YuvConverter::BT601;
+            else if (value == "bt709")
+                settings.m_coefficients = YuvConverter::BT709;
+            else if (value == "bt601full")
+                settings.m_coefficients = YuvConverter::BT601FullRange;
+            else
+                ok = false;
+        }
+        else if (argument == "-o" || argument == "--output") {
+            output = value;
+        }
+        else if (argument == "--format") {
+            format = value;
+        }
+        else if (argument == "--jpeg-quality") {
+            jpegQuality = value.toInt(&ok);
+        }
+        else if (argument == "--threads") {
+            threadCount = value.toInt(&ok);
+        }
+        else if (argument == "--batch") {
+            settings.m_batchSize = value.toInt(&ok);
+        }
+        else if (argument == "--map-cache") {
+            TransformMapStore::instance()->setDirectory(value);
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n\n", qPrintable(argument));
+            printUsage();
+            return 1;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "Invalid value for %s: %s\n",
+                    qPrintable(argument), qPrintable(value));
+            return 1;
+        }
+    }
+
+    if (inputs.isEmpty() || output.isEmpty()) {
+        printUsage();
+        return 1;
+    }
+
+    settings.m_transform = transform->m_transform;
+    settings.m_power = power >= 0.0f ? power : transform->m_power;
+    settings.m_size = size >= 0.0f ? size : transform->m_size;
+    settings.m_layers = layers;
+
+    if (threadCount > 0)
+        WorkerPool::instance()->setThreadCount(threadCount);
+
+    // Source
+    QScopedPointer<FrameSource> source;
+
+    if (uyvySize.isValid()) {
+        source.reset(new RawUyvySource(inputs.first(), uyvySize.width(), uyvySize.height()));
+    }
+    else if (inputs.count() == 1
+             && (inputs.first() == "-" || inputs.first().endsWith(".y4m")))
+    {
+        Y4mSource *y4mSource = new Y4mSource(inputs.first());
+        frameRate = y4mSource->frameRate();
+        source.reset(y4mSource);
+    }
+    else {
+        source.reset(new ImageSequenceSource(inputs));
+    }
+
+    if (!source->errorString().isEmpty()) {
+        fprintf(stderr, "%s\n", qPrintable(source->errorString()));
+        return 1;
+    }
+
+    // Sink
+    QScopedPointer<FrameSink> sink;
+
+    if (output == "-" || output.endsWith(".y4m"))
+        sink.reset(new Y4mSink(output, frameRate, settings.m_coefficients));
+    else if (output.endsWith(".rgb") || output.endsWith(".raw"))
+        sink.reset(new RawRgbSink(output));
+    else
+        sink.reset(new ImageSequenceSink(output, format, jpegQuality));
+
+    if (!sink->errorString().isEmpty()) {
+        fprintf(stderr, "%s\n", qPrintable(sink->errorString()));
+        return 1;
+    }
+
+    BatchProcessor processor(source.data(), sink.data(), settings);
+    QElapsedTimer timer;
+    timer.start();
+
+    const bool succeeded = processor.exec();
+    const qint64 elapsed = qMax(timer.elapsed(), qint64(1));
+
+    if (!succeeded)
+        fprintf(stderr, "%s\n", qPrintable(processor.errorString()));
+
+    // The report goes to stderr, the stdout may be the output stream
+    const int frames = processor.frameCount();
+
+    fprintf(stderr, "%d frames (%d skipped) in %.2f s: %.1f frames/s, %.2f ms/frame, %d threads\n",
+            frames,
+            processor.failedCount(),
+            elapsed / 1000.0,
+            frames * 1000.0 / elapsed,
+            frames ? (double)elapsed / frames : 0.0,
+            WorkerPool::instance()->threadCount());
+
+    return succeeded && processor.failedCount() == 0 ? 0 : 1;
+}
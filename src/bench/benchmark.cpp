@@ -0,0 +1,308 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "benchmark.h"
+
+#include <QElapsedTimer>
+#include <QtAlgorithms>
+#include <math.h>
+
+
+/*!
+  \class BenchmarkCase
+  \brief A single kernel with fixed parameters, run repeatedly by Benchmark.
+*/
+
+
+/*!
+  Constructor.
+*/
+BenchmarkCase::BenchmarkCase()
+    : m_pixels(0),
+      m_bytes(0)
+{
+}
+
+
+/*!
+  Destructor.
+*/
+BenchmarkCase::~BenchmarkCase()
+{
+}
+
+
+/*!
+  \class BenchmarkResult
+  \brief The timings of a BenchmarkCase.
+*/
+
+
+/*!
+  Constructor.
+*/
+BenchmarkResult::BenchmarkResult()
+    : m_pixels(0),
+      m_bytes(0),
+      m_skipped(false),
+      m_runsPerSample(0)
+{
+}
+
+
+/*!
+  Returns the mean of the samples.
+*/
+double BenchmarkResult::mean() const
+{
+    if (m_samples.isEmpty())
+        return 0.0;
+
+    double sum(0.0);
+
+    for (int i = 0; i < m_samples.count(); i++)
+        sum += m_samples.at(i);
+
+    return sum / m_samples.count();
+}
+
+
+/*!
+  Returns the median of the samples. Less sensitive than the mean to the
+  samples disturbed by other processes.
+*/
+double BenchmarkResult::median() const
+{
+    if (m_samples.isEmpty())
+        return 0.0;
+
+    QVector<double> sorted = m_samples;
+    qSort(sorted);
+
+    const int middle = sorted.count() / 2;
+
+    return sorted.count() % 2 ? sorted.at(middle)
+                              : (sorted.at(middle - 1) + sorted.at(middle)) / 2.0;
+}
+
+
+/*!
+  Returns the fastest sample.
+*/
+double BenchmarkResult::minimum() const
+{
+    if (m_samples.isEmpty())
+        return 0.0;
+
+    double result = m_samples.at(0);
+
+    for (int i = 1; i < m_samples.count(); i++)
+        result = qMin(result, m_samples.at(i));
+
+    return result;
+}
+
+
+/*!
+  Returns the slowest sample.
+*/
+double BenchmarkResult::maximum() const
+{
+    double result(0.0);
+
+    for (int i = 0; i < m_samples.count(); i++)
+        result = qMax(result, m_samples.at(i));
+
+    return result;
+}
+
+
+/*!
+  Returns the sample standard deviation.
+*/
+double BenchmarkResult::standardDeviation() const
+{
+    if (m_samples.count() < 2)
+        return 0.0;
+
+    const double average = mean();
+    double sum(0.0);
+
+    for (int i = 0; i < m_samples.count(); i++)
+        sum += (m_samples.at(i) - average) * (m_samples.at(i) - average);
+
+    return sqrt(sum / (m_samples.count() - 1));
+}
+
+
+/*!
+  Returns the coefficient of variation, the standard deviation divided by
+  the mean. Results varying by more than a few percent should be measured
+  again.
+*/
+double BenchmarkResult::variation() const
+{
+    const double average = mean();
+    return average > 0.0 ? standardDeviation() / average : 0.0;
+}
+
+
+/*!
+  Returns the median time per produced pixel in nanoseconds.
+*/
+double BenchmarkResult::nsPerPixel() const
+{
+    return m_pixels > 0 ? median() / m_pixels : 0.0;
+}
+
+
+/*!
+  Returns the produced pixels per second at the median time.
+*/
+double BenchmarkResult::pixelsPerSecond() const
+{
+    const double time = median();
+    return time > 0.0 ? m_pixels * 1.0e9 / time : 0.0;
+}
+
+
+/*!
+  Returns the bytes read and written per second at the median time.
+*/
+double BenchmarkResult::bytesPerSecond() const
+{
+    const double time = median();
+    return time > 0.0 ? m_bytes * 1.0e9 / time : 0.0;
+}
+
+
+/*!
+  \class Benchmark
+  \brief Measures BenchmarkCases with a warm-up and repeated samples.
+*/
+
+
+/*!
+  Constructor. The defaults take about a quarter of a second per case.
+*/
+Benchmark::Benchmark()
+    : m_warmUpTime(50),
+      m_minimumSampleTime(20),
+      m_repetitions(10)
+{
+}
+
+
+/*!
+  Sets the time the case is run before the samples are taken. The case is
+  run at least once whatever the time.
+*/
+void Benchmark::setWarmUpTime(int milliseconds)
+{
+    m_warmUpTime = qMax(0, milliseconds);
+}
+
+
+/*!
+  Returns the warm-up time in milliseconds.
+*/
+int Benchmark::warmUpTime() const
+{
+    return m_warmUpTime;
+}
+
+
+/*!
+  Sets the shortest time a sample may take.
+*/
+void Benchmark::setMinimumSampleTime(int milliseconds)
+{
+    m_minimumSampleTime = qMax(1, milliseconds);
+}
+
+
+/*!
+  Returns the minimum sample time in milliseconds.
+*/
+int Benchmark::minimumSampleTime() const
+{
+    return m_minimumSampleTime;
+}
+
+
+/*!
+  Sets the number of samples taken.
+*/
+void Benchmark::setRepetitions(int repetitions)
+{
+    m_repetitions = qMax(1, repetitions);
+}
+
+
+/*!
+  Returns the number of samples taken.
+*/
+int Benchmark::repetitions() const
+{
+    return m_repetitions;
+}
+
+
+/*!
+  Measures \a benchmarkCase. The result is marked skipped if the case
+  cannot be set up.
+*/
+BenchmarkResult Benchmark::measure(BenchmarkCase *benchmarkCase) const
+{
+    BenchmarkResult result;
+    result.m_kernel = benchmarkCase->m_kernel;
+    result.m_implementation = benchmarkCase->m_implementation;
+    result.m_transform = benchmarkCase->m_transform;
+    result.m_quality = benchmarkCase->m_quality;
+    result.m_sourceSize = benchmarkCase->m_sourceSize;
+    result.m_targetSize = benchmarkCase->m_targetSize;
+
+    if (!benchmarkCase->setUp()) {
+        result.m_skipped = true;
+        return result;
+    }
+
+    // The counts may depend on what setUp() found out
+    result.m_implementation = benchmarkCase->m_implementation;
+    result.m_pixels = benchmarkCase->m_pixels;
+    result.m_bytes = benchmarkCase->m_bytes;
+
+    // Warm-up. The first run is not used for the calibration, it may
+    // include one-time work like generating a transform map.
+    QElapsedTimer timer;
+    timer.start();
+    benchmarkCase->run();
+
+    qint64 warmUpRuns(0);
+    QElapsedTimer warmUpTimer;
+    warmUpTimer.start();
+
+    do {
+        benchmarkCase->run();
+        warmUpRuns++;
+    } while (timer.elapsed() < m_warmUpTime);
+
+    const double runTime = qMax(1.0, (double)warmUpTimer.nsecsElapsed() / warmUpRuns);
+    result.m_runsPerSample =
+            qMax(1, (int)ceil(m_minimumSampleTime * 1.0e6 / runTime));
+
+    result.m_samples.reserve(m_repetitions);
+
+    for (int i = 0; i < m_repetitions; i++) {
+        timer.start();
+
+        for (int run = 0; run < result.m_runsPerSample; run++)
+            benchmarkCase->run();
+
+        result.m_samples.append((double)timer.nsecsElapsed() / result.m_runsPerSample);
+    }
+
+    benchmarkCase->tearDown();
+    return result;
+}
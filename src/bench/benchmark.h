@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+
+/*!
+  \class BenchmarkCase
+  \brief A single kernel with fixed parameters, run repeatedly by Benchmark.
+
+  The subclasses allocate their buffers in setUp(), so that run() measures
+  only the kernel itself. The pixel and byte counts are the work done by
+  one run(): the pixels are the ones produced, the bytes the nominal
+  amount read and written.
+*/
+class BenchmarkCase
+{
+public:
+    BenchmarkCase();
+    virtual ~BenchmarkCase();
+
+public:
+        // Prepares the case for run(). Returns false if the case cannot be
+        // run, e.g. the implementation is not supported by this CPU.
+    virtual bool setUp() { return true; }
+
+        // Runs the kernel once
+    virtual void run() = 0;
+
+        // Releases what setUp() allocated
+    virtual void tearDown() {}
+
+public: // Data
+    QString m_kernel;           // e.g. "warp", "convert"
+    QString m_implementation;   // The code path or the instruction set used
+    QString m_transform;        // Empty if the kernel has no transform
+    QString m_quality;          // "high", "low" or empty
+    QSize m_sourceSize;
+    QSize m_targetSize;
+    qint64 m_pixels;
+    qint64 m_bytes;
+};
+
+
+/*!
+  \class BenchmarkResult
+  \brief The timings of a BenchmarkCase.
+
+  A sample is the time of one run() in nanoseconds, averaged over a batch
+  of runs long enough for the timer's resolution not to matter.
+*/
+class BenchmarkResult
+{
+public:
+    BenchmarkResult();
+
+public:
+    double mean() const;
+    double median() const;
+    double minimum() const;
+    double maximum() const;
+    double standardDeviation() const;
+
+        // The standard deviation relative to the mean
+    double variation() const;
+
+        // Derived from the median
+    double nsPerPixel() const;
+    double pixelsPerSecond() const;
+    double bytesPerSecond() const;
+
+public: // Data
+    QString m_kernel;
+    QString m_implementation;
+    QString m_transform;
+    QString m_quality;
+    QSize m_sourceSize;
+    QSize m_targetSize;
+    qint64 m_pixels;
+    qint64 m_bytes;
+    bool m_skipped;             // setUp() failed, there are no samples
+    int m_runsPerSample;
+    QVector<double> m_samples;  // Nanoseconds per run()
+};
+
+
+/*!
+  \class Benchmark
+  \brief Measures BenchmarkCases with a warm-up and repeated samples.
+
+  The case is first run for the warm-up time, which fills the caches, lets
+  the CPU clock up and generates whatever the kernel generates on its first
+  run. The number of runs per sample is calibrated from the warm-up so that
+  a sample lasts at least the minimum sample time.
+*/
+class Benchmark
+{
+public:
+    Benchmark();
+
+public:
+    void setWarmUpTime(int milliseconds);
+    int warmUpTime() const;
+
+    void setMinimumSampleTime(int milliseconds);
+    int minimumSampleTime() const;
+
+    void setRepetitions(int repetitions);
+    int repetitions() const;
+
+        // Sets up, measures and tears down benchmarkCase
+    BenchmarkResult measure(BenchmarkCase *benchmarkCase) const;
+
+private: // Data
+    int m_warmUpTime;
+    int m_minimumSampleTime;
+    int m_repetitions;
+};
+
+#endif // BENCHMARK_H
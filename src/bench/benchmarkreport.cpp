@@ -0,0 +1,210 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "benchmarkreport.h"
+
+#include <QStringList>
+
+
+/*!
+  Returns \a text as a JSON string, or null if it is empty.
+*/
+static QByteArray jsonString(const QString &text)
+{
+    if (text.isEmpty())
+        return "null";
+
+    QByteArray result("\"");
+    const QByteArray utf8 = text.toUtf8();
+
+    for (int i = 0; i < utf8.size(); i++) {
+        const char c = utf8.at(i);
+
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        }
+        else if ((unsigned char)c < 0x20) {
+            char escaped[8];
+            sprintf(escaped, "\\u%04x", (unsigned char)c);
+            result += escaped;
+        }
+        else {
+            result += c;
+        }
+    }
+
+    return result + '"';
+}
+
+
+/*!
+  Returns \a value as a JSON number.
+*/
+static QByteArray jsonNumber(double value)
+{
+    return QByteArray::number(value, 'g', 10);
+}
+
+
+/*!
+  Returns \a size as a JSON object.
+*/
+static QByteArray jsonSize(const QSize &size)
+{
+    return "{ \"width\": " + QByteArray::number(size.width())
+            + ", \"height\": " + QByteArray::number(size.height()) + " }";
+}
+
+
+/*!
+  Returns \a size as "<width>x<height>".
+*/
+static QString sizeText(const QSize &size)
+{
+    return QString("%1x%2").arg(size.width()).arg(size.height());
+}
+
+
+/*!
+  \class BenchmarkReport
+  \brief Collects the BenchmarkResults and formats them as a table or as JSON.
+*/
+
+
+/*!
+  Constructor.
+*/
+BenchmarkReport::BenchmarkReport()
+    : m_headerPrinted(false)
+{
+}
+
+
+/*!
+  Adds \a key with a string \a value to the environment.
+*/
+void BenchmarkReport::setEnvironment(const QString &key, const QString &value)
+{
+    m_environment.append(qMakePair(key, jsonString(value)));
+}
+
+
+/*!
+  Adds \a key with a numeric \a value to the environment.
+*/
+void BenchmarkReport::setEnvironment(const QString &key, int value)
+{
+    m_environment.append(qMakePair(key, QByteArray::number(value)));
+}
+
+
+/*!
+  Adds \a result to the report.
+*/
+void BenchmarkReport::add(const BenchmarkResult &result)
+{
+    m_results.append(result);
+}
+
+
+/*!
+  Returns the results added so far.
+*/
+const QList<BenchmarkResult> &BenchmarkReport::results() const
+{
+    return m_results;
+}
+
+
+/*!
+  Prints \a result to \a file as a row of a fixed-width table. The rates are
+  in millions of pixels and megabytes per second.
+*/
+void BenchmarkReport::printRow(FILE *file, const BenchmarkResult &result)
+{
+    if (!m_headerPrinted) {
+        fprintf(file, "%-16s %-14s %-11s %-5s %-10s %-10s %9s %9s %9s %6s\n",
+                "kernel", "implementation", "transform", "qual", "source", "target",
+                "ns/pixel", "Mpixel/s", "MB/s", "cv %");
+        m_headerPrinted = true;
+    }
+
+    fprintf(file, "%-16s %-14s %-11s %-5s %-10s %-10s ",
+            qPrintable(result.m_kernel),
+            qPrintable(result.m_implementation),
+            qPrintable(result.m_transform.isEmpty() ? QString("-") : result.m_transform),
+            qPrintable(result.m_quality.isEmpty() ? QString("-") : result.m_quality),
+            qPrintable(sizeText(result.m_sourceSize)),
+            qPrintable(sizeText(result.m_targetSize)));
+
+    if (result.m_skipped) {
+        fprintf(file, "%9s\n", "skipped");
+    }
+    else {
+        fprintf(file, "%9.3f %9.1f %9.1f %6.2f\n",
+                result.nsPerPixel(),
+                result.pixelsPerSecond() / 1.0e6,
+                result.bytesPerSecond() / 1.0e6,
+                result.variation() * 100.0);
+    }
+
+    fflush(file);
+}
+
+
+/*!
+  Returns the environment and all the results as a JSON document.
+*/
+QByteArray BenchmarkReport::toJson() const
+{
+    QByteArray json("{\n  \"environment\": {");
+
+    for (int i = 0; i < m_environment.count(); i++) {
+        json += i ? ",\n    " : "\n    ";
+        json += jsonString(m_environment.at(i).first) + ": " + m_environment.at(i).second;
+    }
+
+    json += "\n  },\n  \"results\": [";
+
+    for (int i = 0; i < m_results.count(); i++) {
+        const BenchmarkResult &result = m_results.at(i);
+
+        json += i ? ",\n    {\n" : "\n    {\n";
+        json += "      \"kernel\": " + jsonString(result.m_kernel) + ",\n";
+        json += "      \"implementation\": " + jsonString(result.m_implementation) + ",\n";
+        json += "      \"transform\": " + jsonString(result.m_transform) + ",\n";
+        json += "      \"quality\": " + jsonString(result.m_quality) + ",\n";
+        json += "      \"source\": " + jsonSize(result.m_sourceSize) + ",\n";
+        json += "      \"target\": " + jsonSize(result.m_targetSize) + ",\n";
+
+        if (result.m_skipped) {
+            json += "      \"skipped\": true\n    }";
+            continue;
+        }
+
+        QStringList samples;
+
+        for (int j = 0; j < result.m_samples.count(); j++)
+            samples.append(QString(jsonNumber(result.m_samples.at(j))));
+
+        json += "      \"skipped\": false,\n";
+        json += "      \"pixels\": " + QByteArray::number(result.m_pixels) + ",\n";
+        json += "      \"bytes\": " + QByteArray::number(result.m_bytes) + ",\n";
+        json += "      \"runsPerSample\": " + QByteArray::number(result.m_runsPerSample) + ",\n";
+        json += "      \"ns\": { \"mean\": " + jsonNumber(result.mean())
+                + ", \"median\": " + jsonNumber(result.median())
+                + ", \"min\": " + jsonNumber(result.minimum())
+                + ", \"max\": " + jsonNumber(result.maximum())
+                + ", \"stddev\": " + jsonNumber(result.standardDeviation()) + " },\n";
+        json += "      \"variation\": " + jsonNumber(result.variation()) + ",\n";
+        json += "      \"nsPerPixel\": " + jsonNumber(result.nsPerPixel()) + ",\n";
+        json += "      \"pixelsPerSecond\": " + jsonNumber(result.pixelsPerSecond()) + ",\n";
+        json += "      \"bytesPerSecond\": " + jsonNumber(result.bytesPerSecond()) + ",\n";
+        json += "      \"samples\": [ " + samples.join(", ").toLatin1() + " ]\n    }";
+    }
+
+    json += "\n  ]\n}\n";
+    return json;
+}
@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef BENCHMARKREPORT_H
+#define BENCHMARKREPORT_H
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <stdio.h>
+
+#include "benchmark.h"
+
+
+/*!
+  \class BenchmarkReport
+  \brief Collects the BenchmarkResults and formats them as a table or as JSON.
+
+  The JSON document has an "environment" object describing the machine and
+  the settings, and a "results" array with one object per case:
+
+  \code
+  { "kernel": "warp", "implementation": "SSE2", "transform": "spiral",
+    "quality": "high", "source": { "width": 640, "height": 480 },
+    "target": { "width": 640, "height": 480 }, "pixels": 307200,
+    "bytes": 4300800, "runsPerSample": 12,
+    "ns": { "mean": ..., "median": ..., "min": ..., "max": ..., "stddev": ... },
+    "variation": 0.012, "nsPerPixel": 5.4, "pixelsPerSecond": 1.8e8,
+    "bytesPerSecond": 2.5e9, "samples": [ ... ] }
+  \endcode
+
+  The fields which don't apply to a kernel are null. A case which could not
+  be run has "skipped": true and no timings.
+*/
+class BenchmarkReport
+{
+public:
+    BenchmarkReport();
+
+public:
+        // Describes the environment in the JSON document
+    void setEnvironment(const QString &key, const QString &value);
+    void setEnvironment(const QString &key, int value);
+
+    void add(const BenchmarkResult &result);
+    const QList<BenchmarkResult> &results() const;
+
+        // Prints the result as a row of the table, with the header before
+        // the first row
+    void printRow(FILE *file, const BenchmarkResult &result);
+
+    QByteArray toJson() const;
+
+private: // Data
+    QList<QPair<QString, QByteArray> > m_environment;  // Values in JSON
+    QList<BenchmarkResult> m_results;
+    bool m_headerPrinted;
+};
+
+#endif // BENCHMARKREPORT_H
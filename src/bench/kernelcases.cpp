@@ -0,0 +1,506 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "kernelcases.h"
+
+#include "bufferpool.h"
+#include "separablewarp.h"
+#include "transformgenerator.h"
+#include "transformpreset.h"
+
+
+/*!
+  Fills \a count words at \a data with pseudo-random noise.
+*/
+static void fillNoise(unsigned int *data, int count)
+{
+    unsigned int seed(0x12345678);
+
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1664525 + 1013904223;
+        data[i] = seed;
+    }
+}
+
+
+/*!
+  \class WarpCase
+  \brief MirrorEffect::process() with a transform whose map is already generated.
+*/
+
+
+/*!
+  Constructor. The kernel is "warp" for an RGB32 source with the map
+  engine, "warp-uyvy" for a UYVY source and "warp-procedural" for the
+  procedural engine.
+*/
+WarpCase::WarpCase(const TransformPreset &preset,
+                   bool highQuality,
+                   MirrorEffect::SourceFormat format,
+                   MirrorEffect::Engine engine,
+                   const QSize &sourceSize,
+                   const QSize &targetSize,
+                   int threadCount)
+    : m_mirrorTransform(preset.m_transform),
+      m_power(preset.m_power),
+      m_size(preset.m_size),
+      m_highQuality(highQuality),
+      m_format(format),
+      m_engine(engine),
+      m_threadCount(threadCount),
+      m_effect(0),
+      m_source(0),
+      m_target(0)
+{
+    if (format == MirrorEffect::SourceUYVY)
+        m_kernel = "warp-uyvy";
+    else if (engine == MirrorEffect::ProceduralEngine)
+        m_kernel = "warp-procedural";
+    else
+        m_kernel = "warp";
+
+    m_transform = preset.m_name;
+    m_quality = highQuality ? "high" : "low";
+    m_sourceSize = sourceSize;
+    m_targetSize = targetSize;
+}
+
+
+/*!
+  Destructor.
+*/
+WarpCase::~WarpCase()
+{
+    tearDown();
+}
+
+
+/*!
+  From BenchmarkCase. Creates the effect with the source and the target
+  set. The map is generated on the first run(), during the warm-up.
+*/
+bool WarpCase::setUp()
+{
+    const int sourcePixels = m_sourceSize.width() * m_sourceSize.height();
+    const int targetPixels = m_targetSize.width() * m_targetSize.height();
+    BufferPool *pool = BufferPool::instance();
+
+    m_effect = new MirrorEffect();
+    m_effect->setThreadCount(m_threadCount);
+    m_effect->setEngine(m_engine);
+    m_effect->setHighQuality(m_highQuality);
+    m_effect->setMirrorTransform(m_mirrorTransform, m_power, m_size);
+
+    if (m_format == MirrorEffect::SourceUYVY) {
+        const int bytesPerLine = ((m_sourceSize.width() + 1) & ~1) * 2;
+        const int words = (bytesPerLine * m_sourceSize.height() + 3) / 4;
+
+        m_source = pool->acquireArray<unsigned int>(words);
+        fillNoise(m_source, words);
+        m_effect->setSourceUYVY((const unsigned char*)m_source,
+                                m_sourceSize.width(),
+                                m_sourceSize.height(),
+                                bytesPerLine);
+    }
+    else {
+        m_source = pool->acquireArray<unsigned int>(sourcePixels);
+        fillNoise(m_source, sourcePixels);
+        m_effect->setSource(m_source,
+                            m_sourceSize.width(),
+                            m_sourceSize.height(),
+                            m_sourceSize.width());
+    }
+
+    m_target = pool->acquireArray<unsigned int>(targetPixels);
+    m_effect->setTarget(m_target,
+                        m_targetSize.width(),
+                        m_targetSize.height(),
+                        m_targetSize.width());
+
+    // The same choices MirrorEffect::process() makes
+    m_pixels = targetPixels;
+    m_bytes = (qint64)targetPixels * 4
+            + (qint64)sourcePixels * (m_format == MirrorEffect::SourceUYVY ? 2 : 4);
+
+    if (m_format == MirrorEffect::SourceRGB32
+            && SeparableWarp::isSeparable(m_mirrorTransform))
+    {
+        m_implementation = "separable";
+    }
+    else if (m_engine == MirrorEffect::ProceduralEngine) {
+        m_implementation = "procedural";
+    }
+    else {
+        if (m_format == MirrorEffect::SourceUYVY)
+            m_implementation = m_highQuality ? "uyvy-bilinear" : "uyvy-nearest";
+        else if (m_highQuality)
+            m_implementation = WarpKernels::variantName(WarpKernels::bilinearVariant());
+        else
+            m_implementation = "nearest";
+
+        // The co-ordinate planes and, with the linear resampling, the shine
+        m_bytes += (qint64)targetPixels * (m_highQuality ? 5 : 4);
+    }
+
+    return true;
+}
+
+
+/*!
+  From BenchmarkCase.
+*/
+void WarpCase::run()
+{
+    m_effect->process();
+}
+
+
+/*!
+  From BenchmarkCase. Deletes the effect and releases the buffers.
+*/
+void WarpCase::tearDown()
+{
+    delete m_effect;
+    m_effect = 0;
+
+    BufferPool *pool = BufferPool::instance();
+    pool->release(m_source);
+    pool->release(m_target);
+    m_source = 0;
+    m_target = 0;
+}
+
+
+/*!
+  \class LineKernelCase
+  \brief One of the WarpKernels row functions over a whole target, on a single thread.
+*/
+
+
+/*!
+  Constructor.
+*/
+LineKernelCase::LineKernelCase(bool highQuality,
+                               WarpKernels::Variant variant,
+                               const QSize &sourceSize,
+                               const QSize &targetSize)
+    : m_highQuality(highQuality),
+      m_bilinearLine(highQuality ? WarpKernels::bilinearLine(variant) : 0),
+      m_source(0),
+      m_target(0)
+{
+    m_kernel = "line";
+    m_implementation = highQuality ? WarpKernels::variantName(variant) : "nearest";
+    m_transform = "bubbles";
+    m_quality = highQuality ? "high" : "low";
+    m_sourceSize = sourceSize;
+    m_targetSize = targetSize;
+}
+
+
+/*!
+  Destructor.
+*/
+LineKernelCase::~LineKernelCase()
+{
+    tearDown();
+}
+
+
+/*!
+  From BenchmarkCase. Generates the map. Fails if the variant is not
+  supported by this CPU.
+*/
+bool LineKernelCase::setUp()
+{
+    if (m_highQuality && !m_bilinearLine)
+        return false;
+
+    const int sourcePixels = m_sourceSize.width() * m_sourceSize.height();
+    const int targetPixels = m_targetSize.width() * m_targetSize.height();
+    BufferPool *pool = BufferPool::instance();
+
+    m_source = pool->acquireArray<unsigned int>(sourcePixels);
+    m_target = pool->acquireArray<unsigned int>(targetPixels);
+    fillNoise(m_source, sourcePixels);
+
+    m_map.create(m_targetSize.width(), m_targetSize.height(),
+                 m_sourceSize.width(), m_sourceSize.height());
+
+    const TransformPreset *bubbles = TransformPreset::find(m_transform);
+    TransformGenerator generator(&m_map, bubbles->m_transform,
+                                 bubbles->m_power, bubbles->m_size,
+                                 m_sourceSize.width(), m_sourceSize.height());
+    generator.generate();
+
+    m_pixels = targetPixels;
+    m_bytes = (qint64)targetPixels * (m_highQuality ? 9 : 8) + (qint64)sourcePixels * 4;
+
+    return true;
+}
+
+
+/*!
+  From BenchmarkCase. Samples every row of the target.
+*/
+void LineKernelCase::run()
+{
+    const int width = m_targetSize.width();
+
+    for (int y = 0; y < m_targetSize.height(); y++) {
+        unsigned int *t = m_target + width * y;
+
+        if (m_highQuality) {
+            m_bilinearLine(t, t + width,
+                           m_map.xRow(y), m_map.yRow(y), m_map.shineRow(y),
+                           m_map.fracBits(),
+                           m_source, m_sourceSize.width());
+        }
+        else {
+            WarpKernels::nearestLine(t, t + width,
+                                     m_map.xRow(y), m_map.yRow(y),
+                                     m_map.fracBits(),
+                                     m_source, m_sourceSize.width());
+        }
+    }
+}
+
+
+/*!
+  From BenchmarkCase. Releases the map and the buffers.
+*/
+void LineKernelCase::tearDown()
+{
+    m_map.clear();
+
+    BufferPool *pool = BufferPool::instance();
+    pool->release(m_source);
+    pool->release(m_target);
+    m_source = 0;
+    m_target = 0;
+}
+
+
+/*!
+  \class MapGenerationCase
+  \brief TransformGenerator filling a map, the work of TransformBuilder::build().
+*/
+
+
+/*!
+  Constructor.
+*/
+MapGenerationCase::MapGenerationCase(const TransformPreset &preset,
+                                     const QSize &sourceSize,
+                                     const QSize &targetSize,
+                                     int threadCount)
+    : m_mirrorTransform(preset.m_transform),
+      m_power(preset.m_power),
+      m_size(preset.m_size),
+      m_threadCount(threadCount)
+{
+    m_kernel = "mapgen";
+    m_implementation = "generator";
+    m_transform = preset.m_name;
+    m_sourceSize = sourceSize;
+    m_targetSize = targetSize;
+}
+
+
+/*!
+  From BenchmarkCase. Allocates the map, which every run() fills again.
+*/
+bool MapGenerationCase::setUp()
+{
+    m_map.create(m_targetSize.width(), m_targetSize.height(),
+                 m_sourceSize.width(), m_sourceSize.height());
+
+    m_pixels = m_targetSize.width() * m_targetSize.height();
+    m_bytes = m_map.byteCount();
+
+    return true;
+}
+
+
+/*!
+  From BenchmarkCase. Generates the whole map, including the column tables
+  TransformGenerator computes when constructed.
+*/
+void MapGenerationCase::run()
+{
+    TransformGenerator generator(&m_map, m_mirrorTransform, m_power, m_size,
+                                 m_sourceSize.width(), m_sourceSize.height());
+    generator.generate(m_threadCount);
+}
+
+
+/*!
+  From BenchmarkCase. Releases the map.
+*/
+void MapGenerationCase::tearDown()
+{
+    m_map.clear();
+}
+
+
+/*!
+  \class ConversionCase
+  \brief A YuvConverter variant converting a whole UYVY frame to RGB32, on a single thread.
+*/
+
+
+/*!
+  Constructor. The frame is converted with the BT.601 coefficients.
+*/
+ConversionCase::ConversionCase(YuvConverter::Variant variant, const QSize &size)
+    : m_convertLine(YuvConverter::lineFunction(variant)),
+      m_matrix(YuvConverter::matrix(YuvConverter::BT601)),
+      m_source(0),
+      m_target(0)
+{
+    m_kernel = "convert";
+    m_implementation = YuvConverter::variantName(variant);
+    m_sourceSize = size;
+    m_targetSize = size;
+}
+
+
+/*!
+  Destructor.
+*/
+ConversionCase::~ConversionCase()
+{
+    tearDown();
+}
+
+
+/*!
+  From BenchmarkCase. Fails if the variant is not supported by this CPU.
+*/
+bool ConversionCase::setUp()
+{
+    if (!m_convertLine)
+        return false;
+
+    const int pixels = m_sourceSize.width() * m_sourceSize.height();
+    const int bytesPerLine = ((m_sourceSize.width() + 1) & ~1) * 2;
+    const int words = (bytesPerLine * m_sourceSize.height() + 3) / 4;
+    BufferPool *pool = BufferPool::instance();
+
+    m_source = pool->acquireArray<unsigned char>(words * 4);
+    m_target = pool->acquireArray<unsigned int>(pixels);
+    fillNoise((unsigned int*)m_source, words);
+
+    m_pixels = pixels;
+    m_bytes = (qint64)pixels * 6;
+
+    return true;
+}
+
+
+/*!
+  From BenchmarkCase. Converts every row of the frame.
+*/
+void ConversionCase::run()
+{
+    const int width = m_sourceSize.width();
+    const int bytesPerLine = ((width + 1) & ~1) * 2;
+
+    for (int y = 0; y < m_sourceSize.height(); y++)
+        m_convertLine(m_target + width * y, m_source + bytesPerLine * y, width, m_matrix);
+}
+
+
+/*!
+  From BenchmarkCase. Releases the buffers.
+*/
+void ConversionCase::tearDown()
+{
+    BufferPool *pool = BufferPool::instance();
+    pool->release(m_source);
+    pool->release(m_target);
+    m_source = 0;
+    m_target = 0;
+}
+
+
+/*!
+  \class RotationCase
+  \brief ImageRotator copying a frame rotated and/or flipped, as MirrorEffect::setSource() does.
+*/
+
+
+/*!
+  Constructor. The kernel is "rotate", "flip" or "rotate-flip".
+*/
+RotationCase::RotationCase(bool rotate90degrees, bool flipY, const QSize &size)
+    : m_rotate90degrees(rotate90degrees),
+      m_flipY(flipY),
+      m_source(0),
+      m_target(0)
+{
+    if (rotate90degrees && flipY)
+        m_kernel = "rotate-flip";
+    else if (rotate90degrees)
+        m_kernel = "rotate";
+    else
+        m_kernel = "flip";
+
+    m_implementation = ImageRotator::variantName(ImageRotator::variant());
+    m_sourceSize = size;
+    m_targetSize = rotate90degrees ? QSize(size.height(), size.width()) : size;
+}
+
+
+/*!
+  Destructor.
+*/
+RotationCase::~RotationCase()
+{
+    tearDown();
+}
+
+
+/*!
+  From BenchmarkCase. Allocates the frame and the rotated copy.
+*/
+bool RotationCase::setUp()
+{
+    const int pixels = m_sourceSize.width() * m_sourceSize.height();
+    BufferPool *pool = BufferPool::instance();
+
+    m_source = pool->acquireArray<unsigned int>(pixels);
+    m_target = pool->acquireArray<unsigned int>(pixels);
+    fillNoise(m_source, pixels);
+
+    m_pixels = pixels;
+    m_bytes = (qint64)pixels * 8;
+
+    return true;
+}
+
+
+/*!
+  From BenchmarkCase.
+*/
+void RotationCase::run()
+{
+    ImageRotator::rotate(m_target, m_targetSize.width(),
+                         m_source, m_sourceSize.width(),
+                         m_sourceSize.width(), m_sourceSize.height(),
+                         m_rotate90degrees, m_flipY);
+}
+
+
+/*!
+  From BenchmarkCase. Releases the buffers.
+*/
+void RotationCase::tearDown()
+{
+    BufferPool *pool = BufferPool::instance();
+    pool->release(m_source);
+    pool->release(m_target);
+    m_source = 0;
+    m_target = 0;
+}
@@ -0,0 +1,175 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef KERNELCASES_H
+#define KERNELCASES_H
+
+#include "benchmark.h"
+#include "imagerotator.h"
+#include "mirroreffect.h"
+#include "transformmap.h"
+#include "warpkernels.h"
+#include "yuvconverter.h"
+
+// Forward declarations
+class TransformPreset;
+
+
+/*
+  The benchmark cases of the effect's kernels. The source images are filled
+  with noise, so that the kernels cannot take shortcuts a camera frame
+  would not allow either. The buffers come from BufferPool like in the
+  application.
+*/
+
+
+/*!
+  \class WarpCase
+  \brief MirrorEffect::process() with a transform whose map is already generated.
+
+  This is the per-frame cost of a mirror: processLine() or processLineHQ()
+  over the whole target, or the separable or procedural warp the effect
+  uses instead.
+*/
+class WarpCase : public BenchmarkCase
+{
+public:
+    WarpCase(const TransformPreset &preset,
+             bool highQuality,
+             MirrorEffect::SourceFormat format,
+             MirrorEffect::Engine engine,
+             const QSize &sourceSize,
+             const QSize &targetSize,
+             int threadCount);
+    ~WarpCase();
+
+public: // From BenchmarkCase
+    bool setUp();
+    void run();
+    void tearDown();
+
+private: // Data
+    MirrorEffect::MirrorTransform m_mirrorTransform;
+    float m_power;
+    float m_size;
+    bool m_highQuality;
+    MirrorEffect::SourceFormat m_format;
+    MirrorEffect::Engine m_engine;
+    int m_threadCount;
+    MirrorEffect *m_effect;
+    unsigned int *m_source;
+    unsigned int *m_target;
+};
+
+
+/*!
+  \class LineKernelCase
+  \brief One of the WarpKernels row functions over a whole target, on a single thread.
+
+  Compares the instruction set variants of the linear resampling with each
+  other and with the nearest-pixel sampling. The map is the one of Bubbles,
+  which samples the source in every direction and has shine.
+*/
+class LineKernelCase : public BenchmarkCase
+{
+public:
+        // With highQuality false the variant is ignored
+    LineKernelCase(bool highQuality,
+                   WarpKernels::Variant variant,
+                   const QSize &sourceSize,
+                   const QSize &targetSize);
+    ~LineKernelCase();
+
+public: // From BenchmarkCase
+    bool setUp();
+    void run();
+    void tearDown();
+
+private: // Data
+    bool m_highQuality;
+    WarpKernels::LineFunction m_bilinearLine;
+    TransformMap m_map;
+    unsigned int *m_source;
+    unsigned int *m_target;
+};
+
+
+/*!
+  \class MapGenerationCase
+  \brief TransformGenerator filling a map, the work of TransformBuilder::build().
+
+  This is the cost of changing the transform, its power or its size, or the
+  dimensions of a mirror, when TransformMapCache doesn't have the map.
+*/
+class MapGenerationCase : public BenchmarkCase
+{
+public:
+    MapGenerationCase(const TransformPreset &preset,
+                      const QSize &sourceSize,
+                      const QSize &targetSize,
+                      int threadCount);
+
+public: // From BenchmarkCase
+    bool setUp();
+    void run();
+    void tearDown();
+
+private: // Data
+    MirrorEffect::MirrorTransform m_mirrorTransform;
+    float m_power;
+    float m_size;
+    int m_threadCount;
+    TransformMap m_map;
+};
+
+
+/*!
+  \class ConversionCase
+  \brief A YuvConverter variant converting a whole UYVY frame to RGB32, on a single thread.
+
+  This is the conversion EffectWorker does when the target is larger than
+  the camera frame, the direct UYVY sampling is used otherwise.
+*/
+class ConversionCase : public BenchmarkCase
+{
+public:
+    ConversionCase(YuvConverter::Variant variant, const QSize &size);
+    ~ConversionCase();
+
+public: // From BenchmarkCase
+    bool setUp();
+    void run();
+    void tearDown();
+
+private: // Data
+    YuvConverter::LineFunction m_convertLine;
+    const YuvConverter::Matrix &m_matrix;
+    unsigned char *m_source;
+    unsigned int *m_target;
+};
+
+
+/*!
+  \class RotationCase
+  \brief ImageRotator copying a frame rotated and/or flipped, as MirrorEffect::setSource() does.
+*/
+class RotationCase : public BenchmarkCase
+{
+public:
+    RotationCase(bool rotate90degrees, bool flipY, const QSize &size);
+    ~RotationCase();
+
+public: // From BenchmarkCase
+    bool setUp();
+    void run();
+    void tearDown();
+
+private: // Data
+    bool m_rotate90degrees;
+    bool m_flipY;
+    unsigned int *m_source;
+    unsigned int *m_target;
+};
+
+#endif // KERNELCASES_H
@@ -0,0 +1,389 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QStringList>
+#include <QThread>
+#include <stdio.h>
+
+#include "benchmarkreport.h"
+#include "kernelcases.h"
+#include "transformpreset.h"
+#include "workerpool.h"
+
+
+/*
+  The resolutions swept by default, from the viewfinder of the older
+  devices to full HD.
+*/
+struct Resolution {
+    const char *m_name;
+    int m_width;
+    int m_height;
+};
+
+static const Resolution Resolutions[] = {
+    { "qvga", 320, 240 },
+    { "vga", 640, 480 },
+    { "720p", 1280, 720 },
+    { "1080p", 1920, 1080 }
+};
+
+static const int ResolutionCount = sizeof(Resolutions) / sizeof(Resolutions[0]);
+
+static const char *const Kernels[] = {
+    "warp", "warp-uyvy", "warp-procedural", "line", "mapgen", "convert", "rotate"
+};
+
+static const int KernelCount = sizeof(Kernels) / sizeof(Kernels[0]);
+
+
+/*!
+  Drops the debug messages of the effect, which would be printed for every
+  case. The warnings are printed as usual.
+*/
+static void messageHandler(QtMsgType type, const char *message)
+{
+    if (type != QtDebugMsg)
+        fprintf(stderr, "%s\n", message);
+}
+
+
+/*!
+  Prints the usage.
+*/
+static void printUsage()
+{
+    fprintf(stderr,
+            "Usage: mirrorhouse-bench [options]\n"
+            "\n"
+            "Measures the kernels of the mirror effect over a sweep of resolutions,\n"
+            "transforms and quality modes.\n"
+            "\n"
+            "Sweep:\n"
+            "  --kernels <list>        Comma separated: warp, warp-uyvy, warp-procedural,\n"
+            "                          line, mapgen, convert, rotate (default all)\n"
+            "  --sizes <list>          qvga, vga, 720p, 1080p or <W>x<H> (default all four)\n"
+            "  --all-pairs             Every source size with every target size, instead\n"
+            "                          of targets of the source's size\n"
+            "  --transforms <list>     none, hwave, vwave, bubbles, invbubbles, spiral,\n"
+            "                          ripple, spike, tile, dither (default all)\n"
+            "  --quality <list>        high, low (default both)\n"
+            "  --threads <n>           Threads for warp and mapgen, 0 for all cores\n"
+            "                          (default 1). The other kernels use one thread.\n"
+            "\n"
+            "Measurement:\n"
+            "  --warmup <ms>           Time each case runs before the samples (default 50)\n"
+            "  --min-time <ms>         Shortest time of a sample (default 20)\n"
+            "  --repetitions <n>       Samples per case (default 10)\n"
+            "\n"
+            "Output:\n"
+            "  --json <path>           Write the results as JSON, - for the standard output\n"
+            "  --verbose               Print the debug messages of the effect\n");
+}
+
+
+/*!
+  Parses a resolution name or "<width>x<height>" into \a size.
+*/
+static bool parseSize(const QString &text, QSize &size)
+{
+    for (int i = 0; i < ResolutionCount; i++) {
+        if (text == Resolutions[i].m_name) {
+            size = QSize(Resolutions[i].m_width, Resolutions[i].m_height);
+            return true;
+        }
+    }
+
+    const QStringList parts = text.split('x');
+    bool widthOk(false);
+    bool heightOk(false);
+
+    if (parts.count() == 2) {
+        size = QSize(parts.at(0).toInt(&widthOk), parts.at(1).toInt(&heightOk));
+    }
+
+    return widthOk && heightOk && !size.isEmpty();
+}
+
+
+/*!
+  Returns true if every item of the comma separated \a text is one of \a
+  names.
+*/
+static bool parseList(const QString &text, const char *const *names, int count,
+                      QStringList &list)
+{
+    list = text.split(',');
+
+    for (int i = 0; i < list.count(); i++) {
+        bool found(false);
+
+        for (int j = 0; j < count; j++) {
+            if (list.at(i) == names[j])
+                found = true;
+        }
+
+        if (!found)
+            return false;
+    }
+
+    return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList arguments = app.arguments();
+    arguments.removeFirst();
+
+    QStringList kernels;
+    QList<QSize> sizes;
+    QList<const TransformPreset*> transforms;
+    QList<bool> qualities;
+    QString jsonPath;
+    bool allPairs(false);
+    bool verbose(false);
+    int threadCount(1);
+    Benchmark benchmark;
+
+    for (int i = 0; i < KernelCount; i++)
+        kernels.append(Kernels[i]);
+
+    for (int i = 0; i < ResolutionCount; i++)
+        sizes.append(QSize(Resolutions[i].m_width, Resolutions[i].m_height));
+
+    for (int i = 0; i < TransformPreset::count(); i++)
+        transforms.append(&TransformPreset::at(i));
+
+    qualities << true << false;
+
+    while (!arguments.isEmpty()) {
+        const QString argument = arguments.takeFirst();
+
+        if (argument == "-h" || argument == "--help") {
+            printUsage();
+            return 0;
+        }
+
+        if (argument == "--all-pairs") {
+            allPairs = true;
+            continue;
+        }
+
+        if (argument == "--verbose") {
+            verbose = true;
+            continue;
+        }
+
+        if (arguments.isEmpty()) {
+            fprintf(stderr, "Missing value for %s\n", qPrintable(argument));
+            return 1;
+        }
+
+        const QString value = arguments.takeFirst();
+        bool ok(true);
+
+        if (argument == "--kernels") {
+            ok = parseList(value, Kernels, KernelCount, kernels);
+        }
+        else if (argument == "--sizes") {
+            const QStringList names = value.split(',');
+            sizes.clear();
+
+            for (int i = 0; ok && i < names.count(); i++) {
+                QSize size;
+                ok = parseSize(names.at(i), size);
+                sizes.append(size);
+            }
+        }
+        else if (argument == "--transforms") {
+            const QStringList names = value.split(',');
+            transforms.clear();
+
+            for (int i = 0; ok && i < names.count(); i++) {
+                const TransformPreset *preset = TransformPreset::find(names.at(i));
+                ok = preset != 0;
+                transforms.append(preset);
+            }
+        }
+        else if (argument == "--quality") {
+            const QStringList names = value.split(',');
+            qualities.clear();
+
+            for (int i = 0; ok && i < names.count(); i++) {
+                ok = names.at(i) == "high" || names.at(i) == "low";
+                qualities.append(names.at(i) == "high");
+            }
+        }
+        else if (argument == "--threads") {
+            threadCount = value.toInt(&ok);
+            ok = ok && threadCount >= 0;
+        }
+        else if (argument == "--warmup") {
+            benchmark.setWarmUpTime(value.toInt(&ok));
+        }
+        else if (argument == "--min-time") {
+            benchmark.setMinimumSampleTime(value.toInt(&ok));
+        }
+        else if (argument == "--repetitions") {
+            benchmark.setRepetitions(value.toInt(&ok));
+        }
+        else if (argument == "--json") {
+            jsonPath = value;
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n\n", qPrintable(argument));
+            printUsage();
+            return 1;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "Invalid value for %s: %s\n",
+                    qPrintable(argument), qPrintable(value));
+            return 1;
+        }
+    }
+
+    if (!verbose)
+        qInstallMsgHandler(messageHandler);
+
+    // With more than one thread the effect uses the whole pool, sized to
+    // the thread count
+    WorkerPool *pool = WorkerPool::instance();
+
+    if (threadCount != 1)
+        pool->setThreadCount(threadCount);
+
+    const int effectThreads = threadCount == 1 ? 1 : 0;
+
+    BenchmarkReport report;
+    report.setEnvironment("qtVersion", QString(qVersion()));
+    report.setEnvironment("idealThreadCount", QThread::idealThreadCount());
+    report.setEnvironment("threadCount", threadCount == 1 ? 1 : pool->threadCount());
+    report.setEnvironment("bilinearKernel",
+                          QString(WarpKernels::variantName(WarpKernels::bilinearVariant())));
+    report.setEnvironment("yuvConverter",
+                          QString(YuvConverter::variantName(YuvConverter::variant())));
+    report.setEnvironment("imageRotator",
+                          QString(ImageRotator::variantName(ImageRotator::variant())));
+    report.setEnvironment("warmUpMs", benchmark.warmUpTime());
+    report.setEnvironment("minimumSampleMs", benchmark.minimumSampleTime());
+    report.setEnvironment("repetitions", benchmark.repetitions());
+
+    // The table goes to stderr when the JSON goes to stdout
+    FILE *table = jsonPath == "-" ? stderr : stdout;
+
+    // The source and target sizes of the kernels which resample
+    QList<QPair<QSize, QSize> > pairs;
+
+    for (int i = 0; i < sizes.count(); i++) {
+        for (int j = 0; j < sizes.count(); j++) {
+            if (i == j || allPairs)
+                pairs.append(qMakePair(sizes.at(i), sizes.at(j)));
+        }
+    }
+
+    for (int k = 0; k < kernels.count(); k++) {
+        const QString &kernel = kernels.at(k);
+        QList<BenchmarkCase*> cases;
+
+        if (kernel.startsWith("warp")) {
+            const MirrorEffect::SourceFormat format = kernel == "warp-uyvy"
+                    ? MirrorEffect::SourceUYVY : MirrorEffect::SourceRGB32;
+            const MirrorEffect::Engine engine = kernel == "warp-procedural"
+                    ? MirrorEffect::ProceduralEngine : MirrorEffect::MapEngine;
+
+            for (int p = 0; p < pairs.count(); p++) {
+                for (int t = 0; t < transforms.count(); t++) {
+                    for (int q = 0; q < qualities.count(); q++) {
+                        cases.append(new WarpCase(*transforms.at(t), qualities.at(q),
+                                                  format, engine,
+                                                  pairs.at(p).first, pairs.at(p).second,
+                                                  effectThreads));
+                    }
+                }
+            }
+        }
+        else if (kernel == "line") {
+            for (int p = 0; p < pairs.count(); p++) {
+                for (int q = 0; q < qualities.count(); q++) {
+                    if (!qualities.at(q)) {
+                        cases.append(new LineKernelCase(false, WarpKernels::Scalar,
+                                                        pairs.at(p).first,
+                                                        pairs.at(p).second));
+                        continue;
+                    }
+
+                    for (int v = WarpKernels::Scalar; v <= WarpKernels::NEON; v++) {
+                        if (WarpKernels::bilinearLine((WarpKernels::Variant)v)) {
+                            cases.append(new LineKernelCase(true, (WarpKernels::Variant)v,
+                                                            pairs.at(p).first,
+                                                            pairs.at(p).second));
+                        }
+                    }
+                }
+            }
+        }
+        else if (kernel == "mapgen") {
+            for (int p = 0; p < pairs.count(); p++) {
+                for (int t = 0; t < transforms.count(); t++) {
+                    cases.append(new MapGenerationCase(*transforms.at(t),
+                                                       pairs.at(p).first,
+                                                       pairs.at(p).second,
+                                                       effectThreads));
+                }
+            }
+        }
+        else if (kernel == "convert") {
+            for (int s = 0; s < sizes.count(); s++) {
+                for (int v = YuvConverter::Scalar; v <= YuvConverter::NEON; v++) {
+                    if (YuvConverter::lineFunction((YuvConverter::Variant)v))
+                        cases.append(new ConversionCase((YuvConverter::Variant)v, sizes.at(s)));
+                }
+            }
+        }
+        else if (kernel == "rotate") {
+            for (int s = 0; s < sizes.count(); s++) {
+                cases.append(new RotationCase(true, false, sizes.at(s)));
+                cases.append(new RotationCase(false, true, sizes.at(s)));
+                cases.append(new RotationCase(true, true, sizes.at(s)));
+            }
+        }
+
+        // One case at a time, so that only its buffers are allocated
+        for (int i = 0; i < cases.count(); i++) {
+            const BenchmarkResult result = benchmark.measure(cases.at(i));
+            report.add(result);
+            report.printRow(table, result);
+        }
+
+        qDeleteAll(cases);
+    }
+
+    if (jsonPath.isEmpty())
+        return 0;
+
+    QFile file;
+    bool opened(false);
+
+    if (jsonPath == "-") {
+        opened = file.open(stdout, QIODevice::WriteOnly);
+    }
+    else {
+        file.setFileName(jsonPath);
+        opened = file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    }
+
+    if (!opened || file.write(report.toJson()) < 0) {
+        fprintf(stderr, "Cannot write %s: %s\n",
+                qPrintable(jsonPath), qPrintable(file.errorString()));
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,310 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "bufferpool.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <stdlib.h>
+
+#if defined(Q_OS_LINUX)
+    #include <sys/mman.h>
+#endif
+
+// The memory kept in the released buffers by default. Enough for the
+// buffers of a camera switch: a converted and a rotated frame, three
+// targets and a map or two.
+static const int DefaultMaxBytes = 16 * 1024 * 1024;
+
+
+/*!
+  \class BufferPool
+  \brief Process-wide pool of large, aligned pixel and map buffers.
+*/
+
+
+/*!
+  Constructor.
+*/
+BufferPool::BufferPool()
+    : m_maxBytes(DefaultMaxBytes),
+      m_freeBytes(0),
+      m_usedBytes(0),
+      m_systemAllocationCount(0),
+      m_hugePagesEnabled(false)
+{
+}
+
+
+/*!
+  Destructor. Frees the released buffers. The buffers still in use are
+  left alone, their owners may be destroyed later.
+*/
+BufferPool::~BufferPool()
+{
+    trim(0);
+
+    if (!m_used.isEmpty()) {
+        qDebug() << "BufferPool::~BufferPool():" << m_used.count()
+                 << "buffers still in use";
+    }
+}
+
+
+/*!
+  Returns the pool shared by the whole process.
+*/
+BufferPool *BufferPool::instance()
+{
+    static BufferPool pool;
+    return &pool;
+}
+
+
+/*!
+  Returns a buffer of at least \a bytes bytes, aligned to CacheLineSize or,
+  if it is a page or more, to PageSize. A released buffer of the same size
+  class is reused if there is one, the most recently released first since
+  it is the most likely to still be in the caches.
+*/
+void *BufferPool::acquire(int bytes)
+{
+    if (bytes < 1)
+        return 0;
+
+    const int size = classBytes(bytes);
+
+    QMutexLocker locker(&m_mutex);
+
+    for (int i = m_free.count() - 1; i >= 0; i--) {
+        if (m_free.at(i).m_bytes == size) {
+            const Block block = m_free.takeAt(i);
+            m_freeBytes -= block.m_bytes;
+            m_usedBytes += block.m_bytes;
+            m_used.append(block);
+            return block.m_data;
+        }
+    }
+
+    Block block;
+    block.m_bytes = size;
+
+    if (!allocate(block))
+        return 0;
+
+    m_systemAllocationCount++;
+    m_usedBytes += block.m_bytes;
+    m_used.append(block);
+    return block.m_data;
+}
+
+
+/*!
+  Returns \a buffer, acquired from this pool, to the pool. Frees the least
+  recently released buffers if the pool exceeds its limit.
+*/
+void BufferPool::release(void *buffer)
+{
+    if (!buffer)
+        return;
+
+    QMutexLocker locker(&m_mutex);
+
+    for (int i = m_used.count() - 1; i >= 0; i--) {
+        if (m_used.at(i).m_data == buffer) {
+            const Block block = m_used.takeAt(i);
+            m_usedBytes -= block.m_bytes;
+            m_freeBytes += block.m_bytes;
+            m_free.append(block);
+            break;
+        }
+    }
+
+    while (m_freeBytes > m_maxBytes && !m_free.isEmpty()) {
+        const Block block = m_free.takeFirst();
+        m_freeBytes -= block.m_bytes;
+        deallocate(block);
+    }
+}
+
+
+/*!
+  Frees released buffers, least recently released first, until at most
+  \a maxBytes remain in the pool.
+*/
+void BufferPool::trim(int maxBytes /* = 0 */)
+{
+    QMutexLocker locker(&m_mutex);
+
+    while (m_freeBytes > maxBytes && !m_free.isEmpty()) {
+        const Block block = m_free.takeFirst();
+        m_freeBytes -= block.m_bytes;
+        deallocate(block);
+    }
+}
+
+
+/*!
+  Sets the limit for the memory held by the released buffers. Trims the
+  pool if it holds more.
+*/
+void BufferPool::setMaxBytes(int maxBytes)
+{
+    m_mutex.lock();
+    m_maxBytes = maxBytes;
+    m_mutex.unlock();
+
+    trim(maxBytes);
+}
+
+
+/*!
+  Returns the limit for the memory held by the released buffers.
+*/
+int BufferPool::maxBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maxBytes;
+}
+
+
+/*!
+  Enables or disables backing the buffers of HugePageSize or more with
+  transparent huge pages. Only has an effect on Linux.
+*/
+void BufferPool::setHugePagesEnabled(bool enabled)
+{
+    QMutexLocker locker(&m_mutex);
+    m_hugePagesEnabled = enabled;
+}
+
+
+/*!
+  Returns true if the large buffers are backed by huge pages.
+*/
+bool BufferPool::hugePagesEnabled() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_hugePagesEnabled;
+}
+
+
+/*!
+  Returns the memory held by the released buffers.
+*/
+int BufferPool::freeBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_freeBytes;
+}
+
+
+/*!
+  Returns the memory in the buffers currently in use.
+*/
+int BufferPool::usedBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_usedBytes;
+}
+
+
+/*!
+  Returns the number of buffers taken from the system allocator.
+*/
+int BufferPool::systemAllocationCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_systemAllocationCount;
+}
+
+
+/*!
+  Rounds \a bytes up to the next size class. Small buffers are rounded to
+  whole cache lines, larger ones to a quarter of the largest power of two
+  below them.
+*/
+int BufferPool::classBytes(int bytes)
+{
+    if (bytes <= 4 * CacheLineSize)
+        return (bytes + CacheLineSize - 1) & ~(CacheLineSize - 1);
+
+    int power = 1;
+
+    while (power <= (bytes - 1) / 2)
+        power <<= 1;
+
+    const int step = power / 4;
+    return (bytes + step - 1) / step * step;
+}
+
+
+/*!
+  Allocates the memory for \a block from the system. Returns the aligned
+  start of the buffer, or 0 on failure.
+*/
+void *BufferPool::allocate(Block &block)
+{
+    const int alignment = block.m_bytes >= PageSize ? PageSize : CacheLineSize;
+
+#if defined(Q_OS_LINUX) && defined(MADV_HUGEPAGE)
+    if (m_hugePagesEnabled && block.m_bytes >= HugePageSize) {
+            // Map a huge page more than needed and unmap the ends, so the
+            // buffer starts at a huge page boundary
+        const size_t length = (block.m_bytes + HugePageSize - 1) & ~(HugePageSize - 1);
+        const size_t mappedLength = length + HugePageSize;
+        void *mapped = mmap(0, mappedLength, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (mapped != MAP_FAILED) {
+            char *start = (char*)(((size_t)mapped + HugePageSize - 1)
+                                  & ~(size_t)(HugePageSize - 1));
+            const size_t head = start - (char*)mapped;
+
+            if (head)
+                munmap(mapped, head);
+
+            if (mappedLength - head > length)
+                munmap(start + length, mappedLength - head - length);
+
+            madvise(start, length, MADV_HUGEPAGE);
+
+            block.m_base = start;
+            block.m_data = start;
+            block.m_mappedBytes = length;
+            return block.m_data;
+        }
+
+        qDebug() << "BufferPool::allocate(): Huge page mapping failed";
+    }
+#endif
+
+    block.m_base = malloc(block.m_bytes + alignment - 1);
+
+    if (!block.m_base) {
+        qDebug() << "BufferPool::allocate(): Out of memory," << block.m_bytes << "bytes";
+        return 0;
+    }
+
+    block.m_data = (void*)(((size_t)block.m_base + alignment - 1)
+                           & ~(size_t)(alignment - 1));
+    block.m_mappedBytes = 0;
+    return block.m_data;
+}
+
+
+/*!
+  Returns the memory of \a block to the system.
+*/
+void BufferPool::deallocate(const Block &block)
+{
+#if defined(Q_OS_LINUX) && defined(MADV_HUGEPAGE)
+    if (block.m_mappedBytes) {
+        munmap(block.m_base, block.m_mappedBytes);
+        return;
+    }
+#endif
+
+    free(block.m_base);
+}
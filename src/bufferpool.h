@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <QList>
+#include <QMutex>
+
+
+/*!
+  \class BufferPool
+  \brief Process-wide pool of large, aligned pixel and map buffers.
+
+  The frame conversions, the rotated sources, the target images and the
+  transform maps need buffers of a few well known sizes, which change only
+  when the camera or the mirror size changes. Instead of handing the
+  buffers back to the system allocator, they are returned to the pool and
+  reused by the next request of the same size class. The size classes are
+  a quarter of a power of two apart, so a buffer is at most 25 % larger
+  than asked.
+
+  The buffers are aligned to a cache line, and the ones of a page or more
+  to a page, so the vector kernels can use aligned loads on them. On Linux
+  the largest buffers can optionally be backed by transparent huge pages.
+
+  Released buffers are kept until their total size exceeds the limit,
+  after which the least recently released ones are freed first. trim()
+  frees them at once, e.g. when the system runs low on memory.
+*/
+class BufferPool
+{
+public:
+    enum {
+        CacheLineSize = 64,
+        PageSize = 4096,
+        HugePageSize = 2 * 1024 * 1024
+    };
+
+public:
+    BufferPool();
+    ~BufferPool();
+
+    static BufferPool *instance();
+
+public:
+        // Returns a buffer of at least bytes bytes. The contents are
+        // undefined. Returns 0 if bytes < 1 or the memory runs out.
+    void *acquire(int bytes);
+
+        // Returns an array of count items of T, see acquire()
+    template <class T>
+    T *acquireArray(int count) { return static_cast<T*>(acquire(count * sizeof(T))); }
+
+        // Returns buffer to the pool. Does nothing if buffer is 0.
+    void release(void *buffer);
+
+        // Frees released buffers, least recently released first, until at
+        // most maxBytes remain in the pool.
+    void trim(int maxBytes = 0);
+
+        // The limit for the memory held by the released buffers
+    void setMaxBytes(int maxBytes);
+    int maxBytes() const;
+
+        // Backs the buffers of HugePageSize or more with transparent huge
+        // pages where the system supports them. Applies to new buffers.
+    void setHugePagesEnabled(bool enabled);
+    bool hugePagesEnabled() const;
+
+        // The memory in the released buffers and in the ones in use
+    int freeBytes() const;
+    int usedBytes() const;
+
+        // The number of buffers taken from the system allocator so far
+    int systemAllocationCount() const;
+
+private:
+        // A buffer and how it was allocated
+    class Block
+    {
+    public:
+        Block() : m_data(0), m_base(0), m_bytes(0), m_mappedBytes(0) {}
+
+        void *m_data;       // Aligned start of the buffer
+        void *m_base;       // What the system allocator returned
+        int m_bytes;        // The size class of the buffer
+        int m_mappedBytes;  // The size of the mapping, 0 if allocated from the heap
+    };
+
+        // Rounds bytes up to its size class
+    static int classBytes(int bytes);
+
+    void *allocate(Block &block);
+    void deallocate(const Block &block);
+
+private: // Data
+    mutable QMutex m_mutex;
+    QList<Block> m_used;
+    QList<Block> m_free;        // Most recently released last
+    int m_maxBytes;
+    int m_freeBytes;
+    int m_usedBytes;
+    int m_systemAllocationCount;
+    bool m_hugePagesEnabled;
+};
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,484 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "capturehub.h"
+
+#include <QAbstractVideoSurface>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVideoRendererControl>
+#include <QVideoSurfaceFormat>
+
+// How long a camera keeps running without subscribers, in milliseconds.
+// MirrorItem starts the camera of a mirror three seconds after it is asked.
+static const int StopDelay = 4000;
+
+// How long the frame sizes are negotiated after the last change of the
+// requirements, in milliseconds. Zooming a mirror takes a second.
+static const int NegotiateDelay = 500;
+
+// The common viewfinder sizes, from the smallest
+static const int FrameSizes[][2] = {
+    { 160, 120 }, { 176, 144 }, { 320, 180 }, { 320, 240 }, { 352, 288 },
+    { 640, 360 }, { 640, 480 }, { 800, 448 }, { 800, 480 }, { 848, 480 },
+    { 1280, 720 }, { 1920, 1080 }
+};
+
+// How much the aspect ratio of a viewfinder size may differ from the
+// camera's
+static const float AspectTolerance = 0.05f;
+
+
+/*
+  The camera of a device and the sinks its frames go to.
+*/
+class CaptureHub::Session
+{
+public:
+    Session() : m_camera(0), m_surface(0), m_requiredSize(0, 0), m_prefersRgb32(false) {}
+
+        // Passes frame to every sink. Called on the camera's thread.
+    void deliver(const SourceFramePointer &frame)
+    {
+        QMutexLocker locker(&m_mutex);
+
+        foreach (CaptureSink *sink, m_sinks)
+            sink->presentFrame(frame);
+    }
+
+        // Updates the required size and format from the sinks. Returns
+        // true if either changed. Called on the GUI thread.
+    bool updateRequirements()
+    {
+        QMutexLocker locker(&m_mutex);
+        QSize size(0, 0);
+        bool rgb32 = false;
+
+        foreach (CaptureSink *sink, m_sinks)
+            rgb32 = rgb32 || sink->prefersRgb32();
+
+        foreach (CaptureSink *sink, m_sinks) {
+            const QSize required = sink->requiredFrameSize();
+
+            if (required.isEmpty()) {
+                size = QSize(0, 0);
+                break;
+            }
+
+            size = size.expandedTo(required);
+        }
+
+        if (size == m_requiredSize && rgb32 == m_prefersRgb32)
+            return false;
+
+        m_requiredSize = size;
+        m_prefersRgb32 = rgb32;
+        return true;
+    }
+
+        // The largest frame the sinks require, empty if any will do
+    QSize requiredSize() const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_requiredSize;
+    }
+
+        // True if any of the sinks prefers RGB32 frames
+    bool prefersRgb32() const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_prefersRgb32;
+    }
+
+public: // Data
+    QCamera *m_camera;      // Owned
+    Surface *m_surface;     // Owned
+    mutable QMutex m_mutex; // Guards m_sinks, m_requiredSize and m_prefersRgb32
+    QList<CaptureSink*> m_sinks;
+    QSize m_requiredSize;
+    bool m_prefersRgb32;
+};
+
+
+/*
+  The video surface of a session. Maps every frame once and hands it to
+  the session, and negotiates the frame size the session requires.
+*/
+class CaptureHub::Surface : public QAbstractVideoSurface
+{
+public:
+    explicit Surface(Session *session) : m_session(session), m_nativeSize(0, 0) {}
+
+        // The frame size nearestFormat() picks for pixelFormat
+    QSize negotiatedSize(QVideoFrame::PixelFormat pixelFormat) const
+    {
+        QSize required = m_session->requiredSize();
+
+            // The rotated frames are shown sideways
+        if (isRotated(pixelFormat))
+            required.transpose();
+
+        return CaptureHub::frameSizeFor(nativeSize(), required);
+    }
+
+    static bool isRotated(QVideoFrame::PixelFormat pixelFormat)
+    {
+        return pixelFormat == QVideoFrame::Format_UYVY;
+    }
+
+        // The format the session would rather have the frames in
+    QVideoFrame::PixelFormat preferredPixelFormat() const
+    {
+        return supportedPixelFormats().first();
+    }
+
+public: // From QAbstractVideoSurface
+    QList<QVideoFrame::PixelFormat> supportedPixelFormats(
+            QAbstractVideoBuffer::HandleType handleType =
+                QAbstractVideoBuffer::NoHandle) const
+    {
+        // UYVY first: it has half the bytes of RGB32, and the effect
+        // samples it without converting the whole frame. The effects of
+        // SeparableWarp, which takes RGB32 only, would rather have RGB32.
+        if (handleType == QAbstractVideoBuffer::NoHandle) {
+            if (m_session->prefersRgb32()) {
+                return QList<QVideoFrame::PixelFormat>()
+                        << QVideoFrame::Format_RGB32
+                        << QVideoFrame::Format_UYVY;
+            }
+
+            return QList<QVideoFrame::PixelFormat>()
+                    << QVideoFrame::Format_UYVY
+                    << QVideoFrame::Format_RGB32;
+        }
+
+        return QList<QVideoFrame::PixelFormat>();
+    }
+
+    QVideoSurfaceFormat nearestFormat(const QVideoSurfaceFormat &format) const
+    {
+        QVideoSurfaceFormat nearest(format);
+
+        if (supportedPixelFormats(format.handleType()).contains(format.pixelFormat())) {
+            updateNativeSize(format.frameSize());
+            nearest.setFrameSize(negotiatedSize(format.pixelFormat()));
+        }
+
+        return nearest;
+    }
+
+    bool isFormatSupported(const QVideoSurfaceFormat &format,
+                           QVideoSurfaceFormat *similar) const
+    {
+        Q_UNUSED(similar);
+
+        return (supportedPixelFormats(format.handleType()).contains(format.pixelFormat())
+                && !format.frameSize().isEmpty());
+    }
+
+    bool start(const QVideoSurfaceFormat &format)
+    {
+        if (!isFormatSupported(format, 0))
+            return false;
+
+        updateNativeSize(format.frameSize());
+
+        return QAbstractVideoSurface::start(format);
+    }
+
+    bool present(const QVideoFrame &frame)
+    {
+        if (surfaceFormat().pixelFormat() != frame.pixelFormat()
+                || surfaceFormat().frameSize() != frame.size())
+        {
+            stop();
+            return false;
+        }
+
+        // The UYVY frames come from the Harmattan's cameras, which are
+        // mounted sideways. The frontcamera (the smaller frames) must also
+        // be flipped in order to be correctly rotated. The frames may have
+        // been negotiated smaller, so the camera is recognized from the
+        // largest size it has proposed.
+        const bool rotate = isRotated(frame.pixelFormat());
+        const bool flipY = rotate && nativeSize().width() < 600;
+
+        SourceFramePointer sourceFrame(new SourceFrame(frame, rotate, flipY));
+
+        if (sourceFrame->isMapped())
+            m_session->deliver(sourceFrame);
+
+        return true;
+    }
+
+private:
+        // The camera proposes its own size first, and may propose the
+        // negotiated one after a restart, so the largest is kept
+    void updateNativeSize(const QSize &size) const
+    {
+        QMutexLocker locker(&m_mutex);
+
+        if (size.width() * size.height() > m_nativeSize.width() * m_nativeSize.height())
+            m_nativeSize = size;
+    }
+
+    QSize nativeSize() const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_nativeSize;
+    }
+
+private: // Data
+    Session *m_session;
+    mutable QMutex m_mutex;         // Guards m_nativeSize
+    mutable QSize m_nativeSize;     // The largest frame the camera has proposed
+};
+
+
+/*!
+  \class CaptureHub
+  \brief Runs one camera per device and fans its frames out to the mirrors.
+*/
+
+
+/*!
+  Constructor.
+*/
+CaptureHub::CaptureHub(QObject *parent)
+    : QObject(parent)
+{
+    m_devices = QCamera::availableDevices();
+
+    m_stopTimer.setSingleShot(true);
+    m_stopTimer.setInterval(StopDelay);
+    connect(&m_stopTimer, SIGNAL(timeout()), this, SLOT(stopUnusedSessions()));
+
+    m_negotiateTimer.setSingleShot(true);
+    m_negotiateTimer.setInterval(NegotiateDelay);
+    connect(&m_negotiateTimer, SIGNAL(timeout()), this, SLOT(negotiateFrameSizes()));
+}
+
+
+/*!
+  Destructor. Stops all the cameras.
+*/
+CaptureHub::~CaptureHub()
+{
+    foreach (Session *session, m_sessions) {
+        session->m_sinks.clear();
+    }
+
+    stopUnusedSessions();
+}
+
+
+/*!
+  Returns the hub shared by the whole application. It is deleted with the
+  application object.
+*/
+CaptureHub *CaptureHub::instance()
+{
+    static CaptureHub *hub = new CaptureHub(QCoreApplication::instance());
+    return hub;
+}
+
+
+/*!
+  Returns the camera devices available.
+*/
+QList<QByteArray> CaptureHub::devices() const
+{
+    return m_devices;
+}
+
+
+/*!
+  Starts passing the frames of \a device to \a sink, starting the camera if
+  it isn't running yet. A new camera is started with the frame size
+  \a sink requires, a running one negotiates it a moment later.
+*/
+void CaptureHub::subscribe(const QByteArray &device, CaptureSink *sink)
+{
+    unsubscribe(sink);
+
+    Session *session = m_sessions.value(device);
+
+    if (!session) {
+        qDebug() << "CaptureHub::subscribe(): Starting camera" << device;
+
+        session = new Session;
+        session->m_camera = new QCamera(device);
+        connect(session->m_camera, SIGNAL(error(QCamera::Error)),
+                this, SLOT(handleCameraError(QCamera::Error)));
+
+        // Own video output for the frames
+        QMediaService *mediaService = session->m_camera->service();
+        QVideoRendererControl *rendererControl =
+                mediaService->requestControl<QVideoRendererControl*>();
+        session->m_surface = new Surface(session);
+        rendererControl->setSurface(session->m_surface);
+
+        m_sessions.insert(device, session);
+
+        session->m_sinks.append(sink);
+        session->updateRequirements();
+        session->m_camera->start();
+        return;
+    }
+
+    session->m_mutex.lock();
+    session->m_sinks.append(sink);
+    session->m_mutex.unlock();
+
+    updateFrameSizes();
+}
+
+
+/*!
+  Stops passing frames to \a sink. The camera is stopped a moment later if
+  no one else subscribes to it.
+*/
+void CaptureHub::unsubscribe(CaptureSink *sink)
+{
+    foreach (Session *session, m_sessions) {
+        QMutexLocker locker(&session->m_mutex);
+
+        if (session->m_sinks.removeOne(sink)) {
+            if (session->m_sinks.isEmpty())
+                m_stopTimer.start();
+            else
+                m_negotiateTimer.start();
+        }
+    }
+}
+
+
+/*!
+  Returns the number of sinks subscribed to \a device.
+*/
+int CaptureHub::subscriberCount(const QByteArray &device) const
+{
+    Session *session = m_sessions.value(device);
+
+    if (!session)
+        return 0;
+
+    QMutexLocker locker(&session->m_mutex);
+    return session->m_sinks.count();
+}
+
+
+/*!
+  Negotiates the frame sizes of the cameras again after NegotiateDelay.
+  Restarts the timer, so a mirror being resized negotiates only once it
+  stops.
+*/
+void CaptureHub::updateFrameSizes()
+{
+    m_negotiateTimer.start();
+}
+
+
+/*!
+  Returns the smallest of FrameSizes with the aspect ratio of \a proposed,
+  at most as large, which covers \a required in both dimensions, or
+  \a proposed if none does or \a required is empty.
+*/
+QSize CaptureHub::frameSizeFor(const QSize &proposed, const QSize &required)
+{
+    if (required.isEmpty() || proposed.isEmpty())
+        return proposed;
+
+    const float aspect = (float)proposed.width() / proposed.height();
+    const int count = sizeof(FrameSizes) / sizeof(FrameSizes[0]);
+
+    for (int i = 0; i < count; i++) {
+        const QSize size(FrameSizes[i][0], FrameSizes[i][1]);
+
+        if (size.width() > proposed.width() || size.height() > proposed.height())
+            break;
+
+        if (qAbs((float)size.width() / size.height() - aspect) > aspect * AspectTolerance)
+            continue;
+
+        if (size.width() >= required.width() && size.height() >= required.height())
+            return size;
+    }
+
+    return proposed;
+}
+
+
+/*!
+  Camera send error
+*/
+void CaptureHub::handleCameraError(QCamera::Error error)
+{
+    QCamera *camera = qobject_cast<QCamera*>(sender());
+
+    qDebug() << "CaptureHub::handleCameraError(): QCamera::Error:"
+             << error << ";"
+             << (camera ? camera->errorString() : QString());
+}
+
+
+/*!
+  Updates the frame sizes and the formats the sessions require, and
+  restarts the cameras whose frames would change size or aren't in the
+  preferred format, so that they negotiate again. Only a change of the
+  requirements restarts a camera, so a camera which doesn't follow the
+  negotiation isn't restarted over and over.
+*/
+void CaptureHub::negotiateFrameSizes()
+{
+    foreach (Session *session, m_sessions) {
+        if (!session->updateRequirements() || !session->m_surface->isActive())
+            continue;
+
+        const QVideoSurfaceFormat format = session->m_surface->surfaceFormat();
+
+        if (session->m_surface->negotiatedSize(format.pixelFormat()) == format.frameSize()
+                && session->m_surface->preferredPixelFormat() == format.pixelFormat())
+        {
+            continue;
+        }
+
+        qDebug() << "CaptureHub::negotiateFrameSizes(): Restarting camera for"
+                 << session->requiredSize();
+
+        session->m_surface->stop();
+        session->m_camera->stop();
+        session->m_camera->start();
+    }
+}
+
+
+/*!
+  Stops the cameras nobody subscribes to anymore.
+*/
+void CaptureHub::stopUnusedSessions()
+{
+    QHash<QByteArray, Session*>::iterator i = m_sessions.begin();
+
+    while (i != m_sessions.end()) {
+        Session *session = i.value();
+
+        if (subscriberCount(i.key()) > 0) {
+            ++i;
+            continue;
+        }
+
+        qDebug() << "CaptureHub::stopUnusedSessions(): Stopping camera" << i.key();
+
+        session->m_surface->stop();
+        session->m_camera->stop();
+        delete session->m_camera;
+        delete session->m_surface;
+        delete session;
+
+        i = m_sessions.erase(i);
+    }
+}
@@ -0,0 +1,121 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef CAPTUREHUB_H
+#define CAPTUREHUB_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QSize>
+#include <QTimer>
+
+// Unlike the other APIs in Qt Mobility, the Qt Mobility Multimedia API is not
+// in the Qt Mobility namespace.
+#include <QCamera>
+
+#include "sourceframe.h"
+
+
+/*!
+  \class CaptureSink
+  \brief Receives the frames of a camera from CaptureHub.
+*/
+class CaptureSink
+{
+public:
+    virtual ~CaptureSink() {}
+
+        // Called on the camera's thread for every frame. The frame is
+        // shared by all the sinks of the camera and must not be modified.
+    virtual void presentFrame(const SourceFramePointer &frame) = 0;
+
+        // The smallest frame size which still gives the sink its full
+        // quality, empty if any size will do. Called on the GUI thread.
+    virtual QSize requiredFrameSize() const { return QSize(); }
+
+        // True if the sink processes RGB32 frames faster than UYVY ones.
+        // Called on the GUI thread.
+    virtual bool prefersRgb32() const { return false; }
+};
+
+
+/*!
+  \class CaptureHub
+  \brief Runs one camera per device and fans its frames out to the mirrors.
+
+  Every mirror showing a camera subscribes to the hub with the device it
+  wants. The first subscriber of a device starts a camera session, which
+  maps each frame once into a SourceFrame and passes the same frame to
+  all the subscribers. Anything done to the whole frame, like the YUV
+  conversion or the rotation of SourceFrame::rgbImage(), is therefore done
+  once per frame rather than once per mirror.
+
+  The camera is stopped a moment after its last subscriber leaves, so
+  moving the camera from one mirror to another doesn't restart it.
+
+  The viewfinder frames are negotiated as small as the subscribers allow:
+  the smallest common viewfinder size of the camera's aspect ratio which
+  covers the largest CaptureSink::requiredFrameSize(), or the size the
+  camera proposes if none does. A smaller frame is cheaper to capture, map
+  and convert in proportion to its pixels. UYVY, which the effect samples
+  directly, is preferred over RGB32, unless a subscriber prefers RGB32
+  (see CaptureSink::prefersRgb32()). When the requirements change, the
+  camera is restarted to negotiate again if its frame size or the
+  preferred format would change.
+*/
+class CaptureHub : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CaptureHub(QObject *parent = 0);
+    ~CaptureHub();
+
+        // The hub shared by the whole application
+    static CaptureHub *instance();
+
+public:
+        // The camera devices available
+    QList<QByteArray> devices() const;
+
+        // Starts passing the frames of device to sink. A sink receives the
+        // frames of one device at a time; subscribing again moves it.
+    void subscribe(const QByteArray &device, CaptureSink *sink);
+
+        // Stops passing frames to sink. No frame is passed to it after this
+        // returns.
+    void unsubscribe(CaptureSink *sink);
+
+        // The number of sinks receiving the frames of device
+    int subscriberCount(const QByteArray &device) const;
+
+        // Negotiates the frame sizes again a moment later, so that a
+        // mirror being resized doesn't restart its camera repeatedly. Call
+        // when the requiredFrameSize() of a sink changes.
+    void updateFrameSizes();
+
+        // The smallest viewfinder size with the aspect ratio of proposed,
+        // and not larger, which covers required. proposed if none does or
+        // required is empty.
+    static QSize frameSizeFor(const QSize &proposed, const QSize &required);
+
+private slots:
+    void handleCameraError(QCamera::Error error);
+    void stopUnusedSessions();
+    void negotiateFrameSizes();
+
+private:
+    class Session;
+    class Surface;
+
+private: // Data
+    QHash<QByteArray, Session*> m_sessions;
+    QList<QByteArray> m_devices;
+    QTimer m_stopTimer;         // Stops the unused sessions when it fires
+    QTimer m_negotiateTimer;    // Negotiates the frame sizes when it fires
+};
+
+#endif // CAPTUREHUB_H
@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "cpufeatures.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <cpuid.h>
+#define MH_CPUID_GCC
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define MH_CPUID_MSVC
+#endif
+
+#if defined(__ARM_NEON__) && defined(__linux__) && !defined(__aarch64__)
+#include <stdio.h>
+#endif
+
+
+/*!
+  \class CpuFeatures
+  \brief Run-time detection of the vector instruction sets the effect kernels can use.
+*/
+
+
+/*!
+  Returns the supported features as a bitmask of CpuFeatures::Feature values.
+*/
+unsigned int CpuFeatures::supported()
+{
+    // The detection is cheap and idempotent, so concurrent first calls are
+    // harmless.
+    static unsigned int features = detect();
+    return features;
+}
+
+
+/*!
+  Returns true if \a feature is supported.
+*/
+bool CpuFeatures::has(Feature feature)
+{
+    return (supported() & feature) != 0;
+}
+
+
+/*!
+  Queries the processor (and on x86, the OS for the AVX register state).
+*/
+unsigned int CpuFeatures::detect()
+{
+    unsigned int features = 0;
+
+#if defined(MH_CPUID_GCC) || defined(MH_CPUID_MSVC)
+    unsigned int regs[4] = { 0, 0, 0, 0 };
+    unsigned int maxLeaf = 0;
+
+#ifdef MH_CPUID_GCC
+    maxLeaf = __get_cpuid_max(0, 0);
+
+    if (maxLeaf >= 1)
+        __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#else
+    int info[4];
+    __cpuid(info, 0);
+    maxLeaf = info[0];
+
+    if (maxLeaf >= 1) {
+        __cpuid(info, 1);
+
+        for (int i = 0; i < 4; i++)
+            regs[i] = info[i];
+    }
+#endif
+
+    if (regs[3] & (1 << 26))
+        features |= SSE2;
+
+    if (regs[2] & (1 << 9))
+        features |= SSSE3;
+
+    // AVX2 needs both the CPU support (leaf 7) and the OS saving the YMM
+    // registers (OSXSAVE + XCR0 bits 1 and 2).
+    const bool osxsave = (regs[2] & (1 << 27)) != 0;
+    const bool avx = (regs[2] & (1 << 28)) != 0;
+
+    if (maxLeaf >= 7 && osxsave && avx) {
+        unsigned int xcr0 = 0;
+
+#ifdef MH_CPUID_GCC
+        unsigned int edx = 0;
+        __asm__ volatile("xgetbv" : "=a"(xcr0), "=d"(edx) : "c"(0));
+        __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#else
+        xcr0 = (unsigned int)_xgetbv(0);
+        int info[4];
+        __cpuidex(info, 7, 0);
+        regs[1] = info[1];
+#endif
+
+        if ((xcr0 & 0x6) == 0x6 && (regs[1] & (1 << 5)))
+            features |= AVX2;
+    }
+#endif
+
+#if defined(__aarch64__)
+    // NEON is mandatory on ARMv8
+    features |= NEON;
+#elif defined(__ARM_NEON__)
+#if defined(__linux__)
+    // The binary was built with NEON enabled, but make sure the kernel
+    // reports it as well (HWCAP_NEON is bit 12).
+    FILE *auxv = fopen("/proc/self/auxv", "rb");
+
+    if (auxv) {
+        unsigned long entry[2];
+
+        while (fread(entry, sizeof(entry), 1, auxv) == 1 && entry[0] != 0) {
+            if (entry[0] == 16 /* AT_HWCAP */) {
+                if (entry[1] & (1 << 12))
+                    features |= NEON;
+
+                break;
+            }
+        }
+
+        fclose(auxv);
+    }
+    else {
+        features |= NEON;
+    }
+#else
+    features |= NEON;
+#endif
+#endif
+
+    return features;
+}
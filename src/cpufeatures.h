@@ -0,0 +1,35 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef CPUFEATURES_H
+#define CPUFEATURES_H
+
+
+/*!
+  \class CpuFeatures
+  \brief Run-time detection of the vector instruction sets the effect kernels can use.
+*/
+class CpuFeatures
+{
+public: // Data types
+    enum Feature {
+        SSE2 = 0x01,
+        SSSE3 = 0x02,
+        AVX2 = 0x04,
+        NEON = 0x08
+    };
+
+public:
+        // Returns a bitmask of the Feature values supported by this CPU. The
+        // detection is done only once.
+    static unsigned int supported();
+
+        // Convenience for testing a single feature
+    static bool has(Feature feature);
+
+private:
+    static unsigned int detect();
+};
+
+#endif // CPUFEATURES_H
@@ -0,0 +1,55 @@
+# Copyright (c) 2011-2014 Microsoft Mobile.
+#
+# The mirror effect and the kernels it uses. Shared by the application and
+# the command line tools, none of it depends on the GUI or the camera.
+
+INCLUDEPATH += $$PWD
+
+HEADERS += \
+    $$PWD/animatedtransform.h \
+    $$PWD/bufferpool.h \
+    $$PWD/cpufeatures.h \
+    $$PWD/fastmath.h \
+    $$PWD/imagerotator.h \
+    $$PWD/miplevelselector.h \
+    $$PWD/mirroreffect.h \
+    $$PWD/proceduralwarp.h \
+    $$PWD/separablewarp.h \
+    $$PWD/sourcechangedetector.h \
+    $$PWD/sourcepyramid.h \
+    $$PWD/stagetimer.h \
+    $$PWD/tiletracker.h \
+    $$PWD/transformbuilder.h \
+    $$PWD/transformcomposer.h \
+    $$PWD/transformfunctors.h \
+    $$PWD/transformgenerator.h \
+    $$PWD/transformmap.h \
+    $$PWD/transformmapcache.h \
+    $$PWD/transformmapstore.h \
+    $$PWD/transformpreset.h \
+    $$PWD/warpkernels.h \
+    $$PWD/workerpool.h \
+    $$PWD/yuvconverter.h
+
+SOURCES += \
+    $$PWD/animatedtransform.cpp \
+    $$PWD/bufferpool.cpp \
+    $$PWD/cpufeatures.cpp \
+    $$PWD/imagerotator.cpp \
+    $$PWD/miplevelselector.cpp \
+    $$PWD/mirroreffect.cpp \
+    $$PWD/proceduralwarp.cpp \
+    $$PWD/separablewarp.cpp \
+    $$PWD/sourcechangedetector.cpp \
+    $$PWD/sourcepyramid.cpp \
+    $$PWD/tiletracker.cpp \
+    $$PWD/transformbuilder.cpp \
+    $$PWD/transformcomposer.cpp \
+    $$PWD/transformgenerator.cpp \
+    $$PWD/transformmap.cpp \
+    $$PWD/transformmapcache.cpp \
+    $$PWD/transformmapstore.cpp \
+    $$PWD/transformpreset.cpp \
+    $$PWD/warpkernels.cpp \
+    $$PWD/workerpool.cpp \
+    $$PWD/yuvconverter.cpp
@@ -0,0 +1,446 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "effectworker.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QPainter>
+#include <string.h>
+
+#include "bufferpool.h"
+#include "framestats.h"
+#include "myvideosurface.h"
+
+static const int ExposureMargin = 16;   // Pixels warped around the exposed part of the target
+
+
+/*!
+  \class EffectWorker
+  \brief Applies the mirror effect to the camera frames on a thread of its own.
+*/
+
+
+/*!
+  Constructor.
+*/
+EffectWorker::EffectWorker(QObject *parent)
+    : QThread(parent),
+      m_quit(false),
+      m_queuedEffectId(MirrorEffect::None),
+      m_queuedStrength(1.0f),
+      m_queuedCount(1.0f),
+      m_yuvCoefficients(YuvConverter::BT601),
+      m_droppedFrames(0),
+      m_frameStats(0),
+      m_writeIndex(0),
+      m_readyIndex(1),
+      m_displayIndex(2),
+      m_readyIsNew(false),
+      m_hasImage(false),
+      m_mirrorEffect(0)
+{
+    for (int i = 0; i < BufferCount; i++)
+        m_bufferData[i] = 0;
+}
+
+
+/*!
+  Destructor. Waits for the frame in progress to finish.
+*/
+EffectWorker::~EffectWorker()
+{
+    releaseMemory();
+}
+
+
+/*!
+  Queues \a frame for processing. Called from the camera callback.
+*/
+void EffectWorker::submit(SourceFramePointer frame, const QSize &targetSize,
+                          const QRect &exposedRect, int effectId,
+                          float strength /* = 1.0f */, float count /* = 1.0f */)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_qualityController.frameArrived(m_clock.nsecsElapsed())) {
+        if (m_frameStats)
+            m_frameStats->frameSkipped();
+
+        return;
+    }
+
+    if (m_queuedFrame) {
+            // The worker is still busy with an older frame, the queued one
+            // is stale already
+        m_droppedFrames++;
+        m_qualityController.frameDropped();
+
+        if (m_frameStats)
+            m_frameStats->frameDropped();
+    }
+
+    m_queuedFrame = frame;
+    m_queuedTargetSize = targetSize;
+    m_queuedExposedRect = exposedRect;
+    m_queuedEffectId = effectId;
+    m_queuedStrength = strength;
+    m_queuedCount = count;
+
+    if (!isRunning())
+        start();
+    else
+        m_frameQueued.wakeOne();
+}
+
+
+/*!
+  Drops the queued frame, which releases its mapping.
+*/
+void EffectWorker::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    m_queuedFrame.clear();
+}
+
+
+/*!
+  Stops the thread and releases the effect and the target images. The
+  worker is started again by the next submit().
+*/
+void EffectWorker::releaseMemory()
+{
+    m_mutex.lock();
+    m_quit = true;
+    m_queuedFrame.clear();
+    m_frameQueued.wakeOne();
+    m_mutex.unlock();
+
+    wait();
+
+    delete m_mirrorEffect;
+    m_mirrorEffect = 0;
+
+    QMutexLocker locker(&m_mutex);
+    m_quit = false;
+    m_queuedFrame.clear();
+
+    for (int i = 0; i < BufferCount; i++)
+        allocateBuffer(i, QSize());
+
+    m_readyIsNew = false;
+    m_hasImage = false;
+    m_qualityController.reset();
+}
+
+
+/*!
+  Sets \a stats to record the dropped frames and the time of conversion,
+  rotation, map rebuild and warp of every processed frame into.
+*/
+void EffectWorker::setFrameStats(FrameStats *stats)
+{
+    QMutexLocker locker(&m_mutex);
+    m_frameStats = stats;
+}
+
+
+/*!
+  Selects the coefficients UYVY frames are converted to RGB with. Applies
+  from the next frame on.
+*/
+void EffectWorker::setYuvCoefficients(YuvConverter::Coefficients coefficients)
+{
+    QMutexLocker locker(&m_mutex);
+    m_yuvCoefficients = coefficients;
+}
+
+
+/*!
+  Returns the coefficients UYVY frames are converted to RGB with.
+*/
+YuvConverter::Coefficients EffectWorker::yuvCoefficients() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_yuvCoefficients;
+}
+
+
+/*!
+  Returns true if there is a completed frame to paint.
+*/
+bool EffectWorker::hasImage() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_hasImage;
+}
+
+
+/*!
+  Paints the latest completed frame with \a painter.
+*/
+void EffectWorker::paint(QPainter *painter)
+{
+    const QImage &image = displayImage();
+
+    if (image.byteCount() <= 0)
+        return;
+
+    const QSize &displaySize = m_displaySizes[m_displayIndex];
+
+    if (image.size() == displaySize)
+        painter->drawImage(0, 0, image);
+    else
+        painter->drawImage(QRect(QPoint(0, 0), displaySize), image);
+}
+
+
+/*!
+  Returns a copy of the latest completed frame, at the size of the mirror.
+  The buffers themselves are reused, so they are never handed out.
+*/
+QImage EffectWorker::image()
+{
+    const QImage &image = displayImage();
+    const QSize &displaySize = m_displaySizes[m_displayIndex];
+
+    if (image.isNull() || image.size() == displaySize)
+        return image.copy();
+
+    return image.scaled(displaySize);
+}
+
+
+/*!
+  Returns the number of frames dropped because a newer one arrived before
+  the worker got to them.
+*/
+int EffectWorker::droppedFrames() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_droppedFrames;
+}
+
+
+/*!
+  Returns the quality tier the frames are currently processed at.
+*/
+QualityController::Tier EffectWorker::qualityTier() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_qualityController.tier();
+}
+
+
+/*!
+  Swaps the latest completed frame, if there is a new one, in to be
+  painted. The worker doesn't touch the display buffer, so the returned
+  image can be used without the lock until the next call.
+*/
+const QImage &EffectWorker::displayImage()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_readyIsNew) {
+        qSwap(m_displayIndex, m_readyIndex);
+        m_readyIsNew = false;
+    }
+
+    return m_buffers[m_displayIndex];
+}
+
+
+/*!
+  Replaces the target image \a index with one of \a size, or with a null
+  image if \a size is empty. The pixels are drawn from BufferPool, so
+  resizing the mirror or restarting the worker reuses the old buffers, and
+  the rows are padded to whole cache lines for the vector kernels.
+*/
+void EffectWorker::allocateBuffer(int index, const QSize &size)
+{
+    BufferPool *pool = BufferPool::instance();
+
+    m_buffers[index] = QImage();
+    pool->release(m_bufferData[index]);
+    m_bufferData[index] = 0;
+
+    if (size.isEmpty())
+        return;
+
+    const int bytesPerLine = (size.width() * 4 + BufferPool::CacheLineSize - 1)
+            & ~(BufferPool::CacheLineSize - 1);
+
+    m_bufferData[index] = pool->acquireArray<uchar>(bytesPerLine * size.height());
+
+    if (m_bufferData[index]) {
+            // Not every part of a buffer is written on every frame, see
+            // MirrorEffect::setExposedRect(). The rest must not show the
+            // earlier contents of the pool's memory.
+        memset(m_bufferData[index], 0, bytesPerLine * size.height());
+        m_buffers[index] = QImage(m_bufferData[index], size.width(), size.height(),
+                                  bytesPerLine, QImage::Format_RGB32);
+    }
+}
+
+
+/*!
+  From QThread. Processes the queued frames until released.
+*/
+void EffectWorker::run()
+{
+    forever {
+        m_mutex.lock();
+
+        while (!m_queuedFrame && !m_quit)
+            m_frameQueued.wait(&m_mutex);
+
+        if (m_quit) {
+            m_mutex.unlock();
+            break;
+        }
+
+        const SourceFramePointer frame = m_queuedFrame;
+        const QSize targetSize = m_queuedTargetSize;
+        const QRect exposedRect = m_queuedExposedRect;
+        const int effectId = m_queuedEffectId;
+        const float strength = m_queuedStrength;
+        const float count = m_queuedCount;
+        const YuvConverter::Coefficients coefficients = m_yuvCoefficients;
+        const bool highQuality = m_qualityController.highQuality();
+        const int divisor = m_qualityController.resolutionDivisor();
+        m_queuedFrame.clear();
+        m_mutex.unlock();
+
+        if (targetSize.isEmpty())
+            continue;
+
+        const QSize processSize((targetSize.width() + divisor - 1) / divisor,
+                                (targetSize.height() + divisor - 1) / divisor);
+
+            // The exposed part at the processed resolution, with a margin
+            // for the part scrolled in while the frame is processed
+        QRect processRect;
+
+        if (!exposedRect.isNull()) {
+            const QRect margined = exposedRect.adjusted(-ExposureMargin, -ExposureMargin,
+                                                        ExposureMargin, ExposureMargin);
+            processRect.setCoords(margined.left() / divisor,
+                                  margined.top() / divisor,
+                                  (margined.right() + divisor) / divisor - 1,
+                                  (margined.bottom() + divisor) / divisor - 1);
+        }
+
+            // The write buffer belongs to this thread until it is swapped,
+            // so it can be (re)allocated without the lock.
+        if (m_buffers[m_writeIndex].size() != processSize)
+            allocateBuffer(m_writeIndex, processSize);
+
+        m_displaySizes[m_writeIndex] = targetSize;
+
+        StageTimer timer;
+        processFrame(*frame, processSize, processRect, effectId, strength, count,
+                     coefficients, highQuality);
+
+            // A transform map rebuild is a one-off, so it doesn't count
+            // against the frame budget
+        const qint64 processTime = timer.nsecsElapsed() - m_mirrorEffect->lastRebuildTime();
+
+        m_mutex.lock();
+        m_qualityController.frameProcessed(processTime);
+
+        if (m_frameStats) {
+            m_frameStats->setQualityTier(
+                QualityController::tierName(m_qualityController.tier()));
+        }
+
+        qSwap(m_writeIndex, m_readyIndex);
+        m_readyIsNew = true;
+        m_hasImage = true;
+        m_mutex.unlock();
+
+        emit frameReady();
+    }
+}
+
+
+/*!
+  Warps \a frame into \a exposedRect of the write buffer, resampling
+  linearly if \a highQuality is true.
+*/
+void EffectWorker::processFrame(SourceFrame &frame, const QSize &targetSize,
+                                const QRect &exposedRect, int effectId,
+                                float strength, float count,
+                                YuvConverter::Coefficients coefficients, bool highQuality)
+{
+    if (!m_mirrorEffect) {
+        m_mirrorEffect = new MirrorEffect();
+
+            // Switching the effect must not stall the viewfinder
+        m_mirrorEffect->setBackgroundRebuild(true);
+
+            // The camera frames are usually larger than the mirrors
+        m_mirrorEffect->setMipmapping(true);
+
+            // The buffers are only written by the effect, so the parts of
+            // a static scene can be kept in them
+        m_mirrorEffect->setChangeDetection(true);
+    }
+
+    m_mirrorEffect->setYuvCoefficients(coefficients);
+
+    QImage &target = m_buffers[m_writeIndex];
+    m_mirrorEffect->setTarget((unsigned int*)target.bits(),
+                              target.width(),
+                              target.height(),
+                              target.bytesPerLine() / 4);
+    m_mirrorEffect->setExposedRect(exposedRect);
+
+    // The mirror normally samples only a fraction of the frame, so a UYVY
+    // frame is read directly and only the sampled pixels are converted.
+    // Converting the whole frame is cheaper only when the mirror has more
+    // pixels than the frame, and then the converted image is shared with
+    // the other mirrors showing the same frame.
+    if (frame.pixelFormat() == QVideoFrame::Format_UYVY
+            && targetSize.width() * targetSize.height()
+                <= frame.width() * frame.height())
+    {
+        m_mirrorEffect->setSourceUYVY(frame.bits(),
+                                      frame.width(),
+                                      frame.height(),
+                                      frame.bytesPerLine(),
+                                      frame.rotate90degrees(),
+                                      frame.flipY());
+    }
+    else {
+        const SourceFrame::Image image = frame.rgbImage(coefficients, m_frameStats);
+
+        if (!image.m_data)
+            return;
+
+        m_mirrorEffect->setSource(const_cast<unsigned int*>(image.m_data),
+                                  image.m_width,
+                                  image.m_height,
+                                  image.m_pitch);
+    }
+
+    // Set effect
+    MyVideoSurface::setMirrorTransform(m_mirrorEffect, effectId, strength, count);
+
+    // Effect quality, chosen by the quality controller
+    m_mirrorEffect->setHighQuality(highQuality);
+
+    // Make effect
+    StageTimer timer;
+    m_mirrorEffect->process();
+
+    if (m_frameStats) {
+        const qint64 rebuildTime = m_mirrorEffect->lastRebuildTime();
+
+        if (rebuildTime > 0)
+            m_frameStats->record(FrameStats::RebuildStage, rebuildTime);
+
+        m_frameStats->record(FrameStats::WarpStage, timer.nsecsElapsed() - rebuildTime);
+        m_frameStats->frameProcessed();
+    }
+}
@@ -0,0 +1,156 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef EFFECTWORKER_H
+#define EFFECTWORKER_H
+
+#include <QImage>
+#include <QMutex>
+#include <QRect>
+#include <QSize>
+#include <QThread>
+#include <QWaitCondition>
+
+#include "mirroreffect.h"
+#include "qualitycontroller.h"
+#include "sourceframe.h"
+#include "stagetimer.h"
+#include "yuvconverter.h"
+
+// Forward declarations
+class FrameStats;
+class QPainter;
+
+
+/*!
+  \class EffectWorker
+  \brief Applies the mirror effect to the camera frames on a thread of its own.
+
+  The camera callback only queues the frame with submit() and returns. The
+  queue holds a single frame: a frame which has not been started yet when
+  the next one arrives is dropped, so the worker always processes the
+  latest frame and the camera is never held up by the warp.
+
+  The quality is chosen by a QualityController from the processing time of
+  the frames, so that the worker keeps up with the camera: when the frames
+  take longer than the camera's frame interval allows, the resampling is
+  changed to nearest pixel, then the mirror is processed at half the
+  resolution and scaled up when painted, and finally every other frame is
+  skipped.
+
+  Only the part of the mirror on the screen is warped (see
+  MirrorEffect::setExposedRect()), with a margin for the scrolling. The
+  rest of the target keeps older contents, which aren't seen.
+
+  The results are triple buffered. The worker writes into one target image
+  while another holds the latest completed frame and the third is the one
+  being painted. Completing a frame and starting to paint only swap buffer
+  indices under the mutex, so the painter never sees a half written image,
+  and the images are never shared, so writing into them never detaches.
+*/
+class EffectWorker : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit EffectWorker(QObject *parent = 0);
+    ~EffectWorker();
+
+public:
+        // Queues frame to be warped into a target of targetSize with the
+        // effect effectId at strength and count (see
+        // MyVideoSurface::setMirrorTransform()). Only exposedRect of the
+        // target is warped, a null rect warps all of it. Replaces the
+        // queued frame if the worker hasn't started it yet. Starts the
+        // thread if it isn't running.
+    void submit(SourceFramePointer frame, const QSize &targetSize,
+                const QRect &exposedRect, int effectId,
+                float strength = 1.0f, float count = 1.0f);
+
+        // Drops the queued frame, if any
+    void flush();
+
+        // Stops the thread and releases the effect and the images
+    void releaseMemory();
+
+        // The statistics the dropped frames and the processing stages are
+        // recorded into, not owned. Set before the first submit().
+    void setFrameStats(FrameStats *stats);
+
+        // The coefficients UYVY frames are converted with
+    void setYuvCoefficients(YuvConverter::Coefficients coefficients);
+    YuvConverter::Coefficients yuvCoefficients() const;
+
+        // True when a frame has been completed
+    bool hasImage() const;
+
+        // Paints the latest completed frame. Call from the GUI thread only.
+    void paint(QPainter *painter);
+
+        // A copy of the latest completed frame. Call from the GUI thread only.
+    QImage image();
+
+        // The number of frames dropped without processing
+    int droppedFrames() const;
+
+        // The quality tier the frames are currently processed at
+    QualityController::Tier qualityTier() const;
+
+signals:
+        // Emitted from the worker thread when a frame has been completed
+    void frameReady();
+
+protected: // From QThread
+    void run();
+
+private:
+        // Takes the latest completed frame to be painted
+    const QImage &displayImage();
+
+        // (Re)allocates the target image index
+    void allocateBuffer(int index, const QSize &size);
+
+    void processFrame(SourceFrame &frame, const QSize &targetSize,
+                      const QRect &exposedRect, int effectId,
+                      float strength, float count,
+                      YuvConverter::Coefficients coefficients, bool highQuality);
+
+private: // Data
+    enum { BufferCount = 3 };
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_frameQueued;
+    bool m_quit;
+
+        // The queued frame and its parameters
+    SourceFramePointer m_queuedFrame;
+    QSize m_queuedTargetSize;
+    QRect m_queuedExposedRect;
+    int m_queuedEffectId;
+    float m_queuedStrength;
+    float m_queuedCount;
+    YuvConverter::Coefficients m_yuvCoefficients;
+    int m_droppedFrames;
+    FrameStats *m_frameStats;   // Not owned, may be 0
+
+        // Chooses the quality from the frame arrival and processing times
+    QualityController m_qualityController;
+    StageTimer m_clock;
+
+        // The target images and the indices of the one being written, the
+        // latest completed one and the one being painted
+    QImage m_buffers[BufferCount];
+    uchar *m_bufferData[BufferCount];   // The pixels of m_buffers, from BufferPool
+    QSize m_displaySizes[BufferCount];  // The sizes m_buffers are painted at
+    int m_writeIndex;
+    int m_readyIndex;
+    int m_displayIndex;
+    bool m_readyIsNew;
+    bool m_hasImage;
+
+        // Used by the worker thread only
+    MirrorEffect *m_mirrorEffect;
+};
+
+#endif // EFFECTWORKER_H
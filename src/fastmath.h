@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <string.h>
+
+/*
+  Branch-free polynomial approximations of the functions used by the
+  transform generation. They are written so that the compiler can evaluate
+  a loop calling them with vector instructions: no calls to the math
+  library, no errno, and conditions only as selects.
+
+  The accuracy (about 1e-5) is far better than the 1/128 pixel precision
+  of the transform map.
+*/
+
+namespace FastMath {
+
+static const float Pi = 3.14159265f;
+static const float HalfPi = 1.57079633f;
+static const float TwoPi = 6.28318531f;
+static const float InvTwoPi = 0.159154943f;
+
+
+/*!
+  Approximates 1 / sqrt(x) for x > 0.
+*/
+inline float rsqrt(float x)
+{
+    int i;
+    float y;
+    memcpy(&i, &x, sizeof(i));
+    i = 0x5F375A86 - (i >> 1);
+    memcpy(&y, &i, sizeof(y));
+
+    // Two Newton-Raphson iterations
+    y = y * (1.5f - 0.5f * x * y * y);
+    y = y * (1.5f - 0.5f * x * y * y);
+    return y;
+}
+
+
+/*!
+  Approximates sqrt(x) for x >= 0 (returns 0 for 0).
+*/
+inline float sqrt(float x)
+{
+    const float safe = x > 1e-20f ? x : 1e-20f;
+    return x > 1e-20f ? safe * rsqrt(safe) : 0.0f;
+}
+
+
+/*!
+  Returns the largest integer not greater than x, for |x| < 16384.
+*/
+inline float floor(float x)
+{
+    return (float)(int)(x + 16384.0f) - 16384.0f;
+}
+
+
+/*!
+  Approximates sin(x) for |x| < 16384 * 2 * Pi.
+*/
+inline float sin(float x)
+{
+    // Reduce to [-Pi, Pi) and then fold to [-Pi/2, Pi/2] with
+    // sin(Pi - x) = sin(x).
+    x = x - TwoPi * floor(x * InvTwoPi + 0.5f);
+    x = x > HalfPi ? Pi - x : x;
+    x = x < -HalfPi ? -Pi - x : x;
+
+    const float x2 = x * x;
+    return x * (1.0f + x2 * (-1.6666667e-1f + x2 * (8.3333333e-3f
+                + x2 * (-1.9841270e-4f + x2 * 2.7557319e-6f))));
+}
+
+
+/*!
+  Approximates cos(x).
+*/
+inline float cos(float x)
+{
+    return sin(x + HalfPi);
+}
+
+
+/*!
+  Approximates atan2(y, x). Returns 0 for (0, 0).
+*/
+inline float atan2(float y, float x)
+{
+    const float ax = x < 0.0f ? -x : x;
+    const float ay = y < 0.0f ? -y : y;
+    const float maxValue = ax > ay ? ax : ay;
+    const float minValue = ax > ay ? ay : ax;
+    const float a = minValue / (maxValue > 1e-20f ? maxValue : 1e-20f);
+    const float a2 = a * a;
+
+    // atan(a) for a in [0, 1]
+    float r = a * (0.99997726f + a2 * (-0.33262347f + a2 * (0.19354346f
+                  + a2 * (-0.11643287f + a2 * (0.05265332f + a2 * -0.01172120f)))));
+
+    r = ay > ax ? HalfPi - r : r;
+    r = x < 0.0f ? Pi - r : r;
+    return y < 0.0f ? -r : r;
+}
+
+} // namespace FastMath
+
+#endif // FASTMATH_H
@@ -0,0 +1,301 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "framestats.h"
+
+#include <QMutexLocker>
+#include <QtAlgorithms>
+
+
+/*!
+  \class FrameStats
+  \brief Rolling timings of the stages a camera frame goes through, and the frame counts.
+*/
+
+
+/*!
+  Constructor. \a windowSize is the number of the latest samples each stage
+  keeps.
+*/
+FrameStats::FrameStats(int windowSize /* = DefaultWindowSize */)
+    : m_windowSize(qMax(1, windowSize)),
+      m_delivered(0),
+      m_processed(0),
+      m_dropped(0),
+      m_skipped(0)
+{
+    for (int i = 0; i < StageCount; i++) {
+        m_samples[i].reserve(m_windowSize);
+        m_next[i] = 0;
+    }
+}
+
+
+/*!
+  Adds \a nanoseconds to the samples of \a stage, replacing the oldest
+  sample once the window is full.
+*/
+void FrameStats::record(Stage stage, qint64 nanoseconds)
+{
+    QMutexLocker locker(&m_mutex);
+    QVector<qint64> &samples = m_samples[stage];
+
+    if (samples.count() < m_windowSize)
+        samples.append(nanoseconds);
+    else
+        samples[m_next[stage]] = nanoseconds;
+
+    m_next[stage] = (m_next[stage] + 1) % m_windowSize;
+}
+
+
+/*!
+  Counts a frame delivered by the camera.
+*/
+void FrameStats::frameDelivered()
+{
+    QMutexLocker locker(&m_mutex);
+    m_delivered++;
+}
+
+
+/*!
+  Counts a frame warped into the mirror.
+*/
+void FrameStats::frameProcessed()
+{
+    QMutexLocker locker(&m_mutex);
+    m_processed++;
+}
+
+
+/*!
+  Counts a frame dropped without processing.
+*/
+void FrameStats::frameDropped()
+{
+    QMutexLocker locker(&m_mutex);
+    m_dropped++;
+}
+
+
+/*!
+  Counts a frame skipped to keep up with the camera.
+*/
+void FrameStats::frameSkipped()
+{
+    QMutexLocker locker(&m_mutex);
+    m_skipped++;
+}
+
+
+/*!
+  Sets the name of the quality tier the frames are processed at to \a tier.
+*/
+void FrameStats::setQualityTier(const QByteArray &tier)
+{
+    QMutexLocker locker(&m_mutex);
+    m_qualityTier = tier;
+}
+
+
+/*!
+  Returns the number of frames delivered by the camera.
+*/
+int FrameStats::deliveredCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_delivered;
+}
+
+
+/*!
+  Returns the number of frames warped into the mirror.
+*/
+int FrameStats::processedCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_processed;
+}
+
+
+/*!
+  Returns the number of frames dropped without processing.
+*/
+int FrameStats::droppedCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_dropped;
+}
+
+
+/*!
+  Returns the number of frames skipped to keep up with the camera.
+*/
+int FrameStats::skippedCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_skipped;
+}
+
+
+/*!
+  Returns the name of the latest quality tier reported.
+*/
+QByteArray FrameStats::qualityTier() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_qualityTier;
+}
+
+
+/*!
+  Returns the statistics of the samples of \a stage in the window.
+*/
+FrameStats::Summary FrameStats::summary(Stage stage) const
+{
+    QMutexLocker locker(&m_mutex);
+    return summaryLocked(stage);
+}
+
+
+/*!
+  Forgets all the samples and zeroes the counts.
+*/
+void FrameStats::reset()
+{
+    QMutexLocker locker(&m_mutex);
+
+    for (int i = 0; i < StageCount; i++) {
+        m_samples[i].clear();
+        m_next[i] = 0;
+    }
+
+    m_delivered = 0;
+    m_processed = 0;
+    m_dropped = 0;
+    m_skipped = 0;
+    m_qualityTier.clear();
+}
+
+
+/*!
+  Returns the statistics as a map for QML, the times in milliseconds.
+*/
+QVariantMap FrameStats::toVariantMap() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantMap map;
+
+    for (int i = 0; i < StageCount; i++) {
+        const Summary stats = summaryLocked((Stage)i);
+        QVariantMap stage;
+
+        stage.insert("count", stats.m_count);
+        stage.insert("min", stats.m_minimum / 1.0e6);
+        stage.insert("avg", stats.m_average / 1.0e6);
+        stage.insert("p95", stats.m_p95 / 1.0e6);
+        stage.insert("max", stats.m_maximum / 1.0e6);
+        map.insert(stageName((Stage)i), stage);
+    }
+
+    map.insert("delivered", m_delivered);
+    map.insert("processed", m_processed);
+    map.insert("dropped", m_dropped);
+    map.insert("skipped", m_skipped);
+    map.insert("tier", QString::fromLatin1(m_qualityTier.constData()));
+
+    return map;
+}
+
+
+/*!
+  Returns the names of the columns of csvRow(): the minimum, average, 95th
+  percentile and maximum of every stage, the frame counts and the quality
+  tier.
+*/
+QByteArray FrameStats::csvHeader()
+{
+    QByteArray header;
+
+    for (int i = 0; i < StageCount; i++) {
+        const QByteArray name = stageName((Stage)i);
+        header += name + "_min_ms," + name + "_avg_ms," + name + "_p95_ms," + name + "_max_ms,";
+    }
+
+    return header + "delivered,processed,dropped,skipped,tier\n";
+}
+
+
+/*!
+  Returns the current statistics as a row of comma separated values, the
+  times in milliseconds.
+*/
+QByteArray FrameStats::csvRow() const
+{
+    QMutexLocker locker(&m_mutex);
+    QByteArray row;
+
+    for (int i = 0; i < StageCount; i++) {
+        const Summary stats = summaryLocked((Stage)i);
+
+        row += QByteArray::number(stats.m_minimum / 1.0e6, 'f', 3) + ','
+                + QByteArray::number(stats.m_average / 1.0e6, 'f', 3) + ','
+                + QByteArray::number(stats.m_p95 / 1.0e6, 'f', 3) + ','
+                + QByteArray::number(stats.m_maximum / 1.0e6, 'f', 3) + ',';
+    }
+
+    return row + QByteArray::number(m_delivered) + ','
+            + QByteArray::number(m_processed) + ','
+            + QByteArray::number(m_dropped) + ','
+            + QByteArray::number(m_skipped) + ','
+            + m_qualityTier + '\n';
+}
+
+
+/*!
+  Returns the name of \a stage as used in toVariantMap() and csvHeader().
+*/
+const char *FrameStats::stageName(Stage stage)
+{
+    switch (stage) {
+    case MapStage: return "map";
+    case ConversionStage: return "conversion";
+    case RotationStage: return "rotation";
+    case RebuildStage: return "rebuild";
+    case WarpStage: return "warp";
+    case PaintStage: return "paint";
+    default: return "";
+    }
+}
+
+
+/*!
+  Calculates the statistics of \a stage. The mutex must be locked. The
+  window is small, so sorting a copy of it for the percentile is cheap
+  enough for a few queries a second.
+*/
+FrameStats::Summary FrameStats::summaryLocked(Stage stage) const
+{
+    Summary summary;
+    QVector<qint64> sorted = m_samples[stage];
+
+    if (sorted.isEmpty())
+        return summary;
+
+    qSort(sorted);
+
+    qint64 sum(0);
+
+    for (int i = 0; i < sorted.count(); i++)
+        sum += sorted.at(i);
+
+    summary.m_count = sorted.count();
+    summary.m_minimum = sorted.first();
+    summary.m_average = sum / sorted.count();
+    summary.m_p95 = sorted.at(qMin(sorted.count() - 1, (sorted.count() * 95 + 99) / 100 - 1));
+    summary.m_maximum = sorted.last();
+
+    return summary;
+}
@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QVariantMap>
+#include <QVector>
+
+
+/*!
+  \class FrameStats
+  \brief Rolling timings of the stages a camera frame goes through, and the frame counts.
+
+  Every stage keeps the times of its latest samples in a ring buffer, from
+  which the minimum, the average, the 95th percentile and the maximum are
+  calculated when asked. Recording a time only stores it under the mutex,
+  so the stages can be recorded from the camera, the worker and the GUI
+  threads alike without slowing them down.
+
+  The counts are totals: the frames delivered by the camera, processed by
+  the effect, dropped because a newer frame arrived first and skipped on
+  purpose to keep up with the camera. The quality tier is the latest one
+  reported.
+*/
+class FrameStats
+{
+public: // Data types
+    enum Stage {
+        MapStage,           // Mapping the camera frame for reading
+        ConversionStage,    // Converting a UYVY frame to RGB32
+        RotationStage,      // Rotating the converted frame
+        RebuildStage,       // Generating the transform map
+        WarpStage,          // Warping the frame into the mirror
+        PaintStage,         // Painting the mirror
+        StageCount
+    };
+
+    /*
+     * The statistics of a stage's window of samples, in nanoseconds.
+     */
+    class Summary
+    {
+    public:
+        Summary() : m_count(0), m_minimum(0), m_average(0), m_p95(0), m_maximum(0) {}
+
+        int m_count;
+        qint64 m_minimum;
+        qint64 m_average;
+        qint64 m_p95;
+        qint64 m_maximum;
+    };
+
+    enum { DefaultWindowSize = 120 };  // About four seconds of frames
+
+public:
+    explicit FrameStats(int windowSize = DefaultWindowSize);
+
+public:
+        // Adds a sample of stage. Thread safe, like all the functions.
+    void record(Stage stage, qint64 nanoseconds);
+
+    void frameDelivered();
+    void frameProcessed();
+    void frameDropped();
+    void frameSkipped();
+
+        // The name of the quality tier the frames are processed at
+    void setQualityTier(const QByteArray &tier);
+
+    int deliveredCount() const;
+    int processedCount() const;
+    int droppedCount() const;
+    int skippedCount() const;
+    QByteArray qualityTier() const;
+
+    Summary summary(Stage stage) const;
+
+        // Forgets the samples and zeroes the counts
+    void reset();
+
+        // The statistics for QML. Every stage is a map of "min", "avg",
+        // "p95" and "max" in milliseconds and the "count" of samples. The
+        // frame counts are "delivered", "processed", "dropped" and
+        // "skipped", and the quality tier is "tier".
+    QVariantMap toVariantMap() const;
+
+        // The names of the csvRow() columns and a row of the current
+        // statistics, both terminated by a newline
+    static QByteArray csvHeader();
+    QByteArray csvRow() const;
+
+    static const char *stageName(Stage stage);
+
+private:
+    Summary summaryLocked(Stage stage) const;
+
+private: // Data
+    mutable QMutex m_mutex;
+    int m_windowSize;
+    QVector<qint64> m_samples[StageCount];  // Ring buffers of m_windowSize
+    int m_next[StageCount];                 // The ring position to write next
+    int m_delivered;
+    int m_processed;
+    int m_dropped;
+    int m_skipped;
+    QByteArray m_qualityTier;
+};
+
+#endif // FRAMESTATS_H
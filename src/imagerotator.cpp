@@ -0,0 +1,284 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "imagerotator.h"
+
+#include <string.h>
+
+#include "cpufeatures.h"
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#define MH_ROTATE_X86
+#include <emmintrin.h>
+#endif
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#define MH_ROTATE_NEON
+#include <arm_neon.h>
+#endif
+
+// See warpkernels.cpp
+#if defined(__GNUC__)
+#define MH_TARGET(x) __attribute__((target(x)))
+#else
+#define MH_TARGET(x)
+#endif
+
+// Tile edge in pixels. A 32x32 tile writes whole cache lines of 32 target
+// rows, and both the source and the target tile (4 kB each) stay in L1.
+static const int TileSize = 32;
+
+
+/*
+  The rotated target is addressed as in MirrorEffect::setSource(): the source
+  pixel (x, y) goes to the column height - 1 - y of the target row x, or of
+  the row width - 1 - x when flipped. The flip is handled by starting from
+  the last target row and stepping the rows backwards, so the tile functions
+  only see a row pointer and a (possibly negative) row step.
+*/
+typedef void (*TileFunction)(unsigned int *targetRow0,
+                             int targetRowStep,
+                             const unsigned int *source,
+                             int sourcePitch,
+                             int height,
+                             int x0, int y0,
+                             int tileWidth, int tileHeight);
+
+
+/*
+  Rotates a tile one pixel at a time. Also handles the partial tiles of the
+  vectorized variants.
+*/
+static void rotateTileScalar(unsigned int *targetRow0,
+                             int targetRowStep,
+                             const unsigned int *source,
+                             int sourcePitch,
+                             int height,
+                             int x0, int y0,
+                             int tileWidth, int tileHeight)
+{
+    for (int x = x0; x < x0 + tileWidth; x++) {
+        unsigned int *t = targetRow0 + targetRowStep * x + (height - 1 - y0);
+        const unsigned int *s = source + sourcePitch * y0 + x;
+        const unsigned int *s_target = s + sourcePitch * tileHeight;
+
+        while (s != s_target) {
+            *t = *s;
+            s += sourcePitch;
+            t--;
+        }
+    }
+}
+
+
+#ifdef MH_ROTATE_X86
+
+/*
+  SSE2: 4x4 blocks. The four source rows are loaded bottom row first, so
+  after the transpose every register holds a target row segment in order.
+*/
+static MH_TARGET("sse2") void rotateTileSSE2(unsigned int *targetRow0,
+                                             int targetRowStep,
+                                             const unsigned int *source,
+                                             int sourcePitch,
+                                             int height,
+                                             int x0, int y0,
+                                             int tileWidth, int tileHeight)
+{
+    const int blockWidth = tileWidth & ~3;
+    const int blockHeight = tileHeight & ~3;
+
+    for (int y = y0; y < y0 + blockHeight; y += 4) {
+        const unsigned int *s = source + sourcePitch * (y + 3) + x0;
+        unsigned int *t = targetRow0 + targetRowStep * x0 + (height - 4 - y);
+
+        for (int x = 0; x < blockWidth; x += 4) {
+            const __m128i r0 = _mm_loadu_si128((const __m128i*)(s + x));
+            const __m128i r1 = _mm_loadu_si128((const __m128i*)(s + x - sourcePitch));
+            const __m128i r2 = _mm_loadu_si128((const __m128i*)(s + x - sourcePitch * 2));
+            const __m128i r3 = _mm_loadu_si128((const __m128i*)(s + x - sourcePitch * 3));
+
+            const __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+            const __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+            const __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+            const __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+            _mm_storeu_si128((__m128i*)t, _mm_unpacklo_epi64(t0, t1));
+            _mm_storeu_si128((__m128i*)(t + targetRowStep), _mm_unpackhi_epi64(t0, t1));
+            _mm_storeu_si128((__m128i*)(t + targetRowStep * 2), _mm_unpacklo_epi64(t2, t3));
+            _mm_storeu_si128((__m128i*)(t + targetRowStep * 3), _mm_unpackhi_epi64(t2, t3));
+
+            t += targetRowStep * 4;
+        }
+    }
+
+        // The columns and the rows left over
+    rotateTileScalar(targetRow0, targetRowStep, source, sourcePitch, height,
+                     x0 + blockWidth, y0, tileWidth - blockWidth, tileHeight);
+    rotateTileScalar(targetRow0, targetRowStep, source, sourcePitch, height,
+                     x0, y0 + blockHeight, blockWidth, tileHeight - blockHeight);
+}
+
+#endif // MH_ROTATE_X86
+
+
+#ifdef MH_ROTATE_NEON
+
+/*
+  NEON: as SSE2, the 4x4 transpose is done with two vtrn and the halves of
+  the results.
+*/
+static void rotateTileNEON(unsigned int *targetRow0,
+                           int targetRowStep,
+                           const unsigned int *source,
+                           int sourcePitch,
+                           int height,
+                           int x0, int y0,
+                           int tileWidth, int tileHeight)
+{
+    const int blockWidth = tileWidth & ~3;
+    const int blockHeight = tileHeight & ~3;
+
+    for (int y = y0; y < y0 + blockHeight; y += 4) {
+        const unsigned int *s = source + sourcePitch * (y + 3) + x0;
+        unsigned int *t = targetRow0 + targetRowStep * x0 + (height - 4 - y);
+
+        for (int x = 0; x < blockWidth; x += 4) {
+            const uint32x4x2_t p = vtrnq_u32(vld1q_u32(s + x),
+                                             vld1q_u32(s + x - sourcePitch));
+            const uint32x4x2_t q = vtrnq_u32(vld1q_u32(s + x - sourcePitch * 2),
+                                             vld1q_u32(s + x - sourcePitch * 3));
+
+            vst1q_u32(t, vcombine_u32(vget_low_u32(p.val[0]), vget_low_u32(q.val[0])));
+            vst1q_u32(t + targetRowStep,
+                      vcombine_u32(vget_low_u32(p.val[1]), vget_low_u32(q.val[1])));
+            vst1q_u32(t + targetRowStep * 2,
+                      vcombine_u32(vget_high_u32(p.val[0]), vget_high_u32(q.val[0])));
+            vst1q_u32(t + targetRowStep * 3,
+                      vcombine_u32(vget_high_u32(p.val[1]), vget_high_u32(q.val[1])));
+
+            t += targetRowStep * 4;
+        }
+    }
+
+    rotateTileScalar(targetRow0, targetRowStep, source, sourcePitch, height,
+                     x0 + blockWidth, y0, tileWidth - blockWidth, tileHeight);
+    rotateTileScalar(targetRow0, targetRowStep, source, sourcePitch, height,
+                     x0, y0 + blockHeight, blockWidth, tileHeight - blockHeight);
+}
+
+#endif // MH_ROTATE_NEON
+
+
+/*
+  Picks the first supported variant.
+*/
+static ImageRotator::Variant selectVariant()
+{
+#ifdef MH_ROTATE_X86
+    if (CpuFeatures::has(CpuFeatures::SSE2))
+        return ImageRotator::SSE2;
+#endif
+#ifdef MH_ROTATE_NEON
+    if (CpuFeatures::has(CpuFeatures::NEON))
+        return ImageRotator::NEON;
+#endif
+
+    return ImageRotator::Scalar;
+}
+
+
+/*
+  Returns the tile function of variant.
+*/
+static TileFunction tileFunction(ImageRotator::Variant variant)
+{
+    switch (variant) {
+#ifdef MH_ROTATE_X86
+    case ImageRotator::SSE2:
+        return rotateTileSSE2;
+#endif
+#ifdef MH_ROTATE_NEON
+    case ImageRotator::NEON:
+        return rotateTileNEON;
+#endif
+    default:
+        break;
+    }
+
+    return rotateTileScalar;
+}
+
+
+/*!
+  \class ImageRotator
+  \brief Copies an RGB32 image rotated by 90 degrees and/or flipped vertically.
+*/
+
+
+/*!
+  Copies \a source to \a target. Without the rotation only the row order
+  changes, which is a plain copy of every row.
+*/
+void ImageRotator::rotate(unsigned int *target,
+                          int targetPitch,
+                          const unsigned int *source,
+                          int sourcePitch,
+                          int width,
+                          int height,
+                          bool rotate90degrees,
+                          bool flipY)
+{
+    if (!rotate90degrees) {
+        for (int y = 0; y < height; y++) {
+            memcpy(target + targetPitch * (flipY ? height - 1 - y : y),
+                   source + sourcePitch * y,
+                   width * sizeof(unsigned int));
+        }
+
+        return;
+    }
+
+    const TileFunction rotateTile = tileFunction(variant());
+    unsigned int *targetRow0 = flipY ? target + targetPitch * (width - 1) : target;
+    const int targetRowStep = flipY ? -targetPitch : targetPitch;
+
+        // The tiles are walked along the source rows, so the source is read
+        // in order and a band of target columns is filled at a time.
+    for (int y0 = 0; y0 < height; y0 += TileSize) {
+        const int tileHeight = height - y0 < TileSize ? height - y0 : TileSize;
+
+        for (int x0 = 0; x0 < width; x0 += TileSize) {
+            const int tileWidth = width - x0 < TileSize ? width - x0 : TileSize;
+
+            rotateTile(targetRow0, targetRowStep, source, sourcePitch, height,
+                       x0, y0, tileWidth, tileHeight);
+        }
+    }
+}
+
+
+/*!
+  Returns the variant used on this CPU. The selection is done only once.
+*/
+ImageRotator::Variant ImageRotator::variant()
+{
+    static Variant selected = selectVariant();
+    return selected;
+}
+
+
+/*!
+  Returns a human readable name of \a variant.
+*/
+const char *ImageRotator::variantName(Variant variant)
+{
+    switch (variant) {
+    case SSE2: return "SSE2";
+    case NEON: return "NEON";
+    default: break;
+    }
+
+    return "Scalar";
+}
@@ -0,0 +1,47 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef IMAGEROTATOR_H
+#define IMAGEROTATOR_H
+
+
+/*!
+  \class ImageRotator
+  \brief Copies an RGB32 image rotated by 90 degrees and/or flipped vertically.
+
+  The 90 degree rotation is a transpose, which reads the source in rows and
+  writes the target in columns. It is done in square tiles that fit into
+  the cache, and inside the tiles in 4x4 blocks transposed in registers
+  when the CPU has the instructions for it.
+*/
+class ImageRotator
+{
+public: // Data types
+    enum Variant {
+        Scalar,
+        SSE2,
+        NEON
+    };
+
+public:
+        // Copies the width x height source to the target. With the rotation
+        // the target must be height x width pixels. The rotation and the
+        // flip are the ones of MirrorEffect::setSource(): the source's
+        // bottom row becomes the left column of the target, and flipY
+        // turns the result upside down. The pitches are in pixels.
+    static void rotate(unsigned int *target,
+                       int targetPitch,
+                       const unsigned int *source,
+                       int sourcePitch,
+                       int width,
+                       int height,
+                       bool rotate90degrees,
+                       bool flipY);
+
+        // The variant used for the rotation on this CPU
+    static Variant variant();
+    static const char *variantName(Variant variant);
+};
+
+#endif // IMAGEROTATOR_H
@@ -6,6 +6,8 @@
 #include <QDeclarativeContext>
 #include <QDeclarativeView>
 #include <QDebug>
+#include <QDesktopServices>
+#include <QStringList>
 
 // Lock Symbian orientation
 #ifdef Q_OS_SYMBIAN
@@ -20,7 +22,10 @@
     #include <w32std.h>
 #endif
 
+#include "bufferpool.h"
 #include "mirroritem.h"
+#include "transformmapcache.h"
+#include "transformmapstore.h"
 
 static const int KGoomMemoryLowEvent = 0x10282DBF;
 static const int KGoomMemoryGoodEvent = 0x20026790;
@@ -55,6 +60,10 @@ protected:
 
                     if ((*eventData) == KGoomMemoryLowEvent) {
                         qDebug() << "KGoomMemoryLowEvent";
+
+                        // Release the maps and the buffers not in use
+                        TransformMapCache::instance()->trim();
+                        BufferPool::instance()->trim();
                         return true;
                     }
                 }
@@ -80,6 +89,11 @@ int main(int argc, char *argv[])
     MyApplication app(argc, argv);
     qmlRegisterType<MirrorItem>("CustomItems", 1, 0, "MirrorItem");
 
+    // The generated transform maps are kept between the runs, so that the
+    // effects start without generating them again
+    TransformMapStore::instance()->setDirectory(
+        QDesktopServices::storageLocation(QDesktopServices::CacheLocation) + "/maps");
+
     // Lock Symbian orientation
 #ifdef Q_OS_SYMBIAN
     CAknAppUi* appUi = dynamic_cast<CAknAppUi*> (CEikonEnv::Static()->AppUi());
@@ -98,6 +112,20 @@ int main(int argc, char *argv[])
     view->rootContext()->setContextProperty("isHarmattan", false);
 #endif
 
+    // Diagnostics of the frame processing, see FrameStats: --stats shows
+    // the timings on the mirrors, --stats-csv <file> (or the environment
+    // variable MIRRORHOUSE_STATS_CSV) logs them into a CSV file.
+    const QStringList arguments = app.arguments();
+    const int csvIndex = arguments.indexOf("--stats-csv");
+    QString statsFile = QString::fromLocal8Bit(qgetenv("MIRRORHOUSE_STATS_CSV"));
+
+    if (csvIndex >= 0 && csvIndex + 1 < arguments.count())
+        statsFile = arguments.at(csvIndex + 1);
+
+    view->rootContext()->setContextProperty("showFrameStats",
+                                            arguments.contains("--stats"));
+    view->rootContext()->setContextProperty("frameStatsFile", statsFile);
+
     view->setSource(QUrl("qrc:/main.qml"));
     view->setResizeMode(QDeclarativeView::SizeRootObjectToView);
     QObject::connect((QObject*)view->engine(), SIGNAL(quit()), &app, SLOT(quit()));
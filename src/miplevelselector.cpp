@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "miplevelselector.h"
+
+#include <QtGlobal>
+
+#include "sourcepyramid.h"
+#include "transformmap.h"
+
+
+/*!
+  \class MipLevelSelector
+  \brief Selects the SourcePyramid level each pixel of a transform map is sampled from.
+*/
+
+
+/*!
+  Returns the squared distance of the source co-ordinates (\a ax, \a ay)
+  and (\a bx, \a by) of a map, in the units of the map.
+*/
+static inline float distance2(int ax, int ay, int bx, int by)
+{
+    const float dx = (float)(ax - bx);
+    const float dy = (float)(ay - by);
+    return dx * dx + dy * dy;
+}
+
+
+/*!
+  Constructor.
+*/
+MipLevelSelector::MipLevelSelector(TransformMap *map)
+    : m_map(map)
+{
+}
+
+
+/*!
+  From WorkerTask. Stores the levels of the rows [begin, end).
+*/
+void MipLevelSelector::run(int begin, int end)
+{
+    const int width = m_map->width();
+    const int maxX = width - 1;
+    const int maxY = m_map->height() - 1;
+
+        // A span of one source pixel, squared
+    const float unit = (float)(1 << m_map->fracBits());
+    const float scale = 1.0f / (unit * unit);
+
+    for (int y = begin; y < end; y++) {
+        const unsigned short *x0 = m_map->xRow(y);
+        const unsigned short *y0 = m_map->yRow(y);
+        const unsigned short *xAbove = m_map->xRow(y > 0 ? y - 1 : y);
+        const unsigned short *yAbove = m_map->yRow(y > 0 ? y - 1 : y);
+        const unsigned short *xBelow = m_map->xRow(y < maxY ? y + 1 : y);
+        const unsigned short *yBelow = m_map->yRow(y < maxY ? y + 1 : y);
+        unsigned char *levels = m_map->levelRow(y);
+
+        for (int x = 0; x < width; x++) {
+            const int left = x > 0 ? x - 1 : x;
+            const int right = x < maxX ? x + 1 : x;
+
+                // A missing neighbour at the edge is replaced by the other
+            float spanX = distance2(x0[x], y0[x], x0[left], y0[left]);
+            const float spanRight = distance2(x0[x], y0[x], x0[right], y0[right]);
+
+            if (x == 0 || (x < maxX && spanRight < spanX))
+                spanX = spanRight;
+
+            float spanY = distance2(x0[x], y0[x], xAbove[x], yAbove[x]);
+            const float spanBelow = distance2(x0[x], y0[x], xBelow[x], yBelow[x]);
+
+            if (y == 0 || (y < maxY && spanBelow < spanY))
+                spanY = spanBelow;
+
+            const float span = qMax(spanX, spanY) * scale;
+            float limit = 4.0f;
+            int level = 0;
+
+            while (level < SourcePyramid::MaxLevel && span >= limit) {
+                level++;
+                limit *= 4.0f;
+            }
+
+            levels[x] = (unsigned char)level;
+        }
+    }
+}
@@ -0,0 +1,43 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef MIPLEVELSELECTOR_H
+#define MIPLEVELSELECTOR_H
+
+#include "workerpool.h"
+
+// Forward declarations
+class TransformMap;
+
+
+/*!
+  \class MipLevelSelector
+  \brief Selects the SourcePyramid level each pixel of a transform map is sampled from.
+
+  The level follows from the Jacobian of the map: the source co-ordinates
+  of the neighbouring target pixels tell how many source pixels a target
+  pixel spans along either axis. The larger span gives the level, the
+  base 2 logarithm rounded down, so a pixel of the level spans at most a
+  target pixel.
+
+  The map has seams, like the edges of Tile, where the neighbours are far
+  apart in the source although the source isn't shrunk. Both neighbours
+  along an axis are looked at and the closer one used, so the pixels at a
+  seam keep their level.
+*/
+class MipLevelSelector : public WorkerTask
+{
+public:
+        // The level plane of the map must be created, see
+        // TransformMap::createLevels().
+    explicit MipLevelSelector(TransformMap *map);
+
+public: // From WorkerTask
+    void run(int begin, int end);
+
+private: // Data
+    TransformMap *m_map;
+};
+
+#endif // MIPLEVELSELECTOR_H
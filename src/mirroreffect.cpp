@@ -5,7 +5,20 @@
 #include "mirroreffect.h"
 
 #include <QDebug>
-#include <math.h>
+#include <QVarLengthArray>
+#include <stdlib.h>
+
+#include "animatedtransform.h"
+#include "bufferpool.h"
+#include "imagerotator.h"
+#include "proceduralwarp.h"
+#include "separablewarp.h"
+#include "sourcechangedetector.h"
+#include "sourcepyramid.h"
+#include "stagetimer.h"
+#include "tiletracker.h"
+#include "transformbuilder.h"
+#include "workerpool.h"
 
 
 /*!
@@ -18,16 +31,36 @@
   Constructor.
 */
 MirrorEffect::MirrorEffect()
-    : m_transMap(0),
+    : m_separableWarp(0),
+      m_animatedTransform(0),
+      m_approximateMap(false),
+      m_transformBuilder(0),
+      m_backgroundRebuild(false),
+      m_sourcePyramid(0),
+      m_mipmapping(false),
+      m_changeDetector(0),
+      m_tileTracker(0),
+      m_dirtyTiles(0),
+      m_changeDetection(false),
       m_selectedTransform(None),
       m_currentTransform(None),
       m_selectedTransformPower(0.0f),
       m_selectedTransformSize(0.0f),
       m_currentTransformPower(0.0f),
       m_currentTransformSize(0.0f),
-      m_highQuality(true)
+      m_highQuality(true),
+      m_threadCount(0),
+      m_engine(MapEngine),
+      m_ditherSeed((unsigned int)rand()),
+      m_bilinearLine(WarpKernels::bilinearLine()),
+      m_sourceFormat(SourceRGB32),
+      m_yuvCoefficients(YuvConverter::BT601),
+      m_sourceRotation(0),
+      m_lastRebuildTime(0)
 {
-
+    qDebug() << "MirrorEffect::MirrorEffect(): Using"
+             << WarpKernels::variantName(WarpKernels::bilinearVariant())
+             << "resampling kernel";
 }
 
 
@@ -36,18 +69,25 @@ MirrorEffect::MirrorEffect()
 */
 MirrorEffect::~MirrorEffect()
 {
+    delete m_transformBuilder;
+    delete m_sourcePyramid;
+    delete m_changeDetector;
+    delete m_tileTracker;
     recreateTransformMap(0, 0);
+    delete m_separableWarp;
+    delete m_animatedTransform;
 
-    // Set the source and the target data to zero to prevent unwanted deletion.
-    m_sourceProperties.m_data = 0;
-    m_targetProperties.m_data = 0;
+    // The source and the target belong to the caller, only the rotation
+    // buffer is owned.
+    BufferPool::instance()->release(m_sourcePropertiesRotated.m_data);
 }
 
 
 /*!
   Note that the source must be set before calling process().
   The 90degree rotation is customly added to support the harmattan's
-  wrongly oriented camera. It's not used for any other purpose.
+  wrongly oriented camera. It's not used for any other purpose. \a flipY
+  turns the (rotated) image upside down.
 */
 void MirrorEffect::setSource(unsigned int *data,
                              int width,
@@ -57,11 +97,19 @@ void MirrorEffect::setSource(unsigned int *data,
                              bool flipY /* = false */)
 {
     if (m_sourceProperties.m_width * m_sourceProperties.m_height != width * height) {
-        // Must be recreated
-        m_currentTransform = None;
+        // Must be recreated, the map's precision depends on the source size
+        recreateTransformMap(0, 0);
     }
 
-    if (!rotate90degrees) {
+    const int rotation = (rotate90degrees ? 1 : 0) | (flipY ? 2 : 0);
+
+    if (rotation != m_sourceRotation || m_sourceFormat != SourceRGB32)
+        forgetTiles();
+
+    m_sourceRotation = rotation;
+    m_sourceFormat = SourceRGB32;
+
+    if (!rotate90degrees && !flipY) {
             // When source can be used without the rotation, just directly
             // place the source image's data into the according capsule.
         m_sourceProperties.m_data = data;
@@ -70,57 +118,43 @@ void MirrorEffect::setSource(unsigned int *data,
         m_sourceProperties.m_pitch = pitch;
     }
     else {
-            // If source image need to be rotated, a temporary memory is
-            // required which wil contain the source image's data rotated
-            // 90 degrees. The rotation is done manually few lines below.
+            // If source image need to be rotated or flipped, a temporary
+            // memory is required which wil contain the source image's data
+            // rotated 90 degrees and/or upside down.
+        const int rotatedWidth = rotate90degrees ? height : width;
+        const int rotatedHeight = rotate90degrees ? width : height;
+
         if (!m_sourcePropertiesRotated.m_data
-                || m_sourcePropertiesRotated.m_width != height
-                || m_sourcePropertiesRotated.m_height != width)
+                || m_sourcePropertiesRotated.m_width != rotatedWidth
+                || m_sourcePropertiesRotated.m_height != rotatedHeight)
         {
                 // The temporary rotation buffer size is incorrect,
                 // It must be recreated.
             qDebug() << "MirrorEffect::setSource(): Recreating temporary rotated buffer...";
-            m_sourcePropertiesRotated.m_width = height;
-            m_sourcePropertiesRotated.m_height = width;
-
-            if (m_sourcePropertiesRotated.m_data)
-                delete[] m_sourcePropertiesRotated.m_data;
+            m_sourcePropertiesRotated.m_width = rotatedWidth;
+            m_sourcePropertiesRotated.m_height = rotatedHeight;
 
+            BufferPool *pool = BufferPool::instance();
+            pool->release(m_sourcePropertiesRotated.m_data);
             m_sourcePropertiesRotated.m_data =
-                    new unsigned int[height * width];
-        }
-
-            // This loop does the manual 90 degree rotation from sourceData, to
-            // sourceDataRotated either with Y-flip or without it.
-        for (int y = 0; y < height; y++) {
-            if (!flipY) {
-                unsigned int *t = m_sourcePropertiesRotated.m_data + (height - 1- y);
-                unsigned int *s = data + pitch * y;
-                unsigned int *s_target = s + width;
-
-                while (s != s_target) {
-                    *t = *s;
-                    s++;
-                    t += m_sourcePropertiesRotated.m_width;
-                }
-            }
-            else {
-                unsigned int *t =
-                        m_sourcePropertiesRotated.m_data + (height - 1 - y)
-                        + m_sourcePropertiesRotated.m_width
-                        * (m_sourcePropertiesRotated.m_height - 1);
-
-                unsigned int *s = data + pitch * y;
-                unsigned int *s_target = s + width;
-
-                while (s != s_target) {
-                    *t = *s;
-                    s++;
-                    t -= m_sourcePropertiesRotated.m_width;
-                }
+                    pool->acquireArray<unsigned int>(height * width);
+
+            if (!m_sourcePropertiesRotated.m_data) {
+                    // Out of memory, process() does nothing until a source
+                    // is set successfully
+                m_sourcePropertiesRotated.m_width = 0;
+                m_sourcePropertiesRotated.m_height = 0;
+                m_sourceProperties.m_data = 0;
+                return;
             }
         }
 
+            // The rotation is done in cache sized tiles, see ImageRotator.
+        ImageRotator::rotate(m_sourcePropertiesRotated.m_data,
+                             m_sourcePropertiesRotated.m_width,
+                             data, pitch, width, height,
+                             rotate90degrees, flipY);
+
         m_sourceProperties.m_data = m_sourcePropertiesRotated.m_data;
         m_sourceProperties.m_width = m_sourcePropertiesRotated.m_width;
         m_sourceProperties.m_pitch = m_sourcePropertiesRotated.m_width;
@@ -129,6 +163,109 @@ void MirrorEffect::setSource(unsigned int *data,
 }
 
 
+/*!
+  Sets a packed UYVY frame as the source. The transform map is addressed in
+  the same, possibly rotated, co-ordinates as with setSource(), but the
+  rotation and the flip are done while sampling: the map co-ordinates are
+  translated to the frame's own columns and rows by the steps of
+  m_uyvySource. Neither a converted nor a rotated copy of the frame is made.
+
+  \a width and \a height are the dimensions of the frame, \a data must stay
+  valid until process() returns.
+*/
+void MirrorEffect::setSourceUYVY(const unsigned char *data,
+                                 int width,
+                                 int height,
+                                 int bytesPerLine,
+                                 bool rotate90degrees /* = false */,
+                                 bool flipY /* = false */)
+{
+    if (m_sourceProperties.m_width * m_sourceProperties.m_height != width * height) {
+        // Must be recreated, the map's precision depends on the source size
+        recreateTransformMap(0, 0);
+    }
+
+    const int rotation = (rotate90degrees ? 1 : 0) | (flipY ? 2 : 0);
+
+    if (rotation != m_sourceRotation || m_sourceFormat != SourceUYVY)
+        forgetTiles();
+
+    m_sourceRotation = rotation;
+    m_sourceFormat = SourceUYVY;
+
+    m_uyvySource.m_data = data;
+    m_uyvySource.m_bytesPerLine = bytesPerLine;
+    m_uyvySource.m_matrix = &YuvConverter::matrix(m_yuvCoefficients);
+
+    if (!rotate90degrees) {
+        m_uyvySource.m_columnOrigin = 0;
+        m_uyvySource.m_columnStepX = 1;
+        m_uyvySource.m_columnStepY = 0;
+        m_uyvySource.m_rowOrigin = flipY ? height - 1 : 0;
+        m_uyvySource.m_rowStepX = 0;
+        m_uyvySource.m_rowStepY = flipY ? -1 : 1;
+
+        m_sourceProperties.m_width = width;
+        m_sourceProperties.m_height = height;
+    }
+    else {
+            // Same rotation as in setSource(): the map's x runs up the rows
+            // of the frame and y along the columns, backwards when flipped.
+        m_uyvySource.m_columnOrigin = flipY ? width - 1 : 0;
+        m_uyvySource.m_columnStepX = 0;
+        m_uyvySource.m_columnStepY = flipY ? -1 : 1;
+        m_uyvySource.m_rowOrigin = height - 1;
+        m_uyvySource.m_rowStepX = -1;
+        m_uyvySource.m_rowStepY = 0;
+
+        m_sourceProperties.m_width = height;
+        m_sourceProperties.m_height = width;
+    }
+
+        // The RGB32 source and the rotation buffer are not used
+    m_sourceProperties.m_data = 0;
+    m_sourceProperties.m_pitch = 0;
+
+    if (m_sourcePropertiesRotated.m_data) {
+        BufferPool::instance()->release(m_sourcePropertiesRotated.m_data);
+        m_sourcePropertiesRotated.m_data = 0;
+        m_sourcePropertiesRotated.m_width = 0;
+        m_sourcePropertiesRotated.m_height = 0;
+    }
+}
+
+
+/*!
+  Returns the format of the current source.
+*/
+MirrorEffect::SourceFormat MirrorEffect::sourceFormat() const
+{
+    return m_sourceFormat;
+}
+
+
+/*!
+  Selects the YUV to RGB conversion of a UYVY source. Takes effect from the
+  next setSourceUYVY().
+*/
+void MirrorEffect::setYuvCoefficients(YuvConverter::Coefficients coefficients)
+{
+    if (coefficients != m_yuvCoefficients)
+        forgetTiles();
+
+    m_yuvCoefficients = coefficients;
+}
+
+
+/*!
+  Returns the YUV to RGB conversion of a UYVY source.
+*/
+YuvConverter::Coefficients MirrorEffect::yuvCoefficients() const
+{
+    return m_yuvCoefficients;
+}
+
+
 /*!
   Straight forward setter function which places the target image's attributes
   into the according capsule targetImage of the MirrorEffect - class.
@@ -148,6 +285,9 @@ void MirrorEffect::setTarget(unsigned int *data, int width, int height, int pitc
         recreateTransformMap(0, 0);
     }
 
+    if (pitch != m_targetProperties.m_pitch)
+        forgetTiles();
+
     m_targetProperties.m_data = data;
     m_targetProperties.m_width = width;
     m_targetProperties.m_height = height;
@@ -155,11 +295,36 @@ void MirrorEffect::setTarget(unsigned int *data, int width, int height, int pitc
 }
 
 
+/*!
+  Limits process() to \a rect of the target. The pixels of the target
+  outside it keep the contents they have, so the caller must not show
+  them. An empty \a rect, e.g. for a mirror which is hidden, skips the
+  processing altogether, and a null one processes the whole target.
+*/
+void MirrorEffect::setExposedRect(const QRect &rect)
+{
+    m_exposedRect = rect;
+}
+
+
+/*!
+  Returns the part of the target process() is limited to, a null rect for
+  the whole target.
+*/
+QRect MirrorEffect::exposedRect() const
+{
+    return m_exposedRect;
+}
+
+
 /*!
   Enables/disables high quality setting.
 */
 void MirrorEffect::setHighQuality(bool highQuality)
 {
+    if (highQuality != m_highQuality)
+        forgetTiles();
+
     m_highQuality = highQuality;
 }
 
@@ -173,6 +338,138 @@ bool MirrorEffect::highQuality() const
 }
 
 
+/*!
+  Sets the number of threads process() splits the target rows to. 1 disables
+  the parallel processing, 0 uses all the threads of WorkerPool::instance().
+*/
+void MirrorEffect::setThreadCount(int threadCount)
+{
+    m_threadCount = threadCount;
+}
+
+
+/*!
+  Returns the thread count setting.
+*/
+int MirrorEffect::threadCount() const
+{
+    return m_threadCount;
+}
+
+
+/*!
+  Selects the engine evaluating the transforms. ProceduralEngine needs no
+  memory for the maps and changing the transform's power or size is free,
+  MapEngine is faster when the transform stays the same.
+*/
+void MirrorEffect::setEngine(Engine engine)
+{
+    m_engine = engine;
+}
+
+
+/*!
+  Returns the engine evaluating the transforms.
+*/
+MirrorEffect::Engine MirrorEffect::engine() const
+{
+    return m_engine;
+}
+
+
+/*!
+  Selects where the transform maps are built. By default process() builds
+  a map which isn't cached when it needs it, which delays the frame. With
+  \a background true the map is built by a TransformBuilder on a thread of
+  its own instead, and the frames are warped with the previous map until
+  it is ready. Without a previous map the transform is evaluated while
+  warping (see ProceduralWarp), and a chain of transforms is shown as the
+  source until its map is ready.
+*/
+void MirrorEffect::setBackgroundRebuild(bool background)
+{
+    m_backgroundRebuild = background;
+
+    if (!background && m_transformBuilder)
+        m_transformBuilder->cancel();
+}
+
+
+/*!
+  Returns true if the transform maps are built in the background.
+*/
+bool MirrorEffect::backgroundRebuild() const
+{
+    return m_backgroundRebuild;
+}
+
+
+/*!
+  Enables the sampling from a SourcePyramid when \a mipmapping is true.
+  Where the map shrinks the source by two or more, a target pixel is
+  sampled from a level in which a pixel covers about as much of the source
+  as the target pixel does, instead of from the source, which aliases.
+  Building the levels costs about a third of a pass over the source per
+  frame, and is skipped when the map doesn't shrink the source. The maps
+  blended while animating (see AnimatedTransform), the transforms with
+  independent axes (see SeparableWarp) and ProceduralEngine always sample
+  the source.
+*/
+void MirrorEffect::setMipmapping(bool mipmapping)
+{
+    if (mipmapping != m_mipmapping)
+        forgetTiles();
+
+    m_mipmapping = mipmapping;
+
+    if (!mipmapping && m_sourcePyramid)
+        m_sourcePyramid->clear();
+}
+
+
+/*!
+  Returns true if the shrunk parts of the source are sampled from a
+  SourcePyramid.
+*/
+bool MirrorEffect::mipmapping() const
+{
+    return m_mipmapping;
+}
+
+
+/*!
+  Enables/disables the change detection. With it a frame of the map engine
+  only warps the tiles of the target whose source blocks have changed, and
+  nothing at all for a static scene. The rest of the target is left as it
+  was written by an earlier frame, so a target must only be written by
+  process(). A few targets used in turn, like triple buffers, are tracked
+  separately.
+
+  The separable and the procedural warps, and the maps blended while the
+  transform is animated, always warp the whole target.
+*/
+void MirrorEffect::setChangeDetection(bool changeDetection)
+{
+    m_changeDetection = changeDetection;
+
+    if (!changeDetection) {
+        delete m_changeDetector;
+        m_changeDetector = 0;
+        delete m_tileTracker;
+        m_tileTracker = 0;
+    }
+}
+
+
+/*!
+  Returns true if the change detection is enabled.
+*/
+bool MirrorEffect::changeDetection() const
+{
+    return m_changeDetection;
+}
+
+
 /*!
   Sets the mirror transform properties.
 */
@@ -183,6 +480,23 @@ void MirrorEffect::setMirrorTransform(MirrorTransform transform,
     m_selectedTransform = transform;
     m_selectedTransformPower = power;
     m_selectedTransformSize = size;
+    m_selectedLayers.clear();
+}
+
+
+/*!
+  Composes \a transform with \a power and \a size on top of the transforms
+  set: it distorts the image they produce, as if the target were warped
+  again. The transforms are composed into a single map when it is built
+  (see TransformComposer), so a chain costs a single warp per frame and is
+  cached like a single transform. A chain is always warped with a map,
+  whichever the engine.
+*/
+void MirrorEffect::addMirrorTransform(MirrorTransform transform,
+                                      float power /* = 1.0f */,
+                                      float size /* = 1.0f */)
+{
+    m_selectedLayers.append(TransformLayer(transform, power, size));
 }
 
 
@@ -193,22 +507,81 @@ void MirrorEffect::setMirrorTransform(MirrorTransform transform,
 bool MirrorEffect::process()
 {
     // Don't continue if source or target is not set
-    if (!m_sourceProperties.m_data || !m_targetProperties.m_data)
+    const bool sourceSet = m_sourceFormat == SourceUYVY ? m_uyvySource.m_data != 0
+                                                        : m_sourceProperties.m_data != 0;
+
+    if (!sourceSet || !m_targetProperties.m_data)
         return false;
 
-    if (m_transMap == 0) {
-        qDebug() << "MirrorEffect::process(): Transmap zeroed, recreate.";
-        recreateTransformMap(m_targetProperties.m_width,
-                             m_targetProperties.m_height);
+    m_lastRebuildTime = 0;
+
+    const QRect target(0, 0, m_targetProperties.m_width, m_targetProperties.m_height);
+    m_processRect = m_exposedRect.isNull() ? target : (m_exposedRect & target);
+
+        // Nothing of the target is seen
+    if (m_processRect.isEmpty())
+        return true;
+
+    const bool composed = !m_selectedLayers.isEmpty();
+
+    if (m_sourceFormat == SourceRGB32 && !composed
+            && SeparableWarp::isSeparable(m_selectedTransform))
+    {
+            // A column and a row table do instead of a map, whichever the
+            // engine. Release the map of the previous transform.
+        if (m_transMap)
+            recreateTransformMap(0, 0);
+
+        forgetTiles();
+
+        if (!m_separableWarp)
+            m_separableWarp = new SeparableWarp;
+
+        StageTimer timer;
+        m_separableWarp->create(m_selectedTransform,
+                                m_selectedTransformPower,
+                                m_selectedTransformSize,
+                                m_sourceProperties.m_width,
+                                m_sourceProperties.m_height,
+                                m_targetProperties.m_width,
+                                m_targetProperties.m_height);
+        m_lastRebuildTime = timer.nsecsElapsed();
+
+        m_separableWarp->process(m_targetProperties.m_data,
+                                 m_targetProperties.m_pitch,
+                                 m_sourceProperties.m_data,
+                                 m_sourceProperties.m_pitch,
+                                 m_processRect,
+                                 m_highQuality,
+                                 m_threadCount);
+        return true;
+    }
+
+    if (m_separableWarp)
+        m_separableWarp->clear();
+
+    if (m_engine == ProceduralEngine && !composed) {
+            // No map is needed, release the one of the map engine
+        if (m_transMap)
+            recreateTransformMap(0, 0);
+
+        forgetTiles();
+
+        processProcedural(m_selectedTransform,
+                          m_selectedTransformPower,
+                          m_selectedTransformSize);
+        return true;
     }
 
-    // The transform needs to be (re)created
-    if (m_currentTransform != m_selectedTransform
+    // The transform needs to be (re)created, or the exact map generated
+    // once an animation has settled
+    if (!m_transMap
+            || m_approximateMap
+            || m_currentTransform != m_selectedTransform
             || m_currentTransformPower != m_selectedTransformPower
-            || m_currentTransformSize != m_selectedTransformSize)
+            || m_currentTransformSize != m_selectedTransformSize
+            || m_currentLayers != m_selectedLayers)
     {
-        qDebug() << "MirrorEffect::process(): Recreating transform...";
-
         /*
         // Uncomment this block to enable the full debug printing.
         if (m_currentTransform != m_selectedTransform) qDebug() << "Transform changed";
@@ -216,395 +589,516 @@ bool MirrorEffect::process()
         if (m_currentTransformSize != m_selectedTransformSize) qDebug() << "Size changed";
         */
 
-        recreateTransform(m_selectedTransform,
-                          m_selectedTransformPower,
-                          m_selectedTransformSize);
+        const TransformMapKey key = transformKey(m_selectedTransform,
+                                                 m_selectedTransformPower,
+                                                 m_selectedTransformSize,
+                                                 m_selectedLayers);
+        TransformMapCache::MapPointer map;
+
+            // A map completed in the background is taken at the start of a
+            // frame, never while warping
+        if (m_transformBuilder)
+            map = m_transformBuilder->takeResult(key);
+
+        if (!map)
+            map = TransformMapCache::instance()->find(key);
+
+        const bool animated = m_currentTransform == m_selectedTransform
+                && m_selectedTransform != None
+                && !composed && m_currentLayers.isEmpty()
+                && (m_currentTransformPower != m_selectedTransformPower
+                    || m_currentTransformSize != m_selectedTransformSize);
+
+        if (!map && animated && blendTransformMap()) {
+                // The parameters are changing, blended from the key fields
+                // in a fraction of the time of generating the map
+            m_approximateMap = true;
+        }
+        else if (map) {
+            qDebug() << "MirrorEffect::process(): Using a cached transform.";
+            m_transMap = map;
+            m_currentTransform = m_selectedTransform;
+            m_currentTransformPower = m_selectedTransformPower;
+            m_currentTransformSize = m_selectedTransformSize;
+            m_currentLayers = m_selectedLayers;
+            m_approximateMap = false;
+        }
+        else {
+            TransformBuilder::Request request;
+            request.m_key = key;
+            request.m_transform = m_selectedTransform;
+            request.m_power = m_selectedTransformPower;
+            request.m_size = m_selectedTransformSize;
+            request.m_layers = m_selectedLayers;
+
+            if (m_backgroundRebuild) {
+                    // Built on the builder's thread, the frames go on with
+                    // the previous map meanwhile
+                if (!m_transformBuilder)
+                    m_transformBuilder = new TransformBuilder;
+
+                m_transformBuilder->request(request);
+
+                if (!m_transMap) {
+                    forgetTiles();
+
+                    const bool single = m_selectedLayers.isEmpty();
+                    processProcedural(single ? m_selectedTransform : None,
+                                      single ? m_selectedTransformPower : 1.0f,
+                                      single ? m_selectedTransformSize : 1.0f);
+                    return true;
+                }
+            }
+            else {
+                StageTimer timer;
+                recreateTransformMap(0, 0);
+                m_transMap = TransformBuilder::build(request, m_threadCount);
+
+                if (!m_transMap)
+                    return false;
+
+                m_currentTransform = m_selectedTransform;
+                m_currentTransformPower = m_selectedTransformPower;
+                m_currentTransformSize = m_selectedTransformSize;
+                m_currentLayers = m_selectedLayers;
+                m_lastRebuildTime = timer.nsecsElapsed();
+                m_approximateMap = false;
+            }
+        }
     }
 
-    for (int y = 0; y < m_targetProperties.m_height; y++) {
-        if (!m_highQuality) {
-            processLine(m_targetProperties.m_data + m_targetProperties.m_pitch * y,
-                        m_targetProperties.m_data + m_targetProperties.m_pitch * y
-                        + m_targetProperties.m_width,
-                        m_transMap + m_targetProperties.m_width * y * 3);
+        // A static scene needs no warp at all, not even the pyramid
+    if (!trackChanges())
+        return true;
+
+    const int maxLevel = m_mipmapping ? m_transMap->maxLevel() : 0;
+
+    if (maxLevel > 0) {
+        if (!m_sourcePyramid)
+            m_sourcePyramid = new SourcePyramid;
+
+        if (m_sourceFormat == SourceUYVY) {
+            m_sourcePyramid->build(m_uyvySource,
+                                   m_sourceProperties.m_width,
+                                   m_sourceProperties.m_height,
+                                   maxLevel, m_threadCount);
         }
         else {
-            processLineHQ(m_targetProperties.m_data + m_targetProperties.m_pitch * y,
-                          m_targetProperties.m_data + m_targetProperties.m_pitch * y
-                          + m_targetProperties.m_width,
-                          m_transMap + m_targetProperties.m_width * y * 3);
+            m_sourcePyramid->build(m_sourceProperties.m_data,
+                                   m_sourceProperties.m_width,
+                                   m_sourceProperties.m_height,
+                                   m_sourceProperties.m_pitch,
+                                   maxLevel, m_threadCount);
         }
     }
+    else if (m_sourcePyramid) {
+        m_sourcePyramid->clear();
+    }
+
+        // Every row only reads the map and the source and writes its own
+        // target row, so the rows can be processed in any order.
+    WorkerMemberTask<MirrorEffect> task(this, &MirrorEffect::processRows);
+    WorkerPool::instance()->runBands(&task, m_processRect.height(), m_threadCount, 8);
 
     return true;
 }
 
 
 /*!
-  Sample ("copy") the source image contained by m_sourceProperties to the row beginning at
-  unsigned int *t and ending at unsigned int *t_target. Copy source pixels from the coordinates
-  defined by srcCoords[0] and scrCoords[1] (18/14 fixedpoint).
-
-  The >>14 (same as dividing the number with 16384) used by the function takes only the real-part
-  of the fixed-point number and uses it directly.
+  Returns the time the last process() spent generating the transform map,
+  or the tables of SeparableWarp, in nanoseconds. 0 if the map was reused
+  or found in TransformMapCache, or if it is being built in the background
+  (see setBackgroundRebuild()). Mapping a map of TransformMapStore counts
+  as a (short) rebuild.
 */
-void MirrorEffect::processLine(unsigned int *t,
-                               unsigned int *t_target,
-                               int *srcCoords)
-{
-    unsigned int *sourceData = m_sourceProperties.m_data;
-    int sourcePropertiesPitch = m_sourceProperties.m_pitch;
-    while (t != t_target) {
-        *t = sourceData[(srcCoords[1] >> 14)
-                         * sourcePropertiesPitch
-                         + (srcCoords[0] >> 14)];
-        t++;
-        srcCoords += 3;
-    }
+qint64 MirrorEffect::lastRebuildTime() const
+{
+    return m_lastRebuildTime;
 }
 
 
 /*!
-  This is HIGHLY optimized function for doing the same task as function above but with full,
-  4-component linear resampling (with one bit accuracylost).
+  Processes the rows from \a begin to \a end (exclusive) of m_processRect,
+  the columns of m_processRect only. With m_dirtyTiles only the runs of
+  the tiles marked in it are processed.
 */
-void MirrorEffect::processLineHQ(unsigned int *t,
-                                 unsigned int *t_target,
-                                 int *srcCoords)
-{
-    int x(0);
-    int y(0);
-    unsigned int temp(0);
-    unsigned int mask(0);
-    unsigned int *pos(0);
-
-    unsigned int *sourceData = m_sourceProperties.m_data;
-    unsigned int sourceDataPitch = m_sourceProperties.m_pitch;
-
-    while (t != t_target) {
-            // Place the source x and y coordinates (18/14 - fixedpoint) to the temporary attributes
-        x = srcCoords[0];
-        y = srcCoords[1];
-
-            // Seek the initial place of the source image by using only real-parts of the source
-            // coordinates. sourceImage[ pitch * (y/16384) + (x/16383) ] is the startingpoint.
-        pos = sourceData + sourceDataPitch
-                * (y >> 14) + (x >> 14);
-
-            // Mask only the decimal part of the source coordinate and round it to 7-bits.
-            // After this the source coordinate "fractions" are between 0-and 127
-            // Don't think of them as coordinates anymore, only fractions of
-            // coordinates.
-        x = ((x & 16383) >> 7);
-        y = ((y & 16383) >> 7);
-
-            // Temp is used as negative x just to limit the number of calculations
-            // it should be named "negx", but we don't want to add any more values
-            // into the stack to make sure it doesn't end.
-        temp = 128 - x;
-
-        /*
-           The basic one dimensional interpolation goes:
-           resampled_pixel = (pixelonleft*x + pixelonright*negx ) / 128
-
-           When adding second component (y), we must do second x interpolation, and
-           interpolate between those two with y:
+void MirrorEffect::processRows(int begin, int end)
+{
+    const int left = m_processRect.left();
+    const int right = left + m_processRect.width();
 
-           toppixel = (pixelontopleft*x + pixelontopright*negx) / 128;
-           bottompixel = (pixelonbottomleft*x + pixelonbottomright*negx) / 128;
-           finalpixel = toppixel*y + bottompixel*negy) / 128
+    for (int y = m_processRect.top() + begin; y < m_processRect.top() + end; y++) {
+        unsigned int *row = m_targetProperties.m_data + m_targetProperties.m_pitch * y;
+        const unsigned char *dirty = m_dirtyTiles
+                ? m_dirtyTiles + (y >> TileTracker::TileShift) * m_tileTracker->tilesX()
+                : 0;
+        int x = left;
 
-           Obviously, this must be done to each of the components R,G,B and A to
-           get the actual colour.
+        while (x < right) {
+            int runEnd = right;
 
-           The following code interpolates between four 4component RGBA-pixels
-           pos[0], pos[1], pos[pitch] and pos[pitch+1] with x,y,negx and negy.
+            if (dirty) {
+                while (x < right && !dirty[x >> TileTracker::TileShift])
+                    x = ((x >> TileTracker::TileShift) + 1) << TileTracker::TileShift;
 
-           The reason we are using 7bit interpolation is that we can combine
-           two of the colour components with the same calculation without getting
-           any overflows. For example:
+                runEnd = x;
 
-           pixel = (RGBAPixel & 0x00FF00FF) leaves only red and green components in
-           the pixel. When we multiply this value with any 7bit number (from 0 to 127)
-           the resulting value will not be above 0xFF00FF00. This means than when
-           shifting the result back (dividing it with 128), we have the multiplied
-           values directly at the same places (with some trash possibly from the
-           multiplications but we can get rid of those easily with a simple AND).
+                while (runEnd < right && dirty[runEnd >> TileTracker::TileShift])
+                    runEnd = ((runEnd >> TileTracker::TileShift) + 1) << TileTracker::TileShift;
 
+                runEnd = qMin(runEnd, right);
 
-           So when doing,
+                if (x >= runEnd)
+                    break;
+            }
 
-           pixel = ( ( (RGBAPixel & 0x00FF00FF) * mul ) / 128 ) & 0x00FF00FF
+            if (!m_highQuality)
+                processLine(row + x, row + runEnd, y, x);
+            else
+                processLineHQ(row + x, row + runEnd, y, x);
 
-           we can multiply 2 components at the same time (at this example, those would
-           be red and green).
+            x = runEnd;
+        }
+    }
+}
 
-           Obviously, all of the divisions are replaced with according shift-operands
-           to get good performance.
 
-           The resulting pixel of the resample will be place directly into the target
-           at 't'.
+/*!
+  Sample ("copy") the source image contained by m_sourceProperties to the row beginning at
+  unsigned int *t and ending at unsigned int *t_target. Copy source pixels from the coordinates
+  defined by the row mapRow of the transform map, from the column mapColumn on, using only the
+  real-parts of them.
+*/
+void MirrorEffect::processLine(unsigned int *t,
+                               unsigned int *t_target,
+                               int mapRow,
+                               int mapColumn)
+{
+    const unsigned char *levels = m_transMap->levelRow(mapRow);
+
+    if (levels && m_sourcePyramid && m_sourcePyramid->maxLevel() > 0) {
+        sampleLevelLine(t, t_target,
+                        m_transMap->xRow(mapRow) + mapColumn,
+                        m_transMap->yRow(mapRow) + mapColumn,
+                        0,
+                        levels + mapColumn,
+                        m_transMap->fracBits(),
+                        false);
+        return;
+    }
 
-        */
+    sampleLine(t, t_target,
+               m_transMap->xRow(mapRow) + mapColumn,
+               m_transMap->yRow(mapRow) + mapColumn,
+               0,
+               m_transMap->fracBits(),
+               false);
+}
 
-        *t = ((((((((((pos[0] & 0x00FF00FF) * (temp)) + ((pos[1] & 0x00FF00FF)
-             * (x))) >> 7) & 0x00FF00FF) * (128 - y))
-             + ((((((pos[sourceDataPitch] & 0x00FF00FF) * (temp))
-             + ((pos[sourceDataPitch] & 0x00FF00FF) * (x))) >> 7)
-             & 0x00FF00FF) * y)) >> 7) & 0x00FF00FF) | (((((((((((pos[0] >> 8)
-             & 0x00FF00FF) * (temp)) + (((pos[1] >> 8) & 0x00FF00FF) * (x)))
-             >> 7) & 0x00FF00FF) * (128 - y)) +
-             (((((((pos[sourceDataPitch] >> 8) & 0x00FF00FF)
-             * (temp)) + (((pos[sourceDataPitch + 1] >> 8)
-             & 0x00FF00FF) * (x))) >> 7) & 0x00FF00FF) * y)) >> 7)
-             & 0x00FF00FF) << 8));
-
-        // In the definition of srcCoords earlier, it was said that the third value
-        // Of the srcCoords is a "shine"-value which should be added into the final,
-        // resampled colour.
-        // The following code creates RGBA (shine, shine, shine, 0) value,
-        // and adds it into the pixel at 't' using common temporary
-        // attributes temp and mask for the purpose.
-        // If you like playing with bits, think of the section with
-        // paper and you will see it works ;) Only with one bit
-        // of accuracylost.
-        // This is the fastest way of adding two RGB - pixels together
-        // that i'm aware of.
-        if (srcCoords[2] > 0) {
-            temp = ((*t & 0xFEFEFEFE) >> 1)
-                + (((srcCoords[2] | (srcCoords[2] << 8)
-                     | (srcCoords[2] << 16)) & 0xFEFEFEFE) >> 1);
-            mask = (temp & 0x80808080);
-            temp |= (mask - (mask >> 7));
-            *t = ((temp & 0x7F7F7F7F) << 1);
-        }
 
-            // This pixel of the row is processed, move on to the next one.
-        t++;
-        srcCoords += 3;
+/*!
+  Does the same task as function above but with full, 4-component linear
+  resampling (with one bit accuracylost) and the shine of the map added.
+*/
+void MirrorEffect::processLineHQ(unsigned int *t,
+                                 unsigned int *t_target,
+                                 int mapRow,
+                                 int mapColumn)
+{
+    const unsigned char *levels = m_transMap->levelRow(mapRow);
+    const unsigned char *shine = m_transMap->shineRow(mapRow);
+
+    if (shine)
+        shine += mapColumn;
+
+    if (levels && m_sourcePyramid && m_sourcePyramid->maxLevel() > 0) {
+        sampleLevelLine(t, t_target,
+                        m_transMap->xRow(mapRow) + mapColumn,
+                        m_transMap->yRow(mapRow) + mapColumn,
+                        shine,
+                        levels + mapColumn,
+                        m_transMap->fracBits(),
+                        true);
+        return;
     }
+
+    sampleLine(t, t_target,
+               m_transMap->xRow(mapRow) + mapColumn,
+               m_transMap->yRow(mapRow) + mapColumn,
+               shine,
+               m_transMap->fracBits(),
+               true);
 }
 
 
 /*!
-  (Re)create the transform of the (member srcCoords) with provided attributes.
-  Function places the source coordinates from where the target pixel should be
-  taken from the sourceimage. And the third "shine"-value as well.
-
-  Note, this method is not designed for real-time use. The user should make sure
-  it is not used very often. (MirrorHouse uses it only when the mirror or the camera
-  changes).
+  Resamples the row from t to t_target. The linear resampling is done by the
+  fastest kernel available for this CPU, see WarpKernels. A UYVY source is
+  interpolated in YUV instead.
 */
-void MirrorEffect::recreateTransform(MirrorTransform transform, float power, float size)
+void MirrorEffect::sampleLine(unsigned int *t,
+                              unsigned int *t_target,
+                              const unsigned short *srcX,
+                              const unsigned short *srcY,
+                              const unsigned char *shine,
+                              int fracBits,
+                              bool highQuality) const
 {
-    qDebug() << "MirrorEffect::recreateTransform()";
+    if (m_sourceFormat == SourceUYVY) {
+        if (highQuality) {
+            WarpKernels::uyvyBilinearLine(t, t_target, srcX, srcY, shine,
+                                          fracBits, m_uyvySource);
+        }
+        else {
+            WarpKernels::uyvyNearestLine(t, t_target, srcX, srcY,
+                                         fracBits, m_uyvySource);
+        }
+    }
+    else if (highQuality) {
+        m_bilinearLine(t, t_target, srcX, srcY, shine, fracBits,
+                       m_sourceProperties.m_data, m_sourceProperties.m_pitch);
+    }
+    else {
+        WarpKernels::nearestLine(t, t_target, srcX, srcY, fracBits,
+                                 m_sourceProperties.m_data,
+                                 m_sourceProperties.m_pitch);
+    }
+}
 
-    float fTemp;
-    float a;
-    float fx;
-    float fy;
-    float fz;
-    float nx;
-    float ny;
-    float nz;
 
-    int xInc = ((m_sourceProperties.m_width) << 14) / m_targetProperties.m_width;
-    int yInc = ((m_sourceProperties.m_height) << 14) / m_targetProperties.m_height;
-    int maxX = ((m_sourceProperties.m_width-1) << 14) - 1;
-    int maxY = ((m_sourceProperties.m_height-1) << 14) - 1;
+/*!
+  Resamples the row from \a t to \a t_target like sampleLine(), but each
+  pixel from the level of m_sourcePyramid in \a levels. The row is split
+  into the runs of pixels at the same level, and the source co-ordinates
+  of a run are scaled to its level, so the same kernels sample every
+  level. The levels missing from the pyramid are replaced by its highest
+  one.
+*/
+void MirrorEffect::sampleLevelLine(unsigned int *t,
+                                   unsigned int *t_target,
+                                   const unsigned short *srcX,
+                                   const unsigned short *srcY,
+                                   const unsigned char *shine,
+                                   const unsigned char *levels,
+                                   int fracBits,
+                                   bool highQuality) const
+{
+        // The co-ordinates refer to the pixel centers of a level, which are
+        // half a pixel off the ones of the source
+    const int half = fracBits > 0 ? 1 << (fracBits - 1) : 0;
+    const int maxLevel = m_sourcePyramid->maxLevel();
+    QVarLengthArray<unsigned short, 1024> levelX;
+    QVarLengthArray<unsigned short, 1024> levelY;
 
-    float pixelMul =
-            (float)(m_sourceProperties.m_width
-                    + (float)m_sourceProperties.m_height)
-            * 2000.0f / m_selectedTransformSize;
+    while (t < t_target) {
+        int count = 1;
 
-    int *t = m_transMap;
-    int sy = 0;
+        while (t + count < t_target && levels[count] == levels[0])
+            count++;
 
-    for (int y = 0; y < m_targetProperties.m_height; y++) {
-        int sx = 0;
+        const int level = levels[0] < maxLevel ? levels[0] : maxLevel;
 
-        for (int x = 0; x < m_targetProperties.m_width; x++) {
-            switch (transform) {
-            default:
-            case None: {
-                fx = 0.0f;
-                fy = 0.0f;
-                break;
-            }
-            case Dither: {
-                fx = -1.0f + (float)(rand() & 255) / 128.0f;
-                fy = -1.0f + (float)(rand() & 255) / 128.0f;
-                fx *= power;
-                fy *= power;
-                break;
-            }
-            case Tile: {
-                fx = ((float)x / (float)m_targetProperties.m_width);
-                fy = ((float)y / (float)m_targetProperties.m_height);
-                fx *= size;
-                fy *= size;
-                fx -= floor(fx);
-                fy -= floor(fy);
-                fx = (fx - 0.5f) * 2.0f;
-                fy = (fy - 0.5f) * 2.0f;
-                fx *= power;
-                fy *= power;
-                break;
-            }
-            case Spike: {
-                fx = ((float)x / (float)m_targetProperties.m_width - 0.5f) * 2.0f;
-                fy = ((float)y / (float)m_targetProperties.m_height - 0.5f) * 2.0f;
-                fTemp = sqrtf(fx * fx + fy * fy);
-                fx /= fTemp;
-                fy /= fTemp;
-                fTemp = (1.0f - fTemp);
-
-                if (fTemp < 0.0f)
-                    fTemp = 0.0f;
-
-                fTemp *= power;
-                fx *= fTemp;
-                fy *= fTemp;
-                break;
-            }
-            case Ripple: {
-                fx = ((float)x / (float)m_targetProperties.m_width - 0.5f) * 2.0f;
-                fy = ((float)y / (float)m_targetProperties.m_height - 0.5f) * 2.0f;
-                fTemp = sqrtf(fx * fx + fy * fy);
-                fx /= fTemp;
-                fy /= fTemp;
-                fx = fx * sinf(fTemp * size * 3.14159f * 2.0f) * power;
-                fy = fy * sinf(fTemp * size * 3.14159f * 2.0f) * power;
-                break;
-            }
-            case Spiral: {
-                fx = ((float)x / (float)m_targetProperties.m_width - 0.5f) * 2.0f;
-                fy = ((float)y / (float)m_targetProperties.m_height - 0.5f) * 2.0f;
-                fTemp = sqrtf(fx * fx + fy * fy);
-                a = atan2(fy, fx);
-                a += (sqrtf(2.0f) - fTemp) * 20.0f * power;
-                fx = -fx/4 + sinf(a) * fTemp;
-                fy = -fy/4 + cosf(a) * fTemp;
-                fx *= size;
-                fy *= size;
-                break;
-            }
-            case Bubbles: {
-                fx = ((float)x / (float)m_targetProperties.m_width - 0.5f) * 2.0f;
-                fy = ((float)y / (float)m_targetProperties.m_height - 0.5f) * 2.0f;
-                fTemp = sqrtf(fx * fx + fy * fy);
-                fTemp *= fTemp * fTemp;
-                fTemp = 1.0f - fTemp;
-
-                if (fTemp < 0.0f)
-                    fTemp = 0.0f;
-
-                fx = (sinf((float)x / (float)m_targetProperties.m_width
-                           * 3.14159f * 2.0f * m_selectedTransformSize)) * power;
-                fy = (sinf((float)y/(float)m_targetProperties.m_height
-                           * 3.14159f * 2.0f * m_selectedTransformSize)) * power;
-                break;
-            }
-            case InvBubbles: {
-                fx = ((float)x / (float)m_targetProperties.m_width - 0.5f) * 2.0f;
-                fy = ((float)y / (float)m_targetProperties.m_height - 0.5f) * 2.0f;
-                // fTemp = (sqrtf(fx * fx + fy * fy) / sqrtf(2.0f));
-                fTemp = sqrtf(fx * fx + fy * fy);
-                fTemp *= fTemp * fTemp;
-                fTemp = 1.0f - fTemp;
-
-                if (fTemp < 0.0f)
-                    fTemp = 0.0f;
-
-                fx = (cosf((float)x / (float)m_targetProperties.m_width
-                           * 3.14159f * 2.0f * m_selectedTransformSize)) * power;
-                fy = (cosf((float)y / (float)m_targetProperties.m_height
-                           * 3.14159f * 2.0f * m_selectedTransformSize)) * power;
-                fx *= fTemp;
-                fy *= fTemp;
-                break;
+        if (level == 0) {
+            sampleLine(t, t + count, srcX, srcY, shine, fracBits, highQuality);
+        }
+        else {
+                // Kept off the last column and row, like the map keeps
+                // them off the ones of the source
+            const int maxX = ((m_sourcePyramid->levelWidth(level) - 1) << fracBits) - 1;
+            const int maxY = ((m_sourcePyramid->levelHeight(level) - 1) << fracBits) - 1;
+            levelX.resize(count);
+            levelY.resize(count);
+
+            for (int i = 0; i < count; i++) {
+                const int x = ((srcX[i] + half) >> level) - half;
+                const int y = ((srcY[i] + half) >> level) - half;
+                levelX[i] = x < 0 ? 0 : (x > maxX ? maxX : x);
+                levelY[i] = y < 0 ? 0 : (y > maxY ? maxY : y);
             }
-            case VerticalWave: {
-                fx = 0.0f;
-                fy = (sinf((float)y / (float)m_targetProperties.m_height
-                           * 3.14159f * 2.0f * m_selectedTransformSize)) * power;
-                break;
+
+            if (highQuality) {
+                m_bilinearLine(t, t + count, levelX.constData(), levelY.constData(),
+                               shine, fracBits,
+                               m_sourcePyramid->levelData(level),
+                               m_sourcePyramid->levelPitch(level));
             }
-            case HorizontalWave: {
-                fx = (sinf((float)x / (float)m_targetProperties.m_width
-                           * 3.14159f * 2.0f * m_selectedTransformSize)) * power;
-                fy = 0.0f;
-                break;
+            else {
+                WarpKernels::nearestLine(t, t + count,
+                                         levelX.constData(), levelY.constData(),
+                                         fracBits,
+                                         m_sourcePyramid->levelData(level),
+                                         m_sourcePyramid->levelPitch(level));
             }
-            } // switch(transform)
+        }
+
+        t += count;
+        srcX += count;
+        srcY += count;
+        levels += count;
 
-            fz = sqrtf(3.0f - (fx * fx + fy * fy));
+        if (shine)
+            shine += count;
+    }
+}
 
-            // Calculate reflection mul TODO: Calculate WHAT???
-            fTemp = sqrtf(fx * fx + fy * fy + fz * fz);
-            nx = fx / fTemp;
-            ny = fy / fTemp;
-            nz = fz / fTemp;
 
-            fTemp = nx * -0.57f + ny * -0.57f + nz * 0.57f;
+/*!
+  Sets m_dirtyTiles for the frame. Without the change detection, or with a
+  blended map which changes on every frame, every tile is warped. Returns
+  false if no tile of m_processRect has to be warped.
+*/
+bool MirrorEffect::trackChanges()
+{
+    m_dirtyTiles = 0;
+
+    if (!m_changeDetection || m_approximateMap) {
+        forgetTiles();
+        return true;
+    }
 
-            fTemp = fTemp - 0.5f;
-            fTemp *= 2.0f;
+    if (!m_changeDetector) {
+        m_changeDetector = new SourceChangeDetector;
+        m_tileTracker = new TileTracker;
+    }
 
-            if (fTemp < 0.0f)
-                fTemp = 0.0f;
+    if (m_sourceFormat == SourceUYVY) {
+        m_changeDetector->detect(m_uyvySource,
+                                 m_sourceProperties.m_width,
+                                 m_sourceProperties.m_height,
+                                 m_threadCount);
+    }
+    else {
+        m_changeDetector->detect(m_sourceProperties.m_data,
+                                 m_sourceProperties.m_width,
+                                 m_sourceProperties.m_height,
+                                 m_sourceProperties.m_pitch,
+                                 m_threadCount);
+    }
 
-            fTemp = fTemp * fTemp * fTemp;
+    m_tileTracker->setMap(m_transMap,
+                          m_sourceProperties.m_width,
+                          m_sourceProperties.m_height);
+    m_dirtyTiles = m_tileTracker->update(m_changeDetector->changedBlocks(),
+                                         m_targetProperties.m_data,
+                                         m_processRect);
 
-            if (fTemp > 1.0f)
-                fTemp = 1.0f;
+    return m_tileTracker->dirtyCount() > 0;
+}
 
 
-            t[2] = (int)(fTemp * 100.0f);
+/*!
+  Forgets the tiles written into the targets, e.g. when the resampling
+  changes, so that the next frame warps them all.
+*/
+void MirrorEffect::forgetTiles()
+{
+    if (m_tileTracker)
+        m_tileTracker->reset();
+}
 
-            // Place the transform co-ordinate into the array
-            t[0] = sx + (int)(fx * pixelMul);
-            t[1] = sy + (int)(fy * pixelMul);
 
-            if (t[0] < 0)
-                t[0] = 0;
+/*!
+  Warps the source into the target with \a transform at \a power and
+  \a size evaluated while warping, without a map.
+*/
+void MirrorEffect::processProcedural(MirrorTransform transform, float power, float size)
+{
+    ProceduralWarp warp(transform, power, size, m_ditherSeed);
+    warp.process(this,
+                 m_targetProperties.m_data,
+                 m_targetProperties.m_width,
+                 m_targetProperties.m_height,
+                 m_targetProperties.m_pitch,
+                 m_sourceProperties.m_width,
+                 m_sourceProperties.m_height,
+                 m_processRect,
+                 m_highQuality,
+                 m_threadCount);
+}
 
-            if (t[1] < 0)
-                t[1] = 0;
 
-            if (t[0] > maxX)
-                t[0] = maxX;
+/*!
+  Fills a new map with the selected transform blended by AnimatedTransform
+  from the displacement fields of nearby parameters. Used while the power
+  or the size changes from frame to frame: only the key fields missing are
+  generated, and their generation is the only time counted as a rebuild.
+  Returns false if the map couldn't be blended.
+*/
+bool MirrorEffect::blendTransformMap()
+{
+    if (!m_animatedTransform)
+        m_animatedTransform = new AnimatedTransform;
 
-            if (t[1] > maxY)
-                t[1] = maxY;
+    recreateTransformMap(m_targetProperties.m_width, m_targetProperties.m_height);
 
-            sx += xInc;
-            t += 3;
-        }
+    qint64 generationTime = 0;
 
-        sy += yInc;
+    if (!m_animatedTransform->blend(m_transMap.data(),
+                                    m_selectedTransform,
+                                    m_selectedTransformPower,
+                                    m_selectedTransformSize,
+                                    m_sourceProperties.m_width,
+                                    m_sourceProperties.m_height,
+                                    m_threadCount,
+                                    &generationTime))
+    {
+        recreateTransformMap(0, 0);
+        return false;
     }
 
-    m_currentTransform = transform;
-    m_currentTransformPower = power;
-    m_currentTransformSize = size;
+    m_transMap->releaseShineIfUnused();
+    m_lastRebuildTime = generationTime;
+
+    m_currentTransform = m_selectedTransform;
+    m_currentTransformPower = m_selectedTransformPower;
+    m_currentTransformSize = m_selectedTransformSize;
+    return true;
 }
 
 
 /*!
- Cleaning
+ Releases the current map and, if the size is valid, allocates a new,
+ unshared one for recreateTransform().
 */
 void MirrorEffect::recreateTransformMap(int width, int height)
 {
-    if (m_transMap) {
-        delete[] m_transMap;
-    }
+    m_transMap.reset();
 
     m_currentTransform = None;
     m_currentTransformPower = 0.0f;
+    m_currentLayers.clear();
 
     if (width >= 1 && height >= 1) {
-        m_transMap = new int[width * height * 3];
+        m_transMap = new TransformMap();
+        m_transMap->create(width, height,
+                           m_sourceProperties.m_width,
+                           m_sourceProperties.m_height);
     }
 }
+
+
+/*!
+  Returns the key identifying the map of \a transform, with \a layers
+  composed on top, with the current source and target dimensions.
+*/
+TransformMapKey MirrorEffect::transformKey(MirrorTransform transform,
+                                           float power,
+                                           float size,
+                                           const QVector<TransformLayer> &layers) const
+{
+    TransformMapKey key(transform, power, size,
+                        m_sourceProperties.m_width,
+                        m_sourceProperties.m_height,
+                        m_targetProperties.m_width,
+                        m_targetProperties.m_height,
+                        m_sourceRotation);
+
+        // The parameters of the layers as they are, the key is only
+        // compared for equality
+    if (!layers.isEmpty()) {
+        key.m_layers = QByteArray((const char*)layers.constData(),
+                                  layers.count() * sizeof(TransformLayer));
+    }
+
+    return key;
+}
@@ -5,6 +5,19 @@
 #ifndef MIRROREFFECT_H
 #define MIRROREFFECT_H
 
+#include <QRect>
+#include <QVector>
+
+#include "transformmapcache.h"
+#include "warpkernels.h"
+
+// Forward declarations
+class AnimatedTransform;
+class SeparableWarp;
+class SourceChangeDetector;
+class SourcePyramid;
+class TileTracker;
+class TransformBuilder;
 
 /*!
   \class MirrorEffect
@@ -27,11 +40,43 @@ public: // Data types
         Dither
     };
 
+    enum Engine {
+        MapEngine,          // Precomputed, cached transform maps
+        ProceduralEngine    // Transforms evaluated while warping, no maps
+    };
+
+    enum SourceFormat {
+        SourceRGB32,
+        SourceUYVY
+    };
+
+    /*
+     * A transform composed on top of the selected one, see
+     * addMirrorTransform().
+     */
+    class TransformLayer
+    {
+    public:
+        TransformLayer() : m_transform(None), m_power(1.0f), m_size(1.0f) {}
+        TransformLayer(MirrorTransform transform, float power, float size)
+            : m_transform(transform), m_power(power), m_size(size) {}
+
+        bool operator==(const TransformLayer &other) const
+        {
+            return m_transform == other.m_transform
+                    && m_power == other.m_power
+                    && m_size == other.m_size;
+        }
+
+        MirrorTransform m_transform;
+        float m_power;
+        float m_size;
+    };
+
     class ImageProperties
     {
     public:
         ImageProperties() : m_data(0), m_width(0), m_height(0), m_pitch(0) {}
-        ~ImageProperties() { if (m_data) delete[] m_data; }
 
         unsigned int *m_data;   // Pointer to memory where the image starts
         int m_width;
@@ -48,50 +93,166 @@ public:
     void setSource(unsigned int *data, int width, int height, int pitch,
                    bool rotate90degrees = false, bool flipY = false);
 
+        // Set a packed UYVY frame as the source. The frame is sampled as it
+        // is, without converting or rotating it first.
+    void setSourceUYVY(const unsigned char *data, int width, int height,
+                       int bytesPerLine, bool rotate90degrees = false,
+                       bool flipY = false);
+    SourceFormat sourceFormat() const;
+
+        // The coefficients a UYVY source is converted to RGB with
+    void setYuvCoefficients(YuvConverter::Coefficients coefficients);
+    YuvConverter::Coefficients yuvCoefficients() const;
+
         // Set the target image as a memory reference. To this target, transformation's
         // results will be placed.
     void setTarget(unsigned int *data, int width, int height, int pitch);
 
+        // Limits process() to rect of the target, e.g. the part of the mirror
+        // on the screen. The pixels outside it are left as they are, and an
+        // empty rect skips the processing. A null rect, the default,
+        // processes the whole target.
+    void setExposedRect(const QRect &rect);
+    QRect exposedRect() const;
+
         // When highQuality is true, linear resampling is done instead of nearest pixel
     void setHighQuality(bool highQuality);
     bool highQuality() const;
 
-        // Set the current transform and it's attributes.
+        // Number of threads used by process(). 1 processes on the calling
+        // thread only, 0 uses every thread of the shared WorkerPool.
+    void setThreadCount(int threadCount);
+    int threadCount() const;
+
+        // Selects how the transforms are evaluated. MapEngine by default.
+    void setEngine(Engine engine);
+    Engine engine() const;
+
+        // When true, a transform map which must be generated is built on a
+        // background thread and process() goes on without it meanwhile.
+        // False by default.
+    void setBackgroundRebuild(bool background);
+    bool backgroundRebuild() const;
+
+        // When true, the parts of the source the map shrinks are sampled
+        // from a SourcePyramid, which removes their aliasing. False by
+        // default.
+    void setMipmapping(bool mipmapping);
+    bool mipmapping() const;
+
+        // When true, only the tiles of the target whose part of the source
+        // has changed since they were written are warped, see
+        // SourceChangeDetector and TileTracker. The target must not be
+        // written by anything else meanwhile. False by default.
+    void setChangeDetection(bool changeDetection);
+    bool changeDetection() const;
+
+        // Set the current transform and it's attributes. Removes the
+        // transforms added with addMirrorTransform().
     void setMirrorTransform(MirrorTransform transform,
                             float power = 1.0f,
                             float size = 1.0f);
 
+        // Composes transform on top of the ones set: it distorts their
+        // result. The chain is warped in a single pass with one map.
+    void addMirrorTransform(MirrorTransform transform,
+                            float power = 1.0f,
+                            float size = 1.0f);
+
         // Apply a single transformation from the source to the target defined
         // outside of this class.
     bool process();
 
+        // The nanoseconds the last process() spent (re)generating the
+        // transform, 0 if it reused the map
+    qint64 lastRebuildTime() const;
+
+        // Resamples a target row from the given source co-ordinates (see
+        // TransformMap) with nearest-pixel or linear resampling, from the
+        // current source whatever its format.
+    void sampleLine(unsigned int *t, unsigned int *t_target,
+                    const unsigned short *srcX, const unsigned short *srcY,
+                    const unsigned char *shine, int fracBits,
+                    bool highQuality) const;
+
 protected:
-        // Process a single row of pixels with nearest-pixel sampling
-    void processLine(unsigned int *t, unsigned int *t_target, int *srcCoords);
+        // Process the rows [begin, end) of m_processRect. Called from the
+        // worker threads.
+    void processRows(int begin, int end);
+
+        // Process a single row of pixels with nearest-pixel sampling, from
+        // the column mapColumn of the map on
+    void processLine(unsigned int *t, unsigned int *t_target, int mapRow, int mapColumn);
 
         // Process a single row of pixels with linear-resampling
-    void processLineHQ(unsigned int *t, unsigned int *t_target, int *srcCoords);
+    void processLineHQ(unsigned int *t, unsigned int *t_target, int mapRow, int mapColumn);
+
+        // Finds the tiles of the target to warp with m_transMap. Returns
+        // false if there are none.
+    bool trackChanges();
 
-        // (Re)sets the transform map with the attributes provided
-    void recreateTransform(MirrorTransform transform, float power, float size);
+        // Forgets the tiles written, the next frame is warped completely
+    void forgetTiles();
+
+        // Resamples a target row like sampleLine(), each pixel from the
+        // level of m_sourcePyramid given by levels
+    void sampleLevelLine(unsigned int *t, unsigned int *t_target,
+                         const unsigned short *srcX, const unsigned short *srcY,
+                         const unsigned char *shine, const unsigned char *levels,
+                         int fracBits, bool highQuality) const;
+
+        // Warps the target with ProceduralWarp instead of a map
+    void processProcedural(MirrorTransform transform, float power, float size);
+
+        // Fills a new map with the selected transform blended from the key
+        // fields of AnimatedTransform
+    bool blendTransformMap();
 
         // Makes sure the actual memory for the transform-map is in order, according to
         // current settings.
     void recreateTransformMap(int width, int height);
 
+        // Returns the cache key of the transform, with the layers composed
+        // on top, with the current source and target
+    TransformMapKey transformKey(MirrorTransform transform, float power, float size,
+                                 const QVector<TransformLayer> &layers
+                                     = QVector<TransformLayer>()) const;
+
 protected: // Data
     /*
-     * Source co-ordinate map
-     * Each pixel has 3 integers making the total size of the map
-     * width * height * 3. First two attributes of the map are 18-14 fixedpoint coordinates
-     * of the source pixel FROM WHERE this pixel should take it's color. The coordinates
-     * are ABSOLUTE (and therefore relative to source image's current dimensions) => they
-     * must be recreated each time when source's or target's dimensions change.
-     * The third attribute of each pixel is a "shine" value. Just a single integer telling
-     * how much white should be added to this pixel when it's resampled (This makes the mirror
-     * effect looks little bit better). The shine-value is used only with highQuality sampling.
+     * Source co-ordinate map, one entry per target pixel. The co-ordinates
+     * are ABSOLUTE (and therefore relative to source image's current
+     * dimensions) => they must be recreated each time when source's or
+     * target's dimensions change. See TransformMap for the layout. Identical
+     * maps are shared between the effects through TransformMapCache.
      */
-    int *m_transMap;
+    TransformMapCache::MapPointer m_transMap;
+
+        // Replaces the map for the transforms with independent axes, see
+        // SeparableWarp. Created when first needed.
+    SeparableWarp *m_separableWarp;
+
+        // Blends the maps while the power or the size is animated. Created
+        // when first needed.
+    AnimatedTransform *m_animatedTransform;
+    bool m_approximateMap;      // m_transMap is blended, not exact
+
+        // Builds the maps in the background when m_backgroundRebuild is
+        // set. Created when first needed.
+    TransformBuilder *m_transformBuilder;
+    bool m_backgroundRebuild;
+
+        // The halved copies of the source the map samples when
+        // m_mipmapping is set. Created when first needed.
+    SourcePyramid *m_sourcePyramid;
+    bool m_mipmapping;
+
+        // Find the tiles to warp when m_changeDetection is set. Created
+        // when first needed.
+    SourceChangeDetector *m_changeDetector;
+    TileTracker *m_tileTracker;
+    const unsigned char *m_dirtyTiles;  // The tiles processRows() warps, 0 for all
+    bool m_changeDetection;
 
     MirrorTransform m_selectedTransform;
     MirrorTransform m_currentTransform;
@@ -99,10 +260,23 @@ protected: // Data
     float m_selectedTransformSize;
     float m_currentTransformPower;
     float m_currentTransformSize;
+    QVector<TransformLayer> m_selectedLayers;   // Innermost first
+    QVector<TransformLayer> m_currentLayers;
     bool m_highQuality;
+    int m_threadCount;
+    Engine m_engine;
+    unsigned int m_ditherSeed;  // Dither of ProceduralEngine
+    WarpKernels::LineFunction m_bilinearLine;
     ImageProperties m_sourceProperties;
     ImageProperties m_targetProperties;
+    QRect m_exposedRect;        // Null for the whole target
+    QRect m_processRect;        // The part of the target process() warps
     ImageProperties m_sourcePropertiesRotated;
+    SourceFormat m_sourceFormat;
+    WarpKernels::UyvySource m_uyvySource;
+    YuvConverter::Coefficients m_yuvCoefficients;
+    int m_sourceRotation;   // Rotation/flip flags of the last setSource()
+    qint64 m_lastRebuildTime;
 };
 
 #endif // MIRROREFFECT_H
@@ -4,20 +4,26 @@
 
 #include "mirroritem.h"
 
-#include <QCameraImageCapture>
-#include <QCameraViewfinder>
+#include <QDateTime>
 #include <QDebug>
 #include <QDesktopServices>
 #include <QDir>
 #include <QEvent>
+#include <QFile>
+#include <QGraphicsScene>
+#include <QGraphicsView>
 #include <QPainter>
 #include <QStyleOptionGraphicsItem>
 #include <QTimer>
 #include <QTouchEvent>
-#include <QVideoRendererControl>
 
+#include "capturehub.h"
 #include "mirroreffect.h"
 #include "myvideosurface.h"
+#include "stagetimer.h"
+
+static const int StatsInterval = 1000; // Milliseconds between the statistics updates
+static const qreal MinEffectCount = 0.1; // The size of the effect must stay positive
 
 
 /*!
@@ -31,10 +37,9 @@
 */
 MirrorItem::MirrorItem(QDeclarativeItem *parent) :
     QDeclarativeItem(parent),
-    m_camera(0),
     m_myVideoSurface(0),
-    m_strength(0.0f),
-    m_count(0.0f),
+    m_strength(1.0),
+    m_count(1.0),
     m_deviceId(0),
     m_effectId(MirrorEffect::None),
     m_pinchCounter(0),
@@ -51,7 +56,10 @@ MirrorItem::MirrorItem(QDeclarativeItem *parent) :
     setAcceptTouchEvents(true);
 
     // Get the list of available camera devices
-    m_devices = QCamera::availableDevices();
+    m_devices = CaptureHub::instance()->devices();
+
+    m_statsTimer.setInterval(StatsInterval);
+    connect(&m_statsTimer, SIGNAL(timeout()), this, SLOT(updateFrameStats()));
 }
 
 
@@ -61,14 +69,11 @@ MirrorItem::MirrorItem(QDeclarativeItem *parent) :
 MirrorItem::~MirrorItem()
 {
     if (m_myVideoSurface) {
+        CaptureHub::instance()->unsubscribe(m_myVideoSurface);
         m_myVideoSurface->stop();
     }
 
-    if (m_camera) {
-        m_camera->stop();
-    }
-
-    delete m_camera;
+    delete m_myVideoSurface;
 }
 
 
@@ -146,7 +151,9 @@ void MirrorItem::paint(QPainter *painter,
 
     if (m_myVideoSurface && m_myVideoSurface->framesExists()) {
         // Show the view finder
+        StageTimer timer;
         m_myVideoSurface->paint(painter);
+        m_frameStats.record(FrameStats::PaintStage, timer.nsecsElapsed());
     }
     else if (m_lastPicture.byteCount() > 0) {
         // Keep painting last stored QImage picture
@@ -165,6 +172,22 @@ void MirrorItem::paint(QPainter *painter,
 }
 
 
+/*!
+  From QDeclarativeItem.
+
+  The camera frames are negotiated for the size of the mirror, so a resized
+  mirror, e.g. when maximized or minimized, has them negotiated again.
+*/
+void MirrorItem::geometryChanged(const QRectF &newGeometry,
+                                 const QRectF &oldGeometry)
+{
+    QDeclarativeItem::geometryChanged(newGeometry, oldGeometry);
+
+    if (m_myVideoSurface && newGeometry.size() != oldGeometry.size())
+        CaptureHub::instance()->updateFrameSizes();
+}
+
+
 /*!
   If the view finder is shown, paints this item.
 */
@@ -175,6 +198,38 @@ void MirrorItem::updateVideo()
     }
 }
 
+
+/*!
+  From VideoIF. Returns the part of the mirror inside the viewports of the
+  scene's views and the clip of its parents, e.g. the Flickable. Empty if
+  the mirror or a parent of it is hidden or fully transparent, which is how
+  Flipable hides its back face.
+*/
+QRect MirrorItem::exposedRect() const
+{
+    if (!isVisible() || effectiveOpacity() <= 0.0 || !scene())
+        return QRect();
+
+    QRectF exposed = boundingRect();
+
+    if (isClipped())
+        exposed &= clipPath().boundingRect();
+
+    const QList<QGraphicsView*> views = scene()->views();
+    QRectF inViews;
+
+    for (int i = 0; i < views.count(); i++) {
+        QGraphicsView *view = views.at(i);
+
+        if (view->isVisible()) {
+            const QPolygonF viewport = view->mapToScene(view->viewport()->rect());
+            inViews |= mapFromScene(viewport).boundingRect();
+        }
+    }
+
+    return (exposed & inViews).toAlignedRect();
+}
+
 /*!
   Current used effect id
 */
@@ -196,6 +251,92 @@ void MirrorItem::setEffectId(int effect)
 }
 
 
+/*!
+  Returns the multiplier of the effect's power.
+*/
+qreal MirrorItem::effectStrength() const
+{
+    return m_strength;
+}
+
+
+/*!
+  Sets the multiplier of the effect's power to \a strength. 0 turns the
+  effect off. Takes effect from the next camera frame on.
+*/
+void MirrorItem::setEffectStrength(qreal strength)
+{
+    if (m_strength != strength) {
+        m_strength = strength;
+
+        if (m_myVideoSurface)
+            m_myVideoSurface->setEffectParameters(m_strength, m_count);
+
+        emit effectStrengthChanged(m_strength);
+    }
+}
+
+
+/*!
+  Returns the multiplier of the effect's size: the number of the waves,
+  the bubbles and the tiles.
+*/
+qreal MirrorItem::effectCount() const
+{
+    return m_count;
+}
+
+
+/*!
+  Sets the multiplier of the effect's size to \a count, at least
+  MinEffectCount. Takes effect from the next camera frame on.
+*/
+void MirrorItem::setEffectCount(qreal count)
+{
+    count = qMax(MinEffectCount, count);
+
+    if (m_count != count) {
+        m_count = count;
+
+        if (m_myVideoSurface)
+            m_myVideoSurface->setEffectParameters(m_strength, m_count);
+
+        emit effectCountChanged(m_count);
+    }
+}
+
+
+/*!
+  Returns the statistics of the frame processing stages.
+*/
+QVariantMap MirrorItem::frameStats() const
+{
+    return m_frameStats.toVariantMap();
+}
+
+
+/*!
+  Returns the file the statistics are logged into.
+*/
+QString MirrorItem::statsLogFile() const
+{
+    return m_statsLogFile;
+}
+
+
+/*!
+  Sets the CSV file the statistics are appended to once a second while the
+  camera runs. An empty name disables the logging.
+*/
+void MirrorItem::setStatsLogFile(const QString &fileName)
+{
+    if (m_statsLogFile != fileName) {
+        m_statsLogFile = fileName;
+        emit statsLogFileChanged(m_statsLogFile);
+    }
+}
+
+
 /*!
 */
 void MirrorItem::enableCamera(QVariant enable)
@@ -254,8 +395,8 @@ void MirrorItem::pauseCamera()
 void MirrorItem::enableEffect(QVariant id, QVariant strength, QVariant count)
 {
     setEffectId(id.toInt());
-    m_strength = strength.toDouble();
-    m_count = count.toDouble();
+    setEffectStrength(strength.toDouble());
+    setEffectCount(count.toDouble());
 }
 
 
@@ -265,11 +406,8 @@ void MirrorItem::enableEffect(QVariant id, QVariant strength, QVariant count)
 void MirrorItem::saveToFile()
 {
     if (m_myVideoSurface && m_myVideoSurface->framesExists()) {
-        QImage image(m_myVideoSurface->targetImage().size(),
-                     m_myVideoSurface->targetImageFormat());
-        QPainter painter(&image);
-        m_myVideoSurface->paint(&painter);
-        doSave(image);
+        // A copy of the latest completed frame
+        doSave(m_myVideoSurface->targetImage());
     }
     else if (m_lastPicture.width() > 0) {
         doSave(m_lastPicture);
@@ -282,7 +420,7 @@ void MirrorItem::saveToFile()
 */
 void MirrorItem::startCamera()
 {
-    if (m_camera || m_myVideoSurface) {
+    if (m_myVideoSurface) {
         stopCamera();
         enableCamera(QVariant(true));
         return;
@@ -292,22 +430,21 @@ void MirrorItem::startCamera()
         m_deviceId = 0;
     }
 
-    m_camera = new QCamera(m_devices[m_deviceId]);
-    connect(m_camera, SIGNAL(error(QCamera::Error)),
-            this, SLOT(handleCameraError(QCamera::Error)));
+    if (m_devices.isEmpty()) {
+        qDebug() << "MirrorItem::startCamera(): No camera devices";
+        return;
+    }
 
-    // Own video output for drawing
-    QMediaService *mediaService = m_camera->service();
-    QVideoRendererControl *rendererControl =
-            mediaService->requestControl<QVideoRendererControl*>();
-    m_myVideoSurface = new MyVideoSurface(this, this, this);
+    m_myVideoSurface = new MyVideoSurface(this, this);
     m_myVideoSurface->enableEffect(m_effectId, m_strength, m_count);
 
-    // The video renderer control takes ownership of the surface
-    rendererControl->setSurface(m_myVideoSurface);
+    // The statistics are of this camera session only
+    m_frameStats.reset();
+    m_myVideoSurface->setFrameStats(&m_frameStats);
+    m_statsTimer.start();
 
-    // Start the camera
-    m_camera->start();
+    // The camera is shared with the other mirrors showing the same device
+    CaptureHub::instance()->subscribe(m_devices[m_deviceId], m_myVideoSurface);
     m_showViewFinder = true;
 }
 
@@ -319,31 +456,30 @@ void MirrorItem::stopCamera()
 {
     // Stop the camera device
     m_showViewFinder = false;
+    m_statsTimer.stop();
 
     if (m_myVideoSurface) {
+        // No frames arrive after unsubscribing, so the surface can go
+        CaptureHub::instance()->unsubscribe(m_myVideoSurface);
         m_myVideoSurface->stop();
         m_myVideoSurface->releaseMemory();
+        delete m_myVideoSurface;
         m_myVideoSurface = 0;
     }
 
-    if (m_camera) {
-        m_camera->stop();
-    }
-
-    delete m_camera;
-    m_camera = 0;
     m_deviceId = 0;
 }
 
 
 /*!
-  Camera send error
+  Notifies the new statistics and logs them, if enabled.
 */
-void MirrorItem::handleCameraError(QCamera::Error error)
+void MirrorItem::updateFrameStats()
 {
-    qDebug() << "MirrorItem::handleCameraError(): QCamera::Error:"
-             << error << ";"
-             << m_camera->errorString();
+    emit frameStatsChanged();
+
+    if (!m_statsLogFile.isEmpty())
+        writeStatsLog();
 }
 
 
@@ -387,3 +523,35 @@ void MirrorItem::doSave(QImage image)
 
     image.save(path);
 }
+
+
+/*!
+  Appends a row of the statistics to the log file, with the time, the
+  camera device, the effect and the size of the mirror in front of it. The
+  header is written into a new file. The file is opened for every row, so
+  it can be collected or removed at any time, and several mirrors can log
+  into the same file.
+*/
+void MirrorItem::writeStatsLog()
+{
+    QFile file(m_statsLogFile);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "MirrorItem::writeStatsLog(): Cannot open" << m_statsLogFile;
+        return;
+    }
+
+    if (file.size() == 0)
+        file.write("time,device,effect,width,height," + FrameStats::csvHeader());
+
+    const QByteArray device = m_deviceId < m_devices.count() ? m_devices.at(m_deviceId)
+                                                             : QByteArray();
+    QByteArray row = QDateTime::currentDateTime().toString(Qt::ISODate).toLatin1();
+    row += ',' + device
+            + ',' + QByteArray::number(m_effectId)
+            + ',' + QByteArray::number((int)boundingRect().width())
+            + ',' + QByteArray::number((int)boundingRect().height())
+            + ',' + m_frameStats.csvRow();
+
+    file.write(row);
+}
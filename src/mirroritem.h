@@ -6,16 +6,13 @@
 #define MIRRORITEM_H
 
 #include <QByteArray>
-
-// Unlike the other APIs in Qt Mobility, the Qt Mobility Multimedia API is not
-// in the Qt Mobility namespace.
-#include <QCamera>
-
 #include <QDeclarativeItem>
 #include <QImage>
 #include <QList>
+#include <QTimer>
 #include <QVariant>
 
+#include "framestats.h"
 #include "videoif.h"
 
 // Forward declarations
@@ -34,6 +31,10 @@ class MirrorItem : public QDeclarativeItem, public VideoIF
 {
     Q_OBJECT
     Q_PROPERTY(int effectId READ effectId WRITE setEffectId NOTIFY effectIdChanged)
+    Q_PROPERTY(qreal effectStrength READ effectStrength WRITE setEffectStrength NOTIFY effectStrengthChanged)
+    Q_PROPERTY(qreal effectCount READ effectCount WRITE setEffectCount NOTIFY effectCountChanged)
+    Q_PROPERTY(QVariantMap frameStats READ frameStats NOTIFY frameStatsChanged)
+    Q_PROPERTY(QString statsLogFile READ statsLogFile WRITE setStatsLogFile NOTIFY statsLogFileChanged)
 
 public:
     explicit MirrorItem(QDeclarativeItem *parent = 0);
@@ -45,13 +46,36 @@ public: // From QDeclarativeItem
                const QStyleOptionGraphicsItem *option,
                QWidget *widget);
 
-public:
+protected: // From QDeclarativeItem
+    void geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry);
+
+public: // From VideoIF
     void updateVideo();
+    QRect exposedRect() const;
+
+public:
 
     // Property setters and getters
     int effectId() const;
     void setEffectId(int id);
 
+    // The multipliers of the effect's power and size, 1.0 by default. Can
+    // be animated, the mirror keeps up with the camera while they change.
+    qreal effectStrength() const;
+    void setEffectStrength(qreal strength);
+    qreal effectCount() const;
+    void setEffectCount(qreal count);
+
+    // The timings of the frame processing stages, see
+    // FrameStats::toVariantMap(). Updated once a second while the camera
+    // runs.
+    QVariantMap frameStats() const;
+
+    // A CSV file a row of the statistics is appended to on every update.
+    // Empty, the default, disables the logging.
+    QString statsLogFile() const;
+    void setStatsLogFile(const QString &fileName);
+
 public slots:
     void enableCamera(QVariant enable);
     void enableCameraAt(QVariant enable, QVariant cameraIndex);
@@ -62,11 +86,12 @@ public slots:
 private slots:
     void startCamera();
     void stopCamera();
-    void handleCameraError(QCamera::Error);
+    void updateFrameStats();
 
 private:
     void keepPaintingStoredPicture();
     void doSave(QImage image);
+    void writeStatsLog();
 
 signals:
     void minimizeMirror();
@@ -74,14 +99,20 @@ signals:
 
     // Property signals
     void effectIdChanged(int id);
+    void effectStrengthChanged(qreal strength);
+    void effectCountChanged(qreal count);
+    void frameStatsChanged();
+    void statsLogFileChanged(const QString &fileName);
 
 private: // Data
-    QCamera* m_camera; // Owned
-    MyVideoSurface* m_myVideoSurface; // Not owned
+    MyVideoSurface* m_myVideoSurface; // Owned
     QImage m_lastPicture;
+    FrameStats m_frameStats;
+    QTimer m_statsTimer;
+    QString m_statsLogFile;
     QList<QByteArray> m_devices;
-    double m_strength;
-    double m_count;
+    qreal m_strength;
+    qreal m_count;
     int m_deviceId;
     int m_effectId;
     int m_pinchCounter;
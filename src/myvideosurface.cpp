@@ -6,9 +6,15 @@
 
 #include <QDebug>
 #include <QDeclarativeItem>
+#include <QMutexLocker>
 #include <QPainter>
 #include <QStyleOptionGraphicsItem>
+#include <math.h>
 
+#include "effectworker.h"
+#include "framestats.h"
+#include "separablewarp.h"
+#include "transformgenerator.h"
 #include "videoif.h"
 
 
@@ -24,17 +30,23 @@
 MyVideoSurface::MyVideoSurface(QDeclarativeItem *targetItem,
                                VideoIF *target,
                                QObject *parent)
-    : QAbstractVideoSurface(parent),
+    : QObject(parent),
       m_targetItem(targetItem),
       m_target(target),
-      m_mirrorEffect(0),
-      m_imageFormat(QImage::Format_Invalid),
-      m_strength(0.0f),
-      m_count(0.0f),
-      m_effectId(MirrorEffect::None),
+      m_worker(0),
+      m_exposurePending(0),
+      m_frameStats(0),
+      m_samplingScale(1.0f),
+      m_separable(true),
       m_framesExists(false)
 {
-    setError(QAbstractVideoSurface::NoError);
+    // The effect is applied on the worker's thread, and the results are
+    // painted on the GUI thread when they are ready.
+    m_worker = new EffectWorker();
+    connect(m_worker, SIGNAL(frameReady()), this, SLOT(handleFrameReady()),
+            Qt::QueuedConnection);
+
+    updateExposure();
 }
 
 
@@ -43,8 +55,7 @@ MyVideoSurface::MyVideoSurface(QDeclarativeItem *targetItem,
 */
 MyVideoSurface::~MyVideoSurface()
 {
-    if (m_mirrorEffect)
-        delete m_mirrorEffect;
+    delete m_worker;
 }
 
 /*!
@@ -52,153 +63,112 @@ MyVideoSurface::~MyVideoSurface()
 */
 void MyVideoSurface::releaseMemory()
 {
-    delete m_mirrorEffect;
-    m_mirrorEffect = 0;
+    m_worker->releaseMemory();
+}
+
+/*!
+  Drops the frame waiting for the worker, so that no frame stays mapped
+  after the camera has stopped. Unsubscribe from CaptureHub first.
+*/
+void MyVideoSurface::stop()
+{
+    m_framesExists = false;
+    m_worker->flush();
 }
 
+
 /*!
-  From QAbstractVideoSurface.
+  From CaptureSink. Called on the camera's thread. The frame is only queued
+  for the worker, see EffectWorker. A frame the worker doesn't get to
+  before the next one arrives is dropped.
+
+  Only the exposed part of the target is warped. While the target is hidden
+  the frames aren't processed at all, and the GUI thread is only asked to
+  check whether the target can be seen again. The target and the effect
+  are only known by the copy of m_settings taken here, so that a frame is
+  never submitted with half of the settings changed.
 */
-QList<QVideoFrame::PixelFormat> MyVideoSurface::supportedPixelFormats(
-        QAbstractVideoBuffer::HandleType handleType) const
+void MyVideoSurface::presentFrame(const SourceFramePointer &frame)
 {
-    if (handleType == QAbstractVideoBuffer::NoHandle) {
-        return QList<QVideoFrame::PixelFormat>()
-                << QVideoFrame::Format_RGB32
-                << QVideoFrame::Format_UYVY;
+    if (m_frameStats) {
+        m_frameStats->frameDelivered();
+        m_frameStats->record(FrameStats::MapStage, frame->mapTime());
+    }
+
+    m_settingsMutex.lock();
+    const FrameSettings settings = m_settings;
+    m_settingsMutex.unlock();
+
+    if (settings.m_exposedRect.isEmpty() || settings.m_targetSize.isEmpty()) {
+        if (m_exposurePending.testAndSetOrdered(0, 1))
+            QMetaObject::invokeMethod(this, "updateExposure", Qt::QueuedConnection);
+
+        return;
     }
 
-    return QList<QVideoFrame::PixelFormat>();
+    m_worker->submit(frame, settings.m_targetSize, settings.m_exposedRect,
+                     settings.m_effectId, settings.m_strength, settings.m_count);
 }
 
 
 /*!
-  From QAbstractVideoSurface.
+  From CaptureSink. Returns the smallest frame which gives the effect its
+  full detail on the mirror: the size of the mirror times the sampling
+  scale of the effect. The frames are stretched over the mirror, so both
+  dimensions matter.
 */
-QVideoSurfaceFormat MyVideoSurface::nearestFormat(
-        const QVideoSurfaceFormat &format) const
+QSize MyVideoSurface::requiredFrameSize() const
 {
-    return format;
+    const QRectF rect = m_targetItem->boundingRect();
+
+    return QSize((int)ceilf(rect.width() * m_samplingScale),
+                 (int)ceilf(rect.height() * m_samplingScale));
 }
 
 
 /*!
-  From QAbstractVideoSurface.
+  From CaptureSink. Returns true if the effect is processed by
+  SeparableWarp, which takes RGB32 frames only. The others would take the
+  full transform map path in either format, and UYVY is cheaper to
+  capture and sample.
 */
-bool MyVideoSurface::start(const QVideoSurfaceFormat &format)
+bool MyVideoSurface::prefersRgb32() const
 {
-    m_framesExists = false;
-    m_videoFormat = format;
-    QImage::Format imageFormat =
-            QVideoFrame::imageFormatFromPixelFormat(format.pixelFormat());
-
-    // Force RGB32 - conversion will be done later.
-    if (imageFormat == QImage::Format_Invalid)
-        imageFormat = QImage::Format_RGB32;
+    return m_separable;
+}
 
-    const QSize size = format.frameSize();
 
-    if (imageFormat != QImage::Format_Invalid && !size.isEmpty()) {
-        m_imageFormat = imageFormat;
-        QAbstractVideoSurface::start(format);
-        return true;
-    }
+/*!
+  Called on the GUI thread when the worker has completed a frame.
+*/
+void MyVideoSurface::handleFrameReady()
+{
+    m_framesExists = true;
+    updateExposure();
 
-    return false;
+    // Update widget
+    m_target->updateVideo();
 }
 
 
 /*!
-  From QAbstractVideoSurface.
+  Called on the GUI thread, for every completed frame and while the target
+  is hidden. The items can't be read on the camera's thread, so the size
+  of the target and its exposed part are copied for presentFrame().
 */
-bool MyVideoSurface::present(const QVideoFrame &frame)
+void MyVideoSurface::updateExposure()
 {
-    // Handle frame
-    m_frame = frame;
-
-    if (surfaceFormat().pixelFormat() != m_frame.pixelFormat()
-            || surfaceFormat().frameSize() != m_frame.size())
-    {
-        stop();
-        return false;
-    }
+    m_exposurePending.fetchAndStoreOrdered(0);
 
-    if (m_frame.map(QAbstractVideoBuffer::ReadOnly)) {
-
-        if(!m_mirrorEffect)
-            m_mirrorEffect = new MirrorEffect();
-
-
-        m_mirrorEffect->setSource((unsigned int*)m_frame.bits(),
-                                  m_frame.width(),
-                                  m_frame.height(),
-                                  m_frame.bytesPerLine() / 4);
-
-        // RGB or UYVY
-        if (frame.pixelFormat() == QVideoFrame::Format_UYVY) {
-            convertFrameData(frame);
-
-            bool flipY(false);
-
-            if (m_frame.width() < 600) {
-                // Harmattan's frontcamera is in use. It must be flipped in
-                // order to be correctly rotated
-                flipY = true;
-            }
-
-            m_mirrorEffect->setSource(m_convertedImage.m_data,
-                                      m_convertedImage.m_width,
-                                      m_convertedImage.m_height,
-                                      m_convertedImage.m_width,
-                                      true,
-                                      flipY);
-        }
-        else if (frame.pixelFormat() == QVideoFrame::Format_RGB32) {
-            m_mirrorEffect->setSource((unsigned int*)m_frame.bits(),
-                                      m_frame.width(),
-                                      m_frame.height(),
-                                      m_frame.bytesPerLine() / 4);
-        }
-
-        // Target
-        if (m_targetImage.width() == 0) {
-            // Make QImage from frame
-            // Using smaller target picture that source
-            m_targetImage = QImage(m_targetItem->boundingRect().width(),
-                                   m_targetItem->boundingRect().height(),
-                                   m_imageFormat);
-
-            // Set target
-            m_mirrorEffect->setTarget((unsigned int*)m_targetImage.bits(),
-                                      m_targetImage.width(),
-                                      m_targetImage.height(),
-                                      m_targetImage.bytesPerLine() / 4);
-        }
-
-        // Set effect
-        MyVideoSurface::setMirrorTransform(m_mirrorEffect, m_effectId);
-
-
-        // Effect quality selection
-        if (m_targetImage.size().width() > 300) {
-            m_mirrorEffect->setHighQuality(false);
-        }
-        else {
-            m_mirrorEffect->setHighQuality(true);
-        }
-
-        // Make effect
-        m_mirrorEffect->process();
-
-        m_frame.unmap();
-
-        m_framesExists = true;
-
-        // Update widget
-        m_target->updateVideo();
-    }
+    const QRect exposedRect = m_target->exposedRect();
+
+    // Using smaller target picture that source
+    const QSize targetSize(m_targetItem->boundingRect().width(),
+                           m_targetItem->boundingRect().height());
 
-    return true;
+    QMutexLocker locker(&m_settingsMutex);
+    m_settings.m_exposedRect = exposedRect;
+    m_settings.m_targetSize = targetSize;
 }
 
 
@@ -216,7 +186,7 @@ bool MyVideoSurface::framesExists() const
 */
 QImage MyVideoSurface::targetImage() const
 {
-    return m_targetImage;
+    return m_worker->image();
 }
 
 
@@ -225,7 +195,7 @@ QImage MyVideoSurface::targetImage() const
 */
 QImage::Format MyVideoSurface::targetImageFormat() const
 {
-    return m_imageFormat;
+    return QImage::Format_RGB32;
 }
 
 
@@ -234,9 +204,35 @@ QImage::Format MyVideoSurface::targetImageFormat() const
 */
 void MyVideoSurface::enableEffect(int id, double strength, double count)
 {
-    m_effectId = id;
-    m_strength = strength;
-    m_count = count;
+    m_settingsMutex.lock();
+    m_settings.m_effectId = id;
+    m_settings.m_strength = (float)strength;
+    m_settings.m_count = (float)count;
+    m_settingsMutex.unlock();
+
+    MirrorEffect::MirrorTransform transform;
+    float power;
+    float size;
+    transformParameters(id, &transform, &power, &size);
+    m_separable = SeparableWarp::isSeparable(transform);
+    m_samplingScale = TransformGenerator::samplingScale(transform,
+                                                        power * (float)strength,
+                                                        size * (float)count);
+}
+
+
+/*!
+  Sets the \a strength and the \a count of the effect, which multiply its
+  power and its size, from the next frame on. Cheap enough to call on every
+  frame of an animation: the effect blends the transform maps of changing
+  parameters instead of regenerating them (see AnimatedTransform). The
+  frame size asked from the camera is left as enableEffect() chose it.
+*/
+void MyVideoSurface::setEffectParameters(double strength, double count)
+{
+    QMutexLocker locker(&m_settingsMutex);
+    m_settings.m_strength = (float)strength;
+    m_settings.m_count = (float)count;
 }
 
 
@@ -245,79 +241,95 @@ void MyVideoSurface::enableEffect(int id, double strength, double count)
 */
 void MyVideoSurface::paint(QPainter *painter)
 {
-    if (m_targetImage.byteCount() > 0) {
-        painter->drawImage(0, 0, m_targetImage);
-    }
+    m_worker->paint(painter);
 }
 
 
 /*!
-  From QAbstractVideoSurface.
+  Sets the mirror house effect according to \a effect, with its power
+  multiplied by \a strength and its size by \a count.
 */
-bool MyVideoSurface::isFormatSupported(const QVideoSurfaceFormat &format,
-                                       QVideoSurfaceFormat *similar) const
+void MyVideoSurface::setMirrorTransform(MirrorEffect *mirrorEffect,
+                                        int effect,
+                                        float strength /* = 1.0f */,
+                                        float count /* = 1.0f */)
 {
-    Q_UNUSED(similar);
-
-    const QImage::Format imageFormat =
-            QVideoFrame::imageFormatFromPixelFormat(format.pixelFormat());
-    const QSize size = format.frameSize();
+    MirrorEffect::MirrorTransform transform;
+    float power;
+    float size;
+    transformParameters(effect, &transform, &power, &size);
 
-    return (imageFormat != QImage::Format_Invalid
-            && !size.isEmpty()
-            && format.handleType() == QAbstractVideoBuffer::NoHandle);
+    mirrorEffect->setMirrorTransform(transform, power * strength, size * count);
 }
 
 
 /*!
-  Sets the mirror house effect according to \a effect.
+  Returns the transform of \a effect in \a transform and its attributes in
+  \a power and \a size.
 */
-void MyVideoSurface::setMirrorTransform(MirrorEffect *mirrorEffect,
-                                        int effect)
+void MyVideoSurface::transformParameters(int effect,
+                                         MirrorEffect::MirrorTransform *transform,
+                                         float *power,
+                                         float *size)
 {
+    *power = 1.0f;
+    *size = 1.0f;
+
     switch (effect) {
     case 1: {
-        mirrorEffect->setMirrorTransform(MirrorEffect::Bubbles, 0.5f, 1.0f);
+        *transform = MirrorEffect::Bubbles;
+        *power = 0.5f;
         break;
     }
     case 2: {
-        mirrorEffect->setMirrorTransform(MirrorEffect::InvBubbles, 0.5f, 1.0f);
+        *transform = MirrorEffect::InvBubbles;
+        *power = 0.5f;
         break;
     }
     case 3: {
-        mirrorEffect->setMirrorTransform(MirrorEffect::VerticalWave, 0.5f, 6.0f);
+        *transform = MirrorEffect::VerticalWave;
+        *power = 0.5f;
+        *size = 6.0f;
         break;
     }
     case 4: {
-        mirrorEffect->setMirrorTransform(MirrorEffect::HorizontalWave, 0.5f, 6.0f);
+        *transform = MirrorEffect::HorizontalWave;
+        *power = 0.5f;
+        *size = 6.0f;
         break;
     }
     case 5: {
-        mirrorEffect->setMirrorTransform(MirrorEffect::Spiral, 0.5f, 1.0f);
+        *transform = MirrorEffect::Spiral;
+        *power = 0.5f;
         break;
     }
     case 6: {
-        mirrorEffect->setMirrorTransform(MirrorEffect::Spiral, 0.7f, 1.0f);
+        *transform = MirrorEffect::Spiral;
+        *power = 0.7f;
         break;
     }
     case 7: {
-        mirrorEffect->setMirrorTransform(MirrorEffect::Ripple, 0.6f, 4.0f);
+        *transform = MirrorEffect::Ripple;
+        *power = 0.6f;
+        *size = 4.0f;
         break;
     }
     case 8: {
-        mirrorEffect->setMirrorTransform(MirrorEffect::Spike, 1.0f, 1.0f);
+        *transform = MirrorEffect::Spike;
         break;
     }
     case 9: {
-        mirrorEffect->setMirrorTransform(MirrorEffect::Tile, 1.0f, 14.0f);
+        *transform = MirrorEffect::Tile;
+        *size = 14.0f;
         break;
     }
     case 10: {
-        mirrorEffect->setMirrorTransform(MirrorEffect::Dither, 0.04f, 1.0f);
+        *transform = MirrorEffect::Dither;
+        *power = 0.04f;
         break;
     }
     default: {
-        mirrorEffect->setMirrorTransform(MirrorEffect::None);
+        *transform = MirrorEffect::None;
         break;
     }
     } // switch (effect)
@@ -325,83 +337,31 @@ void MyVideoSurface::setMirrorTransform(MirrorEffect *mirrorEffect,
 
 
 /*!
-  Converts the frame data without the 90 degrees rotation.
+  Selects the coefficients UYVY frames are converted to RGB with. BT.601 by
+  default.
 */
-void MyVideoSurface::convertFrameData(const QVideoFrame &source)
+void MyVideoSurface::setYuvCoefficients(YuvConverter::Coefficients coefficients)
 {
-    // From UYVY to RGB32
-    if (!m_convertedImage.m_data
-            || source.width() != m_convertedImage.m_width
-            || source.height() != m_convertedImage.m_height)
-    {
-        if (m_convertedImage.m_data)
-            delete[] m_convertedImage.m_data;
-
-        m_convertedImage.m_width = source.width();
-        m_convertedImage.m_height = source.height();
-        m_convertedImage.m_data =
-                new unsigned int[m_convertedImage.m_width
-                                 * m_convertedImage.m_height];
-    }
+    m_worker->setYuvCoefficients(coefficients);
+}
 
-    signed int y1;
-    signed int y2;
-    signed int rfac;
-    signed int gfac;
-    signed int bfac;
-    signed int r;
-    signed int g;
-    signed int b;
-
-    for (int y = 0; y < m_convertedImage.m_height; ++y) {
-        unsigned int *t = m_convertedImage.m_data + y * m_convertedImage.m_width;
-        unsigned int *t_target = t + m_convertedImage.m_width;
-        const unsigned int *s =
-                (const unsigned int*)((const uchar*)source.bits()
-                                      + source.bytesPerLine() * y);
-
-        while (t != t_target) {
-            // use y1 and y2 as u/v temps before they are overridden by actual y's
-            y1 = (int)((*s >> 0) & 255) - 128;
-            y2 = (int)((*s >> 16) & 255) - 128;
-
-            bfac = (int)((y1 * 517) >> 8);
-            gfac = (int)((y2 * 208) >> 8) - (int)((y1 * 100) >> 8);
-            rfac = (int)((y2 * 409) >> 8);
-
-            y1 = ((((int)((*s >> 8) & 255) - 16) * 298) >> 8);
-            y2 = ((((int)((*s >> 24) & 255) - 16) * 298) >> 8);
-
-            r = y1 + rfac;
-            g = y1 - gfac;
-            b = y1 + bfac;
-
-            if (r < 0) r = 0;
-            if (g < 0) g = 0;
-            if (b < 0) b = 0;
-            if (r > 255) r = 255;
-            if (g > 255) g = 255;
-            if (b > 255) b = 255;
-
-            *t = b | (g << 8) | (r << 16) | 0xFF000000;
-
-            t++;
-
-            r = y2 + rfac;
-            g = y2 - gfac;
-            b = y2 + bfac;
-
-            if (r < 0) r = 0;
-            if (g < 0) g = 0;
-            if (b < 0) b = 0;
-            if (r > 255) r = 255;
-            if (g > 255) g = 255;
-            if (b > 255) b = 255;
-
-            *t = b | (g << 8) | (r << 16) | 0xFF000000;
-
-            t++;
-            s++;
-        }
-    }
+
+/*!
+  Returns the coefficients UYVY frames are converted to RGB with.
+*/
+YuvConverter::Coefficients MyVideoSurface::yuvCoefficients() const
+{
+    return m_worker->yuvCoefficients();
+}
+
+
+/*!
+  Sets \a stats to record the delivered frames and the processing of
+  them into.
+*/
+void MyVideoSurface::setFrameStats(FrameStats *stats)
+{
+    m_frameStats = stats;
+    m_worker->setFrameStats(stats);
 }
+
@@ -5,14 +5,19 @@
 #ifndef MYVIDEOSURFACE_H
 #define MYVIDEOSURFACE_H
 
-#include <QAbstractVideoSurface>
+#include <QAtomicInt>
 #include <QImage>
-#include <QList>
-#include <QVideoSurfaceFormat>
+#include <QMutex>
+#include <QObject>
+#include <QRect>
 
+#include "capturehub.h"
 #include "mirroreffect.h"
+#include "yuvconverter.h"
 
 // Forward declarations
+class EffectWorker;
+class FrameStats;
 class MirrorEffect;
 class QDeclarativeItem;
 class QPainter;
@@ -23,7 +28,7 @@ class VideoIF;
   \class MyVideoSurface
   \brief Class for reading camera viewfinder frames for manipulating them
 */
-class MyVideoSurface: public QAbstractVideoSurface
+class MyVideoSurface: public QObject, public CaptureSink
 {
     Q_OBJECT
 
@@ -33,42 +38,75 @@ public:
                             QObject *parent = 0);
     ~MyVideoSurface();
 
-public: // From QAbstractVideoSurface
-    QList<QVideoFrame::PixelFormat> supportedPixelFormats(
-            QAbstractVideoBuffer::HandleType handleType =
-                QAbstractVideoBuffer::NoHandle) const;
-    QVideoSurfaceFormat	nearestFormat(const QVideoSurfaceFormat &format) const;
-    bool start(const QVideoSurfaceFormat &format);
-    bool present(const QVideoFrame &frame);
+public: // From CaptureSink
+    void presentFrame(const SourceFramePointer &frame);
+    QSize requiredFrameSize() const;
+    bool prefersRgb32() const;
 
 public:
+    void stop();
     bool framesExists() const;
     QImage targetImage() const;
     QImage::Format targetImageFormat() const;
     void enableEffect(int id, double strength, double count);
     void paint(QPainter *painter);
-    bool isFormatSupported(const QVideoSurfaceFormat &format,
-                           QVideoSurfaceFormat *similar) const;
-    static void setMirrorTransform(MirrorEffect *mirrorEffect, int effect);
+
+        // Changes the strength and the count of the effect, e.g. every
+        // frame of an animation. 1.0 is the effect as designed.
+    void setEffectParameters(double strength, double count);
+
+        // Sets the effect with its power multiplied by strength and its
+        // size by count
+    static void setMirrorTransform(MirrorEffect *mirrorEffect, int effect,
+                                   float strength = 1.0f, float count = 1.0f);
+
+    void setYuvCoefficients(YuvConverter::Coefficients coefficients);
+    YuvConverter::Coefficients yuvCoefficients() const;
+
+        // The statistics the frames are recorded into, not owned. Set
+        // before subscribing to the camera.
+    void setFrameStats(FrameStats *stats);
 
     void releaseMemory();
 
+private slots:
+    void handleFrameReady();
+
+        // Reads the size and the exposed part of the target again, on the
+        // GUI thread
+    void updateExposure();
+
 private:
-    void convertFrameData(const QVideoFrame &source);
+        // The transform and its attributes of effect
+    static void transformParameters(int effect,
+                                    MirrorEffect::MirrorTransform *transform,
+                                    float *power,
+                                    float *size);
 
 private: // Data
+        // What presentFrame() submits the frames with. Written on the GUI
+        // thread and copied on the camera's thread, as a whole.
+    class FrameSettings
+    {
+    public:
+        FrameSettings() : m_effectId(MirrorEffect::None), m_strength(0.0f), m_count(0.0f) {}
+
+        QRect m_exposedRect;        // See VideoIF::exposedRect()
+        QSize m_targetSize;         // Of m_targetItem
+        int m_effectId;
+        float m_strength;
+        float m_count;
+    };
+
     QDeclarativeItem *m_targetItem;
     VideoIF *m_target;
-    MirrorEffect *m_mirrorEffect;
-    QVideoFrame m_frame;
-    QImage::Format m_imageFormat;
-    QVideoSurfaceFormat m_videoFormat;
-    QImage m_sourceImage;
-    QImage m_targetImage;
-    MirrorEffect::ImageProperties m_convertedImage;
-    double m_strength;
-    double m_count;
-    int m_effectId;
+    EffectWorker *m_worker; // Owned
+    mutable QMutex m_settingsMutex;
+    FrameSettings m_settings;       // Guarded by m_settingsMutex
+    QAtomicInt m_exposurePending;   // Non-zero while an updateExposure() is queued
+    FrameStats *m_frameStats;
+    float m_samplingScale;  // Of the effect, see TransformGenerator::samplingScale()
+    bool m_separable;       // The effect is processed by SeparableWarp
     bool m_framesExists;
 };
 
@@ -0,0 +1,362 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "proceduralwarp.h"
+
+#include <QVarLengthArray>
+
+#include "transformfunctors.h"
+#include "transformmap.h"
+#include "workerpool.h"
+
+
+/*
+  The target geometry shared by the bands of one process() call. The
+  co-ordinates are calculated as 18/14 fixedpoint like TransformGenerator
+  does, and stored with the precision of a map of the same source.
+*/
+class WarpGeometry
+{
+public:
+    unsigned int *m_target;
+    int m_width;
+    int m_height;
+    int m_pitch;
+    int m_left;         // The part of the target warped
+    int m_right;
+    int m_top;
+    int m_bottom;
+    int m_firstBand;    // The band of m_top
+    int m_xInc;
+    int m_yInc;
+    int m_maxX;
+    int m_maxY;
+    int m_mapShift;
+    int m_fracBits;
+    float m_pixelMul;
+    bool m_highQuality;
+};
+
+
+/*
+  Warps the bands [begin, end) of 1 << GridShift rows with Transform.
+*/
+template <class Transform>
+class ProceduralWarpTask : public WorkerTask
+{
+public:
+    ProceduralWarpTask(const MirrorEffect *effect,
+                       const WarpGeometry &geometry,
+                       const Transform &transform)
+        : m_effect(effect), m_geometry(geometry), m_transform(transform) {}
+
+    void run(int begin, int end);
+
+private:
+        // The shine is interpolated with 4 fraction bits
+    enum { Cell = 1 << Transform::GridShift, ShineShift = 4 };
+
+    void evaluateRow(Transform &transform, int y, int first, int step, int count,
+                     int *sourceX, int *sourceY, int *shine) const;
+
+    void sampleRow(int y, const unsigned short *srcX, const unsigned short *srcY,
+                   const unsigned char *shine) const;
+
+private: // Data
+    const MirrorEffect *m_effect;
+    const WarpGeometry &m_geometry;
+    Transform m_transform;
+};
+
+
+/*
+  Evaluates the transform at count points of the row y, step pixels apart
+  from the column first on. Returns the clamped 18/14 source co-ordinates
+  and the shine.
+*/
+template <class Transform>
+void ProceduralWarpTask<Transform>::evaluateRow(Transform &transform,
+                                                int y, int first, int step, int count,
+                                                int *sourceX, int *sourceY,
+                                                int *shine) const
+{
+    const WarpGeometry &g = m_geometry;
+    const float invWidth = 1.0f / (float)g.m_width;
+    const float rowT = (float)y / (float)g.m_height;
+    const int sy = g.m_yInc * y;
+
+    transform.setRow(y, rowT, (rowT - 0.5f) * 2.0f);
+
+    for (int i = 0; i < count; i++) {
+        const int x = first + i * step;
+        const float t = (float)x * invWidth;
+        float fx;
+        float fy;
+        transform(x, t, (t - 0.5f) * 2.0f, fx, fy);
+
+        int px = g.m_xInc * x + (int)(fx * g.m_pixelMul);
+        int py = sy + (int)(fy * g.m_pixelMul);
+
+        px = px < 0 ? 0 : px;
+        py = py < 0 ? 0 : py;
+        sourceX[i] = px > g.m_maxX ? g.m_maxX : px;
+        sourceY[i] = py > g.m_maxY ? g.m_maxY : py;
+
+        shine[i] = g.m_highQuality
+                ? (int)(TransformFunctors::surfaceShine(fx, fy) * (float)(1 << ShineShift))
+                : 0;
+    }
+}
+
+
+/*
+  Resamples the warped columns of the target row y from the co-ordinates
+  of the row, which start from the column 0.
+*/
+template <class Transform>
+void ProceduralWarpTask<Transform>::sampleRow(int y,
+                                              const unsigned short *srcX,
+                                              const unsigned short *srcY,
+                                              const unsigned char *shine) const
+{
+    const WarpGeometry &g = m_geometry;
+    unsigned int *t = g.m_target + g.m_pitch * y;
+
+    m_effect->sampleLine(t + g.m_left, t + g.m_right, srcX + g.m_left, srcY + g.m_left,
+                         g.m_highQuality ? shine + g.m_left : 0,
+                         g.m_fracBits, g.m_highQuality);
+}
+
+
+/*!
+  From WorkerTask. Warps the bands [begin, end) counted from the band of
+  the first row warped.
+*/
+template <class Transform>
+void ProceduralWarpTask<Transform>::run(int begin, int end)
+{
+    const WarpGeometry &g = m_geometry;
+    const int width = g.m_width;
+
+    begin += g.m_firstBand;
+    end += g.m_firstBand;
+
+    const int columns = (width + Cell - 1) / Cell + 1;
+    Transform transform(m_transform);
+
+    QVarLengthArray<unsigned short, 1024> srcX(width);
+    QVarLengthArray<unsigned short, 1024> srcY(width);
+    QVarLengthArray<unsigned char, 1024> shine(width);
+
+    if (Cell == 1) {
+            // Evaluate every pixel
+        QVarLengthArray<int, 1024> px(width);
+        QVarLengthArray<int, 1024> py(width);
+        QVarLengthArray<int, 1024> ps(width);
+
+        for (int y = begin; y < end && y < g.m_bottom; y++) {
+                // Only the warped columns, evaluating is the costly part
+            const int count = g.m_right - g.m_left;
+            evaluateRow(transform, y, g.m_left, 1, count, px.data(), py.data(), ps.data());
+
+            for (int i = 0; i < count; i++) {
+                const int x = g.m_left + i;
+                srcX[x] = (unsigned short)(px[i] >> g.m_mapShift);
+                srcY[x] = (unsigned short)(py[i] >> g.m_mapShift);
+                shine[x] = g.m_highQuality ? (unsigned char)(ps[i] >> ShineShift) : 0;
+            }
+
+            sampleRow(y, srcX.data(), srcY.data(), shine.data());
+        }
+
+        return;
+    }
+
+        // Grid rows at the top and the bottom of the band, and the
+        // interpolated grid row of the current target row.
+    QVarLengthArray<int, 256> topX(columns), topY(columns), topShine(columns);
+    QVarLengthArray<int, 256> bottomX(columns), bottomY(columns), bottomShine(columns);
+    QVarLengthArray<int, 256> rowX(columns), rowY(columns), rowShine(columns);
+
+    evaluateRow(transform, begin * Cell, 0, Cell, columns,
+                topX.data(), topY.data(), topShine.data());
+
+    for (int band = begin; band < end; band++) {
+        evaluateRow(transform, (band + 1) * Cell, 0, Cell, columns,
+                    bottomX.data(), bottomY.data(), bottomShine.data());
+
+        for (int r = 0; r < Cell; r++) {
+            const int y = band * Cell + r;
+
+            if (y < g.m_top)
+                continue;
+
+            if (y >= g.m_bottom)
+                break;
+
+            for (int i = 0; i < columns; i++) {
+                rowX[i] = (topX[i] * (Cell - r) + bottomX[i] * r) >> Transform::GridShift;
+                rowY[i] = (topY[i] * (Cell - r) + bottomY[i] * r) >> Transform::GridShift;
+                rowShine[i] = (topShine[i] * (Cell - r) + bottomShine[i] * r)
+                        >> Transform::GridShift;
+            }
+
+                // Step through the cells of the row, adding the difference
+                // of the cell's corners for every pixel.
+            const int shift = Transform::GridShift + g.m_mapShift;
+            const int shineShift = Transform::GridShift + ShineShift;
+
+            for (int i = 0; i < columns - 1; i++) {
+                const int x0 = i * Cell;
+                const int x1 = x0 + Cell < width ? x0 + Cell : width;
+                const int stepX = rowX[i + 1] - rowX[i];
+                const int stepY = rowY[i + 1] - rowY[i];
+                const int stepShine = rowShine[i + 1] - rowShine[i];
+                int accX = rowX[i] << Transform::GridShift;
+                int accY = rowY[i] << Transform::GridShift;
+                int accShine = rowShine[i] << Transform::GridShift;
+
+                for (int x = x0; x < x1; x++) {
+                    srcX[x] = (unsigned short)(accX >> shift);
+                    srcY[x] = (unsigned short)(accY >> shift);
+                    shine[x] = (unsigned char)(accShine >> shineShift);
+                    accX += stepX;
+                    accY += stepY;
+                    accShine += stepShine;
+                }
+            }
+
+            sampleRow(y, srcX.data(), srcY.data(), shine.data());
+        }
+
+        for (int i = 0; i < columns; i++) {
+            topX[i] = bottomX[i];
+            topY[i] = bottomY[i];
+            topShine[i] = bottomShine[i];
+        }
+    }
+}
+
+
+/*
+  Runs the warp of Transform over the bands of the warped rows.
+*/
+template <class Transform>
+static void warp(const MirrorEffect *effect, WarpGeometry &geometry,
+                 const Transform &transform, int threadCount)
+{
+    geometry.m_firstBand = geometry.m_top >> Transform::GridShift;
+
+    const int bands = ((geometry.m_bottom + (1 << Transform::GridShift) - 1)
+                       >> Transform::GridShift) - geometry.m_firstBand;
+    ProceduralWarpTask<Transform> task(effect, geometry, transform);
+
+        // Every band evaluates one extra grid row, so the chunks are kept a
+        // few bands high.
+    const int minimumBands = 32 >> Transform::GridShift;
+    WorkerPool::instance()->runBands(&task, bands, threadCount,
+                                     minimumBands > 0 ? minimumBands : 1);
+}
+
+
+/*!
+  \class ProceduralWarp
+  \brief Warps the source of a MirrorEffect without a transform map.
+*/
+
+
+/*!
+  Constructor.
+*/
+ProceduralWarp::ProceduralWarp(MirrorEffect::MirrorTransform transform,
+                               float power,
+                               float size,
+                               unsigned int ditherSeed)
+    : m_transform(transform),
+      m_power(power),
+      m_size(size),
+      m_ditherSeed(ditherSeed)
+{
+}
+
+
+/*!
+  Warps the source of \a effect into \a rect of the \a width x \a height
+  \a target. \a sourceWidth and \a sourceHeight are the dimensions of the
+  source as the map co-ordinates see it, i.e. after the rotation. The
+  transform is evaluated on the rows of \a rect only, and on its columns
+  too when it is evaluated at every pixel.
+*/
+void ProceduralWarp::process(const MirrorEffect *effect,
+                             unsigned int *target,
+                             int width,
+                             int height,
+                             int pitch,
+                             int sourceWidth,
+                             int sourceHeight,
+                             const QRect &rect,
+                             bool highQuality,
+                             int threadCount) const
+{
+    const QRect warped = rect & QRect(0, 0, width, height);
+
+    if (warped.isEmpty() || sourceWidth < 2 || sourceHeight < 2)
+        return;
+
+    WarpGeometry geometry;
+    geometry.m_target = target;
+    geometry.m_width = width;
+    geometry.m_height = height;
+    geometry.m_pitch = pitch;
+    geometry.m_left = warped.left();
+    geometry.m_right = warped.left() + warped.width();
+    geometry.m_top = warped.top();
+    geometry.m_bottom = warped.top() + warped.height();
+    geometry.m_firstBand = 0;
+    geometry.m_xInc = (sourceWidth << 14) / width;
+    geometry.m_yInc = (sourceHeight << 14) / height;
+    geometry.m_maxX = ((sourceWidth - 1) << 14) - 1;
+    geometry.m_maxY = ((sourceHeight - 1) << 14) - 1;
+    geometry.m_fracBits = TransformMap::fracBitsFor(sourceWidth, sourceHeight);
+    geometry.m_mapShift = 14 - geometry.m_fracBits;
+    geometry.m_pixelMul = (float)(sourceWidth + (float)sourceHeight) * 2000.0f / m_size;
+    geometry.m_highQuality = highQuality;
+
+    using namespace TransformFunctors;
+    const Parameters parameters(m_power, m_size, m_ditherSeed);
+
+    switch (m_transform) {
+    default:
+    case MirrorEffect::None:
+        warp(effect, geometry, None(parameters), threadCount);
+        break;
+    case MirrorEffect::HorizontalWave:
+        warp(effect, geometry, HorizontalWave(parameters), threadCount);
+        break;
+    case MirrorEffect::VerticalWave:
+        warp(effect, geometry, VerticalWave(parameters), threadCount);
+        break;
+    case MirrorEffect::Bubbles:
+        warp(effect, geometry, Bubbles(parameters), threadCount);
+        break;
+    case MirrorEffect::InvBubbles:
+        warp(effect, geometry, InvBubbles(parameters), threadCount);
+        break;
+    case MirrorEffect::Spiral:
+        warp(effect, geometry, Spiral(parameters), threadCount);
+        break;
+    case MirrorEffect::Ripple:
+        warp(effect, geometry, Ripple(parameters), threadCount);
+        break;
+    case MirrorEffect::Spike:
+        warp(effect, geometry, Spike(parameters), threadCount);
+        break;
+    case MirrorEffect::Tile:
+        warp(effect, geometry, Tile(parameters), threadCount);
+        break;
+    case MirrorEffect::Dither:
+        warp(effect, geometry, Dither(parameters), threadCount);
+        break;
+    } // switch (m_transform)
+}
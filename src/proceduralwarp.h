@@ -0,0 +1,56 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef PROCEDURALWARP_H
+#define PROCEDURALWARP_H
+
+#include "mirroreffect.h"
+
+
+/*!
+  \class ProceduralWarp
+  \brief Warps the source of a MirrorEffect without a transform map.
+
+  The transform is evaluated while warping. The target is processed in
+  bands of grid cells: the transform functor (see TransformFunctors) is
+  evaluated only at the corners of the cells, and the source co-ordinates
+  and the shine inside a cell are interpolated from the corners with
+  incremental fixed point additions. Transforms which are not smooth are
+  evaluated at every pixel. The resulting co-ordinates of a row go through
+  the same resampling kernels as the rows of a map.
+
+  The warp loop is a template instantiated for each transform, so there is
+  no per-pixel dispatch. Changing the power or the size costs nothing, and
+  the memory use is a few rows of co-ordinates per thread.
+*/
+class ProceduralWarp
+{
+public:
+    ProceduralWarp(MirrorEffect::MirrorTransform transform,
+                   float power,
+                   float size,
+                   unsigned int ditherSeed);
+
+public:
+        // Warps the source of effect into rect of its target. threadCount
+        // as in MirrorEffect::setThreadCount().
+    void process(const MirrorEffect *effect,
+                 unsigned int *target,
+                 int width,
+                 int height,
+                 int pitch,
+                 int sourceWidth,
+                 int sourceHeight,
+                 const QRect &rect,
+                 bool highQuality,
+                 int threadCount) const;
+
+private: // Data
+    MirrorEffect::MirrorTransform m_transform;
+    float m_power;
+    float m_size;
+    unsigned int m_ditherSeed;
+};
+
+#endif // PROCEDURALWARP_H
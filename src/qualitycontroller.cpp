@@ -0,0 +1,248 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "qualitycontroller.h"
+
+static const float DefaultHeadroom = 0.8f;
+static const qint64 DefaultFrameInterval = 1000000000 / 30;
+static const qint64 MaxFrameInterval = 1000000000;  // Longer gaps are pauses, not the frame rate
+static const int AverageWeight = 8;     // The running averages move 1/8 of the way per sample
+static const int StepDownFrames = 3;    // Frames over the budget in a row to step down
+static const int StepUpFrames = 30;     // Frames under StepUpShare in a row to step up
+static const float StepUpShare = 0.5f;  // The share of the budget to stay under to step up
+
+
+/*!
+  \class QualityController
+  \brief Steps the effect's quality down and up to keep the processing of a frame within the frame budget.
+*/
+
+
+/*!
+  Constructor. Starts at the best tier assuming 30 frames per second until
+  the frame rate has been measured.
+*/
+QualityController::QualityController()
+    : m_headroom(DefaultHeadroom),
+      m_bestTier(HighQuality),
+      m_worstTier(HalfFrameRate)
+{
+    reset();
+}
+
+
+/*!
+  Sets the share of the frame interval the processing of a frame may take
+  to \a headroom. The rest is left for the camera, the painting and the
+  other mirrors.
+*/
+void QualityController::setHeadroom(float headroom)
+{
+    m_headroom = qBound(0.1f, headroom, 1.0f);
+}
+
+
+/*!
+  Returns the share of the frame interval the processing of a frame may
+  take.
+*/
+float QualityController::headroom() const
+{
+    return m_headroom;
+}
+
+
+/*!
+  Limits the tiers the controller steps between to from \a best to
+  \a worst.
+*/
+void QualityController::setTierRange(Tier best, Tier worst)
+{
+    m_bestTier = qMin(best, worst);
+    m_worstTier = qMax(best, worst);
+
+    if (m_tier < m_bestTier || m_tier > m_worstTier)
+        stepTo(qBound(m_bestTier, m_tier, m_worstTier));
+}
+
+
+/*!
+  Measures the frame interval from \a timestamp, in nanoseconds, and the
+  previous frame's. Returns false if the frame should be skipped, which is
+  every other frame at the HalfFrameRate tier.
+*/
+bool QualityController::frameArrived(qint64 timestamp)
+{
+    if (m_lastArrival >= 0) {
+        const qint64 interval = timestamp - m_lastArrival;
+
+        if (interval > 0 && interval < MaxFrameInterval)
+            m_frameInterval += (interval - m_frameInterval) / AverageWeight;
+    }
+
+    m_lastArrival = timestamp;
+
+    if (m_tier != HalfFrameRate)
+        return true;
+
+    const bool skip = m_skipNext;
+    m_skipNext = !m_skipNext;
+    return !skip;
+}
+
+
+/*!
+  Counts a frame dropped because the previous one was still being
+  processed as a frame over the budget.
+*/
+void QualityController::frameDropped()
+{
+    m_underBudgetFrames = 0;
+
+    if (++m_overBudgetFrames >= StepDownFrames && m_tier < m_worstTier)
+        stepTo(m_tier + 1);
+}
+
+
+/*!
+  Compares the processing time of a frame, \a nanoseconds, to the budget
+  and steps to the next cheaper tier after StepDownFrames frames over it.
+  After StepUpFrames frames well under the budget steps to the next better
+  tier, unless its cost when last used doesn't fit into the budget. In that
+  case the remembered cost is lowered a bit instead, so that the better
+  tier is tried again after a while if the load is gone.
+*/
+void QualityController::frameProcessed(qint64 nanoseconds)
+{
+    qint64 &cost = m_cost[m_tier];
+    cost = cost > 0 ? cost + (nanoseconds - cost) / AverageWeight : nanoseconds;
+
+    const qint64 budget = budgetAt(m_tier);
+
+    if (nanoseconds > budget) {
+        frameDropped();
+        return;
+    }
+
+    m_overBudgetFrames = 0;
+
+    if (nanoseconds > budget * StepUpShare) {
+        m_underBudgetFrames = 0;
+        return;
+    }
+
+    if (++m_underBudgetFrames < StepUpFrames || m_tier <= m_bestTier)
+        return;
+
+    const int better = m_tier - 1;
+
+    if (m_cost[better] <= budgetAt(better)) {
+        stepTo(better);
+    }
+    else {
+        m_cost[better] -= m_cost[better] / AverageWeight;
+        m_underBudgetFrames = 0;
+    }
+}
+
+
+/*!
+  Returns the current tier.
+*/
+QualityController::Tier QualityController::tier() const
+{
+    return (Tier)m_tier;
+}
+
+
+/*!
+  Returns the processing time allowed for a frame at the current tier, in
+  nanoseconds.
+*/
+qint64 QualityController::frameBudget() const
+{
+    return budgetAt(m_tier);
+}
+
+
+/*!
+  Returns the measured interval of the camera frames, in nanoseconds.
+*/
+qint64 QualityController::frameInterval() const
+{
+    return m_frameInterval;
+}
+
+
+/*!
+  Returns true if the current tier resamples linearly.
+*/
+bool QualityController::highQuality() const
+{
+    return m_tier == HighQuality;
+}
+
+
+/*!
+  Returns the divisor of the mirror's width and height the effect should
+  be processed at.
+*/
+int QualityController::resolutionDivisor() const
+{
+    return m_tier >= ReducedResolution ? 2 : 1;
+}
+
+
+/*!
+  Returns to the best tier and forgets the frame interval and the costs.
+*/
+void QualityController::reset()
+{
+    m_lastArrival = -1;
+    m_frameInterval = DefaultFrameInterval;
+
+    for (int i = 0; i < TierCount; i++)
+        m_cost[i] = 0;
+
+    stepTo(m_bestTier);
+}
+
+
+/*!
+  Returns the name of \a tier for the statistics.
+*/
+const char *QualityController::tierName(Tier tier)
+{
+    switch (tier) {
+    case HighQuality: return "high";
+    case LowQuality: return "low";
+    case ReducedResolution: return "reduced";
+    case HalfFrameRate: return "half-rate";
+    default: return "";
+    }
+}
+
+
+/*!
+  Changes to \a tier and starts counting the frames over and under the
+  budget from scratch.
+*/
+void QualityController::stepTo(int tier)
+{
+    m_tier = tier;
+    m_overBudgetFrames = 0;
+    m_underBudgetFrames = 0;
+    m_skipNext = false;
+}
+
+
+/*!
+  Returns the budget at \a tier. At HalfFrameRate a frame has the time of
+  two camera frames.
+*/
+qint64 QualityController::budgetAt(int tier) const
+{
+    const qint64 budget = (qint64)(m_frameInterval * m_headroom);
+    return tier == HalfFrameRate ? budget * 2 : budget;
+}
@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef QUALITYCONTROLLER_H
+#define QUALITYCONTROLLER_H
+
+#include <QtGlobal>
+
+
+/*!
+  \class QualityController
+  \brief Steps the effect's quality down and up to keep the processing of a frame within the frame budget.
+
+  The budget is a share of the interval the camera delivers the frames at,
+  measured from their arrival. The processing time of every frame is
+  compared to it. A few frames over the budget in a row, or a frame
+  dropped because the previous one was still being processed, step to the
+  next cheaper tier. Stepping back up needs a long run of frames well under
+  the budget, and the cost last seen at the better tier must fit into the
+  budget too, so that the quality doesn't oscillate between two tiers.
+
+  The processing time reflects the load of the whole device, so a mirror
+  competing with the other mirrors for the cores steps down by itself.
+*/
+class QualityController
+{
+public: // Data types
+    enum Tier {
+        HighQuality,        // Linear resampling at the full resolution
+        LowQuality,         // Nearest pixel at the full resolution
+        ReducedResolution,  // Nearest pixel at half the resolution, scaled when painted
+        HalfFrameRate,      // As ReducedResolution, every other frame skipped
+        TierCount
+    };
+
+public:
+    QualityController();
+
+public:
+        // The share of the frame interval the processing may take, 0.8 by
+        // default
+    void setHeadroom(float headroom);
+    float headroom() const;
+
+        // The tiers the controller steps between, all by default
+    void setTierRange(Tier best, Tier worst);
+
+        // Call for every frame the camera delivers, with a monotonic time
+        // in nanoseconds. Returns false if the frame should be skipped.
+    bool frameArrived(qint64 timestamp);
+
+        // Call when a frame was dropped because the previous one was
+        // still being processed
+    void frameDropped();
+
+        // Call with the processing time of every frame processed
+    void frameProcessed(qint64 nanoseconds);
+
+    Tier tier() const;
+
+        // The processing time allowed for a frame at the current tier
+    qint64 frameBudget() const;
+
+        // The measured interval of the camera frames
+    qint64 frameInterval() const;
+
+        // The settings of the current tier
+    bool highQuality() const;
+    int resolutionDivisor() const;
+
+        // Returns to the best tier and forgets the measurements
+    void reset();
+
+    static const char *tierName(Tier tier);
+
+private:
+    void stepTo(int tier);
+    qint64 budgetAt(int tier) const;
+
+private: // Data
+    float m_headroom;
+    int m_bestTier;
+    int m_worstTier;
+    int m_tier;
+    qint64 m_lastArrival;
+    qint64 m_frameInterval;         // Running average
+    qint64 m_cost[TierCount];       // Running average per tier, 0 if not known
+    int m_overBudgetFrames;         // Consecutive
+    int m_underBudgetFrames;        // Consecutive
+    bool m_skipNext;
+};
+
+#endif // QUALITYCONTROLLER_H
@@ -0,0 +1,426 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "separablewarp.h"
+
+#include <QVarLengthArray>
+#include <string.h>
+
+#include "transformfunctors.h"
+#include "transformmap.h"
+#include "warpkernels.h"
+
+// Shine levels per axis when the shine varies along both axes
+static const int QuantizedShineLevels = 64;
+
+
+/*
+  The levels of the shine table along one axis. A constant displacement
+  needs one level. If the other axis is constant, every column (or row) gets
+  a level of its own; otherwise the range of the displacement is quantized.
+*/
+static int shineLevels(const QVector<float> &values, bool otherConstant,
+                       QVector<unsigned short> &index, QVector<float> &levels)
+{
+    const int count = values.size();
+    float minimum = values[0];
+    float maximum = values[0];
+
+    for (int i = 1; i < count; i++) {
+        minimum = values[i] < minimum ? values[i] : minimum;
+        maximum = values[i] > maximum ? values[i] : maximum;
+    }
+
+    index.resize(count);
+
+    if (minimum == maximum) {
+        index.fill(0);
+        levels.fill(minimum, 1);
+        return 1;
+    }
+
+    if (otherConstant) {
+        for (int i = 0; i < count; i++)
+            index[i] = (unsigned short)i;
+
+        levels = values;
+        return count;
+    }
+
+    const float step = (maximum - minimum) / (float)(QuantizedShineLevels - 1);
+    levels.resize(QuantizedShineLevels);
+
+    for (int i = 0; i < QuantizedShineLevels; i++)
+        levels[i] = minimum + step * (float)i;
+
+    for (int i = 0; i < count; i++)
+        index[i] = (unsigned short)((values[i] - minimum) / step + 0.5f);
+
+    return QuantizedShineLevels;
+}
+
+
+/*!
+  \class SeparableWarp
+  \brief Warps an RGB32 source with a transform whose axes are independent.
+*/
+
+
+/*!
+  Constructor.
+*/
+SeparableWarp::SeparableWarp()
+    : m_transform(MirrorEffect::None),
+      m_power(0.0f),
+      m_size(0.0f),
+      m_sourceWidth(0),
+      m_sourceHeight(0),
+      m_width(0),
+      m_height(0),
+      m_fracBits(0),
+      m_minColumn(0),
+      m_maxColumn(0),
+      m_nearestCopyCount(0),
+      m_linearCopyCount(0),
+      m_shineColumns(0),
+      m_shineIndexed(false),
+      m_target(0),
+      m_targetPitch(0),
+      m_source(0),
+      m_sourcePitch(0),
+      m_highQuality(false)
+{
+}
+
+
+/*!
+  Returns true if the source column of \a transform depends only on the
+  target column and the source row only on the target row.
+*/
+bool SeparableWarp::isSeparable(MirrorEffect::MirrorTransform transform)
+{
+    switch (transform) {
+    case MirrorEffect::None:
+    case MirrorEffect::HorizontalWave:
+    case MirrorEffect::VerticalWave:
+    case MirrorEffect::Tile:
+        return true;
+    default:
+        break;
+    }
+
+    return false;
+}
+
+
+/*!
+  Creates the tables of \a transform for a \a width x \a height target and a
+  \a sourceWidth x \a sourceHeight source.
+*/
+void SeparableWarp::create(MirrorEffect::MirrorTransform transform,
+                           float power,
+                           float size,
+                           int sourceWidth,
+                           int sourceHeight,
+                           int width,
+                           int height)
+{
+    if (!isNull()
+            && transform == m_transform && power == m_power && size == m_size
+            && sourceWidth == m_sourceWidth && sourceHeight == m_sourceHeight
+            && width == m_width && height == m_height)
+    {
+        return;
+    }
+
+    clear();
+
+    if (!isSeparable(transform) || width < 1 || height < 1
+            || sourceWidth < 2 || sourceHeight < 2)
+    {
+        return;
+    }
+
+    m_transform = transform;
+    m_power = power;
+    m_size = size;
+    m_sourceWidth = sourceWidth;
+    m_sourceHeight = sourceHeight;
+    m_width = width;
+    m_height = height;
+    m_fracBits = TransformMap::fracBitsFor(sourceWidth, sourceHeight);
+
+    using namespace TransformFunctors;
+    const Parameters parameters(power, size, 0);
+
+    switch (transform) {
+    default:
+    case MirrorEffect::None:
+        createTables(None(parameters));
+        break;
+    case MirrorEffect::HorizontalWave:
+        createTables(HorizontalWave(parameters));
+        break;
+    case MirrorEffect::VerticalWave:
+        createTables(VerticalWave(parameters));
+        break;
+    case MirrorEffect::Tile:
+        createTables(Tile(parameters));
+        break;
+    } // switch (transform)
+}
+
+
+/*!
+  Evaluates the displacement of every column and every row with
+  \a transform. The co-ordinates are calculated and clamped as in
+  TransformGenerator::storeRow(), so they are the same as the ones of a map.
+*/
+template <class Transform>
+void SeparableWarp::createTables(Transform transform)
+{
+    const int xInc = (m_sourceWidth << 14) / m_width;
+    const int yInc = (m_sourceHeight << 14) / m_height;
+    const int maxX = ((m_sourceWidth - 1) << 14) - 1;
+    const int maxY = ((m_sourceHeight - 1) << 14) - 1;
+    const int mapShift = 14 - m_fracBits;
+    const float pixelMul = (float)(m_sourceWidth + (float)m_sourceHeight) * 2000.0f / m_size;
+
+    QVector<float> columnFx(m_width);
+    QVector<float> rowFy(m_height);
+    float fx;
+    float fy;
+
+    m_columnX.resize(m_width);
+    m_rowY.resize(m_height);
+
+        // The x displacement doesn't depend on the row
+    transform.setRow(0, 0.0f, -1.0f);
+
+    for (int x = 0; x < m_width; x++) {
+        const float t = (float)x / (float)m_width;
+        transform(x, t, (t - 0.5f) * 2.0f, fx, fy);
+
+        int sourceX = xInc * x + (int)(fx * pixelMul);
+        sourceX = sourceX < 0 ? 0 : sourceX;
+        sourceX = sourceX > maxX ? maxX : sourceX;
+
+        columnFx[x] = fx;
+        m_columnX[x] = (unsigned short)(sourceX >> mapShift);
+    }
+
+        // ...and the y displacement doesn't depend on the column
+    for (int y = 0; y < m_height; y++) {
+        const float rowT = (float)y / (float)m_height;
+        transform.setRow(y, rowT, (rowT - 0.5f) * 2.0f);
+        transform(0, 0.0f, -1.0f, fx, fy);
+
+        int sourceY = yInc * y + (int)(fy * pixelMul);
+        sourceY = sourceY < 0 ? 0 : sourceY;
+        sourceY = sourceY > maxY ? maxY : sourceY;
+
+        rowFy[y] = fy;
+        m_rowY[y] = (unsigned short)(sourceY >> mapShift);
+    }
+
+    m_minColumn = m_columnX[0] >> m_fracBits;
+    m_maxColumn = m_minColumn;
+
+    for (int x = 1; x < m_width; x++) {
+        const int column = m_columnX[x] >> m_fracBits;
+        m_minColumn = column < m_minColumn ? column : m_minColumn;
+        m_maxColumn = column > m_maxColumn ? column : m_maxColumn;
+    }
+
+    while (m_nearestCopyCount < m_width
+           && (m_columnX[m_nearestCopyCount] >> m_fracBits) == m_nearestCopyCount)
+    {
+        m_nearestCopyCount++;
+    }
+
+    while (m_linearCopyCount < m_width
+           && m_columnX[m_linearCopyCount] == (m_linearCopyCount << m_fracBits))
+    {
+        m_linearCopyCount++;
+    }
+
+    createShine(columnFx, rowFy);
+}
+
+
+/*!
+  Builds the shine table. The shine of a pixel is
+  m_shineTable[m_shineRow[y] * m_shineColumns + m_shineColumn[x]].
+*/
+void SeparableWarp::createShine(const QVector<float> &columnFx, const QVector<float> &rowFy)
+{
+    QVector<float> columnLevels;
+    QVector<float> rowLevels;
+    bool columnsConstant = true;
+    bool rowsConstant = true;
+
+    for (int x = 1; x < columnFx.size() && columnsConstant; x++)
+        columnsConstant = columnFx[x] == columnFx[0];
+
+    for (int y = 1; y < rowFy.size() && rowsConstant; y++)
+        rowsConstant = rowFy[y] == rowFy[0];
+
+    m_shineColumns = shineLevels(columnFx, rowsConstant, m_shineColumn, columnLevels);
+    m_shineIndexed = columnsConstant || !rowsConstant;
+    const int shineRows = shineLevels(rowFy, columnsConstant, m_shineRow, rowLevels);
+
+    m_shineTable.resize(m_shineColumns * shineRows);
+    m_shineRowLit.fill(false, shineRows);
+
+    for (int r = 0; r < shineRows; r++) {
+        unsigned char *shine = m_shineTable.data() + r * m_shineColumns;
+
+        for (int c = 0; c < m_shineColumns; c++) {
+            shine[c] = (unsigned char)TransformFunctors::surfaceShine(columnLevels[c],
+                                                                      rowLevels[r]);
+            if (shine[c] > 0)
+                m_shineRowLit[r] = true;
+        }
+    }
+}
+
+
+/*!
+  Releases the tables.
+*/
+void SeparableWarp::clear()
+{
+    m_columnX.clear();
+    m_rowY.clear();
+    m_shineColumn.clear();
+    m_shineRow.clear();
+    m_shineTable.clear();
+    m_shineRowLit.clear();
+    m_width = 0;
+    m_height = 0;
+    m_shineColumns = 0;
+    m_nearestCopyCount = 0;
+    m_linearCopyCount = 0;
+}
+
+
+/*!
+  Returns true if there are no tables.
+*/
+bool SeparableWarp::isNull() const
+{
+    return m_columnX.isEmpty();
+}
+
+
+/*!
+  Returns the number of bytes allocated for the tables.
+*/
+int SeparableWarp::byteCount() const
+{
+    return (m_columnX.size() + m_rowY.size()
+            + m_shineColumn.size() + m_shineRow.size()) * sizeof(unsigned short)
+            + m_shineTable.size() + m_shineRowLit.size() * sizeof(bool);
+}
+
+
+/*!
+  Warps \a source into \a target, spreading the rows over the worker
+  threads.
+*/
+void SeparableWarp::process(unsigned int *target,
+                            int targetPitch,
+                            const unsigned int *source,
+                            int sourcePitch,
+                            const QRect &rect,
+                            bool highQuality,
+                            int threadCount)
+{
+    m_rect = rect & QRect(0, 0, m_width, m_height);
+
+    if (isNull() || m_rect.isEmpty())
+        return;
+
+    m_target = target;
+    m_targetPitch = targetPitch;
+    m_source = source;
+    m_sourcePitch = sourcePitch;
+    m_highQuality = highQuality;
+
+    const int height = m_rect.height();
+    WorkerPool::instance()->runBands(this, height, threadCount, 8);
+}
+
+
+/*!
+  From WorkerTask. Processes the rows [begin, end) of m_rect, the columns
+  of m_rect only. The leading columns which are copied as such are copied
+  as far as they are in m_rect.
+*/
+void SeparableWarp::run(int begin, int end)
+{
+    const WarpKernels::RowFunction separableLine = WarpKernels::separableLine();
+    const WarpKernels::BlendFunction blendRows = WarpKernels::blendRows();
+    const unsigned int fracMask = (1 << m_fracBits) - 1;
+    const int weightShift = 7 - m_fracBits;
+    const int width = m_width;
+    const int spanBegin = m_minColumn;
+    const int spanLength = m_maxColumn + 2 - m_minColumn;
+
+    QVarLengthArray<unsigned int, 1024> blended(m_sourceWidth);
+    QVarLengthArray<unsigned char, 1024> shineRow(width);
+
+    const int left = m_rect.left();
+    const int right = left + m_rect.width();
+
+    for (int y = m_rect.top() + begin; y < m_rect.top() + end; y++) {
+        unsigned int *t = m_target + m_targetPitch * y;
+        const unsigned int sourceY = m_rowY[y];
+        const unsigned int *row = m_source + m_sourcePitch * (sourceY >> m_fracBits);
+
+        if (!m_highQuality) {
+            const int copyEnd = qBound(left, m_nearestCopyCount, right);
+            memcpy(t + left, row + left, (copyEnd - left) * sizeof(unsigned int));
+            WarpKernels::separableNearestLine(t + copyEnd, t + right,
+                                              m_columnX.constData() + copyEnd,
+                                              m_fracBits, row);
+            continue;
+        }
+
+        const int weight = (sourceY & fracMask) << weightShift;
+
+        if (weight > 0) {
+                // Interpolate the two source rows along the span the
+                // columns read
+            blendRows(blended.data() + spanBegin, row + spanBegin,
+                      row + m_sourcePitch + spanBegin, spanLength, weight);
+            row = blended.constData();
+        }
+
+        const int r = m_shineRow[y];
+        const unsigned char *shine = 0;
+        int copyCount = m_linearCopyCount;
+
+        if (m_shineRowLit[r]) {
+            shine = m_shineTable.constData() + r * m_shineColumns;
+            copyCount = 0;
+
+            if (m_shineColumns == 1) {
+                memset(shineRow.data(), *shine, width);
+                shine = shineRow.constData();
+            }
+            else if (m_shineIndexed) {
+                for (int x = 0; x < width; x++)
+                    shineRow[x] = shine[m_shineColumn[x]];
+
+                shine = shineRow.constData();
+            }
+        }
+
+        const int copyEnd = qBound(left, copyCount, right);
+        memcpy(t + left, row + left, (copyEnd - left) * sizeof(unsigned int));
+        separableLine(t + copyEnd, t + right, m_columnX.constData() + copyEnd,
+                      shine ? shine + copyEnd : 0, m_fracBits, row);
+    }
+}
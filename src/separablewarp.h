@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef SEPARABLEWARP_H
+#define SEPARABLEWARP_H
+
+#include <QRect>
+#include <QVector>
+
+#include "mirroreffect.h"
+#include "workerpool.h"
+
+
+/*!
+  \class SeparableWarp
+  \brief Warps an RGB32 source with a transform whose axes are independent.
+
+  With None, HorizontalWave, VerticalWave and Tile the source column of a
+  pixel depends only on its target column and the source row only on its
+  target row. Instead of a map of one entry per target pixel the warp keeps
+  one source column per target column and one source row per target row,
+  computed exactly as TransformGenerator would, so the memory use is
+  O(width + height). A target row is produced from a single source row:
+  the two source rows are first interpolated along the columns the row
+  touches, and the result is resampled horizontally. Leading columns which
+  map one to one are copied as they are.
+
+  The shine is looked up from a small table indexed by the column and the
+  row. It is exact for the waves; for Tile, which has shine varying along
+  both axes, the displacements are quantized to 64 levels per axis.
+*/
+class SeparableWarp : public WorkerTask
+{
+public:
+    SeparableWarp();
+
+public:
+        // True if transform can be processed by SeparableWarp
+    static bool isSeparable(MirrorEffect::MirrorTransform transform);
+
+        // (Re)creates the tables for the transform and the dimensions.
+        // Does nothing when they have not changed since the last call.
+    void create(MirrorEffect::MirrorTransform transform,
+                float power,
+                float size,
+                int sourceWidth,
+                int sourceHeight,
+                int width,
+                int height);
+
+        // Releases the tables
+    void clear();
+    bool isNull() const;
+
+        // The memory used by the tables
+    int byteCount() const;
+
+        // Warps the source into rect of the target. The dimensions are the
+        // ones given to create(), the pitches are in pixels. threadCount as
+        // in MirrorEffect::setThreadCount().
+    void process(unsigned int *target,
+                 int targetPitch,
+                 const unsigned int *source,
+                 int sourcePitch,
+                 const QRect &rect,
+                 bool highQuality,
+                 int threadCount);
+
+public: // From WorkerTask
+    void run(int begin, int end);
+
+protected:
+        // Evaluates the displacement tables with one of TransformFunctors
+    template <class Transform>
+    void createTables(Transform transform);
+
+        // Builds the shine table from the displacements of the columns and
+        // the rows
+    void createShine(const QVector<float> &columnFx, const QVector<float> &rowFy);
+
+private: // Data
+    MirrorEffect::MirrorTransform m_transform;
+    float m_power;
+    float m_size;
+    int m_sourceWidth;
+    int m_sourceHeight;
+    int m_width;
+    int m_height;
+    int m_fracBits;
+
+    QVector<unsigned short> m_columnX;  // Source x of each target column
+    QVector<unsigned short> m_rowY;     // Source y of each target row
+    int m_minColumn;                    // The source columns read by a row
+    int m_maxColumn;
+    int m_nearestCopyCount;             // Leading columns copied as such
+    int m_linearCopyCount;
+
+    QVector<unsigned short> m_shineColumn;  // Shine table column of each column
+    QVector<unsigned short> m_shineRow;     // Shine table row of each row
+    QVector<unsigned char> m_shineTable;
+    QVector<bool> m_shineRowLit;            // False if the table row is all zero
+    int m_shineColumns;
+    bool m_shineIndexed;                    // False if m_shineColumn[x] == x
+
+        // The arguments of the current process() call
+    unsigned int *m_target;
+    int m_targetPitch;
+    const unsigned int *m_source;
+    int m_sourcePitch;
+    QRect m_rect;
+    bool m_highQuality;
+};
+
+#endif // SEPARABLEWARP_H
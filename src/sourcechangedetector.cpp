@@ -0,0 +1,225 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "sourcechangedetector.h"
+
+#include <QVarLengthArray>
+#include <string.h>
+
+static const int ThumbnailShift = 2;        // The thumbnail is a quarter of the source
+static const int BlockRows = SourceChangeDetector::BlockSize >> ThumbnailShift;    // Thumbnail rows of a block
+static const unsigned int ChangeThreshold = 4 * BlockRows * BlockRows;  // 4 levels of luma per sample
+
+
+/*!
+  \class SourceChangeDetector
+  \brief Finds the blocks of the source which have changed since the previous frames.
+*/
+
+
+/*!
+  Constructor.
+*/
+SourceChangeDetector::SourceChangeDetector()
+    : m_source(0),
+      m_sourcePitch(0),
+      m_uyvySource(0),
+      m_width(0),
+      m_height(0),
+      m_blocksX(0),
+      m_blocksY(0),
+      m_hasReference(false),
+      m_sadRows(WarpKernels::blockSadRows())
+{
+}
+
+
+/*!
+  Compares an RGB32 source with the reference and marks the changed
+  blocks.
+*/
+void SourceChangeDetector::detect(const unsigned int *source, int width, int height,
+                                  int pitch, int threadCount)
+{
+    prepare(width, height);
+
+    m_source = source;
+    m_sourcePitch = pitch;
+    m_uyvySource = 0;
+
+    detectRows(threadCount);
+    m_source = 0;
+}
+
+
+/*!
+  Compares a UYVY source with the reference and marks the changed blocks.
+  Only the luma is compared.
+*/
+void SourceChangeDetector::detect(const WarpKernels::UyvySource &source, int width, int height,
+                                  int threadCount)
+{
+    prepare(width, height);
+
+    m_source = 0;
+    m_uyvySource = &source;
+
+    detectRows(threadCount);
+    m_uyvySource = 0;
+}
+
+
+/*!
+  Forgets the reference, so the next detect() marks every block changed.
+*/
+void SourceChangeDetector::reset()
+{
+    m_hasReference = false;
+}
+
+
+/*!
+  Returns the number of blocks along a row of the source.
+*/
+int SourceChangeDetector::blocksX() const
+{
+    return m_blocksX;
+}
+
+
+/*!
+  Returns the number of blocks along a column of the source.
+*/
+int SourceChangeDetector::blocksY() const
+{
+    return m_blocksY;
+}
+
+
+/*!
+  Returns a byte per block, non-zero for the blocks changed by the last
+  detect().
+*/
+const unsigned char *SourceChangeDetector::changedBlocks() const
+{
+    return m_changed.constData();
+}
+
+
+/*!
+  From WorkerTask. Compares the rows of blocks [begin, end) with the
+  reference. The thumbnail rows of a row of blocks are sampled into a
+  buffer of their own, and copied into the reference only for the blocks
+  which have changed.
+*/
+void SourceChangeDetector::run(int begin, int end)
+{
+    const int pitch = m_blocksX * BlockRows;
+    QVarLengthArray<unsigned char, 4096> rows(pitch * BlockRows);
+    QVarLengthArray<unsigned int, 256> sums(m_blocksX);
+
+    for (int by = begin; by < end; by++) {
+        unsigned char *reference = m_reference.data() + pitch * BlockRows * by;
+        unsigned char *changed = m_changed.data() + m_blocksX * by;
+
+        memset(sums.data(), 0, m_blocksX * sizeof(unsigned int));
+
+        for (int row = 0; row < BlockRows; row++) {
+            unsigned char *t = rows.data() + pitch * row;
+            thumbnailRow(t, by * BlockRows + row);
+            m_sadRows(sums.data(), t, reference + pitch * row, m_blocksX);
+        }
+
+        for (int bx = 0; bx < m_blocksX; bx++) {
+            changed[bx] = !m_hasReference || sums[bx] > ChangeThreshold;
+
+            if (!changed[bx])
+                continue;
+
+            for (int row = 0; row < BlockRows; row++) {
+                memcpy(reference + pitch * row + BlockRows * bx,
+                       rows.constData() + pitch * row + BlockRows * bx,
+                       BlockRows);
+            }
+        }
+    }
+}
+
+
+/*!
+  Sizes the reference and the changed blocks for a \a width x \a height
+  source. The reference is forgotten when the dimensions change.
+*/
+void SourceChangeDetector::prepare(int width, int height)
+{
+    if (width == m_width && height == m_height)
+        return;
+
+    m_width = width;
+    m_height = height;
+    m_blocksX = (width + BlockSize - 1) >> BlockShift;
+    m_blocksY = (height + BlockSize - 1) >> BlockShift;
+    m_reference.fill(0, m_blocksX * m_blocksY * BlockRows * BlockRows);
+    m_changed.fill(0, m_blocksX * m_blocksY);
+    m_hasReference = false;
+}
+
+
+/*!
+  Compares the rows of blocks, spreading them over the worker threads.
+  Updates the reference.
+*/
+void SourceChangeDetector::detectRows(int threadCount)
+{
+    WorkerPool::instance()->runBands(this, m_blocksY, threadCount, 1);
+    m_hasReference = true;
+}
+
+
+/*!
+  Samples the thumbnail row \a y into \a t, a byte per thumbnail pixel over
+  all the blocks of the row. A thumbnail pixel averages the luma of four
+  neighbouring pixels of a source row. The samples past the source repeat
+  its last column and row, the same for every frame.
+*/
+void SourceChangeDetector::thumbnailRow(unsigned char *t, int y) const
+{
+    const int count = m_blocksX * BlockRows;
+    const int maxX = m_width - 1;
+    const int sourceY = qMin((y << ThumbnailShift) + 1, m_height - 1);
+
+    if (m_source) {
+        const unsigned int *row = m_source + m_sourcePitch * sourceY;
+
+        for (int i = 0; i < count; i++) {
+            unsigned int sum = 0;
+
+            for (int j = 0; j < 4; j++) {
+                const unsigned int pixel = row[qMin((i << ThumbnailShift) + j, maxX)];
+                sum += ((pixel >> 16) & 0xFF) + ((pixel >> 7) & 0x1FE) + (pixel & 0xFF);
+            }
+
+            t[i] = (unsigned char)((sum + 8) >> 4);
+        }
+
+        return;
+    }
+
+        // The luma of the pixel (x, sourceY) is step * x bytes from the one
+        // of (0, sourceY) whatever the orientation, see UyvySource
+    const WarpKernels::UyvySource &source = *m_uyvySource;
+    const unsigned char *luma = source.m_data
+            + source.m_bytesPerLine * (source.m_rowOrigin + sourceY * source.m_rowStepY)
+            + 2 * (source.m_columnOrigin + sourceY * source.m_columnStepY) + 1;
+    const int step = source.m_bytesPerLine * source.m_rowStepX + 2 * source.m_columnStepX;
+
+    for (int i = 0; i < count; i++) {
+        unsigned int sum = 0;
+
+        for (int j = 0; j < 4; j++)
+            sum += luma[step * qMin((i << ThumbnailShift) + j, maxX)];
+
+        t[i] = (unsigned char)((sum + 2) >> 2);
+    }
+}
@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef SOURCECHANGEDETECTOR_H
+#define SOURCECHANGEDETECTOR_H
+
+#include <QVector>
+
+#include "warpkernels.h"
+#include "workerpool.h"
+
+
+/*!
+  \class SourceChangeDetector
+  \brief Finds the blocks of the source which have changed since the previous frames.
+
+  With the device on a stand the camera often looks at a static scene, and
+  warping it again on every frame gives the same target. The detector
+  compares a luma thumbnail of each frame, a quarter of the source along
+  either axis, with a reference block by block. A block of BlockSize x
+  BlockSize source pixels is 8 x 8 thumbnail pixels, so a row of a block
+  is compared with a single vectorized sum of absolute differences, see
+  WarpKernels::blockSadRows().
+
+  A block whose sum exceeds a threshold has changed, and its reference is
+  replaced with the frame. The reference of the other blocks is kept, so
+  a slow drift adds up until it is noticed, while the noise of the sensor
+  averages out over the 64 samples of a block. The thumbnail reads only
+  every fourth row of the source.
+*/
+class SourceChangeDetector : public WorkerTask
+{
+public:
+    enum {
+        BlockShift = 5,                 // Blocks of 32 x 32 source pixels
+        BlockSize = 1 << BlockShift
+    };
+
+public:
+    SourceChangeDetector();
+
+public:
+        // Compares the width x height RGB32 source, pitch in pixels, with
+        // the reference. threadCount as in MirrorEffect::setThreadCount().
+    void detect(const unsigned int *source, int width, int height, int pitch,
+                int threadCount);
+
+        // Compares the width x height UYVY source, in the orientation it is
+        // sampled in, with the reference
+    void detect(const WarpKernels::UyvySource &source, int width, int height,
+                int threadCount);
+
+        // Forgets the reference, every block of the next frame has changed
+    void reset();
+
+        // The blocks of the source, BlockSize x BlockSize pixels each
+    int blocksX() const;
+    int blocksY() const;
+
+        // One byte per block, row by row, non-zero for the blocks changed
+        // by the last detect()
+    const unsigned char *changedBlocks() const;
+
+public: // From WorkerTask
+    void run(int begin, int end);
+
+private:
+        // Sizes the reference for a width x height source, forgetting it if
+        // the dimensions change
+    void prepare(int width, int height);
+
+        // Compares the rows of blocks with the reference
+    void detectRows(int threadCount);
+
+        // Samples the row y of the thumbnail into t
+    void thumbnailRow(unsigned char *t, int y) const;
+
+private: // Data
+    const unsigned int *m_source;           // Either this or m_uyvySource
+    int m_sourcePitch;
+    const WarpKernels::UyvySource *m_uyvySource;
+    int m_width;
+    int m_height;
+    int m_blocksX;
+    int m_blocksY;
+    bool m_hasReference;
+    QVector<unsigned char> m_reference;     // The thumbnail as the blocks last changed
+    QVector<unsigned char> m_changed;
+    WarpKernels::SadFunction m_sadRows;
+};
+
+#endif // SOURCECHANGEDETECTOR_H
@@ -0,0 +1,244 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "sourceframe.h"
+
+#include <QMutexLocker>
+
+#include "bufferpool.h"
+#include "framestats.h"
+#include "imagerotator.h"
+#include "stagetimer.h"
+
+
+/*
+  An image made by SourceFrame::rgbImage().
+*/
+class SourceFrame::Converted
+{
+public:
+    Converted() : m_coefficients(YuvConverter::BT601), m_buffer(0) {}
+    ~Converted() { BufferPool::instance()->release(m_buffer); }
+
+    YuvConverter::Coefficients m_coefficients;
+    unsigned int *m_buffer;
+    SourceFrame::Image m_image;
+};
+
+
+/*!
+  \class SourceFrame
+  \brief A camera frame mapped for reading for as long as the object lives.
+*/
+
+
+/*!
+  Constructor. Maps \a frame for reading. \a rotate90degrees and \a flipY
+  tell how the frame is to be oriented.
+*/
+SourceFrame::SourceFrame(const QVideoFrame &frame,
+                         bool rotate90degrees /* = false */,
+                         bool flipY /* = false */)
+    : m_frame(frame),
+      m_mapped(false),
+      m_mapTime(0),
+      m_rotate90degrees(rotate90degrees),
+      m_flipY(flipY)
+{
+    StageTimer timer;
+    m_mapped = m_frame.map(QAbstractVideoBuffer::ReadOnly);
+    m_mapTime = timer.nsecsElapsed();
+}
+
+
+/*!
+  Destructor. Unmaps the frame.
+*/
+SourceFrame::~SourceFrame()
+{
+    qDeleteAll(m_converted);
+
+    if (m_mapped)
+        m_frame.unmap();
+}
+
+
+/*!
+  Returns true if the frame data can be read.
+*/
+bool SourceFrame::isMapped() const
+{
+    return m_mapped;
+}
+
+
+/*!
+  Returns the time map() took in the constructor, in nanoseconds. With some
+  cameras mapping copies the frame from the graphics memory.
+*/
+qint64 SourceFrame::mapTime() const
+{
+    return m_mapTime;
+}
+
+
+/*!
+  Returns the mapped frame data.
+*/
+const uchar *SourceFrame::bits() const
+{
+    return m_mapped ? m_frame.bits() : 0;
+}
+
+
+/*!
+  Returns the length of a frame row in bytes.
+*/
+int SourceFrame::bytesPerLine() const
+{
+    return m_frame.bytesPerLine();
+}
+
+
+/*!
+  Returns the width of the frame.
+*/
+int SourceFrame::width() const
+{
+    return m_frame.width();
+}
+
+
+/*!
+  Returns the height of the frame.
+*/
+int SourceFrame::height() const
+{
+    return m_frame.height();
+}
+
+
+/*!
+  Returns the pixel format of the frame.
+*/
+QVideoFrame::PixelFormat SourceFrame::pixelFormat() const
+{
+    return m_frame.pixelFormat();
+}
+
+
+/*!
+  Returns true if the frame is to be rotated by 90 degrees.
+*/
+bool SourceFrame::rotate90degrees() const
+{
+    return m_rotate90degrees;
+}
+
+
+/*!
+  Returns true if the (rotated) frame is to be turned upside down.
+*/
+bool SourceFrame::flipY() const
+{
+    return m_flipY;
+}
+
+
+/*!
+  Returns the frame as an oriented RGB32 image. The first caller makes the
+  image while holding the lock, the others wait for it and share it. Only
+  the caller making the image records the conversion and the rotation into
+  \a stats. The image is null if the frame can't be read or the buffers
+  can't be allocated.
+*/
+SourceFrame::Image SourceFrame::rgbImage(YuvConverter::Coefficients coefficients
+                                         /* = YuvConverter::BT601 */,
+                                         FrameStats *stats /* = 0 */)
+{
+    const bool rgb = pixelFormat() == QVideoFrame::Format_RGB32;
+    Image image;
+
+    if (!m_mapped || (!rgb && pixelFormat() != QVideoFrame::Format_UYVY))
+        return image;
+
+    if (rgb && !m_rotate90degrees && !m_flipY) {
+        image.m_data = (const unsigned int*)bits();
+        image.m_width = width();
+        image.m_height = height();
+        image.m_pitch = bytesPerLine() / 4;
+        return image;
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    foreach (Converted *converted, m_converted) {
+            // The coefficients don't matter for an RGB32 frame
+        if (rgb || converted->m_coefficients == coefficients)
+            return converted->m_image;
+    }
+
+    const int frameWidth = width();
+    const int frameHeight = height();
+    const bool rotate = m_rotate90degrees || m_flipY;
+
+    BufferPool *pool = BufferPool::instance();
+    Converted *converted = new Converted;
+    converted->m_coefficients = coefficients;
+    converted->m_buffer = pool->acquireArray<unsigned int>(frameWidth * frameHeight);
+
+    if (!converted->m_buffer) {
+        delete converted;
+        return image;
+    }
+
+    const unsigned int *pixels = (const unsigned int*)bits();
+    int pitch = bytesPerLine() / 4;
+
+    if (!rgb) {
+        unsigned int *target = converted->m_buffer;
+
+        if (rotate) {
+                // Convert first, the rotation needs RGB32 pixels
+            target = pool->acquireArray<unsigned int>(frameWidth * frameHeight);
+
+            if (!target) {
+                delete converted;
+                return image;
+            }
+        }
+
+        StageTimer timer;
+        YuvConverter(coefficients).convert(target, frameWidth, bits(), bytesPerLine(),
+                                           frameWidth, frameHeight);
+
+        if (stats)
+            stats->record(FrameStats::ConversionStage, timer.nsecsElapsed());
+
+        pixels = target;
+        pitch = frameWidth;
+    }
+
+    if (rotate) {
+        const int rotatedWidth = m_rotate90degrees ? frameHeight : frameWidth;
+
+        StageTimer timer;
+        ImageRotator::rotate(converted->m_buffer, rotatedWidth, pixels, pitch,
+                             frameWidth, frameHeight, m_rotate90degrees, m_flipY);
+
+        if (stats)
+            stats->record(FrameStats::RotationStage, timer.nsecsElapsed());
+
+        if (!rgb)
+            pool->release(const_cast<unsigned int*>(pixels));
+    }
+
+    converted->m_image.m_data = converted->m_buffer;
+    converted->m_image.m_width = m_rotate90degrees ? frameHeight : frameWidth;
+    converted->m_image.m_height = m_rotate90degrees ? frameWidth : frameHeight;
+    converted->m_image.m_pitch = converted->m_image.m_width;
+
+    m_converted.append(converted);
+    return converted->m_image;
+}
@@ -0,0 +1,98 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef SOURCEFRAME_H
+#define SOURCEFRAME_H
+
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QVideoFrame>
+
+#include "yuvconverter.h"
+
+// Forward declarations
+class FrameStats;
+
+
+/*!
+  \class SourceFrame
+  \brief A camera frame mapped for reading for as long as the object lives.
+
+  The frame is mapped read-only in the constructor and unmapped in the
+  destructor, so a frame can be handed from the camera callback to other
+  threads through a SourceFramePointer: the frame stays valid until the
+  last holder lets it go.
+
+  The frame also knows its orientation, i.e. how MirrorEffect::setSource()
+  should rotate and flip it, and provides an RGB32 image of the frame in
+  that orientation. The image is made only once however many mirrors ask
+  for it.
+*/
+class SourceFrame
+{
+public: // Data types
+    /*
+     * An RGB32 image owned by the frame. The pitch is in pixels.
+     */
+    class Image
+    {
+    public:
+        Image() : m_data(0), m_width(0), m_height(0), m_pitch(0) {}
+
+        const unsigned int *m_data;
+        int m_width;
+        int m_height;
+        int m_pitch;
+    };
+
+public:
+    SourceFrame(const QVideoFrame &frame, bool rotate90degrees = false, bool flipY = false);
+    ~SourceFrame();
+
+public:
+        // False if the frame could not be mapped
+    bool isMapped() const;
+
+        // The nanoseconds mapping the frame took
+    qint64 mapTime() const;
+
+    const uchar *bits() const;
+    int bytesPerLine() const;
+    int width() const;
+    int height() const;
+    QVideoFrame::PixelFormat pixelFormat() const;
+
+        // The orientation, as in MirrorEffect::setSource()
+    bool rotate90degrees() const;
+    bool flipY() const;
+
+        // Returns the frame as RGB32, rotated and flipped. UYVY frames are
+        // converted with coefficients. The image is made on the first call
+        // (for each set of coefficients) and shared by the later ones; an
+        // RGB32 frame which needs no rotation is returned as it is. The
+        // conversion and the rotation done by the call are recorded into
+        // stats, if given. Thread safe.
+    Image rgbImage(YuvConverter::Coefficients coefficients = YuvConverter::BT601,
+                   FrameStats *stats = 0);
+
+private:
+    Q_DISABLE_COPY(SourceFrame)
+
+    class Converted;
+
+private: // Data
+    QVideoFrame m_frame;
+    bool m_mapped;
+    qint64 m_mapTime;
+    bool m_rotate90degrees;
+    bool m_flipY;
+
+    QMutex m_mutex;
+    QList<Converted*> m_converted;  // The images made by rgbImage()
+};
+
+typedef QSharedPointer<SourceFrame> SourceFramePointer;
+
+#endif // SOURCEFRAME_H
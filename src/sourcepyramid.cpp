@@ -0,0 +1,281 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "sourcepyramid.h"
+
+#include <QVarLengthArray>
+
+#include "bufferpool.h"
+
+
+/*!
+  \class SourcePyramid
+  \brief Successively halved copies of the source, for sampling it where the transform shrinks it.
+*/
+
+
+/*!
+  Constructor.
+*/
+SourcePyramid::SourcePyramid()
+    : m_maxLevel(0),
+      m_buildLevel(0),
+      m_uyvySource(0),
+      m_downsampleRows(WarpKernels::downsampleRows()),
+      m_convertLine(YuvConverter::lineFunction())
+{
+}
+
+
+/*!
+  Destructor.
+*/
+SourcePyramid::~SourcePyramid()
+{
+    clear();
+}
+
+
+/*!
+  Builds the levels of an RGB32 source. Level 0 refers to \a source, so it
+  must stay valid for as long as the pyramid is sampled.
+*/
+void SourcePyramid::build(const unsigned int *source, int width, int height, int pitch,
+                          int maxLevel, int threadCount)
+{
+    const int levels = allocate(width, height, maxLevel);
+
+    m_levels[0].m_data = const_cast<unsigned int*>(source);
+    m_levels[0].m_pitch = pitch;
+    m_uyvySource = 0;
+
+    for (int level = 1; level <= levels; level++)
+        buildLevel(level, threadCount);
+}
+
+
+/*!
+  Builds the levels of a UYVY source: the level 1 straight from the frame,
+  averaged in YUV, and the ones above it from the level 1. There is no
+  level 0, the source is sampled with the UYVY kernels.
+*/
+void SourcePyramid::build(const WarpKernels::UyvySource &source, int width, int height,
+                          int maxLevel, int threadCount)
+{
+    const int levels = allocate(width, height, maxLevel);
+
+    m_levels[0].m_data = 0;
+    m_levels[0].m_pitch = 0;
+    m_uyvySource = &source;
+
+    for (int level = 1; level <= levels; level++)
+        buildLevel(level, threadCount);
+
+    m_uyvySource = 0;
+}
+
+
+/*!
+  Releases the levels back to BufferPool.
+*/
+void SourcePyramid::clear()
+{
+    BufferPool *pool = BufferPool::instance();
+
+    for (int level = 1; level <= MaxLevel; level++) {
+        pool->release(m_levels[level].m_data);
+        m_levels[level] = Level();
+    }
+
+    m_levels[0] = Level();
+    m_maxLevel = 0;
+}
+
+
+/*!
+  Returns the highest level built by the last build(), 0 if there are
+  none.
+*/
+int SourcePyramid::maxLevel() const
+{
+    return m_maxLevel;
+}
+
+
+/*!
+  Returns the pixels of \a level.
+*/
+const unsigned int *SourcePyramid::levelData(int level) const
+{
+    return m_levels[level].m_data;
+}
+
+
+/*!
+  Returns the width of \a level: half of the level below it, rounded up.
+*/
+int SourcePyramid::levelWidth(int level) const
+{
+    return m_levels[level].m_width;
+}
+
+
+/*!
+  Returns the height of \a level: half of the level below it, rounded up.
+*/
+int SourcePyramid::levelHeight(int level) const
+{
+    return m_levels[level].m_height;
+}
+
+
+/*!
+  Returns the pitch of \a level in pixels.
+*/
+int SourcePyramid::levelPitch(int level) const
+{
+    return m_levels[level].m_pitch;
+}
+
+
+/*!
+  Returns the memory used by the levels in bytes.
+*/
+int SourcePyramid::byteCount() const
+{
+    int bytes = 0;
+
+    for (int level = 1; level <= m_maxLevel; level++)
+        bytes += m_levels[level].m_pitch * m_levels[level].m_height * (int)sizeof(unsigned int);
+
+    return bytes;
+}
+
+
+/*!
+  From WorkerTask. Builds the rows [begin, end) of m_buildLevel. A row
+  averages two rows of the level below it; the last row and column of an
+  odd sized level are repeated.
+*/
+void SourcePyramid::run(int begin, int end)
+{
+    if (m_buildLevel == 1 && m_uyvySource) {
+        runUyvy(begin, end);
+        return;
+    }
+
+    const Level &from = m_levels[m_buildLevel - 1];
+    const Level &to = m_levels[m_buildLevel];
+
+    for (int y = begin; y < end; y++) {
+        unsigned int *t = to.m_data + to.m_pitch * y;
+
+        const unsigned int *a = from.m_data + from.m_pitch * (y * 2);
+        const unsigned int *b = y * 2 + 1 < from.m_height ? a + from.m_pitch : a;
+        const int pairs = from.m_width / 2;
+
+        m_downsampleRows(t, a, b, pairs);
+
+        if (from.m_width & 1) {
+            const unsigned int lastA[2] = { a[from.m_width - 1], a[from.m_width - 1] };
+            const unsigned int lastB[2] = { b[from.m_width - 1], b[from.m_width - 1] };
+            WarpKernels::downsampleRowsScalar(t + pairs, lastA, lastB, 1);
+        }
+    }
+}
+
+
+/*!
+  Builds the rows [begin, end) of the level 1 from m_uyvySource. A source
+  which isn't rotated is halved into a UYVY line which is converted with
+  the fastest YuvConverter kernel, since the conversion costs more than
+  the averaging. A rotated one is read pixel by pixel.
+*/
+void SourcePyramid::runUyvy(int begin, int end)
+{
+    const WarpKernels::UyvySource &source = *m_uyvySource;
+    const Level &from = m_levels[0];
+    const Level &to = m_levels[1];
+
+    if (source.m_columnOrigin != 0 || source.m_columnStepX != 1 || source.m_rowStepX != 0
+            || (from.m_width & 1))
+    {
+        for (int y = begin; y < end; y++) {
+            WarpKernels::uyvyDownsampleLine(to.m_data + to.m_pitch * y, to.m_width, y,
+                                            from.m_width, from.m_height, source);
+        }
+
+        return;
+    }
+
+    QVarLengthArray<unsigned char, 4096> line((to.m_width + 1) / 2 * 4);
+
+    for (int y = begin; y < end; y++) {
+        const int y0 = y * 2;
+        const int y1 = y0 + 1 < from.m_height ? y0 + 1 : y0;
+        const unsigned char *a = source.m_data + source.m_bytesPerLine
+                * (source.m_rowOrigin + y0 * source.m_rowStepY);
+        const unsigned char *b = source.m_data + source.m_bytesPerLine
+                * (source.m_rowOrigin + y1 * source.m_rowStepY);
+
+        WarpKernels::uyvyDownsampleRows(line.data(), a, b, to.m_width);
+        m_convertLine(to.m_data + to.m_pitch * y, line.constData(), to.m_width,
+                      *source.m_matrix);
+    }
+}
+
+
+/*!
+  Sets the dimensions of the levels and (re)allocates their buffers. The
+  buffers are reused while the dimensions stay the same.
+*/
+int SourcePyramid::allocate(int width, int height, int maxLevel)
+{
+    BufferPool *pool = BufferPool::instance();
+    m_levels[0].m_width = width;
+    m_levels[0].m_height = height;
+    m_maxLevel = 0;
+
+    for (int level = 1; level <= MaxLevel; level++) {
+        Level &current = m_levels[level];
+        const int levelWidth = (m_levels[level - 1].m_width + 1) / 2;
+        const int levelHeight = (m_levels[level - 1].m_height + 1) / 2;
+
+        if (level > maxLevel || levelWidth < 2 || levelHeight < 2) {
+            pool->release(current.m_data);
+            current = Level();
+            continue;
+        }
+
+        if (current.m_width != levelWidth || current.m_height != levelHeight) {
+            pool->release(current.m_data);
+            current.m_data = pool->acquireArray<unsigned int>(levelWidth * levelHeight);
+            current.m_width = levelWidth;
+            current.m_height = levelHeight;
+            current.m_pitch = levelWidth;
+        }
+
+            // Out of memory, the levels above can't be built either
+        if (!current.m_data) {
+            current = Level();
+            continue;
+        }
+
+        m_maxLevel = level;
+    }
+
+    return m_maxLevel;
+}
+
+
+/*!
+  Builds \a level, spreading the rows over the worker threads.
+*/
+void SourcePyramid::buildLevel(int level, int threadCount)
+{
+    m_buildLevel = level;
+
+    const int height = m_levels[level].m_height;
+    WorkerPool::instance()->runBands(this, height, threadCount, 8);
+}
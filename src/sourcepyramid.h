@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef SOURCEPYRAMID_H
+#define SOURCEPYRAMID_H
+
+#include "warpkernels.h"
+#include "workerpool.h"
+#include "yuvconverter.h"
+
+
+/*!
+  \class SourcePyramid
+  \brief Successively halved copies of the source, for sampling it where the transform shrinks it.
+
+  When a large source is warped into a small mirror, a target pixel covers
+  many source pixels, and sampling only one of them (or four with the
+  linear resampling) aliases. Each level of the pyramid averages the 2x2
+  boxes of the previous one, so a pixel of the level L covers 2^L x 2^L
+  source pixels, and a single tap from the right level shows all of them.
+  The level of every target pixel is stored in the transform map, see
+  MipLevelSelector.
+
+  Level 0 is the source itself and isn't copied. The other levels are
+  RGB32. A UYVY source is halved in YUV and converted only once per 2x2
+  box while building the level 1. The levels are built with the vectorized WarpKernels for every
+  frame, which costs about a third of a pass over the source.
+*/
+class SourcePyramid : public WorkerTask
+{
+public:
+    enum { MaxLevel = 3 };  // The smallest level is 1/8 of the source
+
+public:
+    SourcePyramid();
+    ~SourcePyramid();
+
+public:
+        // Builds the levels 1 to maxLevel of the width x height RGB32
+        // source, pitch in pixels. threadCount as in
+        // MirrorEffect::setThreadCount().
+    void build(const unsigned int *source, int width, int height, int pitch,
+               int maxLevel, int threadCount);
+
+        // Builds the levels 1 to maxLevel of the width x height UYVY
+        // source, in the orientation it is sampled in
+    void build(const WarpKernels::UyvySource &source, int width, int height,
+               int maxLevel, int threadCount);
+
+        // Releases the levels
+    void clear();
+
+        // The highest level built, 0 if none
+    int maxLevel() const;
+
+        // The pixels and the dimensions of a level. The pitch is in pixels.
+    const unsigned int *levelData(int level) const;
+    int levelWidth(int level) const;
+    int levelHeight(int level) const;
+    int levelPitch(int level) const;
+
+        // The memory used by the levels
+    int byteCount() const;
+
+public: // From WorkerTask
+    void run(int begin, int end);
+
+private:
+        // Allocates the levels 1 to maxLevel of a width x height source,
+        // leaving out the ones smaller than 2 x 2. Returns the highest one.
+    int allocate(int width, int height, int maxLevel);
+
+        // Builds level from the level below it
+    void buildLevel(int level, int threadCount);
+
+        // Builds the rows [begin, end) of the level 1 from m_uyvySource
+    void runUyvy(int begin, int end);
+
+private: // Data
+    class Level
+    {
+    public:
+        Level() : m_data(0), m_width(0), m_height(0), m_pitch(0) {}
+
+        unsigned int *m_data;
+        int m_width;
+        int m_height;
+        int m_pitch;
+    };
+
+    Level m_levels[MaxLevel + 1];   // Level 0 is the source, not owned
+    int m_maxLevel;
+    int m_buildLevel;               // The level run() builds
+    const WarpKernels::UyvySource *m_uyvySource;    // The level 1 is built from it if set
+    WarpKernels::DownsampleFunction m_downsampleRows;
+    YuvConverter::LineFunction m_convertLine;
+};
+
+#endif // SOURCEPYRAMID_H
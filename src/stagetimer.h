@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef STAGETIMER_H
+#define STAGETIMER_H
+
+#include <QElapsedTimer>
+#include <QtGlobal>
+
+
+/*!
+  \class StageTimer
+  \brief Measures the time of a processing stage in nanoseconds.
+
+  A thin wrapper of QElapsedTimer, which uses the monotonic clock of the
+  platform and costs a couple of system calls at most. Qt 4.7 has only
+  millisecond resolution, so with it the times are whole milliseconds.
+*/
+class StageTimer
+{
+public:
+    StageTimer() { m_timer.start(); }
+
+public:
+    void restart() { m_timer.start(); }
+
+        // Nanoseconds since the construction or the last restart()
+    qint64 nsecsElapsed() const
+    {
+#if QT_VERSION >= 0x040800
+        return m_timer.nsecsElapsed();
+#else
+        return m_timer.elapsed() * 1000000;
+#endif
+    }
+
+private: // Data
+    QElapsedTimer m_timer;
+};
+
+#endif // STAGETIMER_H
@@ -0,0 +1,255 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "tiletracker.h"
+
+#include "sourcechangedetector.h"
+#include "transformmap.h"
+
+static const int RefreshFrames = 60;    // The most frames a tile is kept for, about two seconds
+static const int RefreshSpread = 16;    // The frames the refreshes of the tiles are spread over
+
+
+/*!
+  \class TileTracker
+  \brief Tracks the tiles of the target which must be warped again after the source has changed.
+*/
+
+
+/*!
+  Constructor.
+*/
+TileTracker::TileTracker()
+    : m_sourceWidth(0),
+      m_sourceHeight(0),
+      m_tilesX(0),
+      m_tilesY(0),
+      m_frame(0),
+      m_dirtyCount(0)
+{
+}
+
+
+/*!
+  Indexes the tiles of \a map, unless it is the map indexed already for a
+  source of the same dimensions. The tiles written with the previous map
+  are forgotten. The map is held on to, so it can't be replaced by another
+  one at the same address.
+*/
+void TileTracker::setMap(const TransformMapCache::MapPointer &map,
+                         int sourceWidth, int sourceHeight)
+{
+    if (map == m_map && sourceWidth == m_sourceWidth && sourceHeight == m_sourceHeight)
+        return;
+
+    m_map = map;
+    m_sourceWidth = sourceWidth;
+    m_sourceHeight = sourceHeight;
+
+    buildIndex();
+    reset();
+}
+
+
+/*!
+  Forgets the tiles written into every target, so the next update() marks
+  them all for warping.
+*/
+void TileTracker::reset()
+{
+    for (int i = 0; i < MaxTargets; i++)
+        m_targets[i] = Target();
+}
+
+
+/*!
+  Starts a frame: the tiles of the blocks marked in \a changedBlocks have
+  changed. Returns the tiles of \a target to warp: the ones changed since
+  they were written into \a target, the ones never written into it, and
+  the ones due for a refresh. The tiles within \a rect are recorded as
+  written on this frame, the ones partly in it as never written, since
+  only a part of them is.
+*/
+const unsigned char *TileTracker::update(const unsigned char *changedBlocks,
+                                         const unsigned int *target,
+                                         const QRect &rect)
+{
+    m_frame++;
+
+    const int blockCount = m_blockStart.count() - 1;
+
+    for (int block = 0; block < blockCount; block++) {
+        if (!changedBlocks[block])
+            continue;
+
+        for (int i = m_blockStart.at(block); i < m_blockStart.at(block + 1); i++)
+            m_changedFrame[m_blockTiles.at(i)] = m_frame;
+    }
+
+        // The target itself, or the one least recently updated replaced
+    Target *current = &m_targets[0];
+
+    for (int i = 0; i < MaxTargets; i++) {
+        if (m_targets[i].m_data == target) {
+            current = &m_targets[i];
+            break;
+        }
+
+        if (m_targets[i].m_used < current->m_used)
+            current = &m_targets[i];
+    }
+
+    if (current->m_data != target || current->m_written.count() != m_tilesX * m_tilesY) {
+        current->m_data = target;
+        current->m_written.fill(-1, m_tilesX * m_tilesY);
+    }
+
+    current->m_used = m_frame;
+
+    const QRect bounds(0, 0, m_map ? m_map->width() : 0, m_map ? m_map->height() : 0);
+    int *written = current->m_written.data();
+    m_dirtyCount = 0;
+
+    for (int ty = 0; ty < m_tilesY; ty++) {
+        for (int tx = 0; tx < m_tilesX; tx++) {
+            const int tile = ty * m_tilesX + tx;
+            const int age = m_frame - written[tile];
+            const bool dirty = written[tile] < m_changedFrame.at(tile)
+                    || age >= RefreshFrames - tile % RefreshSpread;
+
+            m_dirty[tile] = dirty;
+
+            if (!dirty)
+                continue;
+
+            const QRect tileRect = QRect(tx << TileShift, ty << TileShift,
+                                         TileSize, TileSize) & bounds;
+
+            if (rect.contains(tileRect)) {
+                written[tile] = m_frame;
+                m_dirtyCount++;
+            }
+            else if (!(rect & tileRect).isEmpty()) {
+                written[tile] = -1;
+                m_dirtyCount++;
+            }
+        }
+    }
+
+    return m_dirty.constData();
+}
+
+
+/*!
+  Returns the number of tiles along a row of the target.
+*/
+int TileTracker::tilesX() const
+{
+    return m_tilesX;
+}
+
+
+/*!
+  Returns the number of the tiles within the rect of the last update()
+  which are warped.
+*/
+int TileTracker::dirtyCount() const
+{
+    return m_dirtyCount;
+}
+
+
+/*!
+  Builds the reverse index from the source blocks to the tiles. The blocks
+  of each tile are collected first: a map entry samples the source pixel
+  it points to and the next one, or with a pyramid level L the 2^L x 2^L
+  pixels of a level pixel and the next ones, which is rounded out to a
+  level pixel on either side. The entries of a tile mostly fall into the
+  same blocks, so a stamp per block keeps the lists short. The lists are
+  then turned around, into the tiles of each block.
+*/
+void TileTracker::buildIndex()
+{
+    const int blocksX = (m_sourceWidth + SourceChangeDetector::BlockSize - 1)
+            >> SourceChangeDetector::BlockShift;
+    const int blocksY = (m_sourceHeight + SourceChangeDetector::BlockSize - 1)
+            >> SourceChangeDetector::BlockShift;
+    const int blockCount = blocksX * blocksY;
+    const int width = m_map ? m_map->width() : 0;
+    const int height = m_map ? m_map->height() : 0;
+
+    m_tilesX = (width + TileSize - 1) >> TileShift;
+    m_tilesY = (height + TileSize - 1) >> TileShift;
+
+    const int tileCount = m_tilesX * m_tilesY;
+    m_changedFrame.fill(0, tileCount);
+    m_dirty.fill(1, tileCount);
+    m_blockStart.fill(0, blockCount + 1);
+    m_blockTiles.clear();
+
+    if (!m_map || blockCount == 0)
+        return;
+
+    const int fracBits = m_map->fracBits();
+    const int maxX = m_sourceWidth - 1;
+    const int maxY = m_sourceHeight - 1;
+
+    QVector<int> stamps(blockCount, -1);
+    QVector<int> tileStart(tileCount + 1);
+    QVector<int> tileBlocks;
+
+    for (int tile = 0; tile < tileCount; tile++) {
+        const int left = (tile % m_tilesX) << TileShift;
+        const int top = (tile / m_tilesX) << TileShift;
+        const int right = qMin(left + TileSize, width);
+        const int bottom = qMin(top + TileSize, height);
+
+        tileStart[tile] = tileBlocks.count();
+
+        for (int y = top; y < bottom; y++) {
+            const unsigned short *srcX = m_map->xRow(y);
+            const unsigned short *srcY = m_map->yRow(y);
+            const unsigned char *levels = m_map->levelRow(y);
+
+            for (int x = left; x < right; x++) {
+                const int level = levels ? levels[x] : 0;
+                const int column = (srcX[x] >> fracBits) >> level;
+                const int row = (srcY[x] >> fracBits) >> level;
+
+                const int bx0 = (qMax(column - 1, 0) << level) >> SourceChangeDetector::BlockShift;
+                const int bx1 = qMin(((column + 2) << level) - 1, maxX) >> SourceChangeDetector::BlockShift;
+                const int by0 = (qMax(row - 1, 0) << level) >> SourceChangeDetector::BlockShift;
+                const int by1 = qMin(((row + 2) << level) - 1, maxY) >> SourceChangeDetector::BlockShift;
+
+                for (int by = by0; by <= by1; by++) {
+                    for (int bx = bx0; bx <= bx1; bx++) {
+                        const int block = by * blocksX + bx;
+
+                        if (stamps.at(block) != tile) {
+                            stamps[block] = tile;
+                            tileBlocks.append(block);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    tileStart[tileCount] = tileBlocks.count();
+
+        // Turned into the tiles of each block
+    for (int i = 0; i < tileBlocks.count(); i++)
+        m_blockStart[tileBlocks.at(i) + 1]++;
+
+    for (int block = 0; block < blockCount; block++)
+        m_blockStart[block + 1] += m_blockStart.at(block);
+
+    QVector<int> next = m_blockStart;
+    m_blockTiles.resize(tileBlocks.count());
+
+    for (int tile = 0; tile < tileCount; tile++) {
+        for (int i = tileStart.at(tile); i < tileStart.at(tile + 1); i++)
+            m_blockTiles[next[tileBlocks.at(i)]++] = tile;
+    }
+}
@@ -0,0 +1,96 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef TILETRACKER_H
+#define TILETRACKER_H
+
+#include <QRect>
+#include <QVector>
+
+#include "transformmapcache.h"
+
+
+/*!
+  \class TileTracker
+  \brief Tracks the tiles of the target which must be warped again after the source has changed.
+
+  The target is split into tiles of TileSize x TileSize pixels. For every
+  block of SourceChangeDetector the tracker indexes the tiles which have
+  map entries sampling it, counting in the neighbours read by the linear
+  resampling and the pyramid level of the entry. When blocks change, only
+  the tiles in their lists have to be warped again.
+
+  A target keeps the tiles it was last written with, so the tracker
+  records the frame each tile of a target was written on, for a few
+  targets told apart by their addresses, like the triple buffers of
+  EffectWorker. A tile is skipped only if none of its blocks has changed
+  since. Every tile is warped again at least every RefreshFrames frames,
+  at different frames for different tiles, so that the changes too small
+  for the detector can't linger.
+*/
+class TileTracker
+{
+public:
+    enum {
+        TileShift = 4,                  // Tiles of 16 x 16 target pixels
+        TileSize = 1 << TileShift,
+        MaxTargets = 4                  // The targets remembered
+    };
+
+public:
+    TileTracker();
+
+public:
+        // Indexes the tiles of map for a sourceWidth x sourceHeight source,
+        // unless it has been indexed already. A new map forgets the tiles
+        // written.
+    void setMap(const TransformMapCache::MapPointer &map, int sourceWidth, int sourceHeight);
+
+        // Forgets the tiles written into every target, e.g. when the
+        // resampling changes
+    void reset();
+
+        // Starts a frame with the changed blocks of SourceChangeDetector.
+        // Returns a byte per tile, row by row, non-zero for the tiles of
+        // target to warp. The ones within rect are taken as written.
+    const unsigned char *update(const unsigned char *changedBlocks,
+                                const unsigned int *target,
+                                const QRect &rect);
+
+        // The tiles along a row of the target
+    int tilesX() const;
+
+        // The tiles to warp after the last update()
+    int dirtyCount() const;
+
+private:
+        // Builds the lists of the tiles of every block
+    void buildIndex();
+
+private: // Data
+    class Target
+    {
+    public:
+        Target() : m_data(0), m_used(0) {}
+
+        const unsigned int *m_data;
+        int m_used;                     // The frame the target was last updated on
+        QVector<int> m_written;         // The frame each tile was written on, -1 if never
+    };
+
+    TransformMapCache::MapPointer m_map;
+    int m_sourceWidth;
+    int m_sourceHeight;
+    int m_tilesX;
+    int m_tilesY;
+    QVector<int> m_blockStart;          // The first entry of each block in m_blockTiles, and the end
+    QVector<int> m_blockTiles;
+    QVector<int> m_changedFrame;        // The last frame a block of each tile changed on
+    QVector<unsigned char> m_dirty;
+    Target m_targets[MaxTargets];
+    int m_frame;
+    int m_dirtyCount;
+};
+
+#endif // TILETRACKER_H
@@ -0,0 +1,318 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "transformbuilder.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+
+#include "miplevelselector.h"
+#include "transformcomposer.h"
+#include "transformgenerator.h"
+#include "transformmap.h"
+#include "transformmapstore.h"
+#include "workerpool.h"
+
+static const int CancelRows = 16;   // Rows built between the checks for a cancel
+
+
+/*!
+  \class TransformBuilder
+  \brief Builds transform maps, either on the calling thread or on a background thread of its own.
+*/
+
+
+/*!
+  Constructor.
+*/
+TransformBuilder::Request::Request()
+    : m_transform(MirrorEffect::None),
+      m_power(1.0f),
+      m_size(1.0f)
+{
+}
+
+
+/*!
+  Constructor.
+*/
+TransformBuilder::TransformBuilder()
+    : m_cancel(0),
+      m_quit(false),
+      m_hasRequest(false),
+      m_building(false)
+{
+}
+
+
+/*!
+  Destructor. Cancels the map being built and waits for the thread.
+*/
+TransformBuilder::~TransformBuilder()
+{
+    m_mutex.lock();
+    m_quit = true;
+    m_hasRequest = false;
+    m_cancel.fetchAndStoreOrdered(1);
+    m_requested.wakeOne();
+    m_mutex.unlock();
+
+    wait();
+}
+
+
+/*!
+  Builds the map of \a request on the calling thread and adds it to
+  TransformMapCache. A map generated by an earlier run is mapped from
+  TransformMapStore, and a generated one is stored. A chain of layers is
+  composed on top of the map of the transform alone, which is taken from
+  the cache or generated and cached as well, since it is often used on its
+  own too. The maps of the layers are only needed while composing.
+
+  With \a cancel the rows are built on the calling thread only, and the
+  build is abandoned as soon as \a cancel becomes non-zero.
+*/
+TransformMapCache::MapPointer TransformBuilder::build(const Request &request,
+                                                      int threadCount,
+                                                      const QAtomicInt *cancel /* = 0 */)
+{
+    const TransformMapKey &key = request.m_key;
+    TransformMapStore *store = TransformMapStore::instance();
+    TransformMapCache *cache = TransformMapCache::instance();
+
+    TransformMapCache::MapPointer map = store->load(key);
+
+    if (map) {
+            // Generated by an earlier run, only mapped into memory
+        qDebug() << "TransformBuilder::build(): Using a stored transform.";
+        cache->insert(key, map);
+        return map;
+    }
+
+    qDebug() << "TransformBuilder::build(): Recreating transform...";
+
+    const int width = key.m_targetWidth;
+    const int height = key.m_targetHeight;
+    const bool composed = !request.m_layers.isEmpty();
+
+    TransformMapKey baseKey = key;
+    baseKey.m_layers.clear();
+
+    if (composed)
+        map = cache->find(baseKey);
+
+    if (!map) {
+        map = new TransformMap();
+        map->create(width, height, key.m_sourceWidth, key.m_sourceHeight);
+
+        if (map->isNull())
+            return TransformMapCache::MapPointer();
+
+        TransformGenerator generator(map.data(), request.m_transform,
+                                     request.m_power, request.m_size,
+                                     key.m_sourceWidth, key.m_sourceHeight);
+
+        if (!runRows(&generator, height, threadCount, cancel))
+            return TransformMapCache::MapPointer();
+
+        map->releaseShineIfUnused();
+
+        if (!selectLevels(map.data(), threadCount, cancel))
+            return TransformMapCache::MapPointer();
+
+        if (composed)
+            cache->insert(baseKey, map);
+    }
+
+    for (int i = 0; i < request.m_layers.count(); i++) {
+        const MirrorEffect::TransformLayer &layer = request.m_layers.at(i);
+
+        TransformMap layerMap;
+        layerMap.create(width, height, width, height);
+
+        TransformMapCache::MapPointer next(new TransformMap());
+        next->create(width, height, key.m_sourceWidth, key.m_sourceHeight);
+
+        if (layerMap.isNull() || next->isNull())
+            return TransformMapCache::MapPointer();
+
+        TransformGenerator generator(&layerMap, layer.m_transform,
+                                     layer.m_power, layer.m_size,
+                                     width, height);
+        TransformComposer composer(next.data(), map.data(), &layerMap);
+
+        if (!runRows(&generator, height, threadCount, cancel)
+                || !runRows(&composer, height, threadCount, cancel))
+        {
+            return TransformMapCache::MapPointer();
+        }
+
+        next->releaseShineIfUnused();
+        map = next;
+    }
+
+    if (composed && !selectLevels(map.data(), threadCount, cancel))
+        return TransformMapCache::MapPointer();
+
+    store->save(key, *map);
+    cache->insert(key, map);
+    return map;
+}
+
+
+/*!
+  Queues \a request to be built on the builder's thread, starting the thread
+  if it isn't running. The map being built for another key is cancelled,
+  and so is the one built for the queued request when the map of
+  \a request is there already.
+*/
+void TransformBuilder::request(const Request &request)
+{
+    QMutexLocker locker(&m_mutex);
+
+    const bool building = m_building && m_cancel == 0 && m_buildingKey == request.m_key;
+    const bool built = m_result && m_resultKey == request.m_key;
+
+    if (building || built) {
+            // Whatever was requested after it is stale already
+        m_hasRequest = false;
+
+        if (built && m_building)
+            m_cancel.fetchAndStoreOrdered(1);
+
+        return;
+    }
+
+    if (m_building)
+        m_cancel.fetchAndStoreOrdered(1);
+
+    m_result.reset();
+    m_queued = request;
+    m_hasRequest = true;
+
+    if (!isRunning())
+        start(QThread::LowPriority);
+    else
+        m_requested.wakeOne();
+}
+
+
+/*!
+  Returns the map built for \a key, or a null pointer if the map of the key
+  hasn't been completed. The builder forgets the map it returns.
+*/
+TransformMapCache::MapPointer TransformBuilder::takeResult(const TransformMapKey &key)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_result || !(m_resultKey == key))
+        return TransformMapCache::MapPointer();
+
+    TransformMapCache::MapPointer map = m_result;
+    m_result.reset();
+    return map;
+}
+
+
+/*!
+  Cancels the map being built and the queued request, and releases the map
+  which hasn't been taken. The thread keeps waiting for the next request.
+*/
+void TransformBuilder::cancel()
+{
+    QMutexLocker locker(&m_mutex);
+    m_hasRequest = false;
+
+    if (m_building)
+        m_cancel.fetchAndStoreOrdered(1);
+
+    m_result.reset();
+}
+
+
+/*!
+  From QThread. Builds the queued requests, one at a time, until deleted.
+*/
+void TransformBuilder::run()
+{
+    forever {
+        m_mutex.lock();
+
+        while (!m_hasRequest && !m_quit)
+            m_requested.wait(&m_mutex);
+
+        if (m_quit) {
+            m_mutex.unlock();
+            break;
+        }
+
+        const Request request = m_queued;
+        m_hasRequest = false;
+        m_building = true;
+        m_buildingKey = request.m_key;
+        m_cancel.fetchAndStoreOrdered(0);
+        m_mutex.unlock();
+
+            // On this thread only, the pool is for the warps of the frames
+        const TransformMapCache::MapPointer map = build(request, 1, &m_cancel);
+
+        m_mutex.lock();
+        m_building = false;
+
+        if (map && m_cancel == 0) {
+            m_result = map;
+            m_resultKey = request.m_key;
+        }
+
+        m_mutex.unlock();
+    }
+}
+
+
+/*!
+  Stores the SourcePyramid level of every pixel of \a map, see
+  MipLevelSelector. A map without memory for the levels is sampled from
+  the source only. Returns false if cancelled.
+*/
+bool TransformBuilder::selectLevels(TransformMap *map, int threadCount,
+                                    const QAtomicInt *cancel)
+{
+    map->createLevels();
+
+    if (!map->levelRow(0))
+        return true;
+
+    MipLevelSelector selector(map);
+
+    if (!runRows(&selector, map->height(), threadCount, cancel))
+        return false;
+
+    map->releaseLevelsIfUnused();
+    return true;
+}
+
+
+/*!
+  Runs \a task over the rows [0, \a count). Without \a cancel the rows are
+  spread over \a threadCount threads as in MirrorEffect::setThreadCount().
+  With it they are run on the calling thread CancelRows at a time, and
+  false is returned as soon as \a cancel is non-zero.
+*/
+bool TransformBuilder::runRows(WorkerTask *task, int count, int threadCount,
+                               const QAtomicInt *cancel)
+{
+    if (cancel) {
+        for (int begin = 0; begin < count; begin += CancelRows) {
+            if (*cancel != 0)
+                return false;
+
+            task->run(begin, qMin(begin + CancelRows, count));
+        }
+
+        return *cancel == 0;
+    }
+
+    WorkerPool::instance()->runBands(task, count, threadCount, 8);
+    return true;
+}
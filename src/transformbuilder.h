@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef TRANSFORMBUILDER_H
+#define TRANSFORMBUILDER_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "mirroreffect.h"
+#include "transformmapcache.h"
+
+// Forward declarations
+class TransformMap;
+class WorkerTask;
+
+
+/*!
+  \class TransformBuilder
+  \brief Builds transform maps, either on the calling thread or on a background thread of its own.
+
+  Generating the map of a new transform takes tens of milliseconds on a
+  large mirror, which stalls the frame that needs it. With a builder the
+  frame goes on with the map it has, or without one, and the map is built
+  on the builder's thread. The effect takes the finished map with
+  takeResult() at the start of a later frame, so the switch happens
+  between two frames and a frame is never warped with a half built map.
+
+  Only the latest request matters: a request for another map cancels the
+  one being built, which stops within a few rows. When the effect is
+  changed quickly, only the map of the last one is completed.
+
+  The builder's thread runs at a low priority and doesn't use WorkerPool,
+  so it doesn't hold up the warps of the frames.
+*/
+class TransformBuilder : public QThread
+{
+public:
+    /*
+     * Everything needed to build a map: the transform with the layers
+     * composed on top (see MirrorEffect::addMirrorTransform()), and the
+     * key, which has the dimensions of the source and the target.
+     */
+    class Request
+    {
+    public:
+        Request();
+
+        TransformMapKey m_key;
+        MirrorEffect::MirrorTransform m_transform;
+        float m_power;
+        float m_size;
+        QVector<MirrorEffect::TransformLayer> m_layers;
+    };
+
+public:
+    TransformBuilder();
+    ~TransformBuilder();
+
+public:
+        // Builds the map of request on the calling thread: maps it from
+        // TransformMapStore, or generates or composes it, selects its
+        // SourcePyramid levels and stores it. The
+        // map is added to TransformMapCache. threadCount as in
+        // MirrorEffect::setThreadCount(). Returns a null pointer if the
+        // memory runs out, or if cancel is given and becomes non-zero.
+    static TransformMapCache::MapPointer build(const Request &request,
+                                               int threadCount,
+                                               const QAtomicInt *cancel = 0);
+
+        // Queues request to be built on the builder's thread, cancelling the
+        // map being built for another key. Does nothing if the map of the
+        // key is being built or waiting to be taken already.
+    void request(const Request &request);
+
+        // Returns the map built for key and forgets it, or a null pointer
+        // if it isn't ready
+    TransformMapCache::MapPointer takeResult(const TransformMapKey &key);
+
+        // Cancels the map being built and the queued request, and drops the
+        // map not taken
+    void cancel();
+
+protected: // From QThread
+    void run();
+
+private:
+        // Selects the pyramid levels of map. Returns false if cancelled.
+    static bool selectLevels(TransformMap *map, int threadCount,
+                             const QAtomicInt *cancel);
+
+        // Runs task over count rows, either with threadCount threads or on
+        // the calling thread checking cancel every few rows. Returns false
+        // if cancelled.
+    static bool runRows(WorkerTask *task, int count, int threadCount,
+                        const QAtomicInt *cancel);
+
+private: // Data
+    QMutex m_mutex;
+    QWaitCondition m_requested;
+    QAtomicInt m_cancel;            // Non-zero when the build in progress is superseded
+    bool m_quit;
+    bool m_hasRequest;
+    bool m_building;
+    Request m_queued;               // Valid when m_hasRequest
+    TransformMapKey m_buildingKey;  // Valid when m_building
+    TransformMapKey m_resultKey;
+    TransformMapCache::MapPointer m_result;
+};
+
+#endif // TRANSFORMBUILDER_H
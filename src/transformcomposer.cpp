@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "transformcomposer.h"
+
+#include "transformmap.h"
+
+
+/*!
+  \class TransformComposer
+  \brief Composes two transform maps into one which applies both in a single pass.
+*/
+
+
+/*!
+  Constructor.
+*/
+TransformComposer::TransformComposer(TransformMap *target,
+                                     const TransformMap *inner,
+                                     const TransformMap *outer)
+    : m_target(target),
+      m_inner(inner),
+      m_outer(outer)
+{
+}
+
+
+/*!
+  Fills the target map, spreading the rows over the worker threads.
+*/
+bool TransformComposer::compose(int threadCount /* = 0 */)
+{
+    if (m_target->isNull() || m_inner->isNull() || m_outer->isNull()
+            || m_target->width() != m_inner->width()
+            || m_target->height() != m_inner->height()
+            || m_outer->width() != m_inner->width()
+            || m_outer->height() != m_inner->height())
+    {
+        return false;
+    }
+
+    const int height = m_target->height();
+    WorkerPool::instance()->runBands(this, height, threadCount, 8);
+
+    return true;
+}
+
+
+/*!
+  From WorkerTask. Composes the rows [begin, end): the inner map's
+  co-ordinates are interpolated linearly at the outer map's co-ordinates,
+  and its shine taken from the nearest pixel.
+*/
+void TransformComposer::run(int begin, int end)
+{
+    const int width = m_target->width();
+    const int maxX = width - 1;
+    const int maxY = m_target->height() - 1;
+    const int fracBits = m_outer->fracBits();
+    const unsigned int fracMask = (1u << fracBits) - 1;
+    const unsigned int half = (1u << fracBits) >> 1;
+    const bool innerShine = m_inner->shineRow(0) != 0;
+
+    for (int y = begin; y < end; y++) {
+        const unsigned short *outerX = m_outer->xRow(y);
+        const unsigned short *outerY = m_outer->yRow(y);
+        const unsigned char *outerShine = m_outer->shineRow(y);
+        unsigned short *targetX = m_target->xRow(y);
+        unsigned short *targetY = m_target->yRow(y);
+        unsigned char *targetShine = m_target->shineRow(y);
+
+        for (int x = 0; x < width; x++) {
+            const unsigned int fx = outerX[x] & fracMask;
+            const unsigned int fy = outerY[x] & fracMask;
+            const int x0 = qMin((int)(outerX[x] >> fracBits), maxX);
+            const int y0 = qMin((int)(outerY[x] >> fracBits), maxY);
+            const int x1 = qMin(x0 + 1, maxX);
+            const int y1 = qMin(y0 + 1, maxY);
+
+                // The weights of the four neighbours add up to
+                // 1 << (2 * fracBits), which keeps the sums within 32 bits
+            const unsigned int w00 = (fracMask + 1 - fx) * (fracMask + 1 - fy);
+            const unsigned int w10 = fx * (fracMask + 1 - fy);
+            const unsigned int w01 = (fracMask + 1 - fx) * fy;
+            const unsigned int w11 = fx * fy;
+            const unsigned int round = 1u << (2 * fracBits) >> 1;
+
+            const unsigned short *innerX0 = m_inner->xRow(y0);
+            const unsigned short *innerX1 = m_inner->xRow(y1);
+            const unsigned short *innerY0 = m_inner->yRow(y0);
+            const unsigned short *innerY1 = m_inner->yRow(y1);
+
+            targetX[x] = (unsigned short)((innerX0[x0] * w00 + innerX0[x1] * w10
+                                           + innerX1[x0] * w01 + innerX1[x1] * w11
+                                           + round) >> (2 * fracBits));
+            targetY[x] = (unsigned short)((innerY0[x0] * w00 + innerY0[x1] * w10
+                                           + innerY1[x0] * w01 + innerY1[x1] * w11
+                                           + round) >> (2 * fracBits));
+
+            if (!targetShine)
+                continue;
+
+            int shine = outerShine ? outerShine[x] : 0;
+
+            if (innerShine) {
+                const int nearestX = fx >= half ? x1 : x0;
+                const int nearestY = fy >= half ? y1 : y0;
+                shine += m_inner->shineRow(nearestY)[nearestX];
+            }
+
+            targetShine[x] = (unsigned char)qMin(shine, 255);
+        }
+    }
+}
@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef TRANSFORMCOMPOSER_H
+#define TRANSFORMCOMPOSER_H
+
+#include "workerpool.h"
+
+// Forward declarations
+class TransformMap;
+
+
+/*!
+  \class TransformComposer
+  \brief Composes two transform maps into one which applies both in a single pass.
+
+  The outer map distorts the result of the inner one: its source is the
+  inner map's target. Instead of warping the frame twice, the inner map is
+  resampled at the co-ordinates of the outer map, linearly like the pixels
+  themselves, which gives for every target pixel the source pixel of the
+  whole chain. The shine of both is added up.
+
+  Composing costs about as much as generating a map of the simplest
+  transform, and a chain of any length is warped as fast as a single
+  transform.
+*/
+class TransformComposer : public WorkerTask
+{
+public:
+        // The target must be created for the inner map's target and source
+        // dimensions, and the outer map for the inner map's target both as
+        // its target and its source.
+    TransformComposer(TransformMap *target,
+                      const TransformMap *inner,
+                      const TransformMap *outer);
+
+public:
+        // Composes the whole map. threadCount as in
+        // MirrorEffect::setThreadCount(). Returns false if the dimensions
+        // of the maps don't match.
+    bool compose(int threadCount = 0);
+
+public: // From WorkerTask
+    void run(int begin, int end);
+
+private: // Data
+    TransformMap *m_target;
+    const TransformMap *m_inner;
+    const TransformMap *m_outer;
+};
+
+#endif // TRANSFORMCOMPOSER_H
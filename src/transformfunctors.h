@@ -0,0 +1,365 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef TRANSFORMFUNCTORS_H
+#define TRANSFORMFUNCTORS_H
+
+#include "fastmath.h"
+
+/*
+  The mirror transforms as inline functors. Both TransformGenerator, which
+  fills a TransformMap, and ProceduralWarp, which evaluates the transforms
+  while warping, instantiate their loops for each functor, so the compiler
+  sees the whole per-pixel computation without any switch or call.
+
+  A functor is set to a row with setRow() and then returns the displacement,
+  in the range of about [-1, 1], of the pixels of that row:
+
+  setRow(y, rowT, v)          rowT = y / height, v = rowT * 2 - 1
+  operator()(x, t, u, fx, fy) t = x / width, u = t * 2 - 1
+
+  GridShift tells how smooth the displacement is: ProceduralWarp evaluates
+  it on a grid with a spacing of 1 << GridShift pixels and interpolates in
+  between. 0 means the transform must be evaluated at every pixel.
+*/
+
+namespace TransformFunctors {
+
+// The original transforms use this value of pi, keep the results identical
+static const float TransformPi = 3.14159f;
+
+
+/*!
+  The parameters shared by all the transforms.
+*/
+class Parameters
+{
+public:
+    Parameters(float power, float size, unsigned int seed)
+        : m_power(power), m_size(size), m_seed(seed) {}
+
+    float m_power;
+    float m_size;
+    unsigned int m_seed;    // Dither's random seed
+};
+
+
+/*!
+  Returns a pseudo random number for the pixel (x, y). Unlike rand() it
+  doesn't depend on the order the pixels are processed in.
+*/
+inline unsigned int ditherHash(unsigned int x, unsigned int y, unsigned int seed)
+{
+    unsigned int h = x * 0x9E3779B1u + y * 0x85EBCA77u + seed;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    return h;
+}
+
+
+/*!
+  Returns the shine, 0-100, of a point displaced by (fx, fy). The displaced
+  point is treated as a normal of a surface (fx, fy, fz) with length
+  sqrt(3); the shine is the reflection of a light coming from the upper
+  left. The points off the surface have no shine.
+*/
+inline float surfaceShine(float fx, float fy)
+{
+    const float len2 = fx * fx + fy * fy;
+    const float z2 = 3.0f - len2;
+    const float fz = FastMath::sqrt(z2 > 0.0f ? z2 : 0.0f);
+    const float invLength = FastMath::rsqrt(len2 + fz * fz + 1e-20f);
+
+    float shine = (fx * -0.57f + fy * -0.57f + fz * 0.57f) * invLength;
+    shine = (shine - 0.5f) * 2.0f;
+    shine = shine < 0.0f ? 0.0f : shine;
+    shine = shine * shine * shine;
+    shine = shine > 1.0f ? 1.0f : shine;
+
+    return z2 < 0.0f ? 0.0f : shine * 100.0f;
+}
+
+
+class None
+{
+public:
+    enum { GridShift = 4 };
+
+    explicit None(const Parameters &) {}
+
+    void setRow(int, float, float) {}
+
+    void operator()(int, float, float, float &fx, float &fy) const
+    {
+        fx = 0.0f;
+        fy = 0.0f;
+    }
+};
+
+
+class HorizontalWave
+{
+public:
+    enum { GridShift = 3 };
+
+    explicit HorizontalWave(const Parameters &parameters)
+        : m_power(parameters.m_power),
+          m_frequency(TransformPi * 2.0f * parameters.m_size) {}
+
+    void setRow(int, float, float) {}
+
+    void operator()(int, float t, float, float &fx, float &fy) const
+    {
+        fx = FastMath::sin(t * m_frequency) * m_power;
+        fy = 0.0f;
+    }
+
+private:
+    float m_power;
+    float m_frequency;
+};
+
+
+class VerticalWave
+{
+public:
+    enum { GridShift = 3 };
+
+    explicit VerticalWave(const Parameters &parameters)
+        : m_power(parameters.m_power),
+          m_size(parameters.m_size),
+          m_rowValue(0.0f) {}
+
+    void setRow(int, float rowT, float)
+    {
+        m_rowValue = FastMath::sin(rowT * TransformPi * 2.0f * m_size) * m_power;
+    }
+
+    void operator()(int, float, float, float &fx, float &fy) const
+    {
+        fx = 0.0f;
+        fy = m_rowValue;
+    }
+
+private:
+    float m_power;
+    float m_size;
+    float m_rowValue;
+};
+
+
+class Bubbles
+{
+public:
+    enum { GridShift = 3 };
+
+    explicit Bubbles(const Parameters &parameters)
+        : m_power(parameters.m_power),
+          m_frequency(TransformPi * 2.0f * parameters.m_size),
+          m_rowValue(0.0f) {}
+
+    void setRow(int, float rowT, float)
+    {
+        m_rowValue = FastMath::sin(rowT * m_frequency) * m_power;
+    }
+
+    void operator()(int, float t, float, float &fx, float &fy) const
+    {
+        fx = FastMath::sin(t * m_frequency) * m_power;
+        fy = m_rowValue;
+    }
+
+private:
+    float m_power;
+    float m_frequency;
+    float m_rowValue;
+};
+
+
+class InvBubbles
+{
+public:
+    enum { GridShift = 3 };
+
+    explicit InvBubbles(const Parameters &parameters)
+        : m_power(parameters.m_power),
+          m_frequency(TransformPi * 2.0f * parameters.m_size),
+          m_rowValue(0.0f),
+          m_v(0.0f) {}
+
+    void setRow(int, float rowT, float v)
+    {
+        m_rowValue = FastMath::cos(rowT * m_frequency) * m_power;
+        m_v = v;
+    }
+
+    void operator()(int, float t, float u, float &fx, float &fy) const
+    {
+        float k = FastMath::sqrt(u * u + m_v * m_v);
+        k = 1.0f - k * k * k;
+        k = k < 0.0f ? 0.0f : k;
+        fx = FastMath::cos(t * m_frequency) * m_power * k;
+        fy = m_rowValue * k;
+    }
+
+private:
+    float m_power;
+    float m_frequency;
+    float m_rowValue;
+    float m_v;
+};
+
+
+class Spiral
+{
+public:
+    enum { GridShift = 2 };
+
+    explicit Spiral(const Parameters &parameters)
+        : m_size(parameters.m_size),
+          m_twist(20.0f * parameters.m_power),
+          m_v(0.0f) {}
+
+    void setRow(int, float, float v) { m_v = v; }
+
+    void operator()(int, float, float u, float &fx, float &fy) const
+    {
+        const float sqrt2 = 1.41421356f;
+        const float r = FastMath::sqrt(u * u + m_v * m_v);
+        const float a = FastMath::atan2(m_v, u) + (sqrt2 - r) * m_twist;
+        fx = (-u / 4 + FastMath::sin(a) * r) * m_size;
+        fy = (-m_v / 4 + FastMath::cos(a) * r) * m_size;
+    }
+
+private:
+    float m_size;
+    float m_twist;
+    float m_v;
+};
+
+
+class Ripple
+{
+public:
+    enum { GridShift = 2 };
+
+    explicit Ripple(const Parameters &parameters)
+        : m_power(parameters.m_power),
+          m_frequency(parameters.m_size * TransformPi * 2.0f),
+          m_v(0.0f) {}
+
+    void setRow(int, float, float v) { m_v = v; }
+
+    void operator()(int, float, float u, float &fx, float &fy) const
+    {
+        const float r = FastMath::sqrt(u * u + m_v * m_v);
+        const float invR = 1.0f / (r > 1e-6f ? r : 1e-6f);
+        const float k = FastMath::sin(r * m_frequency) * m_power * invR;
+        fx = u * k;
+        fy = m_v * k;
+    }
+
+private:
+    float m_power;
+    float m_frequency;
+    float m_v;
+};
+
+
+class Spike
+{
+public:
+    enum { GridShift = 2 };
+
+    explicit Spike(const Parameters &parameters)
+        : m_power(parameters.m_power),
+          m_v(0.0f) {}
+
+    void setRow(int, float, float v) { m_v = v; }
+
+    void operator()(int, float, float u, float &fx, float &fy) const
+    {
+        const float r = FastMath::sqrt(u * u + m_v * m_v);
+        const float invR = 1.0f / (r > 1e-6f ? r : 1e-6f);
+        float k = 1.0f - r;
+        k = (k < 0.0f ? 0.0f : k) * m_power * invR;
+        fx = u * k;
+        fy = m_v * k;
+    }
+
+private:
+    float m_power;
+    float m_v;
+};
+
+
+/*!
+  The tiles have sharp edges, so Tile is evaluated at every pixel.
+*/
+class Tile
+{
+public:
+    enum { GridShift = 0 };
+
+    explicit Tile(const Parameters &parameters)
+        : m_power(parameters.m_power),
+          m_size(parameters.m_size),
+          m_rowValue(0.0f) {}
+
+    void setRow(int, float rowT, float)
+    {
+        float ty = rowT * m_size;
+        ty -= FastMath::floor(ty);
+        m_rowValue = (ty - 0.5f) * 2.0f * m_power;
+    }
+
+    void operator()(int, float t, float, float &fx, float &fy) const
+    {
+        float tx = t * m_size;
+        tx -= FastMath::floor(tx);
+        fx = (tx - 0.5f) * 2.0f * m_power;
+        fy = m_rowValue;
+    }
+
+private:
+    float m_power;
+    float m_size;
+    float m_rowValue;
+};
+
+
+/*!
+  Random displacement for every pixel, evaluated at every pixel.
+*/
+class Dither
+{
+public:
+    enum { GridShift = 0 };
+
+    explicit Dither(const Parameters &parameters)
+        : m_power(parameters.m_power),
+          m_seed(parameters.m_seed),
+          m_y(0) {}
+
+    void setRow(int y, float, float) { m_y = y; }
+
+    void operator()(int x, float, float, float &fx, float &fy) const
+    {
+        const unsigned int h = ditherHash(x, m_y, m_seed);
+        fx = (-1.0f + (float)(h & 255) / 128.0f) * m_power;
+        fy = (-1.0f + (float)((h >> 8) & 255) / 128.0f) * m_power;
+    }
+
+private:
+    float m_power;
+    unsigned int m_seed;
+    int m_y;
+};
+
+} // namespace TransformFunctors
+
+#endif // TRANSFORMFUNCTORS_H
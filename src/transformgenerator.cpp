@@ -0,0 +1,308 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "transformgenerator.h"
+
+#include <QVarLengthArray>
+#include <QtAlgorithms>
+#include <math.h>
+#include <stdlib.h>
+
+#include "transformfunctors.h"
+#include "transformmap.h"
+
+// The size of the map samplingScale() estimates the scale from, and of the
+// source it samples
+static const int ScaleMapSize = 64;
+static const int ScaleSourceSize = 1024;
+
+// The share of the pixels allowed to magnify more than samplingScale()
+// tells, so that a few extreme pixels don't decide the scale
+static const float ScalePercentile = 0.05f;
+
+
+/*!
+  \class TransformGenerator
+  \brief Fills a TransformMap with the co-ordinates of a mirror transform.
+*/
+
+
+/*!
+  Constructor.
+*/
+TransformGenerator::TransformGenerator(TransformMap *map,
+                                       MirrorEffect::MirrorTransform transform,
+                                       float power,
+                                       float size,
+                                       int sourceWidth,
+                                       int sourceHeight)
+    : m_map(map),
+      m_fieldX(0),
+      m_fieldY(0),
+      m_transform(transform),
+      m_power(power),
+      m_size(size),
+      m_width(map->width()),
+      m_height(map->height()),
+      m_xInc(0),
+      m_yInc(0),
+      m_maxX(((sourceWidth - 1) << 14) - 1),
+      m_maxY(((sourceHeight - 1) << 14) - 1),
+      m_pixelMul((float)(sourceWidth + (float)sourceHeight) * 2000.0f / size),
+      m_ditherSeed((unsigned int)rand())
+{
+    if (m_width > 0 && m_height > 0) {
+        m_xInc = (sourceWidth << 14) / m_width;
+        m_yInc = (sourceHeight << 14) / m_height;
+    }
+
+    createColumns();
+}
+
+
+/*!
+  Constructor for generating the displacement field of a \a width x
+  \a height target into \a fieldX and \a fieldY.
+*/
+TransformGenerator::TransformGenerator(short *fieldX,
+                                       short *fieldY,
+                                       int width,
+                                       int height,
+                                       MirrorEffect::MirrorTransform transform,
+                                       float power,
+                                       float size)
+    : m_map(0),
+      m_fieldX(fieldX),
+      m_fieldY(fieldY),
+      m_transform(transform),
+      m_power(power),
+      m_size(size),
+      m_width(width),
+      m_height(height),
+      m_xInc(0),
+      m_yInc(0),
+      m_maxX(0),
+      m_maxY(0),
+      m_pixelMul(0.0f),
+      m_ditherSeed((unsigned int)rand())
+{
+    createColumns();
+}
+
+
+/*!
+  Generates the whole map, spreading the rows over the worker threads.
+*/
+void TransformGenerator::generate(int threadCount /* = 0 */)
+{
+    if (m_map ? m_map->isNull() : !m_fieldX)
+        return;
+
+    WorkerPool::instance()->runBands(this, m_height, threadCount, 4);
+}
+
+
+/*!
+  Returns how many source pixels per target pixel \a transform with
+  \a power and \a size needs for full detail: the inverse of the source
+  footprint of a target pixel (the square root of the area its neighbours'
+  source co-ordinates span) where it is the smallest, relative to the
+  identity transform. A source of the target's size times the scale is
+  sampled at least once per pixel everywhere but in the most magnified few
+  per cent of the mirror, and any larger source only adds pixels which are
+  skipped. Returns 0 if the transform samples no area at all.
+
+  The scale is estimated from a small map generated for the purpose, so it
+  is cheap enough to call whenever the mirror changes.
+*/
+float TransformGenerator::samplingScale(MirrorEffect::MirrorTransform transform,
+                                        float power,
+                                        float size)
+{
+    TransformMap map;
+    map.create(ScaleMapSize, ScaleMapSize, ScaleSourceSize, ScaleSourceSize);
+
+    TransformGenerator generator(&map, transform, power, size,
+                                 ScaleSourceSize, ScaleSourceSize);
+    generator.generate(1);
+
+        // The distance of the neighbours' source co-ordinates in the
+        // identity transform, in the units of the map
+    const float identityStep = (float)(ScaleSourceSize << map.fracBits()) / ScaleMapSize;
+
+    QVector<float> steps;
+    steps.reserve((ScaleMapSize - 1) * (ScaleMapSize - 1));
+
+    for (int y = 0; y < ScaleMapSize - 1; y++) {
+        const unsigned short *x0 = map.xRow(y);
+        const unsigned short *y0 = map.yRow(y);
+        const unsigned short *x1 = map.xRow(y + 1);
+        const unsigned short *y1 = map.yRow(y + 1);
+
+        for (int x = 0; x < ScaleMapSize - 1; x++) {
+                // The lengths of the Jacobian's columns
+            const float dxu = (float)x0[x + 1] - x0[x];
+            const float dyu = (float)y0[x + 1] - y0[x];
+            const float dxv = (float)x1[x] - x0[x];
+            const float dyv = (float)y1[x] - y0[x];
+            const float area = fabsf(dxu * dyv - dyu * dxv);
+
+                // The pixels clamped to the edges of the source have no area
+            if (area > 0.0f)
+                steps.append(sqrtf(area) / identityStep);
+        }
+    }
+
+    if (steps.isEmpty())
+        return 0.0f;
+
+    qSort(steps);
+
+    const float step = steps.at((int)(steps.count() * ScalePercentile));
+    return step > 0.0f ? 1.0f / step : 0.0f;
+}
+
+
+/*!
+  From WorkerTask. Generates the rows [begin, end) with the functor of the
+  transform.
+*/
+void TransformGenerator::run(int begin, int end)
+{
+    using namespace TransformFunctors;
+    const Parameters parameters(m_power, m_size, m_ditherSeed);
+
+    switch (m_transform) {
+    default:
+    case MirrorEffect::None:
+        generateRows(None(parameters), begin, end);
+        break;
+    case MirrorEffect::HorizontalWave:
+        generateRows(HorizontalWave(parameters), begin, end);
+        break;
+    case MirrorEffect::VerticalWave:
+        generateRows(VerticalWave(parameters), begin, end);
+        break;
+    case MirrorEffect::Bubbles:
+        generateRows(Bubbles(parameters), begin, end);
+        break;
+    case MirrorEffect::InvBubbles:
+        generateRows(InvBubbles(parameters), begin, end);
+        break;
+    case MirrorEffect::Spiral:
+        generateRows(Spiral(parameters), begin, end);
+        break;
+    case MirrorEffect::Ripple:
+        generateRows(Ripple(parameters), begin, end);
+        break;
+    case MirrorEffect::Spike:
+        generateRows(Spike(parameters), begin, end);
+        break;
+    case MirrorEffect::Tile:
+        generateRows(Tile(parameters), begin, end);
+        break;
+    case MirrorEffect::Dither:
+        generateRows(Dither(parameters), begin, end);
+        break;
+    } // switch (m_transform)
+}
+
+
+/*!
+  Evaluates \a transform for the rows [begin, end) a whole row at a time and
+  stores the results.
+*/
+template <class Transform>
+void TransformGenerator::generateRows(Transform transform, int begin, int end)
+{
+    QVarLengthArray<float, 1024> fx(m_width);
+    QVarLengthArray<float, 1024> fy(m_width);
+    const float *columnT = m_columnT.constData();
+    const float *columnU = m_columnU.constData();
+    const int width = m_width;
+
+    for (int y = begin; y < end; y++) {
+        const float rowT = (float)y / (float)m_height;
+        transform.setRow(y, rowT, (rowT - 0.5f) * 2.0f);
+
+        for (int x = 0; x < width; x++)
+            transform(x, columnT[x], columnU[x], fx[x], fy[x]);
+
+        if (m_fieldX)
+            storeDisplacement(y, fx.data(), fy.data());
+        else
+            storeRow(y, fx.data(), fy.data());
+    }
+}
+
+
+/*!
+  Calculates the shine (see TransformFunctors::surfaceShine()) and the
+  clamped source co-ordinates of the row \a y.
+*/
+void TransformGenerator::storeRow(int y, const float *fx, const float *fy)
+{
+    unsigned short *mapX = m_map->xRow(y);
+    unsigned short *mapY = m_map->yRow(y);
+    unsigned char *mapShine = m_map->shineRow(y);
+
+        // The co-ordinates are calculated as 18/14 fixedpoint and stored with
+        // the precision of the map.
+    const int mapShift = 14 - m_map->fracBits();
+    const int sy = m_yInc * y;
+    const int width = m_width;
+
+    for (int x = 0; x < width; x++) {
+        if (mapShine)
+            mapShine[x] = (unsigned char)TransformFunctors::surfaceShine(fx[x], fy[x]);
+
+        // Place the transform co-ordinate into the map
+        int sourceX = m_xInc * x + (int)(fx[x] * m_pixelMul);
+        int sourceY = sy + (int)(fy[x] * m_pixelMul);
+
+        sourceX = sourceX < 0 ? 0 : sourceX;
+        sourceY = sourceY < 0 ? 0 : sourceY;
+        sourceX = sourceX > m_maxX ? m_maxX : sourceX;
+        sourceY = sourceY > m_maxY ? m_maxY : sourceY;
+
+        mapX[x] = (unsigned short)(sourceX >> mapShift);
+        mapY[x] = (unsigned short)(sourceY >> mapShift);
+    }
+}
+
+
+/*!
+  Stores the displacement of the row \a y into the field in
+  DisplacementScale fixed point, saturated to the range of a short.
+*/
+void TransformGenerator::storeDisplacement(int y, const float *fx, const float *fy)
+{
+    short *fieldX = m_fieldX + m_width * y;
+    short *fieldY = m_fieldY + m_width * y;
+    const float scale = (float)DisplacementScale;
+    const int width = m_width;
+
+    for (int x = 0; x < width; x++) {
+        const float dx = qBound(-32767.0f, fx[x] * scale, 32767.0f);
+        const float dy = qBound(-32767.0f, fy[x] * scale, 32767.0f);
+
+        fieldX[x] = (short)(dx < 0.0f ? dx - 0.5f : dx + 0.5f);
+        fieldY[x] = (short)(dy < 0.0f ? dy - 0.5f : dy + 0.5f);
+    }
+}
+
+
+/*!
+  Calculates the t and u of every column.
+*/
+void TransformGenerator::createColumns()
+{
+    m_columnT.resize(m_width);
+    m_columnU.resize(m_width);
+
+    for (int x = 0; x < m_width; x++) {
+        m_columnT[x] = (float)x / (float)m_width;
+        m_columnU[x] = (m_columnT[x] - 0.5f) * 2.0f;
+    }
+}
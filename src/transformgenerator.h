@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef TRANSFORMGENERATOR_H
+#define TRANSFORMGENERATOR_H
+
+#include <QVector>
+
+#include "mirroreffect.h"
+#include "workerpool.h"
+
+// Forward declarations
+class TransformMap;
+
+
+/*!
+  \class TransformGenerator
+  \brief Fills a TransformMap with the co-ordinates of a mirror transform.
+
+  The transform is evaluated a whole row at a time: first the displacement
+  of every pixel of the row, then the shine and the final co-ordinates. The
+  row loops are instantiated for each of TransformFunctors, which use the
+  branch-free approximations of FastMath so the compiler can vectorize the
+  loops. The rows are spread over the threads of WorkerPool.
+
+  Instead of a map the generator can fill a displacement field: the raw
+  displacement of every pixel in DisplacementScale fixed point, before it
+  is scaled to the source and clamped. AnimatedTransform blends the maps of
+  animated parameters from such fields.
+*/
+class TransformGenerator : public WorkerTask
+{
+public:
+    enum { DisplacementScale = 8192 };  // Of the displacement fields, 1.0 = 8192
+
+public:
+        // The map must already be created (TransformMap::create()) with the
+        // target and source dimensions.
+    TransformGenerator(TransformMap *map,
+                       MirrorEffect::MirrorTransform transform,
+                       float power,
+                       float size,
+                       int sourceWidth,
+                       int sourceHeight);
+
+        // Generates the displacement field of a width x height target into
+        // fieldX and fieldY, width * height items each, instead of a map
+    TransformGenerator(short *fieldX,
+                       short *fieldY,
+                       int width,
+                       int height,
+                       MirrorEffect::MirrorTransform transform,
+                       float power,
+                       float size);
+
+public:
+        // Generates the whole map, or the field. threadCount as in
+        // MirrorEffect::setThreadCount().
+    void generate(int threadCount = 0);
+
+        // Calculates the shine and the source co-ordinates of the row y from
+        // its displacement and stores them into the map.
+    void storeRow(int y, const float *fx, const float *fy);
+
+        // The source pixels per target pixel the transform needs for full
+        // detail where it magnifies the most. 1.0 for the identity.
+    static float samplingScale(MirrorEffect::MirrorTransform transform,
+                               float power,
+                               float size);
+
+public: // From WorkerTask
+    void run(int begin, int end);
+
+protected:
+        // Generates the rows [begin, end) with one of TransformFunctors
+    template <class Transform>
+    void generateRows(Transform transform, int begin, int end);
+
+        // Stores the displacement of the row y into the field
+    void storeDisplacement(int y, const float *fx, const float *fy);
+
+private:
+    void createColumns();
+
+private: // Data
+    TransformMap *m_map;        // 0 when generating a field
+    short *m_fieldX;            // 0 when generating a map
+    short *m_fieldY;
+    MirrorEffect::MirrorTransform m_transform;
+    float m_power;
+    float m_size;
+    int m_width;
+    int m_height;
+    int m_xInc;
+    int m_yInc;
+    int m_maxX;
+    int m_maxY;
+    float m_pixelMul;
+    unsigned int m_ditherSeed;
+    QVector<float> m_columnT;   // x / width for each column
+    QVector<float> m_columnU;   // x in [-1, 1] for each column
+};
+
+#endif // TRANSFORMGENERATOR_H
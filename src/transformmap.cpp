@@ -0,0 +1,236 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "transformmap.h"
+
+#include <QFile>
+
+#include "bufferpool.h"
+
+
+/*!
+  \class TransformMap
+  \brief Source co-ordinate map of a mirror transform in a compact structure-of-arrays layout.
+*/
+
+
+/*!
+  Constructor.
+*/
+TransformMap::TransformMap()
+    : m_x(0),
+      m_y(0),
+      m_shine(0),
+      m_levels(0),
+      m_width(0),
+      m_height(0),
+      m_fracBits(0),
+      m_maxLevel(0),
+      m_file(0),
+      m_mapping(0)
+{
+}
+
+
+/*!
+  Destructor.
+*/
+TransformMap::~TransformMap()
+{
+    clear();
+}
+
+
+/*!
+  Allocates the planes from BufferPool. Existing planes are reused if the
+  size matches, unless they are mapped from a file. The level plane is
+  released, see createLevels(). The map is left null if the co-ordinate
+  planes can't be allocated, while the shine plane is optional.
+*/
+void TransformMap::create(int width, int height, int sourceWidth, int sourceHeight)
+{
+    if (m_file)
+        clear();
+
+    m_fracBits = fracBitsFor(sourceWidth, sourceHeight);
+
+    if (m_x && m_width == width && m_height == height) {
+        BufferPool::instance()->release(m_levels);
+        m_levels = 0;
+        m_maxLevel = 0;
+
+        if (!m_shine)
+            m_shine = BufferPool::instance()->acquireArray<unsigned char>(width * height);
+
+        return;
+    }
+
+    clear();
+
+    if (width < 1 || height < 1)
+        return;
+
+    m_width = width;
+    m_height = height;
+    BufferPool *pool = BufferPool::instance();
+    m_x = pool->acquireArray<unsigned short>(width * height);
+    m_y = pool->acquireArray<unsigned short>(width * height);
+    m_shine = pool->acquireArray<unsigned char>(width * height);
+
+    if (!m_x || !m_y)
+        clear();
+}
+
+
+/*!
+  Replaces the planes with the ones in \a file, mapped read-only at
+  \a data. The planes are \a planeStride bytes apart. The shine plane is
+  used only if \a shine is true, and the level plane, following it, only
+  if \a maxLevel is above 0. The pages are shared with every other map,
+  and process, mapping the same file.
+*/
+void TransformMap::attach(QFile *file, unsigned char *data, int planeStride,
+                          int width, int height, int fracBits, bool shine,
+                          int maxLevel)
+{
+    clear();
+
+    m_file = file;
+    m_mapping = data;
+    m_x = reinterpret_cast<unsigned short*>(data);
+    m_y = reinterpret_cast<unsigned short*>(data + planeStride);
+    m_shine = shine ? data + planeStride * 2 : 0;
+    m_levels = maxLevel > 0 ? data + planeStride * (shine ? 3 : 2) : 0;
+    m_width = width;
+    m_height = height;
+    m_fracBits = fracBits;
+    m_maxLevel = maxLevel;
+}
+
+
+/*!
+  Releases the planes back to BufferPool, or unmaps them.
+*/
+void TransformMap::clear()
+{
+    if (m_file) {
+        m_file->unmap(m_mapping);
+        delete m_file;
+        m_file = 0;
+        m_mapping = 0;
+    }
+    else {
+        BufferPool *pool = BufferPool::instance();
+        pool->release(m_x);
+        pool->release(m_y);
+        pool->release(m_shine);
+        pool->release(m_levels);
+    }
+
+    m_x = 0;
+    m_y = 0;
+    m_shine = 0;
+    m_levels = 0;
+    m_width = 0;
+    m_height = 0;
+    m_maxLevel = 0;
+}
+
+
+/*!
+  Drops the shine plane if all of its values are zero. The resampling then
+  skips the shine addition completely.
+*/
+void TransformMap::releaseShineIfUnused()
+{
+    if (!m_shine || m_file)
+        return;
+
+    const unsigned char *s = m_shine;
+    const unsigned char *s_target = m_shine + m_width * m_height;
+
+    while (s != s_target) {
+        if (*s)
+            return;
+
+        s++;
+    }
+
+    BufferPool::instance()->release(m_shine);
+    m_shine = 0;
+}
+
+
+/*!
+  Allocates the level plane from BufferPool, unless the map is mapped from
+  a file or has no planes. If the memory runs out there is no level plane,
+  and every pixel is sampled from the source itself.
+*/
+void TransformMap::createLevels()
+{
+    if (m_file || !m_x || m_levels)
+        return;
+
+    m_levels = BufferPool::instance()->acquireArray<unsigned char>(m_width * m_height);
+    m_maxLevel = 0;
+}
+
+
+/*!
+  Stores the highest level of the level plane, and drops the plane if it is
+  0 everywhere: the map doesn't shrink the source enough to need
+  SourcePyramid.
+*/
+void TransformMap::releaseLevelsIfUnused()
+{
+    if (!m_levels || m_file)
+        return;
+
+    const unsigned char *l = m_levels;
+    const unsigned char *l_target = m_levels + m_width * m_height;
+    unsigned char maxLevel = 0;
+
+    while (l != l_target) {
+        if (*l > maxLevel)
+            maxLevel = *l;
+
+        l++;
+    }
+
+    m_maxLevel = maxLevel;
+
+    if (maxLevel == 0) {
+        BufferPool::instance()->release(m_levels);
+        m_levels = 0;
+    }
+}
+
+
+/*!
+  The integer part must hold co-ordinates up to max(width, height) - 2
+  (the resampling reads one pixel to the right and below); the rest of the
+  16 bits is used for the fraction, up to 7 bits.
+*/
+int TransformMap::fracBitsFor(int sourceWidth, int sourceHeight)
+{
+    const int maxCoordinate = (sourceWidth > sourceHeight ? sourceWidth : sourceHeight) - 1;
+    int integerBits = 0;
+
+    while (integerBits < 16 && (1 << integerBits) <= maxCoordinate)
+        integerBits++;
+
+    const int fracBits = 16 - integerBits;
+    return fracBits > 7 ? 7 : fracBits;
+}
+
+
+/*!
+  Returns the memory used by the planes.
+*/
+int TransformMap::byteCount() const
+{
+    const int pixels = m_width * m_height;
+    return pixels * 2 * (int)sizeof(unsigned short) + (m_shine ? pixels : 0)
+            + (m_levels ? pixels : 0);
+}
@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef TRANSFORMMAP_H
+#define TRANSFORMMAP_H
+
+#include <QSharedData>
+
+// Forward declarations
+class QFile;
+
+
+/*!
+  \class TransformMap
+  \brief Source co-ordinate map of a mirror transform in a compact structure-of-arrays layout.
+
+  For each target pixel the map tells the source pixel FROM WHERE this pixel
+  should take it's color. The x and y co-ordinates are stored in separate
+  planes as unsigned 16-bit fixed point numbers. The number of fraction bits
+  depends on the source dimensions: as many as fit next to the integer part,
+  at most 7 since the resampling uses 7-bit weights. The co-ordinates are
+  ABSOLUTE (and therefore relative to source image's current dimensions).
+
+  The third plane is a "shine" value per pixel, telling how much white
+  should be added to this pixel when it's resampled. The plane is left out
+  when the whole map has no shine.
+
+  The optional fourth plane is the level of SourcePyramid each pixel is
+  sampled from, selected by MipLevelSelector. It is left out when the map
+  doesn't shrink the source anywhere.
+
+  Once generated, a map is shared read-only between the effects through
+  TransformMapCache. A map loaded from TransformMapStore uses the planes of
+  a file mapped into memory instead of allocated ones.
+*/
+class TransformMap : public QSharedData
+{
+public:
+    TransformMap();
+    ~TransformMap();
+
+public:
+        // Allocates the planes for a width x height target sampling a
+        // sourceWidth x sourceHeight image. The contents are undefined.
+    void create(int width, int height, int sourceWidth, int sourceHeight);
+
+        // Uses the planes in the file mapped read-only at data: the x and
+        // the y plane, the shine plane if shine is true and the level
+        // plane if maxLevel is above 0, each starting planeStride bytes
+        // after the previous one. The map takes the ownership of file,
+        // which unmaps it when the map is cleared.
+    void attach(QFile *file, unsigned char *data, int planeStride,
+                int width, int height, int fracBits, bool shine,
+                int maxLevel);
+    bool isMapped() const { return m_file != 0; }
+
+        // Releases the planes
+    void clear();
+
+        // Frees the shine plane if none of the pixels has shine
+    void releaseShineIfUnused();
+
+        // Allocates the level plane. The contents are undefined.
+    void createLevels();
+
+        // Finds the highest level of the plane, and frees the plane if all
+        // of the pixels are at level 0
+    void releaseLevelsIfUnused();
+
+        // Returns how many fraction bits a map sampling a source of the given
+        // size uses.
+    static int fracBitsFor(int sourceWidth, int sourceHeight);
+
+    bool isNull() const { return m_x == 0; }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    int fracBits() const { return m_fracBits; }
+    int maxLevel() const { return m_levels ? m_maxLevel : 0; }
+    int byteCount() const;
+
+        // Plane rows. shineRow() returns 0 if there is no shine plane.
+    unsigned short *xRow(int y) const { return m_x + m_width * y; }
+    unsigned short *yRow(int y) const { return m_y + m_width * y; }
+    unsigned char *shineRow(int y) const { return m_shine ? m_shine + m_width * y : 0; }
+    unsigned char *levelRow(int y) const { return m_levels ? m_levels + m_width * y : 0; }
+
+private:
+    // Not copyable
+    TransformMap(const TransformMap &);
+    TransformMap &operator=(const TransformMap &);
+
+private: // Data
+    unsigned short *m_x;
+    unsigned short *m_y;
+    unsigned char *m_shine;
+    unsigned char *m_levels;
+    int m_width;
+    int m_height;
+    int m_fracBits;
+    int m_maxLevel;
+    QFile *m_file;              // The mapped file, 0 if the planes are allocated
+    unsigned char *m_mapping;   // The start of the mapping
+};
+
+#endif // TRANSFORMMAP_H
@@ -0,0 +1,275 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "transformmapcache.h"
+
+#include <QDebug>
+#include <string.h>
+
+#include "bufferpool.h"
+
+// Default memory limit, enough for several full screen maps
+static const int DefaultMaxBytes = 24 * 1024 * 1024;
+
+
+/*!
+  Returns \a value with a single bit pattern for each value the keys tell
+  apart: -0 is turned into 0, and every NaN into the same quiet NaN.
+*/
+static float normalizedKeyValue(float value)
+{
+    if (value == 0.0f)
+        return 0.0f;
+
+    if (value != value) {
+        const unsigned int quietNaN = 0x7FC00000;
+        memcpy(&value, &quietNaN, sizeof(value));
+    }
+
+    return value;
+}
+
+
+/*!
+  Returns true if \a a and \a b have the same bit pattern, as qHash()
+  hashes them.
+*/
+static bool sameBits(float a, float b)
+{
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+
+/*!
+  \class TransformMapKey
+  \brief Identifies a transform map: everything the contents of the map depend on.
+*/
+
+
+/*!
+  Constructor.
+*/
+TransformMapKey::TransformMapKey()
+    : m_transform(0),
+      m_power(0.0f),
+      m_size(0.0f),
+      m_sourceWidth(0),
+      m_sourceHeight(0),
+      m_targetWidth(0),
+      m_targetHeight(0),
+      m_rotation(0)
+{
+}
+
+
+/*!
+  Constructor. \a power and \a size are normalized, so that -0 and 0 give
+  the same key, and so do all NaNs.
+*/
+TransformMapKey::TransformMapKey(int transform, float power, float size,
+                                 int sourceWidth, int sourceHeight,
+                                 int targetWidth, int targetHeight,
+                                 int rotation)
+    : m_transform(transform),
+      m_power(normalizedKeyValue(power)),
+      m_size(normalizedKeyValue(size)),
+      m_sourceWidth(sourceWidth),
+      m_sourceHeight(sourceHeight),
+      m_targetWidth(targetWidth),
+      m_targetHeight(targetHeight),
+      m_rotation(rotation)
+{
+}
+
+
+/*!
+  Equality operator. The floats are compared by their bit patterns, like
+  qHash() hashes them, so that a NaN power equals itself.
+*/
+bool TransformMapKey::operator==(const TransformMapKey &other) const
+{
+    return m_transform == other.m_transform
+            && sameBits(m_power, other.m_power)
+            && sameBits(m_size, other.m_size)
+            && m_sourceWidth == other.m_sourceWidth
+            && m_sourceHeight == other.m_sourceHeight
+            && m_targetWidth == other.m_targetWidth
+            && m_targetHeight == other.m_targetHeight
+            && m_rotation == other.m_rotation
+            && m_layers == other.m_layers;
+}
+
+
+/*!
+  Hash function for QHash.
+*/
+uint qHash(const TransformMapKey &key)
+{
+    uint power(0);
+    uint size(0);
+    memcpy(&power, &key.m_power, sizeof(power));
+    memcpy(&size, &key.m_size, sizeof(size));
+
+    uint hash = key.m_transform;
+    hash = hash * 31 + power;
+    hash = hash * 31 + size;
+    hash = hash * 31 + key.m_sourceWidth;
+    hash = hash * 31 + key.m_sourceHeight;
+    hash = hash * 31 + key.m_targetWidth;
+    hash = hash * 31 + key.m_targetHeight;
+    hash = hash * 31 + key.m_rotation;
+    hash = hash * 31 + qHash(key.m_layers);
+    return hash;
+}
+
+
+/*!
+  \class TransformMapCache
+  \brief Process-wide, memory bounded cache of transform maps.
+*/
+
+
+/*!
+  Constructor.
+*/
+TransformMapCache::TransformMapCache()
+    : m_maxBytes(DefaultMaxBytes),
+      m_totalBytes(0)
+{
+    // The maps return their planes to the pool when the cache is
+    // destroyed, so the pool must be constructed first to outlive it.
+    BufferPool::instance();
+}
+
+
+/*!
+  Destructor.
+*/
+TransformMapCache::~TransformMapCache()
+{
+}
+
+
+/*!
+  Returns the cache shared by all the mirror effects of the process.
+*/
+TransformMapCache *TransformMapCache::instance()
+{
+    static TransformMapCache cache;
+    return &cache;
+}
+
+
+/*!
+  Returns the map for \a key and marks it the most recently used, or a null
+  pointer if it is not cached.
+*/
+TransformMapCache::MapPointer TransformMapCache::find(const TransformMapKey &key)
+{
+    QMutexLocker locker(&m_mutex);
+
+    const MapPointer map = m_maps.value(key);
+
+    if (map) {
+        m_recentlyUsed.removeOne(key);
+        m_recentlyUsed.append(key);
+    }
+
+    return map;
+}
+
+
+/*!
+  Adds \a map to the cache with \a key, releasing the least recently used
+  unused maps if the memory limit is exceeded.
+*/
+void TransformMapCache::insert(const TransformMapKey &key, const MapPointer &map)
+{
+    if (!map)
+        return;
+
+    QMutexLocker locker(&m_mutex);
+
+    if (m_maps.contains(key)) {
+        m_totalBytes -= m_maps.value(key)->byteCount();
+        m_recentlyUsed.removeOne(key);
+    }
+
+    m_maps.insert(key, map);
+    m_recentlyUsed.append(key);
+    m_totalBytes += map->byteCount();
+
+    evict(m_maxBytes);
+}
+
+
+/*!
+  Sets the memory limit to \a maxBytes.
+*/
+void TransformMapCache::setMaxBytes(int maxBytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxBytes = maxBytes;
+    evict(m_maxBytes);
+}
+
+
+/*!
+  Returns the memory limit.
+*/
+int TransformMapCache::maxBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maxBytes;
+}
+
+
+/*!
+  Returns the memory used by the cached maps, including the ones in use.
+*/
+int TransformMapCache::totalBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_totalBytes;
+}
+
+
+/*!
+  Releases every map not used by any effect.
+*/
+void TransformMapCache::trim()
+{
+    QMutexLocker locker(&m_mutex);
+    evict(0);
+}
+
+
+/*!
+  Releases the least recently used maps until the total size is at most
+  \a maxBytes. Maps still used by an effect are kept; they are released when
+  the cache is the only owner left and the limit is exceeded again. The
+  mutex must be locked.
+*/
+void TransformMapCache::evict(int maxBytes)
+{
+    int i = 0;
+
+    while (m_totalBytes > maxBytes && i < m_recentlyUsed.count()) {
+        const TransformMapKey key = m_recentlyUsed.at(i);
+        const MapPointer map = m_maps.value(key);
+
+        // The cache's reference plus the local one above
+        if (int(map->ref) > 2) {
+            i++;
+            continue;
+        }
+
+        qDebug() << "TransformMapCache::evict(): Releasing a map of"
+                 << map->byteCount() << "bytes";
+
+        m_totalBytes -= map->byteCount();
+        m_maps.remove(key);
+        m_recentlyUsed.removeAt(i);
+    }
+}
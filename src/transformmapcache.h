@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef TRANSFORMMAPCACHE_H
+#define TRANSFORMMAPCACHE_H
+
+#include <QByteArray>
+#include <QExplicitlySharedDataPointer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+
+#include "transformmap.h"
+
+
+/*!
+  \class TransformMapKey
+  \brief Identifies a transform map: everything the contents of the map depend on.
+*/
+class TransformMapKey
+{
+public:
+    TransformMapKey();
+    TransformMapKey(int transform, float power, float size,
+                    int sourceWidth, int sourceHeight,
+                    int targetWidth, int targetHeight,
+                    int rotation);
+
+    bool operator==(const TransformMapKey &other) const;
+
+public: // Data
+    int m_transform;
+    float m_power;
+    float m_size;
+    int m_sourceWidth;
+    int m_sourceHeight;
+    int m_targetWidth;
+    int m_targetHeight;
+    int m_rotation;     // Rotation/flip flags of the source, see MirrorEffect::setSource()
+    QByteArray m_layers;    // The transforms composed on top, empty for none
+};
+
+uint qHash(const TransformMapKey &key);
+
+
+/*!
+  \class TransformMapCache
+  \brief Process-wide, memory bounded cache of transform maps.
+
+  The maps are reference counted, so every MirrorEffect using the same
+  transform with the same dimensions shares a single map. Maps no longer
+  used by any effect stay in the cache until the total size exceeds the
+  limit, after which the least recently used ones are released first.
+*/
+class TransformMapCache
+{
+public:
+    typedef QExplicitlySharedDataPointer<TransformMap> MapPointer;
+
+public:
+    TransformMapCache();
+    ~TransformMapCache();
+
+    static TransformMapCache *instance();
+
+public:
+        // Returns the map for key or a null pointer if it is not cached
+    MapPointer find(const TransformMapKey &key);
+
+        // Adds a fully generated map. The map must not be modified afterwards.
+    void insert(const TransformMapKey &key, const MapPointer &map);
+
+        // The memory limit in bytes
+    void setMaxBytes(int maxBytes);
+    int maxBytes() const;
+    int totalBytes() const;
+
+        // Releases the maps which are not in use
+    void trim();
+
+private:
+    void evict(int maxBytes);
+
+private: // Data
+    mutable QMutex m_mutex;
+    QHash<TransformMapKey, MapPointer> m_maps;
+    QList<TransformMapKey> m_recentlyUsed;  // Most recently used last
+    int m_maxBytes;
+    int m_totalBytes;
+};
+
+#endif // TRANSFORMMAPCACHE_H
@@ -0,0 +1,424 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "transformmapstore.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QScopedPointer>
+#include <QStringList>
+#include <QTemporaryFile>
+#include <string.h>
+
+#if defined(Q_OS_WIN)
+    #include <sys/utime.h>
+#else
+    #include <utime.h>
+#endif
+
+#include "bufferpool.h"
+#include "sourcepyramid.h"
+
+static const unsigned int FileMagic = 0x4D54484D;                  // "MHTM"
+static const qint64 DefaultMaxBytes = 32 * 1024 * 1024;             // A dozen full screen maps
+static const int PlaneAlignment = BufferPool::PageSize;             // Of the planes in the files
+static const char *const FileSuffix = ".map";
+
+
+/*
+  The header at the start of a file. The serialized TransformMapKey follows
+  it, and the planes start at m_planeOffset.
+*/
+struct FileHeader
+{
+    unsigned int m_magic;
+    unsigned int m_version;
+    unsigned int m_keyBytes;
+    int m_width;
+    int m_height;
+    int m_fracBits;
+    unsigned int m_hasShine;
+    unsigned int m_maxLevel;        // 0 if there is no level plane
+    unsigned int m_planeOffset;
+    unsigned int m_planeStride;     // The bytes from a plane to the next one
+    unsigned int m_checksum;        // Of all the planes with their padding
+};
+
+
+/*!
+  Returns \a value rounded up to a multiple of PlaneAlignment.
+*/
+static unsigned int alignPlane(unsigned int value)
+{
+    return (value + PlaneAlignment - 1) & ~(PlaneAlignment - 1);
+}
+
+
+/*!
+  Sets the modification time of the file \a fileName to now, so that it is
+  evicted after the files used before it.
+*/
+static void touch(const QString &fileName)
+{
+    utime(QFile::encodeName(fileName).constData(), 0);
+}
+
+
+/*!
+  Appends the bytes of \a value to \a data.
+*/
+template <class T>
+static void appendValue(QByteArray &data, T value)
+{
+    data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+
+/*!
+  \class TransformMapStore
+  \brief Persistent store of generated transform maps in a cache directory.
+*/
+
+
+/*!
+  Constructor.
+*/
+TransformMapStore::TransformMapStore()
+    : m_maxBytes(DefaultMaxBytes)
+{
+}
+
+
+/*!
+  Destructor.
+*/
+TransformMapStore::~TransformMapStore()
+{
+}
+
+
+/*!
+  Returns the store shared by all the mirror effects of the process.
+*/
+TransformMapStore *TransformMapStore::instance()
+{
+    static TransformMapStore store;
+    return &store;
+}
+
+
+/*!
+  Sets the directory the maps are stored in to \a directory. An empty
+  directory disables the store.
+*/
+void TransformMapStore::setDirectory(const QString &directory)
+{
+    QMutexLocker locker(&m_mutex);
+    m_directory = directory;
+}
+
+
+/*!
+  Returns the directory the maps are stored in, empty if the store is
+  disabled.
+*/
+QString TransformMapStore::directory() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_directory;
+}
+
+
+/*!
+  Sets the limit for the total size of the files to \a maxBytes and removes
+  the files over it.
+*/
+void TransformMapStore::setMaxBytes(qint64 maxBytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxBytes = maxBytes;
+    evictUnlocked(m_maxBytes);
+}
+
+
+/*!
+  Returns the limit for the total size of the files.
+*/
+qint64 TransformMapStore::maxBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maxBytes;
+}
+
+
+/*!
+  Returns the map stored with \a key, mapped read-only into memory, or a
+  null pointer if the store has no such map. A file which isn't a valid
+  map of this version, or whose planes don't match the checksum, is
+  removed. A file loaded is marked as used, see evict().
+*/
+TransformMapCache::MapPointer TransformMapStore::load(const TransformMapKey &key)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_directory.isEmpty())
+        return TransformMapCache::MapPointer();
+
+    const QByteArray keyBytes = serializeKey(key);
+    QScopedPointer<QFile> file(new QFile(fileName(keyBytes)));
+
+    if (!file->open(QIODevice::ReadOnly))
+        return TransformMapCache::MapPointer();
+
+    FileHeader header;
+    const bool headerRead = file->read(reinterpret_cast<char*>(&header), sizeof(header))
+            == (qint64)sizeof(header);
+
+    const int planeCount = headerRead ? 2 + (header.m_hasShine ? 1 : 0)
+                                          + (header.m_maxLevel > 0 ? 1 : 0)
+                                      : 0;
+    const qint64 planeBytes = headerRead ? (qint64)header.m_planeStride * planeCount : 0;
+
+    if (!headerRead
+            || header.m_magic != FileMagic
+            || header.m_version != FormatVersion
+            || header.m_width != key.m_targetWidth
+            || header.m_height != key.m_targetHeight
+            || header.m_maxLevel > SourcePyramid::MaxLevel
+            || header.m_planeStride < (unsigned int)(header.m_width * header.m_height * 2)
+            || header.m_keyBytes > header.m_planeOffset
+            || header.m_planeOffset - header.m_keyBytes < sizeof(header)
+            || file->size() < header.m_planeOffset + planeBytes)
+    {
+        qDebug() << "TransformMapStore::load(): Removing an invalid map" << file->fileName();
+        file->remove();
+        return TransformMapCache::MapPointer();
+    }
+
+        // A different key with the same file name
+    if (file->read(header.m_keyBytes) != keyBytes)
+        return TransformMapCache::MapPointer();
+
+    unsigned char *data = file->map(header.m_planeOffset, planeBytes);
+
+    if (!data)
+        return TransformMapCache::MapPointer();
+
+    if (checksum(data, (int)planeBytes) != header.m_checksum) {
+        qDebug() << "TransformMapStore::load(): Removing a corrupted map" << file->fileName();
+        file->unmap(data);
+        file->remove();
+        return TransformMapCache::MapPointer();
+    }
+
+    touch(file->fileName());
+
+    TransformMapCache::MapPointer map(new TransformMap());
+    map->attach(file.take(), data, header.m_planeStride,
+                header.m_width, header.m_height, header.m_fracBits,
+                header.m_hasShine != 0, header.m_maxLevel);
+    return map;
+}
+
+
+/*!
+  Writes \a map into the store with \a key, unless a map with the key has
+  been stored already, and removes the oldest files if the size limit is
+  exceeded. Returns false if the store is disabled or the file couldn't be
+  written.
+*/
+bool TransformMapStore::save(const TransformMapKey &key, const TransformMap &map)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_directory.isEmpty() || map.isNull())
+        return false;
+
+    const QByteArray keyBytes = serializeKey(key);
+    const QString name = fileName(keyBytes);
+
+    if (QFile::exists(name))
+        return true;
+
+    if (!QDir().mkpath(m_directory))
+        return false;
+
+    const int width = map.width();
+    const int height = map.height();
+    const int pixels = width * height;
+    const bool hasShine = map.shineRow(0) != 0;
+    const int maxLevel = map.maxLevel();
+    const int planeCount = 2 + (hasShine ? 1 : 0) + (maxLevel > 0 ? 1 : 0);
+
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.m_magic = FileMagic;
+    header.m_version = FormatVersion;
+    header.m_keyBytes = keyBytes.size();
+    header.m_width = width;
+    header.m_height = height;
+    header.m_fracBits = map.fracBits();
+    header.m_hasShine = hasShine ? 1 : 0;
+    header.m_maxLevel = maxLevel;
+    header.m_planeOffset = alignPlane(sizeof(header) + keyBytes.size());
+    header.m_planeStride = alignPlane(pixels * sizeof(unsigned short));
+
+        // The planes with the padding, so the checksum covers exactly the
+        // bytes load() maps
+    QByteArray planes(header.m_planeStride * planeCount, '\0');
+    memcpy(planes.data(), map.xRow(0), pixels * sizeof(unsigned short));
+    memcpy(planes.data() + header.m_planeStride, map.yRow(0), pixels * sizeof(unsigned short));
+
+    if (hasShine)
+        memcpy(planes.data() + header.m_planeStride * 2, map.shineRow(0), pixels);
+
+    if (maxLevel > 0)
+        memcpy(planes.data() + header.m_planeStride * (planeCount - 1), map.levelRow(0), pixels);
+
+    header.m_checksum = checksum(reinterpret_cast<const unsigned char*>(planes.constData()),
+                                 planes.size());
+
+    QByteArray head(reinterpret_cast<const char*>(&header), sizeof(header));
+    head.append(keyBytes);
+    head.append(QByteArray(header.m_planeOffset - head.size(), '\0'));
+
+        // Written completely under a temporary name first, so that no other
+        // process ever maps a partial file
+    QTemporaryFile file(QDir(m_directory).filePath("XXXXXX.tmp"));
+    file.setAutoRemove(false);
+
+    if (!file.open())
+        return false;
+
+    const bool written = file.write(head) == head.size()
+            && file.write(planes) == planes.size();
+    file.close();
+
+    if (!written || !file.rename(name)) {
+            // Out of space, or another process stored the map meanwhile
+        file.remove();
+        return written;
+    }
+
+    evictUnlocked(m_maxBytes);
+    return true;
+}
+
+
+/*!
+  Returns the total size of the files in the store.
+*/
+qint64 TransformMapStore::totalBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_directory.isEmpty())
+        return 0;
+
+    const QFileInfoList files = QDir(m_directory).entryInfoList(
+                QStringList(QString("*") + FileSuffix), QDir::Files);
+    qint64 bytes = 0;
+
+    for (int i = 0; i < files.count(); i++)
+        bytes += files.at(i).size();
+
+    return bytes;
+}
+
+
+/*!
+  Removes the files, least recently used first, until their total size is
+  at most \a maxBytes. A file is used when it is written or loaded, which
+  sets its modification time. The maps already mapped stay valid: the file
+  is released when the last mapping of it goes.
+*/
+void TransformMapStore::evict(qint64 maxBytes)
+{
+    QMutexLocker locker(&m_mutex);
+    evictUnlocked(maxBytes);
+}
+
+
+/*!
+  Returns the name of the file of the serialized key \a key: a 64-bit
+  FNV-1a hash of the key. The key is stored in the file as well, so a
+  collision is only a miss.
+*/
+QString TransformMapStore::fileName(const QByteArray &key) const
+{
+    quint64 hash = Q_UINT64_C(14695981039346656037);
+
+    for (int i = 0; i < key.size(); i++) {
+        hash ^= (unsigned char)key.at(i);
+        hash *= Q_UINT64_C(1099511628211);
+    }
+
+    return QDir(m_directory).filePath(QString("%1%2").arg(hash, 16, 16, QChar('0'))
+                                      .arg(FileSuffix));
+}
+
+
+/*!
+  Removes the oldest files over \a maxBytes, see evict(). The mutex must be
+  locked.
+*/
+void TransformMapStore::evictUnlocked(qint64 maxBytes)
+{
+    if (m_directory.isEmpty())
+        return;
+
+        // Most recently used first
+    const QFileInfoList files = QDir(m_directory).entryInfoList(
+                QStringList(QString("*") + FileSuffix), QDir::Files, QDir::Time);
+    qint64 bytes = 0;
+
+    for (int i = 0; i < files.count(); i++) {
+        bytes += files.at(i).size();
+
+        if (bytes > maxBytes) {
+            qDebug() << "TransformMapStore::evict(): Removing" << files.at(i).fileName();
+            QFile::remove(files.at(i).filePath());
+        }
+    }
+}
+
+
+/*!
+  Returns everything the contents of the map of \a key depend on as bytes,
+  for the file name and for telling the maps with the same file name apart.
+*/
+QByteArray TransformMapStore::serializeKey(const TransformMapKey &key)
+{
+    QByteArray data;
+    appendValue(data, key.m_transform);
+    appendValue(data, key.m_power);
+    appendValue(data, key.m_size);
+    appendValue(data, key.m_sourceWidth);
+    appendValue(data, key.m_sourceHeight);
+    appendValue(data, key.m_targetWidth);
+    appendValue(data, key.m_targetHeight);
+    appendValue(data, key.m_rotation);
+    appendValue(data, key.m_layers.size());
+    data.append(key.m_layers);
+    return data;
+}
+
+
+/*!
+  Returns the FNV-1a hash of the 32-bit words of \a data. \a bytes must be
+  a multiple of 4.
+*/
+unsigned int TransformMapStore::checksum(const unsigned char *data, int bytes)
+{
+    const unsigned int *words = reinterpret_cast<const unsigned int*>(data);
+    const int count = bytes / 4;
+    unsigned int hash = 2166136261u;
+
+    for (int i = 0; i < count; i++)
+        hash = (hash ^ words[i]) * 16777619u;
+
+    return hash;
+}
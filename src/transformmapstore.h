@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef TRANSFORMMAPSTORE_H
+#define TRANSFORMMAPSTORE_H
+
+#include <QMutex>
+#include <QString>
+
+#include "transformmapcache.h"
+
+
+/*!
+  \class TransformMapStore
+  \brief Persistent store of generated transform maps in a cache directory.
+
+  Generating a map evaluates the transform for every pixel of the mirror,
+  which is noticeable on every launch and after every releaseMemory().
+  The store writes the generated maps into files, and later runs map the
+  files read-only into memory instead of generating the maps again. The
+  mapped pages are shared by every mirror and process using the same map,
+  and the system can drop them under memory pressure without writing them
+  anywhere.
+
+  A file has a header followed by the planes of the map (see TransformMap),
+  each starting at a page boundary. The header holds the format version,
+  the complete TransformMapKey of the map and a checksum of the planes,
+  and a file whose header or checksum doesn't match is removed. The files
+  are written under a temporary name and renamed when complete, so an
+  interrupted write never leaves a broken map behind.
+
+  The store is disabled until a directory is set. When the files exceed
+  the size limit, the least recently used ones, written or loaded, are
+  removed first.
+*/
+class TransformMapStore
+{
+public:
+    enum { FormatVersion = 2 };    // Of the files, increase on any change
+
+public:
+    TransformMapStore();
+    ~TransformMapStore();
+
+    static TransformMapStore *instance();
+
+public:
+        // The directory the maps are stored in, created if needed. Empty,
+        // the default, disables the store.
+    void setDirectory(const QString &directory);
+    QString directory() const;
+
+        // The limit for the total size of the files
+    void setMaxBytes(qint64 maxBytes);
+    qint64 maxBytes() const;
+
+        // Returns the stored map for key mapped into memory, or a null
+        // pointer if there is none.
+    TransformMapCache::MapPointer load(const TransformMapKey &key);
+
+        // Writes map with key into the store, unless it is there already.
+        // Returns false if the map couldn't be written.
+    bool save(const TransformMapKey &key, const TransformMap &map);
+
+        // The total size of the files in the store
+    qint64 totalBytes() const;
+
+        // Removes the files, least recently used first, until at most
+        // maxBytes remain
+    void evict(qint64 maxBytes);
+
+private:
+    QString fileName(const QByteArray &key) const;
+    void evictUnlocked(qint64 maxBytes);
+
+    static QByteArray serializeKey(const TransformMapKey &key);
+    static unsigned int checksum(const unsigned char *data, int bytes);
+
+private: // Data
+    mutable QMutex m_mutex;
+    QString m_directory;
+    qint64 m_maxBytes;
+};
+
+#endif // TRANSFORMMAPSTORE_H
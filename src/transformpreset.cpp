@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "transformpreset.h"
+
+/*
+  The power and the size are the ones of MyVideoSurface::setMirrorTransform().
+*/
+static const TransformPreset Presets[] = {
+    { "none", MirrorEffect::None, 1.0f, 1.0f },
+    { "hwave", MirrorEffect::HorizontalWave, 0.5f, 6.0f },
+    { "vwave", MirrorEffect::VerticalWave, 0.5f, 6.0f },
+    { "bubbles", MirrorEffect::Bubbles, 0.5f, 1.0f },
+    { "invbubbles", MirrorEffect::InvBubbles, 0.5f, 1.0f },
+    { "spiral", MirrorEffect::Spiral, 0.5f, 1.0f },
+    { "ripple", MirrorEffect::Ripple, 0.6f, 4.0f },
+    { "spike", MirrorEffect::Spike, 1.0f, 1.0f },
+    { "tile", MirrorEffect::Tile, 1.0f, 14.0f },
+    { "dither", MirrorEffect::Dither, 0.04f, 1.0f }
+};
+
+static const int PresetCount = sizeof(Presets) / sizeof(Presets[0]);
+
+
+/*!
+  \class TransformPreset
+  \brief A mirror transform by name, with the power and the size the application uses for it.
+*/
+
+
+/*!
+  Returns the number of presets, one for each transform.
+*/
+int TransformPreset::count()
+{
+    return PresetCount;
+}
+
+
+/*!
+  Returns the preset at \a index.
+*/
+const TransformPreset &TransformPreset::at(int index)
+{
+    return Presets[index];
+}
+
+
+/*!
+  Returns the preset called \a name, or 0 if there is no such preset.
+*/
+const TransformPreset *TransformPreset::find(const QString &name)
+{
+    for (int i = 0; i < PresetCount; i++) {
+        if (name == Presets[i].m_name)
+            return &Presets[i];
+    }
+
+    return 0;
+}
@@ -0,0 +1,36 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef TRANSFORMPRESET_H
+#define TRANSFORMPRESET_H
+
+#include <QString>
+
+#include "mirroreffect.h"
+
+
+/*!
+  \class TransformPreset
+  \brief A mirror transform by name, with the power and the size the application uses for it.
+
+  The command line tools select the transforms with these. The presets are
+  in the order of MirrorEffect::MirrorTransform.
+*/
+class TransformPreset
+{
+public:
+    static int count();
+    static const TransformPreset &at(int index);
+
+        // Returns the preset called name, or 0 if there is none
+    static const TransformPreset *find(const QString &name);
+
+public: // Data
+    const char *m_name;
+    MirrorEffect::MirrorTransform m_transform;
+    float m_power;
+    float m_size;
+};
+
+#endif // TRANSFORMPRESET_H
@@ -5,6 +5,8 @@
 #ifndef VIDEOIF_H
 #define VIDEOIF_H
 
+#include <QRect>
+
 /*!
   \class VideoIF
   \brief MyVideoSurface asks to MirrorItem update the mirror when the effect is done
@@ -13,6 +15,10 @@ class VideoIF
 {
 public:
     virtual void updateVideo() = 0;
+
+        // The part of the mirror on the screen, in the mirror's coordinates.
+        // Empty if the mirror can't be seen at all. Called on the GUI thread.
+    virtual QRect exposedRect() const = 0;
 };
 
 #endif // VIDEOIF_H
@@ -0,0 +1,1394 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "warpkernels.h"
+
+#include <string.h>
+
+#include "cpufeatures.h"
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#define MH_WARP_X86
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#define MH_WARP_NEON
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang compile the individual kernels for their instruction set
+// without raising the baseline of the whole binary.
+#if defined(__GNUC__)
+#define MH_TARGET(x) __attribute__((target(x)))
+#else
+#define MH_TARGET(x)
+#endif
+
+
+/*!
+  \class WarpKernels
+  \brief Row kernels for resampling the source image through the transform map.
+*/
+
+
+/*!
+  This is HIGHLY optimized function for doing the full, 4-component linear
+  resampling (with one bit accuracylost) without any vector instructions. It is
+  the reference for the vectorized variants below, which produce bit-identical
+  results.
+*/
+void WarpKernels::bilinearLineScalar(unsigned int *t,
+                                     unsigned int *t_target,
+                                     const unsigned short *srcX,
+                                     const unsigned short *srcY,
+                                     const unsigned char *shine,
+                                     int fracBits,
+                                     const unsigned int *source,
+                                     int sourcePitch)
+{
+    unsigned int x(0);
+    unsigned int y(0);
+    unsigned int temp(0);
+    unsigned int mask(0);
+    const unsigned int *pos(0);
+
+    const unsigned int sourceDataPitch = sourcePitch;
+    const unsigned int fracMask = (1 << fracBits) - 1;
+    const int weightShift = 7 - fracBits;
+
+    while (t != t_target) {
+            // Place the source x and y coordinates (fixedpoint) to the temporary attributes
+        x = *srcX;
+        y = *srcY;
+
+            // Seek the initial place of the source image by using only real-parts of the source
+            // coordinates.
+        pos = source + sourceDataPitch
+                * (y >> fracBits) + (x >> fracBits);
+
+            // Mask only the decimal part of the source coordinate and scale it to 7-bits.
+            // After this the source coordinate "fractions" are between 0-and 127
+            // Don't think of them as coordinates anymore, only fractions of
+            // coordinates.
+        x = ((x & fracMask) << weightShift);
+        y = ((y & fracMask) << weightShift);
+
+            // Temp is used as negative x just to limit the number of calculations
+            // it should be named "negx", but we don't want to add any more values
+            // into the stack to make sure it doesn't end.
+        temp = 128 - x;
+
+        /*
+           The basic one dimensional interpolation goes:
+           resampled_pixel = (pixelonleft*x + pixelonright*negx ) / 128
+
+           When adding second component (y), we must do second x interpolation, and
+           interpolate between those two with y:
+
+           toppixel = (pixelontopleft*x + pixelontopright*negx) / 128;
+           bottompixel = (pixelonbottomleft*x + pixelonbottomright*negx) / 128;
+           finalpixel = toppixel*y + bottompixel*negy) / 128
+
+           Obviously, this must be done to each of the components R,G,B and A to
+           get the actual colour.
+
+           The following code interpolates between four 4component RGBA-pixels
+           pos[0], pos[1], pos[pitch] and pos[pitch+1] with x,y,negx and negy.
+
+           The reason we are using 7bit interpolation is that we can combine
+           two of the colour components with the same calculation without getting
+           any overflows. For example:
+
+           pixel = (RGBAPixel & 0x00FF00FF) leaves only red and green components in
+           the pixel. When we multiply this value with any 7bit number (from 0 to 127)
+           the resulting value will not be above 0xFF00FF00. This means than when
+           shifting the result back (dividing it with 128), we have the multiplied
+           values directly at the same places (with some trash possibly from the
+           multiplications but we can get rid of those easily with a simple AND).
+
+
+           So when doing,
+
+           pixel = ( ( (RGBAPixel & 0x00FF00FF) * mul ) / 128 ) & 0x00FF00FF
+
+           we can multiply 2 components at the same time (at this example, those would
+           be red and green).
+
+           Obviously, all of the divisions are replaced with according shift-operands
+           to get good performance.
+
+           The resulting pixel of the resample will be place directly into the target
+           at 't'.
+
+        */
+
+        *t = ((((((((((pos[0] & 0x00FF00FF) * (temp)) + ((pos[1] & 0x00FF00FF)
+             * (x))) >> 7) & 0x00FF00FF) * (128 - y))
+             + ((((((pos[sourceDataPitch] & 0x00FF00FF) * (temp))
+             + ((pos[sourceDataPitch + 1] & 0x00FF00FF) * (x))) >> 7)
+             & 0x00FF00FF) * y)) >> 7) & 0x00FF00FF) | (((((((((((pos[0] >> 8)
+             & 0x00FF00FF) * (temp)) + (((pos[1] >> 8) & 0x00FF00FF) * (x)))
+             >> 7) & 0x00FF00FF) * (128 - y)) +
+             (((((((pos[sourceDataPitch] >> 8) & 0x00FF00FF)
+             * (temp)) + (((pos[sourceDataPitch + 1] >> 8)
+             & 0x00FF00FF) * (x))) >> 7) & 0x00FF00FF) * y)) >> 7)
+             & 0x00FF00FF) << 8));
+
+        // The shine plane of the map (see TransformMap) tells how much white
+        // should be added into the final, resampled colour.
+        // The following code creates RGBA (shine, shine, shine, 0) value,
+        // and adds it into the pixel at 't' using common temporary
+        // attributes temp and mask for the purpose.
+        // If you like playing with bits, think of the section with
+        // paper and you will see it works ;) Only with one bit
+        // of accuracylost.
+        // This is the fastest way of adding two RGB - pixels together
+        // that i'm aware of.
+        if (shine) {
+            if (*shine > 0) {
+                temp = ((*t & 0xFEFEFEFE) >> 1)
+                    + (((*shine | (*shine << 8)
+                         | (*shine << 16)) & 0xFEFEFEFE) >> 1);
+                mask = (temp & 0x80808080);
+                temp |= (mask - (mask >> 7));
+                *t = ((temp & 0x7F7F7F7F) << 1);
+            }
+
+            shine++;
+        }
+
+            // This pixel of the row is processed, move on to the next one.
+        t++;
+        srcX++;
+        srcY++;
+    }
+}
+
+
+/*!
+  Sample ("copy") the source pixels from the co-ordinates of the map row,
+  using only the real-parts of them.
+*/
+void WarpKernels::nearestLine(unsigned int *t,
+                              unsigned int *t_target,
+                              const unsigned short *srcX,
+                              const unsigned short *srcY,
+                              int fracBits,
+                              const unsigned int *source,
+                              int sourcePitch)
+{
+    while (t != t_target) {
+        *t = source[(*srcY >> fracBits) * sourcePitch + (*srcX >> fracBits)];
+        t++;
+        srcX++;
+        srcY++;
+    }
+}
+
+
+/*
+  Reads the pixel at \a column, \a row of a UYVY frame and returns it packed
+  as 0x00VVUUYY. Every two pixels share the chroma of their pair.
+*/
+static inline unsigned int fetchUyvy(const WarpKernels::UyvySource &source,
+                                     int column, int row)
+{
+    const unsigned char *line = source.m_data + source.m_bytesPerLine * row;
+    const unsigned char *pair = line + ((column & ~1) << 1);
+
+    return line[(column << 1) + 1] | (pair[0] << 8) | (pair[2] << 16);
+}
+
+
+/*
+  Interpolates between two packed values with a 7-bit weight \a w, two
+  components at a time like the RGB kernel does.
+*/
+static inline unsigned int lerpPacked(unsigned int a, unsigned int b, unsigned int w)
+{
+    const unsigned int negw = 128 - w;
+
+    return ((((a & 0x00FF00FF) * negw + (b & 0x00FF00FF) * w) >> 7) & 0x00FF00FF)
+         | (((((a >> 8) & 0x00FF00FF) * negw + ((b >> 8) & 0x00FF00FF) * w)
+             >> 7) & 0x00FF00FF) << 8;
+}
+
+
+/*
+  Adds (shine, shine, shine, 0) into \a pixel, see bilinearLineScalar().
+*/
+static inline unsigned int addShine(unsigned int pixel, unsigned int shine)
+{
+    unsigned int temp = ((pixel & 0xFEFEFEFE) >> 1)
+            + (((shine | (shine << 8) | (shine << 16)) & 0xFEFEFEFE) >> 1);
+    const unsigned int mask = (temp & 0x80808080);
+    temp |= (mask - (mask >> 7));
+
+    return ((temp & 0x7F7F7F7F) << 1);
+}
+
+
+/*!
+  Linear resampling from a packed UYVY frame. The four neighbours are
+  interpolated in YUV with the same 7-bit weights as bilinearLineScalar(),
+  and only the result is converted to RGB. The neighbours are looked up
+  through the steps of \a source, so the frame may be rotated.
+*/
+void WarpKernels::uyvyBilinearLine(unsigned int *t,
+                                   unsigned int *t_target,
+                                   const unsigned short *srcX,
+                                   const unsigned short *srcY,
+                                   const unsigned char *shine,
+                                   int fracBits,
+                                   const UyvySource &source)
+{
+    const unsigned int fracMask = (1 << fracBits) - 1;
+    const int weightShift = 7 - fracBits;
+
+    while (t != t_target) {
+        const int x = *srcX >> fracBits;
+        const int y = *srcY >> fracBits;
+        const unsigned int fx = (*srcX & fracMask) << weightShift;
+        const unsigned int fy = (*srcY & fracMask) << weightShift;
+
+        const int column = source.m_columnOrigin + x * source.m_columnStepX
+                + y * source.m_columnStepY;
+        const int row = source.m_rowOrigin + x * source.m_rowStepX
+                + y * source.m_rowStepY;
+
+        const unsigned int top =
+                lerpPacked(fetchUyvy(source, column, row),
+                           fetchUyvy(source, column + source.m_columnStepX,
+                                     row + source.m_rowStepX), fx);
+        const unsigned int bottom =
+                lerpPacked(fetchUyvy(source, column + source.m_columnStepY,
+                                     row + source.m_rowStepY),
+                           fetchUyvy(source,
+                                     column + source.m_columnStepX + source.m_columnStepY,
+                                     row + source.m_rowStepX + source.m_rowStepY), fx);
+
+        *t = YuvConverter::toRgb(lerpPacked(top, bottom, fy), *source.m_matrix);
+
+        if (shine) {
+            if (*shine > 0)
+                *t = addShine(*t, *shine);
+
+            shine++;
+        }
+
+        t++;
+        srcX++;
+        srcY++;
+    }
+}
+
+
+/*!
+  Nearest-pixel sampling from a packed UYVY frame.
+*/
+void WarpKernels::uyvyNearestLine(unsigned int *t,
+                                  unsigned int *t_target,
+                                  const unsigned short *srcX,
+                                  const unsigned short *srcY,
+                                  int fracBits,
+                                  const UyvySource &source)
+{
+    while (t != t_target) {
+        const int x = *srcX >> fracBits;
+        const int y = *srcY >> fracBits;
+
+        *t = YuvConverter::toRgb(fetchUyvy(source,
+                                           source.m_columnOrigin + x * source.m_columnStepX
+                                           + y * source.m_columnStepY,
+                                           source.m_rowOrigin + x * source.m_rowStepX
+                                           + y * source.m_rowStepY),
+                                 *source.m_matrix);
+        t++;
+        srcX++;
+        srcY++;
+    }
+}
+
+
+/*!
+  Linear resampling along a source row. The vertical interpolation is done
+  beforehand for the whole row with blendRows(), so only the two horizontal
+  neighbours are needed.
+*/
+void WarpKernels::separableLineScalar(unsigned int *t,
+                                      unsigned int *t_target,
+                                      const unsigned short *srcX,
+                                      const unsigned char *shine,
+                                      int fracBits,
+                                      const unsigned int *row)
+{
+    const unsigned int fracMask = (1 << fracBits) - 1;
+    const int weightShift = 7 - fracBits;
+
+    while (t != t_target) {
+        const unsigned int *pos = row + (*srcX >> fracBits);
+
+        *t = lerpPacked(pos[0], pos[1], (*srcX & fracMask) << weightShift);
+
+        if (shine) {
+            if (*shine > 0)
+                *t = addShine(*t, *shine);
+
+            shine++;
+        }
+
+        t++;
+        srcX++;
+    }
+}
+
+
+/*!
+  Interpolates between the rows \a a and \a b.
+*/
+void WarpKernels::blendRowsScalar(unsigned int *t,
+                                  const unsigned int *a,
+                                  const unsigned int *b,
+                                  int count,
+                                  int weight)
+{
+    for (int i = 0; i < count; i++)
+        t[i] = lerpPacked(a[i], b[i], weight);
+}
+
+
+/*
+  Returns the per component average of four packed pixels, rounded to the
+  nearest. The sums of the components fit into the 16-bit halves.
+*/
+static inline unsigned int average4Packed(unsigned int a, unsigned int b,
+                                          unsigned int c, unsigned int d)
+{
+    const unsigned int low = (a & 0x00FF00FF) + (b & 0x00FF00FF)
+            + (c & 0x00FF00FF) + (d & 0x00FF00FF) + 0x00020002;
+    const unsigned int high = ((a >> 8) & 0x00FF00FF) + ((b >> 8) & 0x00FF00FF)
+            + ((c >> 8) & 0x00FF00FF) + ((d >> 8) & 0x00FF00FF) + 0x00020002;
+
+    return ((low >> 2) & 0x00FF00FF) | (((high >> 2) & 0x00FF00FF) << 8);
+}
+
+
+/*!
+  Averages the 2x2 boxes of the rows \a a and \a b into \a t, rounding to
+  the nearest. The reference for the vectorized variants.
+*/
+void WarpKernels::downsampleRowsScalar(unsigned int *t,
+                                       const unsigned int *a,
+                                       const unsigned int *b,
+                                       int count)
+{
+    for (int i = 0; i < count; i++)
+        t[i] = average4Packed(a[2 * i], a[2 * i + 1], b[2 * i], b[2 * i + 1]);
+}
+
+
+/*!
+  Adds the sums of absolute differences of the groups of 8 bytes of \a a
+  and \a b to \a sums. The reference for the vectorized variants.
+*/
+void WarpKernels::blockSadRowsScalar(unsigned int *sums,
+                                     const unsigned char *a,
+                                     const unsigned char *b,
+                                     int count)
+{
+    for (int i = 0; i < count; i++) {
+        unsigned int sum = 0;
+
+        for (int j = 0; j < 8; j++) {
+            const int d = a[8 * i + j] - b[8 * i + j];
+            sum += d < 0 ? -d : d;
+        }
+
+        sums[i] += sum;
+    }
+}
+
+
+/*!
+  Averages the 2x2 boxes of a UYVY source in YUV, and converts only the
+  averages to RGB. Reads the source pixel by pixel in any orientation;
+  uyvyDownsampleRows() is faster for a source which isn't rotated.
+*/
+void WarpKernels::uyvyDownsampleLine(unsigned int *t,
+                                     int count,
+                                     int row,
+                                     int width,
+                                     int height,
+                                     const UyvySource &source)
+{
+    const int y0 = row * 2;
+    const int y1 = y0 + 1 < height ? y0 + 1 : y0;
+
+    for (int i = 0; i < count; i++) {
+        const int x0 = i * 2;
+        const int x1 = x0 + 1 < width ? x0 + 1 : x0;
+
+        const unsigned int yuv = average4Packed(
+                fetchUyvy(source,
+                          source.m_columnOrigin + x0 * source.m_columnStepX + y0 * source.m_columnStepY,
+                          source.m_rowOrigin + x0 * source.m_rowStepX + y0 * source.m_rowStepY),
+                fetchUyvy(source,
+                          source.m_columnOrigin + x1 * source.m_columnStepX + y0 * source.m_columnStepY,
+                          source.m_rowOrigin + x1 * source.m_rowStepX + y0 * source.m_rowStepY),
+                fetchUyvy(source,
+                          source.m_columnOrigin + x0 * source.m_columnStepX + y1 * source.m_columnStepY,
+                          source.m_rowOrigin + x0 * source.m_rowStepX + y1 * source.m_rowStepY),
+                fetchUyvy(source,
+                          source.m_columnOrigin + x1 * source.m_columnStepX + y1 * source.m_columnStepY,
+                          source.m_rowOrigin + x1 * source.m_rowStepX + y1 * source.m_rowStepY));
+
+        t[i] = YuvConverter::toRgb(yuv, *source.m_matrix);
+    }
+}
+
+
+/*!
+  Averages the 2x2 boxes of the UYVY lines \a a and \a b, 4 * count bytes
+  each, into the UYVY line \a t of count pixels. The luma is averaged per
+  box, and the chroma per pair of boxes as a UYVY pair shares it. For an
+  odd count the chroma of the last box is averaged alone.
+*/
+void WarpKernels::uyvyDownsampleRows(unsigned char *t,
+                                     const unsigned char *a,
+                                     const unsigned char *b,
+                                     int count)
+{
+    for (int i = 0; i < count; i += 2) {
+        const int next = i + 1 < count ? 4 : 0;
+
+        t[0] = (a[0] + a[next] + b[0] + b[next] + 2) >> 2;
+        t[1] = (a[1] + a[3] + b[1] + b[3] + 2) >> 2;
+        t[2] = (a[2] + a[next + 2] + b[2] + b[next + 2] + 2) >> 2;
+        t[3] = (a[next + 1] + a[next + 3] + b[next + 1] + b[next + 3] + 2) >> 2;
+
+        t += 4;
+        a += 8;
+        b += 8;
+    }
+}
+
+
+/*!
+  Nearest-pixel sampling along a source row.
+*/
+void WarpKernels::separableNearestLine(unsigned int *t,
+                                       unsigned int *t_target,
+                                       const unsigned short *srcX,
+                                       int fracBits,
+                                       const unsigned int *row)
+{
+    while (t != t_target) {
+        *t = row[*srcX >> fracBits];
+        t++;
+        srcX++;
+    }
+}
+
+
+#ifdef MH_WARP_X86
+
+/*
+  The x86 kernels unpack the pixels into 16-bit lanes, one colour component
+  per lane, and do exactly the same 7-bit interpolation as the scalar code:
+
+  result = (a * (128 - w) + b * w) >> 7
+
+  None of the intermediate values exceed 255 * 128, so they fit into
+  signed 16-bit lanes without any masking.
+*/
+
+static MH_TARGET("sse2") inline __m128i lerp16SSE2(__m128i a, __m128i b, __m128i w)
+{
+    const __m128i full = _mm_set1_epi16(128);
+    return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(a, _mm_sub_epi16(full, w)),
+                                        _mm_mullo_epi16(b, w)), 7);
+}
+
+
+/*
+  Adds the (shine, shine, shine, 0) value to the pixels which have
+  shine > 0. Same arithmetic as the scalar version: both operands are halved
+  and the sum saturates to 254.
+*/
+static MH_TARGET("sse2") inline __m128i addShineSSE2(__m128i pixels, __m128i shine)
+{
+    const __m128i noAlpha = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    const __m128i shineMax = _mm_set1_epi16(127);
+
+    const __m128i mask = _mm_cmpgt_epi16(shine, _mm_setzero_si128());
+    const __m128i sum = _mm_add_epi16(_mm_srli_epi16(pixels, 1),
+                                      _mm_srli_epi16(_mm_and_si128(shine, noAlpha), 1));
+    const __m128i shined = _mm_slli_epi16(_mm_min_epi16(sum, shineMax), 1);
+
+    return _mm_or_si128(_mm_and_si128(mask, shined), _mm_andnot_si128(mask, pixels));
+}
+
+
+/*
+  Resamples four pixels. The four corner registers contain one pixel per
+  32-bit lane, the weight and shine registers the value of each pixel
+  repeated in the four 16-bit lanes of its colour components (lo = pixels 0
+  and 1, hi = pixels 2 and 3).
+*/
+static MH_TARGET("sse2") inline __m128i bilinear4SSE2(__m128i a, __m128i b,
+                                                      __m128i c, __m128i d,
+                                                      __m128i fxLo, __m128i fxHi,
+                                                      __m128i fyLo, __m128i fyHi,
+                                                      __m128i shineLo, __m128i shineHi)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    __m128i top = lerp16SSE2(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), fxLo);
+    __m128i bottom = lerp16SSE2(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero), fxLo);
+    const __m128i lo = addShineSSE2(lerp16SSE2(top, bottom, fyLo), shineLo);
+
+    top = lerp16SSE2(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), fxHi);
+    bottom = lerp16SSE2(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero), fxHi);
+    const __m128i hi = addShineSSE2(lerp16SSE2(top, bottom, fyHi), shineHi);
+
+    return _mm_packus_epi16(lo, hi);
+}
+
+
+/*
+  Helper for the SSE2 and SSSE3 kernels: fetch the four corner pixels of
+  four consecutive target pixels.
+*/
+#define MH_LOAD_CORNERS \
+    const unsigned int *p0 = source + sourcePitch * (srcY[0] >> fracBits) + (srcX[0] >> fracBits); \
+    const unsigned int *p1 = source + sourcePitch * (srcY[1] >> fracBits) + (srcX[1] >> fracBits); \
+    const unsigned int *p2 = source + sourcePitch * (srcY[2] >> fracBits) + (srcX[2] >> fracBits); \
+    const unsigned int *p3 = source + sourcePitch * (srcY[3] >> fracBits) + (srcX[3] >> fracBits); \
+    const __m128i a = _mm_set_epi32(p3[0], p2[0], p1[0], p0[0]); \
+    const __m128i b = _mm_set_epi32(p3[1], p2[1], p1[1], p0[1]); \
+    const __m128i c = _mm_set_epi32(p3[sourcePitch], p2[sourcePitch], \
+                                    p1[sourcePitch], p0[sourcePitch]); \
+    const __m128i d = _mm_set_epi32(p3[sourcePitch + 1], p2[sourcePitch + 1], \
+                                    p1[sourcePitch + 1], p0[sourcePitch + 1]); \
+    const __m128i fx = _mm_sll_epi16(_mm_and_si128( \
+        _mm_loadl_epi64((const __m128i*)srcX), fracMask), weightShift); \
+    const __m128i fy = _mm_sll_epi16(_mm_and_si128( \
+        _mm_loadl_epi64((const __m128i*)srcY), fracMask), weightShift); \
+    __m128i shine4 = _mm_setzero_si128(); \
+    if (shine) { \
+        int shineBytes; \
+        memcpy(&shineBytes, shine, sizeof(shineBytes)); \
+        shine4 = _mm_cvtsi32_si128(shineBytes); \
+    }
+
+
+/*
+  SSE2: four pixels per iteration. The per-pixel weights are spread into the
+  component lanes with unpacks.
+*/
+static MH_TARGET("sse2") void bilinearLineSSE2(unsigned int *t,
+                                               unsigned int *t_target,
+                                               const unsigned short *srcX,
+                                               const unsigned short *srcY,
+                                               const unsigned char *shine,
+                                               int fracBits,
+                                               const unsigned int *source,
+                                               int sourcePitch)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i fracMask = _mm_set1_epi16((short)((1 << fracBits) - 1));
+    const __m128i weightShift = _mm_cvtsi32_si128(7 - fracBits);
+
+    while (t_target - t >= 4) {
+        MH_LOAD_CORNERS
+
+        // [w0 w1 w2 w3] => [w0 w0 w0 w0 w1 w1 w1 w1] for the low half and
+        // the same for w2 and w3 for the high half
+        __m128i temp = _mm_unpacklo_epi16(fx, fx);
+        const __m128i fxLo = _mm_unpacklo_epi32(temp, temp);
+        const __m128i fxHi = _mm_unpackhi_epi32(temp, temp);
+
+        temp = _mm_unpacklo_epi16(fy, fy);
+        const __m128i fyLo = _mm_unpacklo_epi32(temp, temp);
+        const __m128i fyHi = _mm_unpackhi_epi32(temp, temp);
+
+        temp = _mm_unpacklo_epi8(shine4, zero);
+        temp = _mm_unpacklo_epi16(temp, temp);
+        const __m128i shineLo = _mm_unpacklo_epi32(temp, temp);
+        const __m128i shineHi = _mm_unpackhi_epi32(temp, temp);
+
+        _mm_storeu_si128((__m128i*)t, bilinear4SSE2(a, b, c, d, fxLo, fxHi,
+                                                     fyLo, fyHi, shineLo, shineHi));
+        t += 4;
+        srcX += 4;
+        srcY += 4;
+
+        if (shine)
+            shine += 4;
+    }
+
+    WarpKernels::bilinearLineScalar(t, t_target, srcX, srcY, shine, fracBits,
+                                    source, sourcePitch);
+}
+
+
+/*
+  SSSE3: as SSE2, but the weights are spread with a single byte shuffle.
+*/
+static MH_TARGET("ssse3") void bilinearLineSSSE3(unsigned int *t,
+                                                 unsigned int *t_target,
+                                                 const unsigned short *srcX,
+                                                 const unsigned short *srcY,
+                                                 const unsigned char *shine,
+                                                 int fracBits,
+                                                 const unsigned int *source,
+                                                 int sourcePitch)
+{
+    const __m128i fracMask = _mm_set1_epi16((short)((1 << fracBits) - 1));
+    const __m128i weightShift = _mm_cvtsi32_si128(7 - fracBits);
+    const __m128i spreadLo = _mm_setr_epi8(0, 1, 0, 1, 0, 1, 0, 1,
+                                           2, 3, 2, 3, 2, 3, 2, 3);
+    const __m128i spreadHi = _mm_setr_epi8(4, 5, 4, 5, 4, 5, 4, 5,
+                                           6, 7, 6, 7, 6, 7, 6, 7);
+    const __m128i spreadShineLo = _mm_setr_epi8(0, -128, 0, -128, 0, -128, 0, -128,
+                                                1, -128, 1, -128, 1, -128, 1, -128);
+    const __m128i spreadShineHi = _mm_setr_epi8(2, -128, 2, -128, 2, -128, 2, -128,
+                                                3, -128, 3, -128, 3, -128, 3, -128);
+
+    while (t_target - t >= 4) {
+        MH_LOAD_CORNERS
+
+        _mm_storeu_si128((__m128i*)t,
+                         bilinear4SSE2(a, b, c, d,
+                                       _mm_shuffle_epi8(fx, spreadLo),
+                                       _mm_shuffle_epi8(fx, spreadHi),
+                                       _mm_shuffle_epi8(fy, spreadLo),
+                                       _mm_shuffle_epi8(fy, spreadHi),
+                                       _mm_shuffle_epi8(shine4, spreadShineLo),
+                                       _mm_shuffle_epi8(shine4, spreadShineHi)));
+        t += 4;
+        srcX += 4;
+        srcY += 4;
+
+        if (shine)
+            shine += 4;
+    }
+
+    WarpKernels::bilinearLineScalar(t, t_target, srcX, srcY, shine, fracBits,
+                                    source, sourcePitch);
+}
+
+#undef MH_LOAD_CORNERS
+
+
+static MH_TARGET("avx2") inline __m256i lerp16AVX2(__m256i a, __m256i b, __m256i w)
+{
+    const __m256i full = _mm256_set1_epi16(128);
+    return _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(a, _mm256_sub_epi16(full, w)),
+                                              _mm256_mullo_epi16(b, w)), 7);
+}
+
+
+static MH_TARGET("avx2") inline __m256i addShineAVX2(__m256i pixels, __m256i shine)
+{
+    const __m256i noAlpha = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1,
+                                             0, -1, -1, -1, 0, -1, -1, -1);
+    const __m256i shineMax = _mm256_set1_epi16(127);
+
+    const __m256i mask = _mm256_cmpgt_epi16(shine, _mm256_setzero_si256());
+    const __m256i sum = _mm256_add_epi16(_mm256_srli_epi16(pixels, 1),
+                                         _mm256_srli_epi16(_mm256_and_si256(shine, noAlpha), 1));
+    const __m256i shined = _mm256_slli_epi16(_mm256_min_epi16(sum, shineMax), 1);
+
+    return _mm256_blendv_epi8(pixels, shined, mask);
+}
+
+
+/*
+  AVX2: eight pixels per iteration. The corner pixels are fetched with
+  gathers. The unpacks work inside the 128-bit lanes, so the low half holds
+  pixels 0, 1, 4, 5 and the high half 2, 3, 6, 7, which the final pack puts
+  back in order.
+*/
+static MH_TARGET("avx2") void bilinearLineAVX2(unsigned int *t,
+                                               unsigned int *t_target,
+                                               const unsigned short *srcX,
+                                               const unsigned short *srcY,
+                                               const unsigned char *shine,
+                                               int fracBits,
+                                               const unsigned int *source,
+                                               int sourcePitch)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i pitch = _mm256_set1_epi32(sourcePitch);
+    const __m128i integerShift = _mm_cvtsi32_si128(fracBits);
+    const __m128i fracMask = _mm_set1_epi16((short)((1 << fracBits) - 1));
+    const __m128i weightShift = _mm_cvtsi32_si128(7 - fracBits);
+    const __m256i spreadLo = _mm256_setr_epi8(0, 1, 0, 1, 0, 1, 0, 1,
+                                              2, 3, 2, 3, 2, 3, 2, 3,
+                                              8, 9, 8, 9, 8, 9, 8, 9,
+                                              10, 11, 10, 11, 10, 11, 10, 11);
+    const __m256i spreadHi = _mm256_setr_epi8(4, 5, 4, 5, 4, 5, 4, 5,
+                                              6, 7, 6, 7, 6, 7, 6, 7,
+                                              12, 13, 12, 13, 12, 13, 12, 13,
+                                              14, 15, 14, 15, 14, 15, 14, 15);
+    const __m256i spreadShineLo = _mm256_setr_epi8(0, -128, 0, -128, 0, -128, 0, -128,
+                                                   1, -128, 1, -128, 1, -128, 1, -128,
+                                                   4, -128, 4, -128, 4, -128, 4, -128,
+                                                   5, -128, 5, -128, 5, -128, 5, -128);
+    const __m256i spreadShineHi = _mm256_setr_epi8(2, -128, 2, -128, 2, -128, 2, -128,
+                                                   3, -128, 3, -128, 3, -128, 3, -128,
+                                                   6, -128, 6, -128, 6, -128, 6, -128,
+                                                   7, -128, 7, -128, 7, -128, 7, -128);
+
+    const int *src = (const int*)source;
+
+    while (t_target - t >= 8) {
+        const __m128i x = _mm_loadu_si128((const __m128i*)srcX);
+        const __m128i y = _mm_loadu_si128((const __m128i*)srcY);
+
+        const __m256i offset = _mm256_add_epi32(
+                    _mm256_mullo_epi32(_mm256_srl_epi32(_mm256_cvtepu16_epi32(y), integerShift), pitch),
+                    _mm256_srl_epi32(_mm256_cvtepu16_epi32(x), integerShift));
+
+        const __m256i a = _mm256_i32gather_epi32(src, offset, 4);
+        const __m256i b = _mm256_i32gather_epi32(src + 1, offset, 4);
+        const __m256i c = _mm256_i32gather_epi32(src + sourcePitch, offset, 4);
+        const __m256i d = _mm256_i32gather_epi32(src + sourcePitch + 1, offset, 4);
+
+        const __m256i fx = _mm256_broadcastsi128_si256(
+                    _mm_sll_epi16(_mm_and_si128(x, fracMask), weightShift));
+        const __m256i fy = _mm256_broadcastsi128_si256(
+                    _mm_sll_epi16(_mm_and_si128(y, fracMask), weightShift));
+        const __m256i shine8 = shine ? _mm256_broadcastsi128_si256(
+                                           _mm_loadl_epi64((const __m128i*)shine))
+                                     : zero;
+
+        __m256i w = _mm256_shuffle_epi8(fx, spreadLo);
+        __m256i top = lerp16AVX2(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero), w);
+        __m256i bottom = lerp16AVX2(_mm256_unpacklo_epi8(c, zero), _mm256_unpacklo_epi8(d, zero), w);
+        const __m256i lo = addShineAVX2(lerp16AVX2(top, bottom, _mm256_shuffle_epi8(fy, spreadLo)),
+                                        _mm256_shuffle_epi8(shine8, spreadShineLo));
+
+        w = _mm256_shuffle_epi8(fx, spreadHi);
+        top = lerp16AVX2(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero), w);
+        bottom = lerp16AVX2(_mm256_unpackhi_epi8(c, zero), _mm256_unpackhi_epi8(d, zero), w);
+        const __m256i hi = addShineAVX2(lerp16AVX2(top, bottom, _mm256_shuffle_epi8(fy, spreadHi)),
+                                        _mm256_shuffle_epi8(shine8, spreadShineHi));
+
+        _mm256_storeu_si256((__m256i*)t, _mm256_packus_epi16(lo, hi));
+        t += 8;
+        srcX += 8;
+        srcY += 8;
+
+        if (shine)
+            shine += 8;
+    }
+
+    WarpKernels::bilinearLineScalar(t, t_target, srcX, srcY, shine, fracBits,
+                                    source, sourcePitch);
+}
+
+
+/*
+  SSE2 separable row: the two horizontal neighbours of a pixel are adjacent,
+  so one 64-bit load fetches both.
+*/
+static MH_TARGET("sse2") void separableLineSSE2(unsigned int *t,
+                                                unsigned int *t_target,
+                                                const unsigned short *srcX,
+                                                const unsigned char *shine,
+                                                int fracBits,
+                                                const unsigned int *row)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i fracMask = _mm_set1_epi16((short)((1 << fracBits) - 1));
+    const __m128i weightShift = _mm_cvtsi32_si128(7 - fracBits);
+
+    while (t_target - t >= 4) {
+        const __m128i p0 = _mm_loadl_epi64((const __m128i*)(row + (srcX[0] >> fracBits)));
+        const __m128i p1 = _mm_loadl_epi64((const __m128i*)(row + (srcX[1] >> fracBits)));
+        const __m128i p2 = _mm_loadl_epi64((const __m128i*)(row + (srcX[2] >> fracBits)));
+        const __m128i p3 = _mm_loadl_epi64((const __m128i*)(row + (srcX[3] >> fracBits)));
+
+            // [a0 b0], [a1 b1], ... => [a0 a1 a2 a3] and [b0 b1 b2 b3]
+        const __m128i p01 = _mm_unpacklo_epi32(p0, p1);
+        const __m128i p23 = _mm_unpacklo_epi32(p2, p3);
+        const __m128i a = _mm_unpacklo_epi64(p01, p23);
+        const __m128i b = _mm_unpackhi_epi64(p01, p23);
+
+        const __m128i fx = _mm_sll_epi16(_mm_and_si128(
+            _mm_loadl_epi64((const __m128i*)srcX), fracMask), weightShift);
+        __m128i temp = _mm_unpacklo_epi16(fx, fx);
+        const __m128i fxLo = _mm_unpacklo_epi32(temp, temp);
+        const __m128i fxHi = _mm_unpackhi_epi32(temp, temp);
+
+        __m128i shineLo = zero;
+        __m128i shineHi = zero;
+
+        if (shine) {
+            int shineBytes;
+            memcpy(&shineBytes, shine, sizeof(shineBytes));
+            temp = _mm_unpacklo_epi8(_mm_cvtsi32_si128(shineBytes), zero);
+            temp = _mm_unpacklo_epi16(temp, temp);
+            shineLo = _mm_unpacklo_epi32(temp, temp);
+            shineHi = _mm_unpackhi_epi32(temp, temp);
+            shine += 4;
+        }
+
+        const __m128i lo = addShineSSE2(lerp16SSE2(_mm_unpacklo_epi8(a, zero),
+                                                   _mm_unpacklo_epi8(b, zero), fxLo),
+                                        shineLo);
+        const __m128i hi = addShineSSE2(lerp16SSE2(_mm_unpackhi_epi8(a, zero),
+                                                   _mm_unpackhi_epi8(b, zero), fxHi),
+                                        shineHi);
+
+        _mm_storeu_si128((__m128i*)t, _mm_packus_epi16(lo, hi));
+        t += 4;
+        srcX += 4;
+    }
+
+    WarpKernels::separableLineScalar(t, t_target, srcX, shine, fracBits, row);
+}
+
+
+/*
+  SSE2 row blend, four pixels per iteration.
+*/
+static MH_TARGET("sse2") void blendRowsSSE2(unsigned int *t,
+                                            const unsigned int *a,
+                                            const unsigned int *b,
+                                            int count,
+                                            int weight)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w = _mm_set1_epi16((short)weight);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        const __m128i pa = _mm_loadu_si128((const __m128i*)(a + i));
+        const __m128i pb = _mm_loadu_si128((const __m128i*)(b + i));
+
+        const __m128i lo = lerp16SSE2(_mm_unpacklo_epi8(pa, zero),
+                                      _mm_unpacklo_epi8(pb, zero), w);
+        const __m128i hi = lerp16SSE2(_mm_unpackhi_epi8(pa, zero),
+                                      _mm_unpackhi_epi8(pb, zero), w);
+
+        _mm_storeu_si128((__m128i*)(t + i), _mm_packus_epi16(lo, hi));
+    }
+
+    WarpKernels::blendRowsScalar(t + i, a + i, b + i, count - i, weight);
+}
+
+
+/*
+  AVX2 separable row: eight pixels per iteration with two gathers. The lane
+  order is the one of bilinearLineAVX2().
+*/
+static MH_TARGET("avx2") void separableLineAVX2(unsigned int *t,
+                                                unsigned int *t_target,
+                                                const unsigned short *srcX,
+                                                const unsigned char *shine,
+                                                int fracBits,
+                                                const unsigned int *row)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m128i integerShift = _mm_cvtsi32_si128(fracBits);
+    const __m128i fracMask = _mm_set1_epi16((short)((1 << fracBits) - 1));
+    const __m128i weightShift = _mm_cvtsi32_si128(7 - fracBits);
+    const __m256i spreadLo = _mm256_setr_epi8(0, 1, 0, 1, 0, 1, 0, 1,
+                                              2, 3, 2, 3, 2, 3, 2, 3,
+                                              8, 9, 8, 9, 8, 9, 8, 9,
+                                              10, 11, 10, 11, 10, 11, 10, 11);
+    const __m256i spreadHi = _mm256_setr_epi8(4, 5, 4, 5, 4, 5, 4, 5,
+                                              6, 7, 6, 7, 6, 7, 6, 7,
+                                              12, 13, 12, 13, 12, 13, 12, 13,
+                                              14, 15, 14, 15, 14, 15, 14, 15);
+    const __m256i spreadShineLo = _mm256_setr_epi8(0, -128, 0, -128, 0, -128, 0, -128,
+                                                   1, -128, 1, -128, 1, -128, 1, -128,
+                                                   4, -128, 4, -128, 4, -128, 4, -128,
+                                                   5, -128, 5, -128, 5, -128, 5, -128);
+    const __m256i spreadShineHi = _mm256_setr_epi8(2, -128, 2, -128, 2, -128, 2, -128,
+                                                   3, -128, 3, -128, 3, -128, 3, -128,
+                                                   6, -128, 6, -128, 6, -128, 6, -128,
+                                                   7, -128, 7, -128, 7, -128, 7, -128);
+
+    const int *src = (const int*)row;
+
+    while (t_target - t >= 8) {
+        const __m128i x = _mm_loadu_si128((const __m128i*)srcX);
+        const __m256i offset = _mm256_srl_epi32(_mm256_cvtepu16_epi32(x), integerShift);
+
+        const __m256i a = _mm256_i32gather_epi32(src, offset, 4);
+        const __m256i b = _mm256_i32gather_epi32(src + 1, offset, 4);
+
+        const __m256i fx = _mm256_broadcastsi128_si256(
+                    _mm_sll_epi16(_mm_and_si128(x, fracMask), weightShift));
+        const __m256i shine8 = shine ? _mm256_broadcastsi128_si256(
+                                           _mm_loadl_epi64((const __m128i*)shine))
+                                     : zero;
+
+        const __m256i lo = addShineAVX2(lerp16AVX2(_mm256_unpacklo_epi8(a, zero),
+                                                   _mm256_unpacklo_epi8(b, zero),
+                                                   _mm256_shuffle_epi8(fx, spreadLo)),
+                                        _mm256_shuffle_epi8(shine8, spreadShineLo));
+        const __m256i hi = addShineAVX2(lerp16AVX2(_mm256_unpackhi_epi8(a, zero),
+                                                   _mm256_unpackhi_epi8(b, zero),
+                                                   _mm256_shuffle_epi8(fx, spreadHi)),
+                                        _mm256_shuffle_epi8(shine8, spreadShineHi));
+
+        _mm256_storeu_si256((__m256i*)t, _mm256_packus_epi16(lo, hi));
+        t += 8;
+        srcX += 8;
+
+        if (shine)
+            shine += 8;
+    }
+
+    WarpKernels::separableLineScalar(t, t_target, srcX, shine, fracBits, row);
+}
+
+
+/*
+  AVX2 row blend, eight pixels per iteration.
+*/
+static MH_TARGET("avx2") void blendRowsAVX2(unsigned int *t,
+                                            const unsigned int *a,
+                                            const unsigned int *b,
+                                            int count,
+                                            int weight)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i w = _mm256_set1_epi16((short)weight);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        const __m256i pa = _mm256_loadu_si256((const __m256i*)(a + i));
+        const __m256i pb = _mm256_loadu_si256((const __m256i*)(b + i));
+
+        const __m256i lo = lerp16AVX2(_mm256_unpacklo_epi8(pa, zero),
+                                      _mm256_unpacklo_epi8(pb, zero), w);
+        const __m256i hi = lerp16AVX2(_mm256_unpackhi_epi8(pa, zero),
+                                      _mm256_unpackhi_epi8(pb, zero), w);
+
+        _mm256_storeu_si256((__m256i*)(t + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    WarpKernels::blendRowsScalar(t + i, a + i, b + i, count - i, weight);
+}
+
+
+/*
+  SSE2 2x2 box downsample, four pixels per iteration. The two rows are added
+  in 16-bit lanes first, then the neighbouring pixels.
+*/
+static MH_TARGET("sse2") void downsampleRowsSSE2(unsigned int *t,
+                                                 const unsigned int *a,
+                                                 const unsigned int *b,
+                                                 int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(2);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        const __m128i a0 = _mm_loadu_si128((const __m128i*)(a + 2 * i));
+        const __m128i a1 = _mm_loadu_si128((const __m128i*)(a + 2 * i + 4));
+        const __m128i b0 = _mm_loadu_si128((const __m128i*)(b + 2 * i));
+        const __m128i b1 = _mm_loadu_si128((const __m128i*)(b + 2 * i + 4));
+
+            // The sums of the columns, two pixels per register
+        const __m128i c0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+        const __m128i c1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+        const __m128i c2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+        const __m128i c3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+        const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi64(c0, c1), _mm_unpackhi_epi64(c0, c1));
+        const __m128i hi = _mm_add_epi16(_mm_unpacklo_epi64(c2, c3), _mm_unpackhi_epi64(c2, c3));
+
+        _mm_storeu_si128((__m128i*)(t + i),
+                         _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(lo, round), 2),
+                                          _mm_srli_epi16(_mm_add_epi16(hi, round), 2)));
+    }
+
+    WarpKernels::downsampleRowsScalar(t + i, a + 2 * i, b + 2 * i, count - i);
+}
+
+
+/*
+  SSE2 sums of absolute differences, two groups per iteration: psadbw sums
+  the two 8 byte halves of a register separately.
+*/
+static MH_TARGET("sse2") void blockSadRowsSSE2(unsigned int *sums,
+                                               const unsigned char *a,
+                                               const unsigned char *b,
+                                               int count)
+{
+    int i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        const __m128i sad = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a + 8 * i)),
+                                         _mm_loadu_si128((const __m128i*)(b + 8 * i)));
+
+        sums[i] += _mm_cvtsi128_si32(sad);
+        sums[i + 1] += _mm_cvtsi128_si32(_mm_srli_si128(sad, 8));
+    }
+
+    WarpKernels::blockSadRowsScalar(sums + i, a + 8 * i, b + 8 * i, count - i);
+}
+
+#endif // MH_WARP_X86
+
+
+#ifdef MH_WARP_NEON
+
+/*
+  Resamples two pixels. NEON can multiply the 8-bit components with 8-bit
+  weights straight into 16-bit lanes, so the unpacking is not needed.
+*/
+static inline uint8x8_t bilinear2NEON(const unsigned short *srcX,
+                                      const unsigned short *srcY,
+                                      const unsigned char *shine,
+                                      int fracBits,
+                                      const unsigned int *source,
+                                      int sourcePitch)
+{
+    const uint8x8_t full = vdup_n_u8(128);
+    const uint8x8_t shineMax = vdup_n_u8(127);
+    const uint8x8_t noAlpha = vreinterpret_u8_u32(vdup_n_u32(0x00FFFFFF));
+    const unsigned int fracMask = (1 << fracBits) - 1;
+    const int weightShift = 7 - fracBits;
+
+    const unsigned int *p0 = source + sourcePitch * (srcY[0] >> fracBits) + (srcX[0] >> fracBits);
+    const unsigned int *p1 = source + sourcePitch * (srcY[1] >> fracBits) + (srcX[1] >> fracBits);
+
+    uint32x2_t temp = vset_lane_u32(p1[0], vdup_n_u32(p0[0]), 1);
+    const uint8x8_t a = vreinterpret_u8_u32(temp);
+    temp = vset_lane_u32(p1[1], vdup_n_u32(p0[1]), 1);
+    const uint8x8_t b = vreinterpret_u8_u32(temp);
+    temp = vset_lane_u32(p1[sourcePitch], vdup_n_u32(p0[sourcePitch]), 1);
+    const uint8x8_t c = vreinterpret_u8_u32(temp);
+    temp = vset_lane_u32(p1[sourcePitch + 1], vdup_n_u32(p0[sourcePitch + 1]), 1);
+    const uint8x8_t d = vreinterpret_u8_u32(temp);
+
+    // Weights and shine repeated in each of the four bytes of a pixel
+    temp = vset_lane_u32(((srcX[1] & fracMask) << weightShift) * 0x01010101u,
+                         vdup_n_u32(((srcX[0] & fracMask) << weightShift) * 0x01010101u), 1);
+    const uint8x8_t fx = vreinterpret_u8_u32(temp);
+    temp = vset_lane_u32(((srcY[1] & fracMask) << weightShift) * 0x01010101u,
+                         vdup_n_u32(((srcY[0] & fracMask) << weightShift) * 0x01010101u), 1);
+    const uint8x8_t fy = vreinterpret_u8_u32(temp);
+
+    const uint8x8_t nfx = vsub_u8(full, fx);
+    const uint8x8_t top = vshrn_n_u16(vmlal_u8(vmull_u8(a, nfx), b, fx), 7);
+    const uint8x8_t bottom = vshrn_n_u16(vmlal_u8(vmull_u8(c, nfx), d, fx), 7);
+    const uint8x8_t pixels = vshrn_n_u16(vmlal_u8(vmull_u8(top, vsub_u8(full, fy)),
+                                                  bottom, fy), 7);
+
+    if (!shine)
+        return pixels;
+
+    temp = vset_lane_u32(shine[1] * 0x01010101u, vdup_n_u32(shine[0] * 0x01010101u), 1);
+    const uint8x8_t shine2 = vreinterpret_u8_u32(temp);
+    const uint8x8_t mask = vcgt_u8(shine2, vdup_n_u8(0));
+    const uint8x8_t sum = vadd_u8(vshr_n_u8(pixels, 1),
+                                  vshr_n_u8(vand_u8(shine2, noAlpha), 1));
+    const uint8x8_t shined = vshl_n_u8(vmin_u8(sum, shineMax), 1);
+
+    return vbsl_u8(mask, shined, pixels);
+}
+
+
+/*
+  NEON: four pixels per iteration.
+*/
+static void bilinearLineNEON(unsigned int *t,
+                             unsigned int *t_target,
+                             const unsigned short *srcX,
+                             const unsigned short *srcY,
+                             const unsigned char *shine,
+                             int fracBits,
+                             const unsigned int *source,
+                             int sourcePitch)
+{
+    while (t_target - t >= 4) {
+        const uint8x8_t lo = bilinear2NEON(srcX, srcY, shine, fracBits,
+                                           source, sourcePitch);
+        const uint8x8_t hi = bilinear2NEON(srcX + 2, srcY + 2, shine ? shine + 2 : 0,
+                                           fracBits, source, sourcePitch);
+        vst1q_u32((uint32_t*)t, vreinterpretq_u32_u8(vcombine_u8(lo, hi)));
+        t += 4;
+        srcX += 4;
+        srcY += 4;
+
+        if (shine)
+            shine += 4;
+    }
+
+    WarpKernels::bilinearLineScalar(t, t_target, srcX, srcY, shine, fracBits,
+                                    source, sourcePitch);
+}
+
+
+
+/*
+  NEON row blend, eight pixels per iteration.
+*/
+static void blendRowsNEON(unsigned int *t,
+                          const unsigned int *a,
+                          const unsigned int *b,
+                          int count,
+                          int weight)
+{
+    const uint8x8_t w = vdup_n_u8(weight);
+    const uint8x8_t nw = vdup_n_u8(128 - weight);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        const uint8x16_t pa = vreinterpretq_u8_u32(vld1q_u32(a + i));
+        const uint8x16_t pb = vreinterpretq_u8_u32(vld1q_u32(b + i));
+        const uint8x16_t qa = vreinterpretq_u8_u32(vld1q_u32(a + i + 4));
+        const uint8x16_t qb = vreinterpretq_u8_u32(vld1q_u32(b + i + 4));
+
+        const uint8x16_t p = vcombine_u8(
+                vshrn_n_u16(vmlal_u8(vmull_u8(vget_low_u8(pa), nw), vget_low_u8(pb), w), 7),
+                vshrn_n_u16(vmlal_u8(vmull_u8(vget_high_u8(pa), nw), vget_high_u8(pb), w), 7));
+        const uint8x16_t q = vcombine_u8(
+                vshrn_n_u16(vmlal_u8(vmull_u8(vget_low_u8(qa), nw), vget_low_u8(qb), w), 7),
+                vshrn_n_u16(vmlal_u8(vmull_u8(vget_high_u8(qa), nw), vget_high_u8(qb), w), 7));
+
+        vst1q_u32(t + i, vreinterpretq_u32_u8(p));
+        vst1q_u32(t + i + 4, vreinterpretq_u32_u8(q));
+    }
+
+    WarpKernels::blendRowsScalar(t + i, a + i, b + i, count - i, weight);
+}
+
+
+/*
+  NEON 2x2 box downsample, four pixels per iteration. The even and the odd
+  pixels are loaded into separate registers, and the rounding shift does
+  the rounding.
+*/
+static void downsampleRowsNEON(unsigned int *t,
+                               const unsigned int *a,
+                               const unsigned int *b,
+                               int count)
+{
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        const uint32x4x2_t pa = vld2q_u32(a + 2 * i);
+        const uint32x4x2_t pb = vld2q_u32(b + 2 * i);
+        const uint8x16_t ae = vreinterpretq_u8_u32(pa.val[0]);
+        const uint8x16_t ao = vreinterpretq_u8_u32(pa.val[1]);
+        const uint8x16_t be = vreinterpretq_u8_u32(pb.val[0]);
+        const uint8x16_t bo = vreinterpretq_u8_u32(pb.val[1]);
+
+        const uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(ae), vget_low_u8(ao)),
+                                        vaddl_u8(vget_low_u8(be), vget_low_u8(bo)));
+        const uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(ae), vget_high_u8(ao)),
+                                        vaddl_u8(vget_high_u8(be), vget_high_u8(bo)));
+
+        vst1q_u32(t + i, vreinterpretq_u32_u8(vcombine_u8(vrshrn_n_u16(lo, 2),
+                                                          vrshrn_n_u16(hi, 2))));
+    }
+
+    WarpKernels::downsampleRowsScalar(t + i, a + 2 * i, b + 2 * i, count - i);
+}
+
+
+/*
+  NEON sums of absolute differences, two groups per iteration. The absolute
+  differences are added pairwise until a lane holds the sum of a group.
+*/
+static void blockSadRowsNEON(unsigned int *sums,
+                             const unsigned char *a,
+                             const unsigned char *b,
+                             int count)
+{
+    int i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        const uint8x16_t diff = vabdq_u8(vld1q_u8(a + 8 * i), vld1q_u8(b + 8 * i));
+        const uint64x2_t sad = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(diff)));
+
+        sums[i] += (unsigned int)vgetq_lane_u64(sad, 0);
+        sums[i + 1] += (unsigned int)vgetq_lane_u64(sad, 1);
+    }
+
+    WarpKernels::blockSadRowsScalar(sums + i, a + 8 * i, b + 8 * i, count - i);
+}
+
+#endif // MH_WARP_NEON
+
+
+/*!
+  Returns the given kernel variant, or 0 if it is not available.
+*/
+WarpKernels::LineFunction WarpKernels::bilinearLine(Variant variant)
+{
+    switch (variant) {
+    case Scalar:
+        return bilinearLineScalar;
+#ifdef MH_WARP_X86
+    case SSE2:
+        return CpuFeatures::has(CpuFeatures::SSE2) ? bilinearLineSSE2 : 0;
+    case SSSE3:
+        return CpuFeatures::has(CpuFeatures::SSSE3) ? bilinearLineSSSE3 : 0;
+    case AVX2:
+        return CpuFeatures::has(CpuFeatures::AVX2) ? bilinearLineAVX2 : 0;
+#endif
+#ifdef MH_WARP_NEON
+    case NEON:
+        return CpuFeatures::has(CpuFeatures::NEON) ? bilinearLineNEON : 0;
+#endif
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+
+/*
+  Picks the first supported variant in the order of preference.
+*/
+static WarpKernels::Variant selectBilinearVariant()
+{
+    const WarpKernels::Variant preferred[] = {
+        WarpKernels::AVX2,
+        WarpKernels::SSSE3,
+        WarpKernels::SSE2,
+        WarpKernels::NEON
+    };
+    const int count = sizeof(preferred) / sizeof(preferred[0]);
+
+    for (int i = 0; i < count; i++) {
+        if (WarpKernels::bilinearLine(preferred[i]))
+            return preferred[i];
+    }
+
+    return WarpKernels::Scalar;
+}
+
+
+/*!
+  Returns the fastest supported variant. The selection is done only once.
+*/
+WarpKernels::Variant WarpKernels::bilinearVariant()
+{
+    static Variant selected = selectBilinearVariant();
+    return selected;
+}
+
+
+/*!
+  Returns the fastest supported linear-resampling kernel.
+*/
+WarpKernels::LineFunction WarpKernels::bilinearLine()
+{
+    return bilinearLine(bilinearVariant());
+}
+
+
+/*!
+  Returns the fastest separable row kernel.
+*/
+WarpKernels::RowFunction WarpKernels::separableLine()
+{
+#ifdef MH_WARP_X86
+    if (CpuFeatures::has(CpuFeatures::AVX2))
+        return separableLineAVX2;
+    if (CpuFeatures::has(CpuFeatures::SSE2))
+        return separableLineSSE2;
+#endif
+
+    return separableLineScalar;
+}
+
+
+/*!
+  Returns the fastest row blend.
+*/
+WarpKernels::BlendFunction WarpKernels::blendRows()
+{
+#ifdef MH_WARP_X86
+    if (CpuFeatures::has(CpuFeatures::AVX2))
+        return blendRowsAVX2;
+    if (CpuFeatures::has(CpuFeatures::SSE2))
+        return blendRowsSSE2;
+#endif
+#ifdef MH_WARP_NEON
+    if (CpuFeatures::has(CpuFeatures::NEON))
+        return blendRowsNEON;
+#endif
+
+    return blendRowsScalar;
+}
+
+
+/*!
+  Returns the fastest 2x2 box downsample.
+*/
+WarpKernels::DownsampleFunction WarpKernels::downsampleRows()
+{
+#ifdef MH_WARP_X86
+    if (CpuFeatures::has(CpuFeatures::SSE2))
+        return downsampleRowsSSE2;
+#endif
+#ifdef MH_WARP_NEON
+    if (CpuFeatures::has(CpuFeatures::NEON))
+        return downsampleRowsNEON;
+#endif
+
+    return downsampleRowsScalar;
+}
+
+
+/*!
+  Returns the fastest sum of absolute differences.
+*/
+WarpKernels::SadFunction WarpKernels::blockSadRows()
+{
+#ifdef MH_WARP_X86
+    if (CpuFeatures::has(CpuFeatures::SSE2))
+        return blockSadRowsSSE2;
+#endif
+#ifdef MH_WARP_NEON
+    if (CpuFeatures::has(CpuFeatures::NEON))
+        return blockSadRowsNEON;
+#endif
+
+    return blockSadRowsScalar;
+}
+
+
+/*!
+  Returns true if the selected kernel uses vector instructions.
+*/
+bool WarpKernels::isVectorized()
+{
+    return bilinearVariant() != Scalar;
+}
+
+
+/*!
+  Returns a human readable name of \a variant.
+*/
+const char *WarpKernels::variantName(Variant variant)
+{
+    switch (variant) {
+    case SSE2: return "SSE2";
+    case SSSE3: return "SSSE3";
+    case AVX2: return "AVX2";
+    case NEON: return "NEON";
+    default: break;
+    }
+
+    return "Scalar";
+}
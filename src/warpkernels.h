@@ -0,0 +1,214 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef WARPKERNELS_H
+#define WARPKERNELS_H
+
+#include "yuvconverter.h"
+
+
+/*!
+  \class WarpKernels
+  \brief Row kernels for resampling the source image through the transform map.
+
+  The linear-resampling kernel has a scalar reference implementation and
+  vectorized variants. The fastest variant supported by the running CPU is
+  selected at run time, so the same binary works on every device.
+*/
+class WarpKernels
+{
+public: // Data types
+    enum Variant {
+        Scalar,
+        SSE2,
+        SSSE3,
+        AVX2,
+        NEON
+    };
+
+        // Resamples a target row from t to t_target. srcX, srcY and shine
+        // are the rows of the TransformMap planes, shine may be 0.
+    typedef void (*LineFunction)(unsigned int *t,
+                                 unsigned int *t_target,
+                                 const unsigned short *srcX,
+                                 const unsigned short *srcY,
+                                 const unsigned char *shine,
+                                 int fracBits,
+                                 const unsigned int *source,
+                                 int sourcePitch);
+
+        // Resamples a target row from a single, already vertically
+        // interpolated source row. The separable transforms, whose source
+        // row depends only on the target row, use these.
+    typedef void (*RowFunction)(unsigned int *t,
+                                unsigned int *t_target,
+                                const unsigned short *srcX,
+                                const unsigned char *shine,
+                                int fracBits,
+                                const unsigned int *row);
+
+        // Interpolates count pixels of the rows a and b with the 7-bit
+        // weight of b into t.
+    typedef void (*BlendFunction)(unsigned int *t,
+                                  const unsigned int *a,
+                                  const unsigned int *b,
+                                  int count,
+                                  int weight);
+
+        // Averages the 2x2 boxes of the rows a and b, 2 * count pixels
+        // each, into count pixels of t. See SourcePyramid.
+    typedef void (*DownsampleFunction)(unsigned int *t,
+                                       const unsigned int *a,
+                                       const unsigned int *b,
+                                       int count);
+
+        // Adds the sum of absolute differences of the count groups of 8
+        // bytes of the rows a and b to the count sums. See
+        // SourceChangeDetector.
+    typedef void (*SadFunction)(unsigned int *sums,
+                                const unsigned char *a,
+                                const unsigned char *b,
+                                int count);
+
+    /*
+     * Packed UYVY source image, sampled in its own orientation. A map
+     * co-ordinate (x, y) refers to the pixel on the column
+     * m_columnOrigin + x * m_columnStepX + y * m_columnStepY and on the row
+     * m_rowOrigin + x * m_rowStepX + y * m_rowStepY of the frame. This way a
+     * rotated or flipped frame can be sampled without turning it first.
+     * The sampled pixels are converted to RGB with m_matrix.
+     */
+    class UyvySource
+    {
+    public:
+        UyvySource()
+            : m_data(0), m_bytesPerLine(0),
+              m_columnOrigin(0), m_columnStepX(1), m_columnStepY(0),
+              m_rowOrigin(0), m_rowStepX(0), m_rowStepY(1),
+              m_matrix(&YuvConverter::matrix(YuvConverter::BT601)) {}
+
+        const unsigned char *m_data;
+        int m_bytesPerLine;
+        int m_columnOrigin;
+        int m_columnStepX;
+        int m_columnStepY;
+        int m_rowOrigin;
+        int m_rowStepX;
+        int m_rowStepY;
+        const YuvConverter::Matrix *m_matrix;
+    };
+
+public:
+        // Returns the fastest linear-resampling kernel for this CPU
+    static LineFunction bilinearLine();
+    static Variant bilinearVariant();
+
+        // Returns the given variant or 0 if it is not compiled in or not
+        // supported by this CPU.
+    static LineFunction bilinearLine(Variant variant);
+
+        // Returns true if the selected kernel is a vectorized one
+    static bool isVectorized();
+
+    static const char *variantName(Variant variant);
+
+        // The reference implementation
+    static void bilinearLineScalar(unsigned int *t,
+                                   unsigned int *t_target,
+                                   const unsigned short *srcX,
+                                   const unsigned short *srcY,
+                                   const unsigned char *shine,
+                                   int fracBits,
+                                   const unsigned int *source,
+                                   int sourcePitch);
+
+        // Nearest-pixel sampling
+    static void nearestLine(unsigned int *t,
+                            unsigned int *t_target,
+                            const unsigned short *srcX,
+                            const unsigned short *srcY,
+                            int fracBits,
+                            const unsigned int *source,
+                            int sourcePitch);
+
+        // The fastest separable row kernels for this CPU. Both produce the
+        // same results as the scalar versions.
+    static RowFunction separableLine();
+    static BlendFunction blendRows();
+
+    static void separableLineScalar(unsigned int *t,
+                                    unsigned int *t_target,
+                                    const unsigned short *srcX,
+                                    const unsigned char *shine,
+                                    int fracBits,
+                                    const unsigned int *row);
+
+    static void blendRowsScalar(unsigned int *t,
+                                const unsigned int *a,
+                                const unsigned int *b,
+                                int count,
+                                int weight);
+
+        // The fastest 2x2 box downsample for this CPU. Produces the same
+        // results as the scalar version.
+    static DownsampleFunction downsampleRows();
+
+    static void downsampleRowsScalar(unsigned int *t,
+                                     const unsigned int *a,
+                                     const unsigned int *b,
+                                     int count);
+
+        // The fastest sum of absolute differences for this CPU
+    static SadFunction blockSadRows();
+
+    static void blockSadRowsScalar(unsigned int *sums,
+                                   const unsigned char *a,
+                                   const unsigned char *b,
+                                   int count);
+
+        // Nearest-pixel sampling from a single source row
+    static void separableNearestLine(unsigned int *t,
+                                     unsigned int *t_target,
+                                     const unsigned short *srcX,
+                                     int fracBits,
+                                     const unsigned int *row);
+
+        // Linear-resampling and nearest-pixel sampling from a UYVY source.
+        // The pixels are interpolated in YUV and converted to RGB32 once
+        // per target pixel.
+    static void uyvyBilinearLine(unsigned int *t,
+                                 unsigned int *t_target,
+                                 const unsigned short *srcX,
+                                 const unsigned short *srcY,
+                                 const unsigned char *shine,
+                                 int fracBits,
+                                 const UyvySource &source);
+
+    static void uyvyNearestLine(unsigned int *t,
+                                unsigned int *t_target,
+                                const unsigned short *srcX,
+                                const unsigned short *srcY,
+                                int fracBits,
+                                const UyvySource &source);
+
+        // Averages the 2x2 boxes of a width x height UYVY source (in its
+        // sampled orientation) on the rows 2 * row and 2 * row + 1 into
+        // count RGB32 pixels of t. The last row and column are repeated
+        // for odd dimensions.
+    static void uyvyDownsampleLine(unsigned int *t,
+                                   int count,
+                                   int row,
+                                   int width,
+                                   int height,
+                                   const UyvySource &source);
+
+        // Averages the 2x2 boxes of the UYVY lines a and b, 2 * count
+        // pixels each, into count UYVY pixels of t
+    static void uyvyDownsampleRows(unsigned char *t,
+                                   const unsigned char *a,
+                                   const unsigned char *b,
+                                   int count);
+};
+
+#endif // WARPKERNELS_H
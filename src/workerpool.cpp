@@ -0,0 +1,259 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "workerpool.h"
+
+#include <QDebug>
+#include <QThread>
+
+
+/*!
+  \class WorkerPool
+  \brief A persistent set of worker threads for data parallel processing.
+*/
+
+
+/*
+  A single run() call.
+*/
+class WorkerPool::Job
+{
+public:
+    WorkerTask *task;
+    int count;
+    int grain;
+    int next;           // First item not yet claimed
+    int chunksLeft;     // Claimed or unclaimed chunks not yet finished
+};
+
+
+/*
+  A thread which serves the jobs of the pool until it is stopped.
+*/
+class WorkerPool::Worker : public QThread
+{
+public:
+    explicit Worker(WorkerPool *pool) : m_pool(pool) {}
+
+protected:
+    void run() { m_pool->workerLoop(); }
+
+private:
+    WorkerPool *m_pool;
+};
+
+
+/*!
+  Constructor.
+*/
+WorkerPool::WorkerPool(int threadCount /* = 0 */)
+    : m_threadCount(1),
+      m_quit(false)
+{
+    startWorkers(threadCount);
+}
+
+
+/*!
+  Destructor. The pool must not be in use anymore.
+*/
+WorkerPool::~WorkerPool()
+{
+    stopWorkers();
+}
+
+
+/*!
+  Returns the pool shared by all the mirror effects of the process.
+*/
+WorkerPool *WorkerPool::instance()
+{
+    static WorkerPool pool;
+    return &pool;
+}
+
+
+/*!
+  Changes the number of threads. Waits for the current jobs to finish.
+*/
+void WorkerPool::setThreadCount(int threadCount)
+{
+    stopWorkers();
+    startWorkers(threadCount);
+}
+
+
+/*!
+  Returns the number of threads working on a job, including the caller.
+*/
+int WorkerPool::threadCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_threadCount;
+}
+
+
+/*!
+  Runs \a task over the items [0, \a count) in chunks of \a grain items and
+  returns when all of them have been processed. The calling thread takes
+  part in the work, so the call works even with no worker threads.
+*/
+void WorkerPool::run(WorkerTask *task, int count, int grain /* = 1 */)
+{
+    if (count <= 0)
+        return;
+
+    if (grain < 1)
+        grain = 1;
+
+    Job job;
+    job.task = task;
+    job.count = count;
+    job.grain = grain;
+    job.next = 0;
+    job.chunksLeft = (count + grain - 1) / grain;
+
+    m_mutex.lock();
+
+    if (job.chunksLeft == 1 || m_workers.isEmpty()) {
+        m_mutex.unlock();
+        task->run(0, count);
+        return;
+    }
+
+    m_jobs.append(&job);
+    m_jobAvailable.wakeAll();
+
+    int begin(0);
+    int end(0);
+
+    while (claimChunk(&job, &begin, &end)) {
+        m_mutex.unlock();
+        task->run(begin, end);
+        m_mutex.lock();
+        job.chunksLeft--;
+    }
+
+    while (job.chunksLeft > 0)
+        m_jobFinished.wait(&m_mutex);
+
+    m_mutex.unlock();
+}
+
+
+/*!
+  Runs \a task over the items [0, \a count) as MirrorEffect::setThreadCount()
+  describes: 1 as \a threadCount runs it on the calling thread only, any
+  other count splits it into as many bands. 0 splits it into four bands per
+  thread of the pool, to balance the load. The bands are at least
+  \a minGrain items, since every band has some overhead of its own.
+*/
+void WorkerPool::runBands(WorkerTask *task, int count, int threadCount, int minGrain)
+{
+    if (threadCount == 1 || this->threadCount() == 1) {
+        task->run(0, count);
+        return;
+    }
+
+    const int bands = threadCount > 0 ? threadCount : this->threadCount() * 4;
+    run(task, count, qMax(minGrain, (count + bands - 1) / bands));
+}
+
+
+/*!
+  Starts threadCount - 1 worker threads.
+*/
+void WorkerPool::startWorkers(int threadCount)
+{
+    if (threadCount <= 0)
+        threadCount = QThread::idealThreadCount();
+
+    if (threadCount < 1)
+        threadCount = 1;
+
+    QMutexLocker locker(&m_mutex);
+    m_quit = false;
+    m_threadCount = threadCount;
+
+    for (int i = 1; i < threadCount; i++) {
+        QThread *worker = new Worker(this);
+        m_workers.append(worker);
+        worker->start();
+    }
+
+    qDebug() << "WorkerPool::startWorkers():" << threadCount << "threads";
+}
+
+
+/*!
+  Stops and deletes the worker threads.
+*/
+void WorkerPool::stopWorkers()
+{
+    m_mutex.lock();
+    m_quit = true;
+    m_jobAvailable.wakeAll();
+    QList<QThread*> workers = m_workers;
+    m_workers.clear();
+    m_mutex.unlock();
+
+    foreach (QThread *worker, workers) {
+        worker->wait();
+        delete worker;
+    }
+}
+
+
+/*!
+  The body of the worker threads.
+*/
+void WorkerPool::workerLoop()
+{
+    QMutexLocker locker(&m_mutex);
+
+    forever {
+        while (m_jobs.isEmpty() && !m_quit)
+            m_jobAvailable.wait(&m_mutex);
+
+        if (m_jobs.isEmpty())
+            break;
+
+        Job *job = m_jobs.first();
+        int begin(0);
+        int end(0);
+
+        if (!claimChunk(job, &begin, &end))
+            continue;
+
+        locker.unlock();
+        job->task->run(begin, end);
+        locker.relock();
+
+        // The owner of the job may return as soon as the count reaches zero,
+        // so the job must not be touched after this.
+        if (--job->chunksLeft == 0)
+            m_jobFinished.wakeAll();
+    }
+}
+
+
+/*!
+  Takes the next unprocessed chunk of \a job. Returns false if every chunk
+  has already been taken. The mutex must be locked.
+*/
+bool WorkerPool::claimChunk(Job *job, int *begin, int *end)
+{
+    if (job->next >= job->count)
+        return false;
+
+    *begin = job->next;
+    *end = qMin(job->next + job->grain, job->count);
+    job->next = *end;
+
+    // Fully claimed jobs are not offered to the workers anymore
+    if (job->next >= job->count)
+        m_jobs.removeOne(job);
+
+    return true;
+}
@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+
+// Forward declarations
+class QThread;
+
+
+/*!
+  \class WorkerTask
+  \brief A piece of work which can be split into independent index ranges.
+*/
+class WorkerTask
+{
+public:
+    virtual ~WorkerTask() {}
+
+        // Processes the items [begin, end). Called concurrently from several
+        // threads with non-overlapping ranges.
+    virtual void run(int begin, int end) = 0;
+};
+
+
+/*!
+  \class WorkerMemberTask
+  \brief Adapts a member function taking an index range to a WorkerTask.
+*/
+template <class T>
+class WorkerMemberTask : public WorkerTask
+{
+public:
+    typedef void (T::*Method)(int begin, int end);
+
+    WorkerMemberTask(T *object, Method method)
+        : m_object(object), m_method(method) {}
+
+    void run(int begin, int end) { (m_object->*m_method)(begin, end); }
+
+private:
+    T *m_object;
+    Method m_method;
+};
+
+
+/*!
+  \class WorkerPool
+  \brief A persistent set of worker threads for data parallel processing.
+
+  WorkerPool::run() splits an index range into chunks and executes them on
+  the worker threads and the calling thread. It returns only after every
+  chunk has been processed. Several threads may use the pool at the same
+  time; their jobs are served in order.
+*/
+class WorkerPool
+{
+public:
+        // threadCount is the total number of threads doing the work,
+        // including the caller of run(). 0 means QThread::idealThreadCount().
+    explicit WorkerPool(int threadCount = 0);
+    ~WorkerPool();
+
+        // The pool shared by the whole process
+    static WorkerPool *instance();
+
+public:
+    void setThreadCount(int threadCount);
+    int threadCount() const;
+
+        // Runs task over [0, count) in chunks of grain items.
+    void run(WorkerTask *task, int count, int grain = 1);
+
+        // Runs task over [0, count) split by threadCount as in
+        // MirrorEffect::setThreadCount(), in bands of at least minGrain items
+    void runBands(WorkerTask *task, int count, int threadCount, int minGrain);
+
+private:
+    class Job;
+    class Worker;
+    friend class Worker;
+
+    void startWorkers(int threadCount);
+    void stopWorkers();
+    void workerLoop();
+    bool claimChunk(Job *job, int *begin, int *end);
+
+private: // Data
+    mutable QMutex m_mutex;
+    QWaitCondition m_jobAvailable;
+    QWaitCondition m_jobFinished;
+    QList<Job*> m_jobs;
+    QList<QThread*> m_workers;
+    int m_threadCount;
+    bool m_quit;
+};
+
+#endif // WORKERPOOL_H
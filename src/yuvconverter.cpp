@@ -0,0 +1,491 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#include "yuvconverter.h"
+
+#include "cpufeatures.h"
+#include "workerpool.h"
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#define MH_YUV_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#define MH_YUV_NEON
+#include <arm_neon.h>
+#endif
+
+// See warpkernels.cpp
+#if defined(__GNUC__)
+#define MH_TARGET(x) __attribute__((target(x)))
+#else
+#define MH_TARGET(x)
+#endif
+
+
+/*
+  The coefficient sets, in the order of YuvConverter::Coefficients.
+*/
+static const YuvConverter::Matrix matrices[] = {
+    { 16, 298, 409, 100, 208, 517 },    // BT601
+    { 16, 298, 459, 55, 136, 541 },     // BT709
+    { 0, 256, 359, 88, 183, 454 }       // BT601FullRange
+};
+
+
+/*
+  Converts the rows [begin, end) of a frame. Used for spreading the frame
+  over the WorkerPool.
+*/
+class YuvConvertTask : public WorkerTask
+{
+public:
+    YuvConvertTask(YuvConverter::LineFunction line,
+                   const YuvConverter::Matrix &matrix,
+                   unsigned int *target, int pitch,
+                   const unsigned char *source, int bytesPerLine,
+                   int width)
+        : m_line(line), m_matrix(matrix),
+          m_target(target), m_pitch(pitch),
+          m_source(source), m_bytesPerLine(bytesPerLine),
+          m_width(width) {}
+
+    void run(int begin, int end)
+    {
+        for (int y = begin; y < end; y++) {
+            m_line(m_target + m_pitch * y,
+                   m_source + m_bytesPerLine * y,
+                   m_width,
+                   m_matrix);
+        }
+    }
+
+private:
+    YuvConverter::LineFunction m_line;
+    const YuvConverter::Matrix &m_matrix;
+    unsigned int *m_target;
+    int m_pitch;
+    const unsigned char *m_source;
+    int m_bytesPerLine;
+    int m_width;
+};
+
+
+/*!
+  \class YuvConverter
+  \brief Converts packed UYVY frames to RGB32.
+*/
+
+
+/*!
+  Constructor.
+*/
+YuvConverter::YuvConverter(Coefficients coefficients /* = BT601 */)
+    : m_coefficients(coefficients),
+      m_threadCount(0)
+{
+}
+
+
+/*!
+  Selects the coefficient set of the conversion.
+*/
+void YuvConverter::setCoefficients(Coefficients coefficients)
+{
+    m_coefficients = coefficients;
+}
+
+
+/*!
+  Returns the coefficient set of the conversion.
+*/
+YuvConverter::Coefficients YuvConverter::coefficients() const
+{
+    return m_coefficients;
+}
+
+
+/*!
+  Returns the matrix of the current coefficient set.
+*/
+const YuvConverter::Matrix &YuvConverter::matrix() const
+{
+    return matrix(m_coefficients);
+}
+
+
+/*!
+  Sets the number of threads convert() splits the rows to. 1 disables the
+  parallel processing, 0 uses all the threads of WorkerPool::instance().
+*/
+void YuvConverter::setThreadCount(int threadCount)
+{
+    m_threadCount = threadCount;
+}
+
+
+/*!
+  Returns the thread count setting.
+*/
+int YuvConverter::threadCount() const
+{
+    return m_threadCount;
+}
+
+
+/*!
+  Converts the \a width x \a height UYVY frame at \a source to RGB32 at
+  \a target.
+*/
+void YuvConverter::convert(unsigned int *target,
+                           int pitch,
+                           const unsigned char *source,
+                           int bytesPerLine,
+                           int width,
+                           int height) const
+{
+    YuvConvertTask task(lineFunction(), matrix(), target, pitch,
+                        source, bytesPerLine, width);
+    WorkerPool *pool = WorkerPool::instance();
+
+    if (m_threadCount == 1 || pool->threadCount() == 1) {
+        task.run(0, height);
+    }
+    else {
+            // A converted row is a few microseconds of work, so the bands
+            // are kept large to keep the scheduling overhead small.
+        const int bands = m_threadCount > 0 ? m_threadCount : pool->threadCount();
+        pool->run(&task, height, qMax(16, (height + bands - 1) / bands));
+    }
+}
+
+
+/*!
+  Returns the matrix of \a coefficients.
+*/
+const YuvConverter::Matrix &YuvConverter::matrix(Coefficients coefficients)
+{
+    return matrices[coefficients];
+}
+
+
+/*!
+  The reference implementation. Two pixels at a time, as they share the
+  chroma.
+*/
+void YuvConverter::convertLineScalar(unsigned int *t,
+                                     const unsigned char *source,
+                                     int width,
+                                     const Matrix &matrix)
+{
+    unsigned int *t_target = t + (width & ~1);
+
+    while (t != t_target) {
+        const unsigned int chroma = (source[0] << 8) | (source[2] << 16);
+
+        t[0] = toRgb(chroma | source[1], matrix);
+        t[1] = toRgb(chroma | source[3], matrix);
+
+        t += 2;
+        source += 4;
+    }
+
+    if (width & 1)
+        *t = toRgb(source[1] | (source[0] << 8) | (source[2] << 16), matrix);
+}
+
+
+#ifdef MH_YUV_X86
+
+/*
+  The x86 variants compute the products of the matrix with _mm_mulhi_epi16:
+  for the 8-bit operands a, (a << 7) * (2 * c) >> 16 equals (a * c) >> 8
+  exactly, including the rounding down of the negative products. The sums
+  fit into 16 bits and the saturating pack does the clamping.
+*/
+
+/*
+  Converts the 8 pixels in 16 UYVY bytes. Returns the B, G and R values
+  as 16-bit lanes.
+*/
+static MH_TARGET("sse2") inline void convert8SSE2(__m128i uyvy,
+                                                  const __m128i *coefficients,
+                                                  __m128i &b, __m128i &g, __m128i &r)
+{
+    const __m128i lowWord = _mm_set1_epi32(0x0000FFFF);
+    const __m128i bias = _mm_set1_epi16(128);
+
+    const __m128i y = _mm_srli_epi16(uyvy, 8);
+    const __m128i chroma = _mm_and_si128(uyvy, _mm_set1_epi16(0x00FF));
+
+        // [U0 V0 U1 V1 ...] => [U0 U0 U1 U1 ...] and [V0 V0 V1 V1 ...]
+    const __m128i u = _mm_slli_epi16(_mm_sub_epi16(
+            _mm_or_si128(_mm_and_si128(chroma, lowWord), _mm_slli_epi32(chroma, 16)),
+            bias), 7);
+    const __m128i v = _mm_slli_epi16(_mm_sub_epi16(
+            _mm_or_si128(_mm_srli_epi32(chroma, 16), _mm_andnot_si128(lowWord, chroma)),
+            bias), 7);
+
+    const __m128i luma = _mm_mulhi_epi16(
+            _mm_slli_epi16(_mm_sub_epi16(y, coefficients[0]), 7), coefficients[1]);
+
+    r = _mm_add_epi16(luma, _mm_mulhi_epi16(v, coefficients[2]));
+    g = _mm_add_epi16(_mm_sub_epi16(luma, _mm_mulhi_epi16(v, coefficients[4])),
+                      _mm_mulhi_epi16(u, coefficients[3]));
+    b = _mm_add_epi16(luma, _mm_mulhi_epi16(u, coefficients[5]));
+}
+
+
+/*
+  SSE2: eight pixels per iteration.
+*/
+static MH_TARGET("sse2") void convertLineSSE2(unsigned int *t,
+                                              const unsigned char *source,
+                                              int width,
+                                              const YuvConverter::Matrix &matrix)
+{
+    const __m128i alpha = _mm_set1_epi8(-1);
+    const __m128i coefficients[] = {
+        _mm_set1_epi16(matrix.m_lumaOffset),
+        _mm_set1_epi16(matrix.m_luma * 2),
+        _mm_set1_epi16(matrix.m_redV * 2),
+        _mm_set1_epi16(matrix.m_greenU * 2),
+        _mm_set1_epi16(matrix.m_greenV * 2),
+        _mm_set1_epi16(matrix.m_blueU * 2)
+    };
+
+    int x = 0;
+
+    for (; x + 8 <= width; x += 8) {
+        __m128i b, g, r;
+        convert8SSE2(_mm_loadu_si128((const __m128i*)(source + x * 2)),
+                     coefficients, b, g, r);
+
+        b = _mm_packus_epi16(b, b);
+        g = _mm_packus_epi16(g, g);
+        r = _mm_packus_epi16(r, r);
+
+        const __m128i bg = _mm_unpacklo_epi8(b, g);
+        const __m128i ra = _mm_unpacklo_epi8(r, alpha);
+
+        _mm_storeu_si128((__m128i*)(t + x), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i*)(t + x + 4), _mm_unpackhi_epi16(bg, ra));
+    }
+
+    YuvConverter::convertLineScalar(t + x, source + x * 2, width - x, matrix);
+}
+
+
+/*
+  AVX2: sixteen pixels per iteration. The arithmetic is the same as with
+  SSE2; the unpacks work inside the 128-bit lanes, so the results are
+  put back in order with a lane permute.
+*/
+static MH_TARGET("avx2") void convertLineAVX2(unsigned int *t,
+                                              const unsigned char *source,
+                                              int width,
+                                              const YuvConverter::Matrix &matrix)
+{
+    const __m256i lowWord = _mm256_set1_epi32(0x0000FFFF);
+    const __m256i bias = _mm256_set1_epi16(128);
+    const __m256i alpha = _mm256_set1_epi8(-1);
+    const __m256i lumaOffset = _mm256_set1_epi16(matrix.m_lumaOffset);
+    const __m256i luma2 = _mm256_set1_epi16(matrix.m_luma * 2);
+    const __m256i redV2 = _mm256_set1_epi16(matrix.m_redV * 2);
+    const __m256i greenU2 = _mm256_set1_epi16(matrix.m_greenU * 2);
+    const __m256i greenV2 = _mm256_set1_epi16(matrix.m_greenV * 2);
+    const __m256i blueU2 = _mm256_set1_epi16(matrix.m_blueU * 2);
+
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        const __m256i uyvy = _mm256_loadu_si256((const __m256i*)(source + x * 2));
+
+        const __m256i y = _mm256_srli_epi16(uyvy, 8);
+        const __m256i chroma = _mm256_and_si256(uyvy, _mm256_set1_epi16(0x00FF));
+        const __m256i u = _mm256_slli_epi16(_mm256_sub_epi16(
+                _mm256_or_si256(_mm256_and_si256(chroma, lowWord),
+                                _mm256_slli_epi32(chroma, 16)), bias), 7);
+        const __m256i v = _mm256_slli_epi16(_mm256_sub_epi16(
+                _mm256_or_si256(_mm256_srli_epi32(chroma, 16),
+                                _mm256_andnot_si256(lowWord, chroma)), bias), 7);
+
+        const __m256i luma = _mm256_mulhi_epi16(
+                _mm256_slli_epi16(_mm256_sub_epi16(y, lumaOffset), 7), luma2);
+
+        const __m256i r = _mm256_add_epi16(luma, _mm256_mulhi_epi16(v, redV2));
+        const __m256i g = _mm256_add_epi16(
+                _mm256_sub_epi16(luma, _mm256_mulhi_epi16(v, greenV2)),
+                _mm256_mulhi_epi16(u, greenU2));
+        const __m256i b = _mm256_add_epi16(luma, _mm256_mulhi_epi16(u, blueU2));
+
+        const __m256i bg = _mm256_unpacklo_epi8(_mm256_packus_epi16(b, b),
+                                                _mm256_packus_epi16(g, g));
+        const __m256i ra = _mm256_unpacklo_epi8(_mm256_packus_epi16(r, r), alpha);
+
+            // Low lane: pixels 0-3 and 8-11, high lane: 4-7 and 12-15
+        const __m256i lo = _mm256_unpacklo_epi16(bg, ra);
+        const __m256i hi = _mm256_unpackhi_epi16(bg, ra);
+
+        _mm256_storeu_si256((__m256i*)(t + x), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(t + x + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    convertLineSSE2(t + x, source + x * 2, width - x, matrix);
+}
+
+#endif // MH_YUV_X86
+
+
+#ifdef MH_YUV_NEON
+
+/*
+  NEON: sixteen pixels per iteration. vld4 separates U, Y0, V and Y1 of
+  eight pixel pairs. vqdmulhq_s16 returns (2 * a * c) >> 16, so with
+  a << 7 it gives the same (a * c) >> 8 as the other variants.
+*/
+static void convertLineNEON(unsigned int *t,
+                            const unsigned char *source,
+                            int width,
+                            const YuvConverter::Matrix &matrix)
+{
+    const int16x8_t bias = vdupq_n_s16(128);
+    const int16x8_t lumaOffset = vdupq_n_s16(matrix.m_lumaOffset);
+    const int16x8_t luma = vdupq_n_s16(matrix.m_luma);
+    const int16x8_t redV = vdupq_n_s16(matrix.m_redV);
+    const int16x8_t greenU = vdupq_n_s16(matrix.m_greenU);
+    const int16x8_t greenV = vdupq_n_s16(matrix.m_greenV);
+    const int16x8_t blueU = vdupq_n_s16(matrix.m_blueU);
+
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        const uint8x8x4_t uyvy = vld4_u8(source + x * 2);
+
+        const int16x8_t u = vshlq_n_s16(vsubq_s16(
+                vreinterpretq_s16_u16(vmovl_u8(uyvy.val[0])), bias), 7);
+        const int16x8_t v = vshlq_n_s16(vsubq_s16(
+                vreinterpretq_s16_u16(vmovl_u8(uyvy.val[2])), bias), 7);
+
+        const int16x8_t redFactor = vqdmulhq_s16(v, redV);
+        const int16x8_t greenFactor = vsubq_s16(vqdmulhq_s16(u, greenU),
+                                                vqdmulhq_s16(v, greenV));
+        const int16x8_t blueFactor = vqdmulhq_s16(u, blueU);
+
+        uint8x8_t r[2];
+        uint8x8_t g[2];
+        uint8x8_t b[2];
+
+        for (int i = 0; i < 2; i++) {
+            const int16x8_t y = vqdmulhq_s16(vshlq_n_s16(vsubq_s16(
+                    vreinterpretq_s16_u16(vmovl_u8(uyvy.val[1 + i * 2])),
+                    lumaOffset), 7), luma);
+
+            r[i] = vqmovun_s16(vaddq_s16(y, redFactor));
+            g[i] = vqmovun_s16(vaddq_s16(y, greenFactor));
+            b[i] = vqmovun_s16(vaddq_s16(y, blueFactor));
+        }
+
+            // Interleave the even and the odd pixels back
+        const uint8x8x2_t rr = vzip_u8(r[0], r[1]);
+        const uint8x8x2_t gg = vzip_u8(g[0], g[1]);
+        const uint8x8x2_t bb = vzip_u8(b[0], b[1]);
+
+        uint8x16x4_t bgra;
+        bgra.val[0] = vcombine_u8(bb.val[0], bb.val[1]);
+        bgra.val[1] = vcombine_u8(gg.val[0], gg.val[1]);
+        bgra.val[2] = vcombine_u8(rr.val[0], rr.val[1]);
+        bgra.val[3] = vdupq_n_u8(255);
+
+        vst4q_u8((unsigned char*)(t + x), bgra);
+    }
+
+    YuvConverter::convertLineScalar(t + x, source + x * 2, width - x, matrix);
+}
+
+#endif // MH_YUV_NEON
+
+
+/*!
+  Returns the given variant, or 0 if it is not available.
+*/
+YuvConverter::LineFunction YuvConverter::lineFunction(Variant variant)
+{
+    switch (variant) {
+    case Scalar:
+        return convertLineScalar;
+#ifdef MH_YUV_X86
+    case SSE2:
+        return CpuFeatures::has(CpuFeatures::SSE2) ? convertLineSSE2 : 0;
+    case AVX2:
+        return CpuFeatures::has(CpuFeatures::AVX2) ? convertLineAVX2 : 0;
+#endif
+#ifdef MH_YUV_NEON
+    case NEON:
+        return CpuFeatures::has(CpuFeatures::NEON) ? convertLineNEON : 0;
+#endif
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+
+/*
+  Picks the first supported variant in the order of preference.
+*/
+static YuvConverter::Variant selectVariant()
+{
+    const YuvConverter::Variant preferred[] = {
+        YuvConverter::AVX2,
+        YuvConverter::SSE2,
+        YuvConverter::NEON
+    };
+    const int count = sizeof(preferred) / sizeof(preferred[0]);
+
+    for (int i = 0; i < count; i++) {
+        if (YuvConverter::lineFunction(preferred[i]))
+            return preferred[i];
+    }
+
+    return YuvConverter::Scalar;
+}
+
+
+/*!
+  Returns the fastest supported variant. The selection is done only once.
+*/
+YuvConverter::Variant YuvConverter::variant()
+{
+    static Variant selected = selectVariant();
+    return selected;
+}
+
+
+/*!
+  Returns the fastest supported line converter.
+*/
+YuvConverter::LineFunction YuvConverter::lineFunction()
+{
+    return lineFunction(variant());
+}
+
+
+/*!
+  Returns a human readable name of \a variant.
+*/
+const char *YuvConverter::variantName(Variant variant)
+{
+    switch (variant) {
+    case SSE2: return "SSE2";
+    case AVX2: return "AVX2";
+    case NEON: return "NEON";
+    default: break;
+    }
+
+    return "Scalar";
+}
@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2011-2014 Microsoft Mobile.
+ */
+
+#ifndef YUVCONVERTER_H
+#define YUVCONVERTER_H
+
+
+/*!
+  \class YuvConverter
+  \brief Converts packed UYVY frames to RGB32.
+
+  The conversion has a scalar reference implementation and vectorized
+  variants which produce bit-identical results. The fastest variant supported
+  by the running CPU is selected at run time.
+*/
+class YuvConverter
+{
+public: // Data types
+    enum Coefficients {
+        BT601,              // Video range (16-235) BT.601, the default
+        BT709,              // Video range (16-235) BT.709, HD cameras
+        BT601FullRange      // Full range (0-255) BT.601, as in JPEG
+    };
+
+    enum Variant {
+        Scalar,
+        SSE2,
+        AVX2,
+        NEON
+    };
+
+    /*
+     * The conversion in 8.8 fixed point:
+     *
+     * luma = ((Y - m_lumaOffset) * m_luma) >> 8
+     * R = luma + ((V' * m_redV) >> 8)
+     * G = luma - ((V' * m_greenV) >> 8) + ((U' * m_greenU) >> 8)
+     * B = luma + ((U' * m_blueU) >> 8)
+     *
+     * where U' = U - 128 and V' = V - 128. Every product is rounded down on
+     * its own, like the original conversion of MyVideoSurface did.
+     */
+    class Matrix
+    {
+    public:
+        int m_lumaOffset;
+        int m_luma;
+        int m_redV;
+        int m_greenU;
+        int m_greenV;
+        int m_blueU;
+    };
+
+        // Converts width pixels of a UYVY row to RGB32
+    typedef void (*LineFunction)(unsigned int *t,
+                                 const unsigned char *source,
+                                 int width,
+                                 const Matrix &matrix);
+
+public:
+    explicit YuvConverter(Coefficients coefficients = BT601);
+
+public:
+    void setCoefficients(Coefficients coefficients);
+    Coefficients coefficients() const;
+    const Matrix &matrix() const;
+
+        // Number of threads used by convert(), as in MirrorEffect
+    void setThreadCount(int threadCount);
+    int threadCount() const;
+
+        // Converts the whole frame. pitch is in pixels and bytesPerLine
+        // in bytes, like everywhere else.
+    void convert(unsigned int *target,
+                 int pitch,
+                 const unsigned char *source,
+                 int bytesPerLine,
+                 int width,
+                 int height) const;
+
+public:
+    static const Matrix &matrix(Coefficients coefficients);
+
+        // Returns the fastest line converter for this CPU
+    static LineFunction lineFunction();
+    static Variant variant();
+
+        // Returns the given variant or 0 if it is not compiled in or not
+        // supported by this CPU.
+    static LineFunction lineFunction(Variant variant);
+
+    static const char *variantName(Variant variant);
+
+        // The reference implementation
+    static void convertLineScalar(unsigned int *t,
+                                  const unsigned char *source,
+                                  int width,
+                                  const Matrix &matrix);
+
+        // Converts a single pixel packed as 0x00VVUUYY. Inline, the
+        // sampling kernels call it for every target pixel.
+    static inline unsigned int toRgb(unsigned int yuv, const Matrix &matrix);
+
+private: // Data
+    Coefficients m_coefficients;
+    int m_threadCount;
+};
+
+
+unsigned int YuvConverter::toRgb(unsigned int yuv, const Matrix &matrix)
+{
+    const int u = (int)((yuv >> 8) & 255) - 128;
+    const int v = (int)((yuv >> 16) & 255) - 128;
+    const int luma = (((int)(yuv & 255) - matrix.m_lumaOffset) * matrix.m_luma) >> 8;
+
+    int r = luma + ((v * matrix.m_redV) >> 8);
+    int g = luma - ((v * matrix.m_greenV) >> 8) + ((u * matrix.m_greenU) >> 8);
+    int b = luma + ((u * matrix.m_blueU) >> 8);
+
+    if (r < 0) r = 0;
+    if (g < 0) g = 0;
+    if (b < 0) b = 0;
+    if (r > 255) r = 255;
+    if (g > 255) g = 255;
+    if (b > 255) b = 255;
+
+    return b | (g << 8) | (r << 16) | 0xFF000000;
+}
+
+#endif // YUVCONVERTER_H